@@ -20,6 +20,11 @@
 
 #define DO_MEMORY_LOGGING 0
 
+// 64-bit file offsets for --seek in large streams (32-bit systems)
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64
+#endif
+
 #include "de265.h"
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -51,10 +56,15 @@ using namespace videogfx;
 
 
 #define BUFFER_SIZE 40960
+
+// largest NAL accepted from length-prefixed input (-n)
+#define MAX_NAL_SIZE (64*1024*1024)
+
 #define NUM_THREADS 4
 
 int nThreads=0;
 bool nal_input=false;
+int nal_length_size=4;
 int quiet=0;
 bool check_hash=false;
 bool show_help=false;
@@ -76,6 +86,13 @@ int highestTID = 100;
 int verbosity=0;
 int disable_deblocking=0;
 int disable_sao=0;
+int keyframes_only=0;
+int luma_only=0;
+int image_allocation_mode=de265_image_allocation_DEFAULT;
+int cabac_engine=de265_cabac_engine_DEFAULT;
+int generic_residual_coding=0;
+int hash_before_output=0;
+int seek_picture=-1;
 
 static struct option long_options[] = {
   {"quiet",      no_argument,       0, 'q' },
@@ -86,6 +103,7 @@ static struct option long_options[] = {
   {"output",     required_argument, 0, 'o' },
   {"dump",       no_argument,       0, 'd' },
   {"nal",        no_argument,       0, 'n' },
+  {"nal-length-size", required_argument, 0, 'N' },
   {"videogfx",   no_argument,       0, 'V' },
   {"no-logging", no_argument,       0, 'L' },
   {"help",       no_argument,       0, 'h' },
@@ -98,11 +116,25 @@ static struct option long_options[] = {
   {"verbose",    no_argument,       0, 'v' },
   {"disable-deblocking", no_argument, &disable_deblocking, 1 },
   {"disable-sao",        no_argument, &disable_sao, 1 },
+  {"keyframes-only",     no_argument, &keyframes_only, 1 },
+  {"luma-only",          no_argument, &luma_only, 1 },
+  {"aligned-planes",     no_argument, &image_allocation_mode, de265_image_allocation_ALIGNED64 },
+  {"hugepages",          no_argument, &image_allocation_mode, de265_image_allocation_HUGEPAGES },
+  {"reference-cabac",    no_argument, &cabac_engine, de265_cabac_engine_REFERENCE },
+  {"generic-residual",   no_argument, &generic_residual_coding, 1 },
+  {"hash-before-output", no_argument, &hash_before_output, 1 },
+  {"seek",       required_argument, 0, 'S' },
   {0,         0,                 0,  0 }
 };
 
 
 
+static void release_NAL_buffer(const void* data, void* userdata)
+{
+  free((void*)data);
+}
+
+
 static void write_picture(const de265_image* img)
 {
   static FILE* fh = NULL;
@@ -570,6 +602,13 @@ int main(int argc, char** argv)
     case 'h': show_help=true; break;
     case 'd': dump_headers=true; break;
     case 'n': nal_input=true; break;
+    case 'N':
+      nal_length_size=atoi(optarg);
+      if (nal_length_size!=1 && nal_length_size!=2 && nal_length_size!=4) {
+        fprintf(stderr,"invalid NAL length size %s (must be 1, 2, or 4)\n", optarg);
+        exit(5);
+      }
+      break;
     case 'V': output_with_videogfx=true; break;
     case 'L': logging=false; break;
     case '0': no_acceleration=true; break;
@@ -579,6 +618,7 @@ int main(int argc, char** argv)
     case 'e': show_psnr_map=true; break;
     case 'T': highestTID=atoi(optarg); break;
     case 'v': verbosity++; break;
+    case 'S': seek_picture=atoi(optarg); break;
     }
   }
 
@@ -592,7 +632,8 @@ int main(int argc, char** argv)
     fprintf(stderr,"  -q, --quiet       do not show decoded image\n");
     fprintf(stderr,"  -t, --threads N   set number of worker threads (0 - no threading)\n");
     fprintf(stderr,"  -c, --check-hash  perform hash check\n");
-    fprintf(stderr,"  -n, --nal         input is a stream with 4-byte length prefixed NAL units\n");
+    fprintf(stderr,"  -n, --nal         input is a stream with length prefixed NAL units\n");
+    fprintf(stderr,"      --nal-length-size N  size of the NAL length prefix (1, 2, 4; default: 4)\n");
     fprintf(stderr,"  -f, --frames N    set number of frames to process\n");
     fprintf(stderr,"  -o, --output      write YUV reconstruction\n");
     fprintf(stderr,"  -d, --dump        dump headers\n");
@@ -611,21 +652,47 @@ int main(int argc, char** argv)
     fprintf(stderr,"  -T, --highest-TID select highest temporal sublayer to decode\n");
     fprintf(stderr,"      --disable-deblocking   disable deblocking filter\n");
     fprintf(stderr,"      --disable-sao          disable sample-adaptive offset filter\n");
+    fprintf(stderr,"      --keyframes-only       decode and output only IRAP pictures\n");
+    fprintf(stderr,"      --luma-only            do not reconstruct the chroma planes\n");
+    fprintf(stderr,"      --aligned-planes       align image planes and rows to 64 bytes\n");
+    fprintf(stderr,"      --hugepages            like --aligned-planes, use huge pages for image planes\n");
+    fprintf(stderr,"      --reference-cabac      use the byte-wise reference CABAC engine\n");
+    fprintf(stderr,"      --generic-residual     use the generic residual syntax parser for all streams\n");
+    fprintf(stderr,"      --hash-before-output   with -c, finish the hash check before a picture is output\n");
+    fprintf(stderr,"      --seek N      start decoding at the random-access point before picture N\n");
     fprintf(stderr,"  -h, --help        show help\n");
 
     exit(show_help ? 0 : 5);
   }
 
+  if (seek_picture>=0 && nal_input) {
+    // the random-access index is built from a byte-stream, not from length-prefixed NALs
+    fprintf(stderr,"--seek cannot be used with NAL input (-n)\n");
+    exit(5);
+  }
+
 
   de265_error err =DE265_OK;
 
   de265_decoder_context* ctx = de265_new_decoder();
 
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH, check_hash);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH_BEFORE_OUTPUT,
+                           hash_before_output);
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_SUPPRESS_FAULTY_PICTURES, false);
 
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_DISABLE_DEBLOCKING, disable_deblocking);
   de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_DISABLE_SAO, disable_sao);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_KEYFRAMES_ONLY, keyframes_only);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_LUMA_ONLY, luma_only);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_GENERIC_RESIDUAL_CODING,
+                           generic_residual_coding);
+
+  de265_set_parameter_int(ctx, DE265_DECODER_PARAM_CABAC_ENGINE, cabac_engine);
+
+  if (image_allocation_mode != de265_image_allocation_DEFAULT) {
+    de265_set_parameter_int(ctx, DE265_DECODER_PARAM_IMAGE_ALLOCATION_MODE, image_allocation_mode);
+  }
 
   if (dump_headers) {
     de265_set_parameter_int(ctx, DE265_DECODER_PARAM_DUMP_SPS_HEADERS, 1);
@@ -672,11 +739,55 @@ int main(int argc, char** argv)
   }
 
   bool stop=false;
+  bool invalid_nal_length=false;
 
   struct timeval tv_start;
   gettimeofday(&tv_start, NULL);
 
-  int pos=0;
+  int64_t pos=0;
+
+  if (seek_picture>=0) {
+    // scan the whole file for random-access points and start at the one before 'seek_picture'
+
+    de265_random_access_index* index = de265_new_random_access_index();
+
+    uint8_t buf[BUFFER_SIZE];
+    size_t n;
+    while ((n = fread(buf,1,BUFFER_SIZE,fh)) > 0) {
+      de265_random_access_index_push_data(index, buf, n);
+    }
+    de265_random_access_index_flush(index);
+
+    int entry = de265_random_access_index_find_entry(index, seek_picture);
+    if (entry<0) {
+      entry=0;
+    }
+
+    err = de265_seek(ctx, index, entry);
+    if (err != DE265_OK) {
+      fprintf(stderr,"cannot seek: %s\n", de265_get_error_text(err));
+      exit(10);
+    }
+
+    const de265_random_access_point* rap = de265_random_access_index_get_entry(index, entry);
+    if (quiet<=1) {
+      fprintf(stderr,"seeking to picture %d (POC %d) at byte %lld\n",
+              rap->picture_number, rap->POC, (long long)rap->byte_offset);
+    }
+
+    pos = rap->byte_offset;
+#ifdef _MSC_VER
+    int seekerr = _fseeki64(fh, pos, SEEK_SET);
+#else
+    int seekerr = fseeko(fh, (off_t)pos, SEEK_SET);
+#endif
+    if (seekerr) {
+      fprintf(stderr,"cannot seek to byte %lld in input file\n", (long long)pos);
+      exit(10);
+    }
+
+    de265_free_random_access_index(index);
+  }
 
   while (!stop)
     {
@@ -684,21 +795,68 @@ int main(int argc, char** argv)
       //de265_set_limit_TID(ctx, tid);
 
       if (nal_input) {
-        uint8_t len[4];
-        int n = fread(len,1,4,fh);
-        int length = (len[0]<<24) + (len[1]<<16) + (len[2]<<8) + len[3];
-
-        uint8_t* buf = (uint8_t*)malloc(length);
-        n = fread(buf,1,length,fh);
-        err = de265_push_NAL(ctx, buf,n,  pos, (void*)1);
-
-        if (write_bytestream) {
-          uint8_t sc[3] = { 0,0,1 };
-          fwrite(sc ,1,3,bytestream_fh);
-          fwrite(buf,1,n,bytestream_fh);
+        // collect length prefixed NALs until we have at least BUFFER_SIZE bytes
+
+        size_t capacity = BUFFER_SIZE;
+        size_t n = 0;
+        uint8_t* buf = (uint8_t*)malloc(capacity);
+        if (buf==NULL) {
+          fprintf(stderr,"out of memory\n");
+          exit(10);
+        }
+
+        while (n < BUFFER_SIZE && !invalid_nal_length) {
+          uint8_t len[4];
+          if (fread(len,1,nal_length_size,fh) != (size_t)nal_length_size) {
+            break;
+          }
+
+          uint32_t length = 0;
+          for (int i=0;i<nal_length_size;i++) {
+            length = (length<<8) | len[i];
+          }
+
+          if (length > MAX_NAL_SIZE) {
+            fprintf(stderr,"invalid NAL length %u (maximum is %d bytes)\n", length, MAX_NAL_SIZE);
+            invalid_nal_length = true;
+            break;
+          }
+
+          size_t needed = n + nal_length_size + (size_t)length;
+          if (needed > capacity) {
+            capacity = needed + BUFFER_SIZE;
+            uint8_t* newbuf = (uint8_t*)realloc(buf, capacity);
+            if (newbuf==NULL) {
+              fprintf(stderr,"out of memory\n");
+              exit(10);
+            }
+            buf = newbuf;
+          }
+
+          uint8_t* nal = buf+n+nal_length_size;
+          length = (uint32_t)fread(nal,1,length,fh);
+
+          // write the (possibly truncated) length back
+          for (int i=0;i<nal_length_size;i++) {
+            buf[n+i] = (length >> (8*(nal_length_size-1-i))) & 0xFF;
+          }
+
+          if (write_bytestream) {
+            uint8_t sc[3] = { 0,0,1 };
+            fwrite(sc ,1,3,bytestream_fh);
+            fwrite(nal,1,length,bytestream_fh);
+          }
+
+          n += nal_length_size + length;
+        }
+
+        // the decoder takes over the buffer and frees it when all NALs are decoded
+        err = de265_push_length_prefixed_NALs_zerocopy(ctx, buf,(int)n, nal_length_size,
+                                                       pos, (void*)1, release_NAL_buffer, NULL);
+        if (err != DE265_OK) {
+          break;
         }
 
-        free(buf);
         pos+=n;
       }
       else {
@@ -729,7 +887,7 @@ int main(int argc, char** argv)
 
       // printf("pending data: %d\n", de265_get_number_of_input_bytes_pending(ctx));
 
-      if (feof(fh)) {
+      if (feof(fh) || invalid_nal_length) {
         err = de265_flush_data(ctx); // indicate end of stream
         stop = true;
       }
@@ -776,6 +934,12 @@ int main(int argc, char** argv)
             }
 
             if (quiet<=1) fprintf(stderr,"WARNING: %s\n", de265_get_error_text(warning));
+
+            if (check_hash && warning == DE265_WARNING_PICTURE_HASH_MISMATCH) {
+              err = DE265_ERROR_CHECKSUM_MISMATCH;
+              stop = 1;
+              more = 0;
+            }
           }
         }
     }
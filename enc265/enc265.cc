@@ -91,6 +91,10 @@ struct inout_params
 
   option_bool input_is_rgb;
 
+  // encoder
+
+  option_int num_threads;
+
   // output
 
   option_string output_filename;
@@ -133,6 +137,10 @@ inout_params::inout_params()
   input_is_rgb.set_ID("rgb");
   input_is_rgb.set_default(false);
   input_is_rgb.set_description("input is sequence of RGB PNG images");
+
+  num_threads.set_ID("threads"); num_threads.set_short_option('t');
+  num_threads.set_minimum(0);  num_threads.set_default(0);
+  num_threads.set_description("number of worker threads (WPP encoding)");
 }
 
 
@@ -144,6 +152,7 @@ void inout_params::register_params(config_parameters& config)
   config.add_option(&max_number_of_frames);
   config.add_option(&input_width);
   config.add_option(&input_height);
+  config.add_option(&num_threads);
 #if HAVE_VIDEOGFX
   if (videogfx::PNG_Supported()) {
     config.add_option(&input_is_rgb);
@@ -300,7 +309,7 @@ int main(int argc, char** argv)
 
   image_source->skip_frames( inout_params.first_frame );
 
-  en265_start_encoder(ectx, 0);
+  en265_start_encoder(ectx, inout_params.num_threads);
 
   int maxPoc = INT_MAX;
   if (inout_params.max_number_of_frames.is_defined()) {
@@ -308,11 +317,16 @@ int main(int argc, char** argv)
   }
 
   bool eof = false;
-  for (int poc=0; poc<maxPoc && !eof ;poc++)
+  for (int poc=0; !eof ;poc++)
     {
       // push one image into the encoder
+      // (the end of the stream has to be signaled, so that the lookahead is flushed)
+
+      de265_image* input_image = NULL;
+      if (poc<maxPoc) {
+        input_image = image_source->get_image();
+      }
 
-      de265_image* input_image = image_source->get_image();
       if (input_image==NULL) {
         en265_push_eof(ectx);
         eof=true;
@@ -198,6 +198,30 @@ struct acceleration_functions
   // forward Hadamard transform (without scaling factor)
   // (4x4,8x8,16x16,32x32) indexed with (log2TbSize-2)
   void (*hadamard_transform_8[4])     (int16_t *coeffs, const int16_t *src, ptrdiff_t stride);
+
+
+  // --- distortion measures (encoder) ---
+
+  // square blocks (4x4,8x8,16x16,32x32,64x64) indexed with (log2BlkSize-2)
+  int  (*sad_8[5]) (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+  int  (*ssd_8[5]) (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+  int  (*satd_8[5])(const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2); // Hadamard, SAD scale
+
+  // SAD of one source block against four reference positions (motion search)
+  void (*sad_x4_8[5])(const uint8_t* src, ptrdiff_t srcStride,
+                      const uint8_t* const ref[4], ptrdiff_t refStride, int sads[4]);
+
+  // Rectangular blocks with sizes that are multiples of 4, evaluated as a grid of square blocks.
+  int sad (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2, int w,int h) const;
+  int ssd (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2, int w,int h) const;
+  int satd(const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2, int w,int h) const;
+
+
+  // --- NAL parsing ---
+
+  // position of the first 00 00 byte pair (start code / emulation prevention candidate),
+  // or 'len' if there is none
+  int (*find_zero_byte_pair)(const uint8_t* data, int len);
 };
 
 
@@ -356,4 +380,70 @@ template <> inline void acceleration_functions::transform_add<uint16_t>(int size
 template <> inline void acceleration_functions::add_residual(uint8_t *dst,  ptrdiff_t stride, const int32_t* r, int nT, int bit_depth) const { add_residual_8(dst,stride,r,nT,bit_depth); }
 template <> inline void acceleration_functions::add_residual(uint16_t *dst, ptrdiff_t stride, const int32_t* r, int nT, int bit_depth) const { add_residual_16(dst,stride,r,nT,bit_depth); }
 
+
+// largest square block size (as log2) that tiles a w x h block
+inline int dist_log2_tile_size(int w,int h)
+{
+  int log2Size=2;
+  while (log2Size<6 && ((w|h) & ((2<<log2Size)-1))==0) {
+    log2Size++;
+  }
+
+  return log2Size;
+}
+
+
+inline int acceleration_functions::sad(const uint8_t* p1, ptrdiff_t stride1,
+                                        const uint8_t* p2, ptrdiff_t stride2, int w,int h) const
+{
+  assert((w&3)==0 && (h&3)==0);
+
+  int log2Size = dist_log2_tile_size(w,h);
+  int size = 1<<log2Size;
+
+  int sum=0;
+  for (int y=0;y<h;y+=size)
+    for (int x=0;x<w;x+=size) {
+      sum += sad_8[log2Size-2](p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
+
+inline int acceleration_functions::ssd(const uint8_t* p1, ptrdiff_t stride1,
+                                        const uint8_t* p2, ptrdiff_t stride2, int w,int h) const
+{
+  assert((w&3)==0 && (h&3)==0);
+
+  int log2Size = dist_log2_tile_size(w,h);
+  int size = 1<<log2Size;
+
+  int sum=0;
+  for (int y=0;y<h;y+=size)
+    for (int x=0;x<w;x+=size) {
+      sum += ssd_8[log2Size-2](p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
+
+inline int acceleration_functions::satd(const uint8_t* p1, ptrdiff_t stride1,
+                                         const uint8_t* p2, ptrdiff_t stride2, int w,int h) const
+{
+  assert((w&3)==0 && (h&3)==0);
+
+  int log2Size = dist_log2_tile_size(w,h);
+  int size = 1<<log2Size;
+
+  int sum=0;
+  for (int y=0;y<h;y+=size)
+    for (int x=0;x<w;x+=size) {
+      sum += satd_8[log2Size-2](p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
 #endif
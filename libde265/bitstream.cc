@@ -20,14 +20,33 @@
 
 #include "bitstream.h"
 #include "de265.h"
+#include "util.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <algorithm>
 
 
 
+void stuffing_bytes_seek(stuffing_bytes* s, const uint8_t* ptr)
+{
+  if (s->begin == s->end) {
+    return;
+  }
+
+  int pos = ptr - s->base;
+  s->next = std::lower_bound(s->begin, s->end, pos);
+}
+
+
 void bitreader_init(bitreader* br, unsigned char* buffer, int len)
+{
+  bitreader_init(br, buffer, len, NULL);
+}
+
+void bitreader_init(bitreader* br, unsigned char* buffer, int len,
+                    const stuffing_bytes* stuffing)
 {
   br->data = buffer;
   br->bytes_remaining = len;
@@ -35,6 +54,14 @@ void bitreader_init(bitreader* br, unsigned char* buffer, int len)
   br->nextbits=0;
   br->nextbits_cnt=0;
 
+  if (stuffing) {
+    br->stuffing = *stuffing;
+    stuffing_bytes_seek(&br->stuffing, buffer);
+  }
+  else {
+    stuffing_bytes_init_empty(&br->stuffing);
+  }
+
   bitreader_refill(br);
 }
 
@@ -42,7 +69,36 @@ void bitreader_refill(bitreader* br)
 {
   int shift = 64-br->nextbits_cnt;
 
+  // fast path: load all missing bytes with a single 64-bit read if there are
+  // enough bytes left and no stuffing byte is among them
+
+  if (shift >= 8 && br->bytes_remaining >= 8) {
+    int nBytes = shift>>3;
+
+    if (stuffing_bytes_empty(&br->stuffing) ||
+        stuffing_bytes_next_ptr(&br->stuffing) >= br->data + nBytes) {
+      uint64_t newval = read_big_endian_64(br->data);
+      newval >>= 64 - 8*nBytes;
+
+      shift -= 8*nBytes;
+      br->nextbits |= newval << shift;
+
+      br->data += nBytes;
+      br->bytes_remaining -= nBytes;
+      br->nextbits_cnt = 64-shift;
+      return;
+    }
+  }
+
   while (shift >= 8 && br->bytes_remaining) {
+    if (!stuffing_bytes_empty(&br->stuffing) &&
+        br->data == stuffing_bytes_next_ptr(&br->stuffing)) {
+      br->data++;
+      br->bytes_remaining--;
+      br->stuffing.next++;
+      continue;
+    }
+
     uint64_t newval = *br->data++;
     br->bytes_remaining--;
 
@@ -82,6 +138,52 @@ int  get_bits_fast(bitreader* br, int n)
   return val;
 }
 
+template <int nBits>
+static void get_bits_bulk_internal(bitreader* br, uint16_t* out, int count)
+{
+  while (count>0) {
+    bitreader_refill(br);
+
+    int n = br->nextbits_cnt / nBits;
+    if (n<=0) {
+      // end of data
+      *out++ = get_bits(br, nBits);
+      count--;
+      continue;
+    }
+
+    if (n>count) n=count;
+
+    uint64_t bits = br->nextbits;
+    for (int i=0;i<n;i++) {
+      out[i] = bits >> (64-nBits);
+      bits <<= nBits;
+    }
+
+    br->nextbits = bits;
+    br->nextbits_cnt -= n*nBits;
+
+    out   += n;
+    count -= n;
+  }
+}
+
+void get_bits_bulk(bitreader* br, int n, uint16_t* out, int count)
+{
+  assert(n>=1 && n<=16);
+
+  switch (n) {
+  case  8: get_bits_bulk_internal< 8>(br,out,count); break;
+  case 10: get_bits_bulk_internal<10>(br,out,count); break;
+  case 12: get_bits_bulk_internal<12>(br,out,count); break;
+  default:
+    for (int i=0;i<count;i++) {
+      out[i] = get_bits(br,n);
+    }
+    break;
+  }
+}
+
 int  peek_bits(bitreader* br, int n)
 {
   if (br->nextbits_cnt < n) {
@@ -123,31 +225,45 @@ void prepare_for_CABAC(bitreader* br)
   skip_to_byte_boundary(br);
 
   int rewind = br->nextbits_cnt/8;
-  br->data -= rewind;
-  br->bytes_remaining += rewind;
+  while (rewind--) {
+    br->data--;
+    br->bytes_remaining++;
+
+    // step back over stuffing bytes that were skipped during refill
+    if (br->stuffing.next != br->stuffing.begin &&
+        br->data == br->stuffing.base + br->stuffing.next[-1]) {
+      br->data--;
+      br->bytes_remaining++;
+      br->stuffing.next--;
+    }
+  }
   br->nextbits = 0;
   br->nextbits_cnt = 0;
 }
 
 int  get_uvlc(bitreader* br)
 {
-  int num_zeros=0;
-
-  while (get_bits(br,1)==0) {
-    num_zeros++;
-
-    if (num_zeros > MAX_UVLC_LEADING_ZEROS) { return UVLC_ERROR; }
+  if (br->nextbits_cnt < 2*MAX_UVLC_LEADING_ZEROS+1) {
+    bitreader_refill(br);
   }
 
-  int offset = 0;
-  if (num_zeros != 0) {
-    offset = get_bits(br, num_zeros);
-    int value = offset + (1<<num_zeros)-1;
-    assert(value>0);
-    return value;
-  } else {
-    return 0;
+  if (br->nextbits == 0) {
+    return UVLC_ERROR;
   }
+
+  int num_zeros = count_leading_zeros_64(br->nextbits);
+  if (num_zeros > MAX_UVLC_LEADING_ZEROS) { return UVLC_ERROR; }
+
+  // codeword is 'num_zeros' zeros, a one, and 'num_zeros' bits offset,
+  // which read as a number is (value+1)
+
+  int len = 2*num_zeros+1;
+  int value = (int)(br->nextbits >> (64-len)) - 1;
+
+  br->nextbits <<= len;
+  br->nextbits_cnt -= len;
+
+  return value;
 }
 
 int  get_svlc(bitreader* br)
@@ -36,20 +36,44 @@
 #define UVLC_ERROR -99999
 
 
+/* Emulation-prevention bytes (the 0x03 in 0x000003) that are still contained
+   in the input data because the NAL was not copied (zero-copy input).
+   Positions are byte offsets relative to 'base' in increasing order.
+   Readers skip these bytes when they reach them.
+ */
+typedef struct {
+  const uint8_t* base;
+  const int* begin;
+  const int* next; // next stuffing byte to skip
+  const int* end;
+} stuffing_bytes;
+
+inline void stuffing_bytes_init_empty(stuffing_bytes* s) { s->base=NULL; s->begin=s->next=s->end=NULL; }
+inline bool stuffing_bytes_empty(const stuffing_bytes* s) { return s->next==s->end; }
+inline const uint8_t* stuffing_bytes_next_ptr(const stuffing_bytes* s) { return s->base + *s->next; }
+
+// set 'next' to the first stuffing byte at or behind 'ptr'
+void stuffing_bytes_seek(stuffing_bytes* s, const uint8_t* ptr);
+
+
 typedef struct {
   uint8_t* data;
   int bytes_remaining;
 
   uint64_t nextbits; // left-aligned bits
   int nextbits_cnt;
+
+  stuffing_bytes stuffing;
 } bitreader;
 
 void bitreader_init(bitreader*, unsigned char* buffer, int len);
+void bitreader_init(bitreader*, unsigned char* buffer, int len, const stuffing_bytes*);
 void bitreader_refill(bitreader*); // refill to at least 56+1 bits
 int  next_bit(bitreader*);
 int  next_bit_norefill(bitreader*);
 int  get_bits(bitreader*, int n);
 int  get_bits_fast(bitreader*, int n);
+void get_bits_bulk(bitreader*, int n, uint16_t* out, int count); // 'count' values of n<=16 bits each
 int  peek_bits(bitreader*, int n);
 void skip_bits(bitreader*, int n);
 void skip_bits_fast(bitreader*, int n);
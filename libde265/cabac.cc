@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
 
 #define INITIAL_CABAC_BUFFER_CAPACITY 4096
 
@@ -129,36 +130,348 @@ static const uint8_t next_state_LPS[64] =
 
 
 
+// Number of renormalization steps for a 9-bit range (index: range>>3).
+// Same as renorm_table for ranges < 256, zero for ranges >= 256.
+static const uint8_t renorm_table_9bit[64] =
+  {
+    6,  5,  4,  4,  3,  3,  3,  3,  2,  2,  2,  2,  2,  2,  2,  2,
+    1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+    0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+  };
+
+
+
 #ifdef DE265_LOG_TRACE
 int logcnt=1;
 #endif
 
-void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length)
+void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length,
+                        const stuffing_bytes* stuffing,
+                        enum de265_cabac_engine engine)
 {
   assert(length >= 0);
 
   decoder->bitstream_start = bitstream;
   decoder->bitstream_curr  = bitstream;
-  decoder->bitstream_end   = bitstream+length;
+  decoder->substream_start = bitstream;
+  decoder->bitstream_stop  = bitstream+length;
+
+  if (stuffing) {
+    decoder->stuffing = *stuffing;
+    stuffing_bytes_seek(&decoder->stuffing, bitstream);
+  }
+  else {
+    stuffing_bytes_init_empty(&decoder->stuffing);
+  }
+
+  decoder->engine = engine;
+  decoder->window = 0;
+  decoder->window_bits = 0;
+  decoder->window_padding = 0;
+
+  CABAC_update_bitstream_end(decoder);
 }
 
-void init_CABAC_decoder_2(CABAC_decoder* decoder)
+void CABAC_update_bitstream_end(CABAC_decoder* decoder)
+{
+  decoder->bitstream_end = decoder->bitstream_stop;
+
+  if (!stuffing_bytes_empty(&decoder->stuffing)) {
+    stuffing_bytes_seek(&decoder->stuffing, decoder->bitstream_curr);
+
+    if (!stuffing_bytes_empty(&decoder->stuffing)) {
+      uint8_t* next = (uint8_t*)stuffing_bytes_next_ptr(&decoder->stuffing);
+      if (next < decoder->bitstream_end) {
+        decoder->bitstream_end = next;
+      }
+    }
+  }
+}
+
+bool CABAC_skip_stuffing_byte(CABAC_decoder* decoder)
+{
+  if (decoder->bitstream_end == decoder->bitstream_stop) {
+    return false;
+  }
+
+  // we are at a stuffing byte
+
+  decoder->bitstream_curr++;
+  decoder->stuffing.next++;
+
+  CABAC_update_bitstream_end(decoder);
+
+  return decoder->bitstream_curr < decoder->bitstream_end;
+}
+
+
+/* --- 64-bit engine ---
+
+   The reference engine keeps the arithmetic decoder value scaled by 2^7 and reads
+   a new byte after each 8 bits of renormalization.
+   The 64-bit engine keeps the value followed by 'window_bits' look-ahead bits in 'window'.
+   Comparing 'window' with (range << window_bits) is equivalent to the comparison in the
+   reference engine, but renormalization only decreases 'window_bits'. New input is
+   appended in blocks of up to six bytes when the look-ahead runs short.
+   As the value is below 2^9, the window can hold up to 55 look-ahead bits.
+
+   After initialization, 'window_bits' is 7, like the 7 fractional bits of the reference
+   engine. Hence, the reference engine would have read 'window_bits/8' bytes less.
+ */
+
+#define CABAC_WINDOW_MAX_BITS 55
+
+
+static void refill_window_slow(CABAC_decoder* decoder)
+{
+  while (decoder->window_bits <= CABAC_WINDOW_MAX_BITS-8) {
+    decoder->window <<= 8;
+    decoder->window_bits += 8;
+
+    if (CABAC_has_input(decoder)) {
+      decoder->window |= *decoder->bitstream_curr++;
+    }
+    else if (decoder->window_padding < 8) {
+      decoder->window_padding++;
+    }
+  }
+}
+
+static inline void refill_window(CABAC_decoder* decoder)
+{
+  if (likely(decoder->bitstream_end - decoder->bitstream_curr >= 8)) {
+    // no stuffing byte in the next 8 bytes
+
+    int nBits = (CABAC_WINDOW_MAX_BITS - decoder->window_bits) & ~7;
+    uint64_t input = read_big_endian_64(decoder->bitstream_curr);
+
+    decoder->window = (decoder->window << nBits) | (input >> (64-nBits));
+    decoder->window_bits += nBits;
+    decoder->bitstream_curr += nBits>>3;
+  }
+  else {
+    refill_window_slow(decoder);
+  }
+}
+
+void CABAC_return_lookahead_bytes(CABAC_decoder* decoder)
+{
+  if (decoder->engine == de265_cabac_engine_REFERENCE) {
+    return;
+  }
+
+  int nBytes = decoder->window_bits/8 - decoder->window_padding;
+
+  while (nBytes-- > 0) {
+    decoder->bitstream_curr--;
+
+    // step back over stuffing bytes that have been skipped while reading ahead
+
+    while (decoder->stuffing.next != decoder->stuffing.begin &&
+           decoder->stuffing.base + decoder->stuffing.next[-1] == decoder->bitstream_curr) {
+      decoder->stuffing.next--;
+      decoder->bitstream_curr--;
+    }
+  }
+
+  decoder->window = 0;
+  decoder->window_bits = 0;
+  decoder->window_padding = 0;
+
+  CABAC_update_bitstream_end(decoder);
+}
+
+
+static void init_CABAC_decoder_window(CABAC_decoder* decoder)
+{
+  decoder->range = 510;
+  decoder->window = 0;
+  decoder->window_padding = 0;
+
+  for (int i=0;i<2;i++) {
+    decoder->window <<= 8;
+
+    if (CABAC_has_input(decoder)) {
+      decoder->window |= *decoder->bitstream_curr++;
+    }
+    else {
+      decoder->window_padding++;
+    }
+  }
+
+  decoder->window_bits = 7;
+}
+
+
+static inline int decode_CABAC_bit_window(CABAC_decoder* decoder, context_model* model)
+{
+  if (unlikely(decoder->window_bits < 7)) {
+    refill_window(decoder);
+  }
+
+  int state = model->state;
+  uint32_t LPS = LPS_table[state][ ( decoder->range >> 6 ) - 4 ];
+  uint32_t MPS = decoder->range - LPS;
+
+  uint64_t scaled_range = (uint64_t)MPS << decoder->window_bits;
+
+  // branchless selection of the MPS / LPS path
+
+  int isLPS = (decoder->window >= scaled_range);
+  decoder->window -= scaled_range & (0-(uint64_t)isLPS);
+
+  uint32_t range = isLPS ? LPS : MPS;
+  int num_bits = renorm_table_9bit[range >> 3];
+  decoder->range = range << num_bits;
+  decoder->window_bits -= num_bits;
+
+  int decoded_bit = model->MPSbit ^ isLPS;
+
+  model->MPSbit ^= (isLPS & (state==0));
+  model->state  = isLPS ? next_state_LPS[state] : next_state_MPS[state];
+
+  return decoded_bit;
+}
+
+static inline int decode_CABAC_term_bit_window(CABAC_decoder* decoder)
+{
+  if (unlikely(decoder->window_bits < 1)) {
+    refill_window(decoder);
+  }
+
+  decoder->range -= 2;
+  uint64_t scaledRange = (uint64_t)decoder->range << decoder->window_bits;
+
+  if (decoder->window >= scaledRange) {
+    return 1;
+  }
+
+  if (decoder->range < 256) {
+    decoder->range <<= 1;
+    decoder->window_bits--;
+  }
+
+  return 0;
+}
+
+// Decode a bypass bin. The window must contain at least one look-ahead bit.
+static inline int decode_CABAC_bypass_window_norefill(CABAC_decoder* decoder)
+{
+  decoder->window_bits--;
+
+  uint64_t scaled_range = (uint64_t)decoder->range << decoder->window_bits;
+  int bit = (decoder->window >= scaled_range);
+  decoder->window -= scaled_range & (0-(uint64_t)bit);
+
+  return bit;
+}
+
+static inline int decode_CABAC_bypass_window(CABAC_decoder* decoder)
+{
+  if (unlikely(decoder->window_bits < 1)) {
+    refill_window(decoder);
+  }
+
+  return decode_CABAC_bypass_window_norefill(decoder);
+}
+
+static inline int decode_CABAC_TU_bypass_window(CABAC_decoder* decoder, int cMax)
 {
-  int length = decoder->bitstream_end - decoder->bitstream_curr;
+  for (int i=0;i<cMax;i++)
+    {
+      if (unlikely(decoder->window_bits < 1)) {
+        refill_window(decoder);
+      }
 
+      if (decode_CABAC_bypass_window_norefill(decoder)==0)
+        return i;
+    }
+
+  return cMax;
+}
+
+/* Decode up to 16 bypass bins at once. They form the binary representation of
+   the quotient of the value (with nBits look-ahead bits) and the range.
+ */
+static inline uint32_t decode_CABAC_FL_bypass_window_16(CABAC_decoder* decoder, int nBits)
+{
+  if (decoder->window_bits < nBits) {
+    refill_window(decoder);
+  }
+
+  if (nBits==1) {
+    return decode_CABAC_bypass_window_norefill(decoder);
+  }
+
+  decoder->window_bits -= nBits;
+
+  // the value is below 2^9, hence the dividend fits into 32 bits
+
+  uint32_t dividend = (uint32_t)(decoder->window >> decoder->window_bits);
+  uint32_t value = dividend / decoder->range;
+  if (unlikely(value >= (1U<<nBits))) { value=(1U<<nBits)-1; } // may happen with broken bitstreams
+
+  decoder->window -= ((uint64_t)(value * decoder->range)) << decoder->window_bits;
+
+  return value;
+}
+
+static inline int decode_CABAC_FL_bypass_window(CABAC_decoder* decoder, int nBits)
+{
+  if (likely(nBits <= 16)) {
+    return nBits ? decode_CABAC_FL_bypass_window_16(decoder, nBits) : 0;
+  }
+
+  uint32_t value = 0;
+  while (nBits > 16) {
+    value = (value<<16) | decode_CABAC_FL_bypass_window_16(decoder, 16);
+    nBits -= 16;
+  }
+
+  value = (value<<nBits) | decode_CABAC_FL_bypass_window_16(decoder, nBits);
+  return value;
+}
+
+
+// --- reference engine ---
+
+static void init_CABAC_decoder_reference(CABAC_decoder* decoder)
+{
   decoder->range = 510;
   decoder->bits_needed = 8;
 
   decoder->value = 0;
 
-  if (length>0) { decoder->value  = (*decoder->bitstream_curr++) << 8;  decoder->bits_needed-=8; }
-  if (length>1) { decoder->value |= (*decoder->bitstream_curr++);       decoder->bits_needed-=8; }
+  if (CABAC_has_input(decoder)) {
+    decoder->value  = (*decoder->bitstream_curr++) << 8;  decoder->bits_needed-=8;
+
+    if (CABAC_has_input(decoder)) {
+      decoder->value |= (*decoder->bitstream_curr++);     decoder->bits_needed-=8;
+    }
+  }
+}
+
+void init_CABAC_decoder_2(CABAC_decoder* decoder)
+{
+  CABAC_return_lookahead_bytes(decoder);
+
+  CABAC_update_bitstream_end(decoder);
+
+  decoder->substream_start = decoder->bitstream_curr;
+
+  if (decoder->engine == de265_cabac_engine_REFERENCE) {
+    init_CABAC_decoder_reference(decoder);
+  }
+  else {
+    init_CABAC_decoder_window(decoder);
+  }
 
   logtrace(LogCABAC,"[%3d] init_CABAC_decode_2 r:%x v:%x\n", logcnt, decoder->range, decoder->value);
 }
 
 
-int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
+static inline int decode_CABAC_bit_reference(CABAC_decoder* decoder, context_model* model)
 {
   logtrace(LogCABAC,"[%3d] decodeBin r:%x v:%x state:%d\n",logcnt,decoder->range, decoder->value, model->state);
 
@@ -190,7 +503,7 @@ int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
           if (decoder->bits_needed == 0)
             {
               decoder->bits_needed = -8;
-              if (decoder->bitstream_curr < decoder->bitstream_end)
+              if (CABAC_has_input(decoder))
                 { decoder->value |= *decoder->bitstream_curr++; }
             }
         }
@@ -223,7 +536,7 @@ int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
       if (decoder->bits_needed >= 0)
         {
           logtrace(LogCABAC,"bits_needed: %d\n", decoder->bits_needed);
-          if (decoder->bitstream_curr < decoder->bitstream_end)
+          if (CABAC_has_input(decoder))
             { decoder->value |= (*decoder->bitstream_curr++) << decoder->bits_needed; }
 
           decoder->bits_needed -= 8;
@@ -238,7 +551,7 @@ int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
   return decoded_bit;
 }
 
-int  decode_CABAC_term_bit(CABAC_decoder* decoder)
+static inline int decode_CABAC_term_bit_reference(CABAC_decoder* decoder)
 {
   logtrace(LogCABAC,"CABAC term: range=%x\n", decoder->range);
 
@@ -263,7 +576,7 @@ int  decode_CABAC_term_bit(CABAC_decoder* decoder)
             {
               decoder->bits_needed = -8;
 
-              if (decoder->bitstream_curr < decoder->bitstream_end) {
+              if (CABAC_has_input(decoder)) {
                 decoder->value += (*decoder->bitstream_curr++);
               }
             }
@@ -275,7 +588,7 @@ int  decode_CABAC_term_bit(CABAC_decoder* decoder)
 
 
 
-int  decode_CABAC_bypass(CABAC_decoder* decoder)
+static inline int decode_CABAC_bypass_reference(CABAC_decoder* decoder)
 {
   logtrace(LogCABAC,"[%3d] bypass r:%x v:%x\n",logcnt,decoder->range, decoder->value);
 
@@ -284,7 +597,7 @@ int  decode_CABAC_bypass(CABAC_decoder* decoder)
 
   if (decoder->bits_needed >= 0)
     {
-      if (decoder->bitstream_end > decoder->bitstream_curr) {
+      if (CABAC_has_input(decoder)) {
         decoder->bits_needed = -8;
         decoder->value |= *decoder->bitstream_curr++;
       }
@@ -311,11 +624,11 @@ int  decode_CABAC_bypass(CABAC_decoder* decoder)
 }
 
 
-int  decode_CABAC_TU_bypass(CABAC_decoder* decoder, int cMax)
+static int decode_CABAC_TU_bypass_reference(CABAC_decoder* decoder, int cMax)
 {
   for (int i=0;i<cMax;i++)
     {
-      int bit = decode_CABAC_bypass(decoder);
+      int bit = decode_CABAC_bypass_reference(decoder);
       if (bit==0)
         return i;
     }
@@ -336,7 +649,7 @@ int  decode_CABAC_TU(CABAC_decoder* decoder, int cMax, context_model* model)
 }
 
 
-int  decode_CABAC_FL_bypass_parallel(CABAC_decoder* decoder, int nBits)
+static int decode_CABAC_FL_bypass_parallel(CABAC_decoder* decoder, int nBits)
 {
   logtrace(LogCABAC,"[%3d] bypass group r:%x v:%x (nBits=%d)\n",logcnt,
            decoder->range, decoder->value, nBits);
@@ -346,7 +659,7 @@ int  decode_CABAC_FL_bypass_parallel(CABAC_decoder* decoder, int nBits)
 
   if (decoder->bits_needed >= 0)
     {
-      if (decoder->bitstream_end > decoder->bitstream_curr) {
+      if (CABAC_has_input(decoder)) {
         int input = *decoder->bitstream_curr++;
         input <<= decoder->bits_needed;
 
@@ -371,7 +684,7 @@ int  decode_CABAC_FL_bypass_parallel(CABAC_decoder* decoder, int nBits)
 }
 
 
-int  decode_CABAC_FL_bypass(CABAC_decoder* decoder, int nBits)
+static int decode_CABAC_FL_bypass_reference(CABAC_decoder* decoder, int nBits)
 {
   int value=0;
 
@@ -395,7 +708,7 @@ int  decode_CABAC_FL_bypass(CABAC_decoder* decoder, int nBits)
 
     while (nBits--) {
       value <<= 1;
-      value |= decode_CABAC_bypass(decoder);
+      value |= decode_CABAC_bypass_reference(decoder);
     }
   }
   logtrace(LogCABAC,"      -> FL: %d\n", value);
@@ -420,29 +733,66 @@ int  decode_CABAC_TR_bypass(CABAC_decoder* decoder, int cRiceParam, int cTRMax)
 
 int  decode_CABAC_EGk_bypass(CABAC_decoder* decoder, int k)
 {
-  int base=0;
-  int n=k;
-
-  for (;;)
-    {
-      int bit = decode_CABAC_bypass(decoder);
-      if (bit==0)
-        break;
-      else {
-        base += 1<<n;
-        n++;
-      }
+  int prefix = decode_CABAC_TU_bypass(decoder, MAX_PREFIX);
+  if (prefix == MAX_PREFIX) {
+    return 0; // TODO: error
+  }
 
-      if (n == k+MAX_PREFIX) {
-        return 0; // TODO: error
-      }
-    }
+  int base = ((1<<prefix)-1) << k;
 
-  int suffix = decode_CABAC_FL_bypass(decoder, n);
+  int suffix = decode_CABAC_FL_bypass(decoder, k+prefix);
   return base + suffix;
 }
 
 
+// --- engine selection ---
+
+int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model)
+{
+  if (likely(decoder->engine != de265_cabac_engine_REFERENCE)) {
+    return decode_CABAC_bit_window(decoder, model);
+  }
+
+  return decode_CABAC_bit_reference(decoder, model);
+}
+
+int  decode_CABAC_term_bit(CABAC_decoder* decoder)
+{
+  if (likely(decoder->engine != de265_cabac_engine_REFERENCE)) {
+    return decode_CABAC_term_bit_window(decoder);
+  }
+
+  return decode_CABAC_term_bit_reference(decoder);
+}
+
+int  decode_CABAC_bypass(CABAC_decoder* decoder)
+{
+  if (likely(decoder->engine != de265_cabac_engine_REFERENCE)) {
+    return decode_CABAC_bypass_window(decoder);
+  }
+
+  return decode_CABAC_bypass_reference(decoder);
+}
+
+int  decode_CABAC_TU_bypass(CABAC_decoder* decoder, int cMax)
+{
+  if (likely(decoder->engine != de265_cabac_engine_REFERENCE)) {
+    return decode_CABAC_TU_bypass_window(decoder, cMax);
+  }
+
+  return decode_CABAC_TU_bypass_reference(decoder, cMax);
+}
+
+int  decode_CABAC_FL_bypass(CABAC_decoder* decoder, int nBits)
+{
+  if (likely(decoder->engine != de265_cabac_engine_REFERENCE)) {
+    return decode_CABAC_FL_bypass_window(decoder, nBits);
+  }
+
+  return decode_CABAC_FL_bypass_reference(decoder, nBits);
+}
+
+
 // ---------------------------------------------------------------------------
 
 void CABAC_encoder::add_trailing_bits()
@@ -481,6 +831,11 @@ void CABAC_encoder_bitstream::reset()
   init_CABAC();
 }
 
+int CABAC_encoder_bitstream::get_num_written_bits() const
+{
+  return (data_size + num_buffered_bytes)*8 + vlc_buffer_len + (23 - bits_left);
+}
+
 void CABAC_encoder_bitstream::write_bits(uint32_t bits,int n)
 {
   vlc_buffer <<= n;
@@ -532,6 +887,20 @@ void CABAC_encoder_bitstream::flush_VLC()
   vlc_buffer = 0;
 }
 
+void CABAC_encoder_bitstream::append_escaped_data(const uint8_t* data, int n)
+{
+  assert(vlc_buffer_len==0);
+
+  while (data_size+n > data_capacity) {
+    check_size_and_resize(n);
+  }
+
+  memcpy(data_mem + data_size, data, n);
+  data_size += n;
+
+  state = 0;
+}
+
 void CABAC_encoder_bitstream::skip_bits(int nBits)
 {
   while (nBits>=8) {
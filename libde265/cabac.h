@@ -22,22 +22,60 @@
 #define DE265_CABAC_H
 
 #include <stdint.h>
+#include "libde265/de265.h"
 #include "contextmodel.h"
+#include "bitstream.h"
 
 
 typedef struct {
   uint8_t* bitstream_start;
   uint8_t* bitstream_curr;
-  uint8_t* bitstream_end;
+  uint8_t* bitstream_end;  // end of data, or next stuffing byte if that comes first
+  uint8_t* substream_start; // first byte read by the last init_CABAC_decoder_2()
 
   uint32_t range;
-  uint32_t value;
-  int16_t  bits_needed;
+  uint32_t value;        // reference engine
+  int16_t  bits_needed;  // reference engine
+
+  // 64-bit engine: arithmetic decoder value followed by 'window_bits' look-ahead bits
+  uint64_t window;
+  int16_t  window_bits;
+  int16_t  window_padding; // zero bytes appended to the window behind the end of the data
+
+  uint8_t  engine;         // enum de265_cabac_engine
+
+  // zero-copy input: stuffing bytes still in the data
+  uint8_t* bitstream_stop; // real end of data
+  stuffing_bytes stuffing;
 } CABAC_decoder;
 
 
-void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length);
+void init_CABAC_decoder(CABAC_decoder* decoder, uint8_t* bitstream, int length,
+                        const stuffing_bytes* stuffing = NULL,
+                        enum de265_cabac_engine engine = de265_cabac_engine_DEFAULT);
 void init_CABAC_decoder_2(CABAC_decoder* decoder);
+
+/* The 64-bit engine reads ahead of the arithmetic decoding position. Move 'bitstream_curr'
+   back to the first byte that has not been consumed yet, i.e., the position that the
+   reference engine would be at. Call this before accessing 'bitstream_curr' directly.
+   Decoding can only continue after init_CABAC_decoder_2().
+ */
+void CABAC_return_lookahead_bytes(CABAC_decoder* decoder);
+
+/* Called when 'bitstream_curr' reached 'bitstream_end'. If this is because of a stuffing byte,
+   the byte is skipped and true is returned when there is more input data.
+ */
+bool CABAC_skip_stuffing_byte(CABAC_decoder* decoder);
+
+/* Set 'bitstream_end' after 'bitstream_curr' has been moved.
+ */
+void CABAC_update_bitstream_end(CABAC_decoder* decoder);
+
+static inline bool CABAC_has_input(CABAC_decoder* decoder)
+{
+  return (decoder->bitstream_curr < decoder->bitstream_end ||
+          CABAC_skip_stuffing_byte(decoder));
+}
 int  decode_CABAC_bit(CABAC_decoder* decoder, context_model* model);
 int  decode_CABAC_TU(CABAC_decoder* decoder, int cMax, context_model* model);
 int  decode_CABAC_term_bit(CABAC_decoder* decoder);
@@ -110,6 +148,10 @@ public:
   virtual int size() const { return data_size; }
   uint8_t* data() const { return data_mem; }
 
+  /* Number of bits written so far, including the bits that are still pending in the
+     VLC buffer or the CABAC engine. Used by rate control to measure the size of a CTB. */
+  int get_num_written_bits() const;
+
   // --- VLC ---
 
   virtual void write_bits(uint32_t bits,int n);
@@ -121,6 +163,10 @@ public:
   // output all remaining bits and fill with zeros to next byte boundary
   virtual void flush_VLC();
 
+  /* Append data that already contains its emulation-prevention bytes (e.g. a WPP substream).
+     The bitstream has to be byte aligned and both parts must end with a non-zero byte. */
+  void append_escaped_data(const uint8_t* data, int n);
+
 
   // --- CABAC ---
 
@@ -27,6 +27,7 @@
 #include "scan.h"
 #include "image.h"
 #include "sei.h"
+#include "random-access.h"
 
 #include <assert.h>
 #include <string.h>
@@ -101,6 +102,10 @@ LIBDE265_API const char* de265_get_error_text(de265_error err)
     return "premature end of slice data";
   case DE265_ERROR_UNSPECIFIED_DECODING_ERROR:
     return "unspecified decoding error";
+  case DE265_ERROR_INVALID_NAL_LENGTH:
+    return "invalid NAL length prefix";
+  case DE265_ERROR_INVALID_RANDOM_ACCESS_POINT:
+    return "random-access point does not exist";
 
   case DE265_WARNING_NO_WPP_CANNOT_USE_MULTITHREADING:
     return "Cannot run decoder multi-threaded because stream does not support WPP";
@@ -156,6 +161,8 @@ LIBDE265_API const char* de265_get_error_text(de265_error err)
     return "SPS header missing, cannot decode SEI";
   case DE265_WARNING_COLLOCATED_MOTION_VECTOR_OUTSIDE_IMAGE_AREA:
     return "collocated motion-vector is outside image area";
+  case DE265_WARNING_PICTURE_HASH_MISMATCH:
+    return "decoded picture hash does not match SEI";
 
   default: return "unknown error";
   }
@@ -330,6 +337,48 @@ LIBDE265_API de265_error de265_push_NAL(de265_decoder_context* de265ctx,
 }
 
 
+LIBDE265_API de265_error de265_push_NAL_zerocopy(de265_decoder_context* de265ctx,
+                                                 const void* data8, int len,
+                                                 de265_PTS pts, void* user_data,
+                                                 de265_release_data_func release,
+                                                 void* release_userdata)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  const uint8_t* data = (const uint8_t*)data8;
+
+  return ctx->nal_parser.push_NAL_zerocopy(data,len,pts,user_data,
+                                           release,release_userdata);
+}
+
+
+LIBDE265_API de265_error de265_push_length_prefixed_NALs(de265_decoder_context* de265ctx,
+                                                         const void* data8, int len,
+                                                         int length_size,
+                                                         de265_PTS pts, void* user_data)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  const uint8_t* data = (const uint8_t*)data8;
+
+  return ctx->nal_parser.push_length_prefixed_NALs(data,len,length_size,pts,user_data,
+                                                   false, NULL,NULL);
+}
+
+
+LIBDE265_API de265_error de265_push_length_prefixed_NALs_zerocopy(de265_decoder_context* de265ctx,
+                                                                  const void* data8, int len,
+                                                                  int length_size,
+                                                                  de265_PTS pts, void* user_data,
+                                                                  de265_release_data_func release,
+                                                                  void* release_userdata)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  const uint8_t* data = (const uint8_t*)data8;
+
+  return ctx->nal_parser.push_length_prefixed_NALs(data,len,length_size,pts,user_data,
+                                                   true, release,release_userdata);
+}
+
+
 LIBDE265_API de265_error de265_decode(de265_decoder_context* de265ctx, int* more)
 {
   decoder_context* ctx = (decoder_context*)de265ctx;
@@ -378,6 +427,97 @@ LIBDE265_API void de265_reset(de265_decoder_context* de265ctx)
 }
 
 
+LIBDE265_API de265_random_access_index* de265_new_random_access_index(void)
+{
+  return (de265_random_access_index*)new random_access_index;
+}
+
+
+LIBDE265_API void de265_free_random_access_index(de265_random_access_index* de265idx)
+{
+  delete (random_access_index*)de265idx;
+}
+
+
+LIBDE265_API de265_error de265_random_access_index_push_data(de265_random_access_index* de265idx,
+                                                             const void* data, int length)
+{
+  random_access_index* idx = (random_access_index*)de265idx;
+  return idx->push_data((const uint8_t*)data, length);
+}
+
+
+LIBDE265_API void de265_random_access_index_flush(de265_random_access_index* de265idx)
+{
+  random_access_index* idx = (random_access_index*)de265idx;
+  idx->flush();
+}
+
+
+LIBDE265_API int de265_random_access_index_get_number_of_entries(const de265_random_access_index* de265idx)
+{
+  const random_access_index* idx = (const random_access_index*)de265idx;
+  return idx->number_of_entries();
+}
+
+
+LIBDE265_API int de265_random_access_index_get_number_of_pictures(const de265_random_access_index* de265idx)
+{
+  const random_access_index* idx = (const random_access_index*)de265idx;
+  return idx->number_of_pictures();
+}
+
+
+LIBDE265_API const struct de265_random_access_point*
+  de265_random_access_index_get_entry(const de265_random_access_index* de265idx, int entry)
+{
+  const random_access_index* idx = (const random_access_index*)de265idx;
+
+  if (entry<0 || entry>=idx->number_of_entries()) {
+    return NULL;
+  }
+
+  return &idx->get_entry(entry);
+}
+
+
+LIBDE265_API int de265_random_access_index_find_entry(const de265_random_access_index* de265idx,
+                                                      int picture_number)
+{
+  const random_access_index* idx = (const random_access_index*)de265idx;
+  return idx->find_entry(picture_number);
+}
+
+
+LIBDE265_API de265_error de265_seek(de265_decoder_context* de265ctx,
+                                    const de265_random_access_index* de265idx, int entry)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+  const random_access_index* idx = (const random_access_index*)de265idx;
+
+  if (entry<0 || entry>=idx->number_of_entries()) {
+    return DE265_ERROR_INVALID_RANDOM_ACCESS_POINT;
+  }
+
+  ctx->reset();
+
+  // The parameter sets may have been sent out-of-band or may have changed since the
+  // entry point. Send the ones that were active at the entry before its picture data.
+
+  std::vector<const std::vector<uint8_t>*> nals;
+  idx->get_parameter_sets(entry, nals);
+
+  FOR_LOOP(const std::vector<uint8_t>*, nal, nals) {
+    de265_error err = ctx->nal_parser.push_NAL(nal->data(), nal->size(), 0, NULL);
+    if (err != DE265_OK) {
+      return err;
+    }
+  }
+
+  return DE265_OK;
+}
+
+
 LIBDE265_API const struct de265_image* de265_get_next_picture(de265_decoder_context* de265ctx)
 {
   const struct de265_image* img = de265_peek_next_picture(de265ctx);
@@ -477,6 +617,22 @@ LIBDE265_API void de265_set_parameter_bool(de265_decoder_context* de265ctx, enum
       ctx->param_sei_check_hash = !!value;
       break;
 
+    case DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH_BEFORE_OUTPUT:
+      ctx->param_sei_check_hash_before_output = !!value;
+      break;
+
+    case DE265_DECODER_PARAM_BOOL_KEYFRAMES_ONLY:
+      ctx->param_keyframes_only = !!value;
+      break;
+
+    case DE265_DECODER_PARAM_BOOL_LUMA_ONLY:
+      ctx->param_luma_only = !!value;
+      break;
+
+    case DE265_DECODER_PARAM_BOOL_GENERIC_RESIDUAL_CODING:
+      ctx->param_generic_residual_coding = !!value;
+      break;
+
     case DE265_DECODER_PARAM_SUPPRESS_FAULTY_PICTURES:
       ctx->param_suppress_faulty_pictures = !!value;
       break;
@@ -532,6 +688,14 @@ LIBDE265_API void de265_set_parameter_int(de265_decoder_context* de265ctx, enum
       ctx->set_acceleration_functions((enum de265_acceleration)value);
       break;
 
+    case DE265_DECODER_PARAM_IMAGE_ALLOCATION_MODE:
+      ctx->set_image_allocation_mode((enum de265_image_allocation_mode)value);
+      break;
+
+    case DE265_DECODER_PARAM_CABAC_ENGINE:
+      ctx->param_cabac_engine = (enum de265_cabac_engine)value;
+      break;
+
     default:
       assert(false);
       break;
@@ -550,6 +714,18 @@ LIBDE265_API int de265_get_parameter_bool(de265_decoder_context* de265ctx, enum
     case DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH:
       return ctx->param_sei_check_hash;
 
+    case DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH_BEFORE_OUTPUT:
+      return ctx->param_sei_check_hash_before_output;
+
+    case DE265_DECODER_PARAM_BOOL_KEYFRAMES_ONLY:
+      return ctx->param_keyframes_only;
+
+    case DE265_DECODER_PARAM_BOOL_LUMA_ONLY:
+      return ctx->param_luma_only;
+
+    case DE265_DECODER_PARAM_BOOL_GENERIC_RESIDUAL_CODING:
+      return ctx->param_generic_residual_coding;
+
     case DE265_DECODER_PARAM_SUPPRESS_FAULTY_PICTURES:
       return ctx->param_suppress_faulty_pictures;
 
@@ -673,6 +849,29 @@ LIBDE265_API const struct de265_image_allocation *de265_get_default_image_alloca
   return &de265_image::default_image_allocation;
 }
 
+LIBDE265_API void de265_get_memory_usage(de265_decoder_context* de265ctx,
+                                         enum de265_memory_category category,
+                                         size_t* current_bytes, size_t* peak_bytes)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  if ((int)category < de265_memory_image_planes || (int)category > de265_memory_total) {
+    if (current_bytes) { *current_bytes = 0; }
+    if (peak_bytes)    { *peak_bytes    = 0; }
+    return;
+  }
+
+  if (current_bytes) { *current_bytes = ctx->memory_usage.get_current(category); }
+  if (peak_bytes)    { *peak_bytes    = ctx->memory_usage.get_peak(category); }
+}
+
+LIBDE265_API void de265_set_memory_limit(de265_decoder_context* de265ctx, size_t max_bytes)
+{
+  decoder_context* ctx = (decoder_context*)de265ctx;
+
+  ctx->memory_usage.set_limit(max_bytes);
+}
+
 LIBDE265_API de265_PTS de265_get_image_PTS(const struct de265_image* img)
 {
   return img->pts;
@@ -683,6 +882,11 @@ LIBDE265_API void* de265_get_image_user_data(const struct de265_image* img)
   return img->user_data;
 }
 
+LIBDE265_API enum de265_sei_hash_check_result de265_get_image_sei_hash_check_result(const struct de265_image* img)
+{
+  return img->get_sei_hash_check_result();
+}
+
 LIBDE265_API void de265_set_image_user_data(struct de265_image* img, void *user_data)
 {
   img->user_data = user_data;
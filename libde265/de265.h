@@ -35,6 +35,7 @@ extern "C" {
 #define __STDC_LIMIT_MACROS 1
 #endif
 #include <stdint.h>
+#include <stddef.h>
 
 #if defined(_MSC_VER) && !defined(LIBDE265_STATIC_BUILD)
   #ifdef LIBDE265_EXPORTS
@@ -99,6 +100,8 @@ typedef enum {
   DE265_ERROR_NO_INITIAL_SLICE_HEADER=16,
   DE265_ERROR_PREMATURE_END_OF_SLICE=17,
   DE265_ERROR_UNSPECIFIED_DECODING_ERROR=18,
+  DE265_ERROR_INVALID_NAL_LENGTH=19,
+  DE265_ERROR_INVALID_RANDOM_ACCESS_POINT=20,
 
   // --- errors that should become obsolete in later libde265 versions ---
 
@@ -135,7 +138,8 @@ typedef enum {
   DE265_NON_EXISTING_LT_REFERENCE_CANDIDATE_IN_SLICE_HEADER=1023,
   DE265_WARNING_CANNOT_APPLY_SAO_OUT_OF_MEMORY=1024,
   DE265_WARNING_SPS_MISSING_CANNOT_DECODE_SEI=1025,
-  DE265_WARNING_COLLOCATED_MOTION_VECTOR_OUTSIDE_IMAGE_AREA=1026
+  DE265_WARNING_COLLOCATED_MOTION_VECTOR_OUTSIDE_IMAGE_AREA=1026,
+  DE265_WARNING_PICTURE_HASH_MISMATCH=1027
 } de265_error;
 
 LIBDE265_API const char* de265_get_error_text(de265_error err);
@@ -177,6 +181,19 @@ LIBDE265_API de265_PTS de265_get_image_PTS(const struct de265_image*);
 LIBDE265_API void* de265_get_image_user_data(const struct de265_image*);
 LIBDE265_API void de265_set_image_user_data(struct de265_image*, void *user_data);
 
+/* Result of the SEI decoded picture hash check (DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH).
+   When the decoder runs with worker threads, the check runs in the background and the
+   picture may be output while the result is still pending.
+ */
+enum de265_sei_hash_check_result {
+  de265_sei_hash_check_result_NOT_CHECKED=0, // no hash SEI or hash checking disabled
+  de265_sei_hash_check_result_PENDING=1,
+  de265_sei_hash_check_result_CORRECT=2,
+  de265_sei_hash_check_result_MISMATCH=3
+};
+
+LIBDE265_API enum de265_sei_hash_check_result de265_get_image_sei_hash_check_result(const struct de265_image*);
+
 /* Get NAL-header information of this frame. You can pass in NULL pointers if you
    do not need this piece of information.
  */
@@ -245,6 +262,53 @@ LIBDE265_API void        de265_push_end_of_frame(de265_decoder_context*);
 LIBDE265_API de265_error de265_push_NAL(de265_decoder_context*, const void* data, int length,
                                         de265_PTS pts, void* user_data);
 
+/* Callback to give a buffer passed to de265_push_NAL_zerocopy() back to the caller.
+ */
+typedef void (*de265_release_data_func)(const void* data, void* release_userdata);
+
+/* Push a complete NAL unit without startcode into the decoder without copying it.
+   The data must still contain all stuffing-bytes. They are not removed from the data,
+   but skipped while decoding.
+   The decoder reads directly from the buffer, which must remain valid and unmodified
+   until 'release' is called for it. This happens as soon as the NAL has been decoded
+   (or discarded by de265_reset() or de265_free_decoder()). If 'release' is NULL,
+   the buffer has to stay valid until the decoder is freed.
+   If an error is returned, 'release' has already been called.
+   This function only pushes data into the decoder, nothing will be decoded.
+*/
+LIBDE265_API de265_error de265_push_NAL_zerocopy(de265_decoder_context*, const void* data, int length,
+                                                 de265_PTS pts, void* user_data,
+                                                 de265_release_data_func release,
+                                                 void* release_userdata);
+
+/* Push a complete access unit (or any sequence of complete NAL units) in
+   length-prefixed format, as stored in MP4 ('hvcC') and Matroska files.
+   Each NAL unit is preceded by its size as a big-endian integer of 'length_size'
+   bytes (1, 2, or 4). The NAL units are split without scanning for start codes.
+   The PTS and user_data are assigned to all contained NAL units.
+   If the data is not a valid sequence of length-prefixed NAL units,
+   DE265_ERROR_INVALID_NAL_LENGTH is returned and no NAL is pushed.
+   The data must still contain all stuffing-bytes.
+   This function only pushes data into the decoder, nothing will be decoded.
+*/
+LIBDE265_API de265_error de265_push_length_prefixed_NALs(de265_decoder_context*,
+                                                         const void* data, int length,
+                                                         int length_size,
+                                                         de265_PTS pts, void* user_data);
+
+/* Like de265_push_length_prefixed_NALs(), but without copying the data.
+   The buffer must remain valid and unmodified until 'release' is called for it,
+   which happens once, after the last contained NAL has been decoded (see
+   de265_push_NAL_zerocopy()).
+   If an error is returned, 'release' has already been called.
+*/
+LIBDE265_API de265_error de265_push_length_prefixed_NALs_zerocopy(de265_decoder_context*,
+                                                                  const void* data, int length,
+                                                                  int length_size,
+                                                                  de265_PTS pts, void* user_data,
+                                                                  de265_release_data_func release,
+                                                                  void* release_userdata);
+
 /* Indicate the end-of-stream. All data pending at the decoder input will be
    pushed into the decoder and the decoded picture queue will be completely emptied.
  */
@@ -279,6 +343,54 @@ LIBDE265_API de265_error de265_decode(de265_decoder_context*, int* more);
  */
 LIBDE265_API void de265_reset(de265_decoder_context*);
 
+
+/* --- random access --- */
+
+/* A random-access index is built by scanning a bytestream once. Only NAL headers,
+   parameter sets and the beginning of the slice headers are parsed, the pictures
+   are not decoded. For each IRAP picture, the index stores its position in the
+   bytestream, its POC and the parameter sets that are active at that point.
+ */
+
+typedef void de265_random_access_index;
+
+struct de265_random_access_point
+{
+  int64_t byte_offset;    // bytestream position of the access unit (start code of its first NAL)
+  int     nal_unit_type;  // IDR, CRA or BLA
+  int     POC;            // picture order count when decoding the stream from its start
+  int     picture_number; // position of the picture in decoding order, starting at 0
+};
+
+LIBDE265_API de265_random_access_index* de265_new_random_access_index(void);
+LIBDE265_API void de265_free_random_access_index(de265_random_access_index*);
+
+/* Scan the next part of the bytestream. The stream can be split into chunks at arbitrary
+   positions. Byte offsets are counted from the first byte ever pushed. */
+LIBDE265_API de265_error de265_random_access_index_push_data(de265_random_access_index*,
+                                                             const void* data, int length);
+
+/* Indicate the end of the bytestream (processes the last NAL). */
+LIBDE265_API void de265_random_access_index_flush(de265_random_access_index*);
+
+LIBDE265_API int de265_random_access_index_get_number_of_entries(const de265_random_access_index*);
+LIBDE265_API int de265_random_access_index_get_number_of_pictures(const de265_random_access_index*);
+LIBDE265_API const struct de265_random_access_point*
+  de265_random_access_index_get_entry(const de265_random_access_index*, int entry);
+
+/* Return the last entry at or before picture 'picture_number' (in decoding order),
+   or -1 if there is none. */
+LIBDE265_API int de265_random_access_index_find_entry(const de265_random_access_index*,
+                                                      int picture_number);
+
+/* Reset the decoder and prepare it for decoding from random-access point 'entry'.
+   The parameter sets that are active at that point are pushed into the decoder.
+   Afterwards, push the bytestream starting at the entry's 'byte_offset'.
+   RASL pictures associated with the entry picture are skipped.
+ */
+LIBDE265_API de265_error de265_seek(de265_decoder_context*,
+                                    const de265_random_access_index*, int entry);
+
 /* Return next decoded picture, if there is any. If no complete picture has been
    decoded yet, NULL is returned. You should call de265_release_next_picture() to
    advance to the next picture. */
@@ -343,6 +455,36 @@ LIBDE265_API const struct de265_image_allocation *de265_get_default_image_alloca
 LIBDE265_API void de265_set_image_plane(struct de265_image* img, int cIdx, void* mem, int stride, void *userdata);
 
 
+/* --- memory accounting ---
+
+   The decoder keeps track of the memory it allocates, split into categories.
+   For the image planes, the memory is also counted when custom image allocation
+   functions are used.
+
+   With de265_set_memory_limit(), the total memory of a decoder context can be limited.
+   When an allocation would exceed the limit, the decoder first frees unused picture
+   buffers and reduces the number of spare buffers kept in the DPB. If this is not
+   sufficient, decoding of the picture fails with DE265_ERROR_OUT_OF_MEMORY.
+*/
+
+enum de265_memory_category {
+  de265_memory_image_planes    = 0, // pixel data of the pictures in the DPB
+  de265_memory_image_metadata  = 1, // per-picture decoding metadata (modes, motion vectors, ...)
+  de265_memory_SAO_scratch     = 2, // SAO output buffers
+  de265_memory_NAL_queue       = 3, // NAL buffers (input, queue, free-list)
+  de265_memory_thread_contexts = 4, // slice decoding thread contexts (WPP, tiles)
+  de265_memory_total           = 5  // sum over all categories
+};
+
+/* Get the number of bytes currently allocated and the peak value. Both output
+   pointers may be NULL. An unknown category reports zero for both values. */
+LIBDE265_API void de265_get_memory_usage(de265_decoder_context*, enum de265_memory_category,
+                                         size_t* current_bytes, size_t* peak_bytes);
+
+/* Set the maximum number of bytes the decoder context may allocate. 0 = unlimited (default). */
+LIBDE265_API void de265_set_memory_limit(de265_decoder_context*, size_t max_bytes);
+
+
 /* --- frame dropping API ---
 
    To limit decoding to a maximum temporal layer (TID), use de265_set_limit_TID().
@@ -382,9 +524,49 @@ enum de265_param {
   DE265_DECODER_PARAM_SUPPRESS_FAULTY_PICTURES=6, // (bool)  do not output frames with decoding errors, default: no (output all images)
 
   DE265_DECODER_PARAM_DISABLE_DEBLOCKING=7,   // (bool)  disable deblocking
-  DE265_DECODER_PARAM_DISABLE_SAO=8           // (bool)  disable SAO filter
+  DE265_DECODER_PARAM_DISABLE_SAO=8,          // (bool)  disable SAO filter
   //DE265_DECODER_PARAM_DISABLE_MC_RESIDUAL_IDCT=9,     // (bool)  disable decoding of IDCT residuals in MC blocks
   //DE265_DECODER_PARAM_DISABLE_INTRA_RESIDUAL_IDCT=10  // (bool)  disable decoding of IDCT residuals in MC blocks
+  DE265_DECODER_PARAM_IMAGE_ALLOCATION_MODE=11, // (int)  enum de265_image_allocation_mode, default: DEFAULT
+  DE265_DECODER_PARAM_CABAC_ENGINE=12,         // (int)  enum de265_cabac_engine, default: DEFAULT
+
+  /* (bool) Complete the SEI hash check before a picture is output and return
+     DE265_ERROR_CHECKSUM_MISMATCH from de265_decode() on a mismatch.
+     Default: no (check runs in parallel to decoding, mismatches are reported as
+     DE265_WARNING_PICTURE_HASH_MISMATCH and through de265_get_image_sei_hash_check_result()). */
+  DE265_DECODER_PARAM_BOOL_SEI_CHECK_HASH_BEFORE_OUTPUT=13,
+
+  /* (bool) Decode only IRAP pictures (IDR, CRA, BLA). All other slice NALs are discarded
+     without decoding and each IRAP picture is output as soon as it is decoded.
+     A CRA picture starts a new coded video sequence like a BLA picture. Default: no */
+  DE265_DECODER_PARAM_BOOL_KEYFRAMES_ONLY=14,
+
+  /* (bool) Reconstruct only the luma plane. The chroma syntax is still parsed, but chroma
+     prediction, residuals and in-loop filters are skipped. The chroma planes of the output
+     pictures are set to mid-gray. Default: no */
+  DE265_DECODER_PARAM_BOOL_LUMA_ONLY=15,
+
+  /* (bool) Decode all residuals with the generic residual_coding() syntax parser instead of
+     the variants specialized for streams without range extension tools. The output is
+     identical; the generic parser is kept for verification. Default: no */
+  DE265_DECODER_PARAM_BOOL_GENERIC_RESIDUAL_CODING=16
+};
+
+/* Built-in allocators for the image planes. Selecting one of these replaces
+   custom allocation functions set with de265_set_image_allocation_functions(). */
+enum de265_image_allocation_mode {
+  de265_image_allocation_DEFAULT   = 0, // planes and rows aligned to 16 bytes
+  de265_image_allocation_ALIGNED64 = 1, // planes and rows aligned to 64 bytes
+  de265_image_allocation_HUGEPAGES = 2  // aligned to 64 bytes, large planes are backed by
+                                        // huge pages (explicit if configured, transparent
+                                        // otherwise), falls back to normal pages
+};
+
+/* Both CABAC engines give identical results. The reference engine reads the input
+   byte by byte and is kept for verification. */
+enum de265_cabac_engine {
+  de265_cabac_engine_DEFAULT   = 0, // 64-bit window, block-wise input, multi-bin bypass decoding
+  de265_cabac_engine_REFERENCE = 1  // 16-bit value register, byte-wise input
 };
 
 // sorted such that a large ID includes all optimizations from lower IDs
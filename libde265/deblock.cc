@@ -46,16 +46,23 @@ void markTransformBlockBoundary(de265_image* img, int x0,int y0,
     markTransformBlockBoundary(img,x1,y1,log2TrafoSize-1,trafoDepth+1, DEBLOCK_FLAG_VERTI, DEBLOCK_FLAG_HORIZ);
   }
   else {
+    // The TB lies inside a single CTB tile, hence we can step through the indices directly.
+
+    CTBTiledBlkInfo& blk = img->get_blk_info();
+    uint8_t* deblk = &blk.deblk(blk.index(x0,y0));
+    const int stride = blk.row_stride();
+    const int nUnits = 1<<(log2TrafoSize-2);
+
     // VER
 
-    for (int k=0;k<(1<<log2TrafoSize);k+=4) {
-      img->set_deblk_flags(x0,y0+k, filterLeftCbEdge);
+    for (int k=0;k<nUnits;k++) {
+      deblk[k*stride] |= filterLeftCbEdge;
     }
 
     // HOR
 
-    for (int k=0;k<(1<<log2TrafoSize);k+=4) {
-      img->set_deblk_flags(x0+k,y0, filterTopCbEdge);
+    for (int k=0;k<nUnits;k++) {
+      deblk[k] |= filterTopCbEdge;
     }
   }
 }
@@ -76,53 +83,42 @@ void markPredictionBlockBoundary(de265_image* img, int x0,int y0,
   int cbSize2 = 1<<(log2CbSize-1);
   int cbSize4 = 1<<(log2CbSize-2);
 
-  switch (partMode) {
-  case PART_NxN:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+cbSize2,y0+k, DEBLOCK_PB_EDGE_VERTI);
-      img->set_deblk_flags(x0+k,y0+cbSize2, DEBLOCK_PB_EDGE_HORIZ);
-    }
-    break;
+  // position of the internal vertical and horizontal PB edge (0: none)
 
-  case PART_Nx2N:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+cbSize2,y0+k, DEBLOCK_PB_EDGE_VERTI);
-    }
-    break;
+  int edgeVerti = 0;
+  int edgeHoriz = 0;
 
-  case PART_2NxN:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+k,y0+cbSize2, DEBLOCK_PB_EDGE_HORIZ);
-    }
-    break;
+  switch (partMode) {
+  case PART_NxN:   edgeVerti = cbSize2;  edgeHoriz = cbSize2;  break;
+  case PART_Nx2N:  edgeVerti = cbSize2;  break;
+  case PART_2NxN:  edgeHoriz = cbSize2;  break;
+  case PART_nLx2N: edgeVerti = cbSize4;  break;
+  case PART_nRx2N: edgeVerti = cbSize2+cbSize4;  break;
+  case PART_2NxnU: edgeHoriz = cbSize4;  break;
+  case PART_2NxnD: edgeHoriz = cbSize2+cbSize4;  break;
 
-  case PART_nLx2N:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+cbSize4,y0+k, DEBLOCK_PB_EDGE_VERTI);
-    }
+  case PART_2Nx2N:
+    // NOP
     break;
+  }
 
-  case PART_nRx2N:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+cbSize2+cbSize4,y0+k, DEBLOCK_PB_EDGE_VERTI);
-    }
-    break;
+  // The CB lies inside a single CTB tile, hence we can step through the indices directly.
 
-  case PART_2NxnU:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+k,y0+cbSize4, DEBLOCK_PB_EDGE_HORIZ);
-    }
-    break;
+  CTBTiledBlkInfo& blk = img->get_blk_info();
+  uint8_t* deblk = &blk.deblk(blk.index(x0,y0));
+  const int stride = blk.row_stride();
+  const int nUnits = cbSize/4;
 
-  case PART_2NxnD:
-    for (int k=0;k<cbSize;k++) {
-      img->set_deblk_flags(x0+k,y0+cbSize2+cbSize4, DEBLOCK_PB_EDGE_HORIZ);
+  if (edgeVerti) {
+    for (int k=0;k<nUnits;k++) {
+      deblk[k*stride + edgeVerti/4] |= DEBLOCK_PB_EDGE_VERTI;
     }
-    break;
+  }
 
-  case PART_2Nx2N:
-    // NOP
-    break;
+  if (edgeHoriz) {
+    for (int k=0;k<nUnits;k++) {
+      deblk[(edgeHoriz/4)*stride + k] |= DEBLOCK_PB_EDGE_HORIZ;
+    }
   }
 }
 
@@ -253,36 +249,54 @@ void derive_boundaryStrength(de265_image* img, bool vertical, int yStart,int yEn
   xEnd = libde265_min(xEnd,img->get_deblk_width());
   yEnd = libde265_min(yEnd,img->get_deblk_height());
 
-  int TUShift = img->get_sps().Log2MinTrafoSize;
-  int TUStride= img->get_sps().PicWidthInTbsY;
+  // The edge flags, bS, prediction mode, and non-zero coefficient flags of P and Q
+  // are all read from the CTB-tiled block metadata. Within a CTB, neighboring
+  // blocks are at constant index offsets.
+  CTBTiledBlkInfo& blk = img->get_blk_info();
+
+  const int unitMask = (1<<blk.log2UnitsPerCtbRow)-1;
+  const int oppOffset = vertical ? 1 : (1<<blk.log2UnitsPerCtbRow);
+
+  uint8_t* const deblk = &blk.deblk(0);
+  const uint8_t* const flags = &blk.flags(0);
+
+  for (int y=yStart;y<yEnd;y+=yIncr) {
+    int idxQ = 0;
 
-  for (int y=yStart;y<yEnd;y+=yIncr)
     for (int x=xStart;x<xEnd;x+=xIncr) {
       int xDi = x<<2;
       int yDi = y<<2;
 
-      logtrace(LogDeblock,"%d %d %s = %s\n",xDi,yDi, vertical?"Vertical":"Horizontal",
-               (img->get_deblk_flags(xDi,yDi) & edgeMask) ? "edge" : "...");
+      if (x==xStart || (x & unitMask)==0) {
+        idxQ = blk.index(xDi,yDi);
+      }
+      else {
+        idxQ += xIncr;
+      }
 
-      uint8_t edgeFlags = img->get_deblk_flags(xDi,yDi);
+      uint8_t edgeFlags = deblk[idxQ];
+
+      logtrace(LogDeblock,"%d %d %s = %s\n",xDi,yDi, vertical?"Vertical":"Horizontal",
+               (edgeFlags & edgeMask) ? "edge" : "...");
 
       if (edgeFlags & edgeMask) {
-        bool p_is_intra_pred = (img->get_pred_mode(xDi-xOffs, yDi-yOffs) == MODE_INTRA);
-        bool q_is_intra_pred = (img->get_pred_mode(xDi,       yDi      ) == MODE_INTRA);
+        // opposing site
+        int xDiOpp = xDi-xOffs;
+        int yDiOpp = yDi-yOffs;
+
+        bool PinSameCtb = ((vertical ? x : y) & unitMask) != 0;
+        int idxP = PinSameCtb ? idxQ - oppOffset : blk.index(xDiOpp,yDiOpp);
+        uint8_t flagsP = flags[idxP];
+        uint8_t flagsQ = flags[idxQ];
 
         int bS;
 
-        if (p_is_intra_pred || q_is_intra_pred) {
+        if ((flagsP | flagsQ) & BLK_FLAG_INTRA) {
           bS = 2;
         }
         else {
-          // opposing site
-          int xDiOpp = xDi-xOffs;
-          int yDiOpp = yDi-yOffs;
-
           if ((edgeFlags & transformEdgeMask) &&
-              (img->get_nonzero_coefficient(xDi   ,yDi) ||
-               img->get_nonzero_coefficient(xDiOpp,yDiOpp))) {
+              ((flagsP | flagsQ) & BLK_FLAG_NONZERO_COEFF)) {
             bS = 1;
           }
           else {
@@ -366,12 +380,13 @@ void derive_boundaryStrength(de265_image* img, bool vertical, int yStart,int yEn
           }
         }
 
-        img->set_deblk_bS(xDi,yDi, bS);
+        deblk[idxQ] = (edgeFlags & ~DEBLOCK_BS_MASK) | bS;
       }
       else {
-        img->set_deblk_bS(xDi,yDi, 0);
+        deblk[idxQ] = edgeFlags & ~DEBLOCK_BS_MASK;
       }
     }
+  }
 }
 
 
@@ -974,7 +989,7 @@ void thread_task_deblock_CTBRow::work()
 
     edge_filtering_luma(img, vertical, first,last, xStart,xEnd);
 
-    if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
+    if (img->get_sps().ChromaArrayType != CHROMA_MONO && !img->luma_only) {
       edge_filtering_chroma(img, vertical, first,last, xStart,xEnd);
     }
   }
@@ -1031,7 +1046,7 @@ void apply_deblocking_filter(de265_image* img) // decoder_context* ctx)
       derive_boundaryStrength(img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
       edge_filtering_luma    (img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
 
-      if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
+      if (img->get_sps().ChromaArrayType != CHROMA_MONO && !img->luma_only) {
         edge_filtering_chroma  (img, true ,0,img->get_deblk_height(),0,img->get_deblk_width());
       }
 #if 0
@@ -1046,7 +1061,7 @@ void apply_deblocking_filter(de265_image* img) // decoder_context* ctx)
       derive_boundaryStrength(img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
       edge_filtering_luma    (img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
 
-      if (img->get_sps().ChromaArrayType != CHROMA_MONO) {
+      if (img->get_sps().ChromaArrayType != CHROMA_MONO && !img->luma_only) {
         edge_filtering_chroma  (img, false ,0,img->get_deblk_height(),0,img->get_deblk_width());
       }
 
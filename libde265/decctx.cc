@@ -83,10 +83,7 @@ thread_context::thread_context()
   */
 
 
-  //memset(coeffList,0,sizeof(int16_t)*3*32*32);
-  //memset(coeffPos,0,sizeof(int16_t)*3*32*32);
-  //memset(nCoeff,0,sizeof(int16_t)*3);
-
+  scratch = NULL;
 
 
   IsCuQpDeltaCoded = false;
@@ -123,19 +120,6 @@ thread_context::thread_context()
 
 
   //memset(this,0,sizeof(thread_context));
-
-  // some compilers/linkers don't align struct members correctly,
-  // adjust if necessary
-  int offset = (uintptr_t)_coeffBuf & 0x0f;
-
-  if (offset == 0) {
-    coeffBuf = _coeffBuf;  // correctly aligned already
-  }
-  else {
-    coeffBuf = (int16_t *) (((uint8_t *)_coeffBuf) + (16-offset));
-  }
-
-  memset(coeffBuf, 0, 32*32*sizeof(int16_t));
 }
 
 
@@ -160,21 +144,32 @@ slice_unit::~slice_unit()
 
   if (thread_contexts) {
     delete[] thread_contexts;
+
+    ctx->memory_usage.release(de265_memory_thread_contexts,
+                              nThreadContexts*sizeof(thread_context));
   }
 }
 
 
-void slice_unit::allocate_thread_contexts(int n)
+LIBDE265_CHECK_RESULT bool slice_unit::allocate_thread_contexts(int n)
 {
   assert(thread_contexts==NULL);
 
+  if (!ctx->memory_usage.reserve(de265_memory_thread_contexts, n*sizeof(thread_context))) {
+    return false;
+  }
+
   thread_contexts = new thread_context[n];
   nThreadContexts = n;
+
+  return true;
 }
 
 
 image_unit::image_unit()
 {
+  sao_output.plane_memory_category = de265_memory_SAO_scratch;
+
   img=NULL;
   role=Invalid;
   state=Unprocessed;
@@ -206,11 +201,16 @@ decoder_context::decoder_context()
   // --- parameters ---
 
   param_sei_check_hash = false;
+  param_sei_check_hash_before_output = false;
   param_conceal_stream_errors = true;
   param_suppress_faulty_pictures = false;
+  param_keyframes_only = false;
+  param_luma_only = false;
+  param_generic_residual_coding = false;
 
   param_disable_deblocking = false;
   param_disable_sao = false;
+  param_cabac_engine = de265_cabac_engine_DEFAULT;
   //param_disable_mc_residual_idct = false;
   //param_disable_intra_residual_idct = false;
 
@@ -224,6 +224,9 @@ decoder_context::decoder_context()
   param_image_allocation_functions = de265_image::default_image_allocation;
   param_image_allocation_userdata  = NULL;
 
+  nal_parser.set_memory_accounting(&memory_usage);
+  nal_parser.set_acceleration_functions(&acceleration);
+
   /*
   memset(&vps, 0, sizeof(video_parameter_set)*DE265_MAX_VPS_SETS);
   memset(&sps, 0, sizeof(seq_parameter_set)  *DE265_MAX_SPS_SETS);
@@ -338,6 +341,22 @@ void decoder_context::set_image_allocation_functions(de265_image_allocation* all
 }
 
 
+void decoder_context::set_image_allocation_mode(enum de265_image_allocation_mode mode)
+{
+  switch (mode) {
+  case de265_image_allocation_ALIGNED64:
+    set_image_allocation_functions(&de265_image::aligned64_image_allocation, NULL);
+    break;
+  case de265_image_allocation_HUGEPAGES:
+    set_image_allocation_functions(&de265_image::hugepage_image_allocation, NULL);
+    break;
+  default:
+    set_image_allocation_functions(&de265_image::default_image_allocation, NULL);
+    break;
+  }
+}
+
+
 de265_error decoder_context::start_thread_pool(int nThreads)
 {
   ::start_thread_pool(&thread_pool_, nThreads);
@@ -348,8 +367,19 @@ de265_error decoder_context::start_thread_pool(int nThreads)
 }
 
 
+void decoder_context::wait_for_sei_hash_checks()
+{
+  for (int i=0;i<dpb.size();i++) {
+    dpb.get_image(i)->wait_for_sei_hash_check();
+  }
+}
+
+
 void decoder_context::stop_thread_pool()
 {
+  // queued tasks are not run after stopping the pool
+  wait_for_sei_hash_checks();
+
   if (get_num_worker_threads()>0) {
     //flush_thread_pool(&ctx->thread_pool);
     ::stop_thread_pool(&thread_pool_);
@@ -359,6 +389,8 @@ void decoder_context::stop_thread_pool()
 
 void decoder_context::reset()
 {
+  wait_for_sei_hash_checks();
+
   if (num_worker_threads>0) {
     //flush_thread_pool(&ctx->thread_pool);
     ::stop_thread_pool(&thread_pool_);
@@ -451,9 +483,6 @@ void base_context::set_acceleration_functions(enum de265_acceleration l)
 
 void decoder_context::init_thread_context(thread_context* tctx)
 {
-  // zero scrap memory for coefficient blocks
-  memset(tctx->_coeffBuf, 0, sizeof(tctx->_coeffBuf));  // TODO: check if we can safely remove this
-
   tctx->currentQG_x = -1;
   tctx->currentQG_y = -1;
 
@@ -581,6 +610,26 @@ de265_error decoder_context::read_pps_NAL(bitreader& reader)
   return success ? DE265_OK : DE265_WARNING_PPS_HEADER_INVALID;
 }
 
+std::shared_ptr<const scaling_factor_table>
+decoder_context::get_shared_scaling_factors(const scaling_list_data& sclist) const
+{
+  for (int i=0;i<DE265_MAX_SPS_SETS;i++) {
+    if (sps[i] && sps[i]->scaling_factors &&
+        memcmp(&sps[i]->scaling_factors->get_scaling_list(), &sclist, sizeof(scaling_list_data))==0) {
+      return sps[i]->scaling_factors;
+    }
+  }
+
+  for (int i=0;i<DE265_MAX_PPS_SETS;i++) {
+    if (pps[i] && pps[i]->scaling_factors &&
+        memcmp(&pps[i]->scaling_factors->get_scaling_list(), &sclist, sizeof(scaling_list_data))==0) {
+      return pps[i]->scaling_factors;
+    }
+  }
+
+  return std::make_shared<scaling_factor_table>(sclist);
+}
+
 de265_error decoder_context::read_sei_NAL(bitreader& reader, bool suffix)
 {
   logdebug(LogHeaders,"----> read SEI\n");
@@ -649,10 +698,14 @@ de265_error decoder_context::read_slice_NAL(bitreader& reader, NAL_unit* nal, na
 
   // modify entry_point_offsets
 
-  int headerLength = reader.data - nal->data();
-  for (int i=0;i<shdr->num_entry_point_offsets;i++) {
-    shdr->entry_point_offset[i] -= nal->num_skipped_bytes_before(shdr->entry_point_offset[i],
-                                                                 headerLength);
+  // (not when the stuffing bytes are still in the data, as the offsets include them)
+
+  if (!nal->stuffing_bytes_in_data()) {
+    int headerLength = reader.data - nal->data();
+    for (int i=0;i<shdr->num_entry_point_offsets;i++) {
+      shdr->entry_point_offset[i] -= nal->num_skipped_bytes_before(shdr->entry_point_offset[i],
+                                                                   headerLength);
+    }
   }
 
 
@@ -760,7 +813,7 @@ de265_error decoder_context::decode_some(bool* did_work)
 
     // run post-processing filters (deblocking & SAO)
 
-    if (img->decctx->num_worker_threads)
+    if (num_worker_threads)
       run_postprocessing_filters_parallel(imgunit);
     else
       run_postprocessing_filters_sequential(imgunit->img);
@@ -809,7 +862,10 @@ de265_error decoder_context::decode_slice_unit_sequential(image_unit* imgunit,
 
 
   struct thread_context tctx;
+  residual_scratch scratch;
+  scratch.init();
 
+  tctx.scratch = &scratch;
   tctx.shdr = sliceunit->shdr;
   tctx.img  = imgunit->img;
   tctx.decctx = this;
@@ -826,7 +882,9 @@ de265_error decoder_context::decode_slice_unit_sequential(image_unit* imgunit,
 
   init_CABAC_decoder(&tctx.cabac_decoder,
                      sliceunit->reader.data,
-                     sliceunit->reader.bytes_remaining);
+                     sliceunit->reader.bytes_remaining,
+                     &sliceunit->reader.stuffing,
+                     param_cabac_engine);
 
   // alloc CABAC-model array if entropy_coding_sync is enabled
 
@@ -997,7 +1055,9 @@ de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
   }
 
 
-  sliceunit->allocate_thread_contexts(nRows);
+  if (!sliceunit->allocate_thread_contexts(nRows)) {
+    return DE265_ERROR_OUT_OF_MEMORY;
+  }
 
 
   // first CTB in this slice
@@ -1054,7 +1114,9 @@ de265_error decoder_context::decode_slice_unit_WPP(image_unit* imgunit,
 
     init_CABAC_decoder(&tctx->cabac_decoder,
                        &sliceunit->reader.data[dataStartIndex],
-                       dataEnd-dataStartIndex);
+                       dataEnd-dataStartIndex,
+                       &sliceunit->reader.stuffing,
+                       param_cabac_engine);
 
     // add task
 
@@ -1102,7 +1164,9 @@ de265_error decoder_context::decode_slice_unit_tiles(image_unit* imgunit,
 
   assert(img->num_threads_active() == 0);
 
-  sliceunit->allocate_thread_contexts(nTiles);
+  if (!sliceunit->allocate_thread_contexts(nTiles)) {
+    return DE265_ERROR_OUT_OF_MEMORY;
+  }
 
 
   // first CTB in this slice
@@ -1156,7 +1220,9 @@ de265_error decoder_context::decode_slice_unit_tiles(image_unit* imgunit,
 
     init_CABAC_decoder(&tctx->cabac_decoder,
                        &sliceunit->reader.data[dataStartIndex],
-                       dataEnd-dataStartIndex);
+                       dataEnd-dataStartIndex,
+                       &sliceunit->reader.stuffing,
+                       param_cabac_engine);
 
     // add task
 
@@ -1187,7 +1253,7 @@ de265_error decoder_context::decode_NAL(NAL_unit* nal)
   de265_error err = DE265_OK;
 
   bitreader reader;
-  bitreader_init(&reader, nal->data(), nal->size());
+  bitreader_init(&reader, nal->data(), nal->size(), nal->get_stuffing_bytes());
 
   nal_header nal_hdr;
   nal_hdr.read(&reader);
@@ -1222,6 +1288,24 @@ de265_error decoder_context::decode_NAL(NAL_unit* nal)
     return DE265_OK;
   }
 
+  // RASL pictures associated with an IRAP that starts decoding (e.g. after seeking)
+  // reference pictures that are not available. They are not output (8.1.3),
+  // so we do not decode them at all.
+
+  if (isRASL(nal_hdr.nal_unit_type) && NoRaslOutputFlag) {
+    nal_parser.free_NAL_unit(nal);
+    return DE265_OK;
+  }
+
+  // in keyframes-only mode, throw away all non-IRAP pictures
+
+  if (param_keyframes_only &&
+      nal_hdr.nal_unit_type < 32 &&
+      !isIRAP(nal_hdr.nal_unit_type)) {
+    nal_parser.free_NAL_unit(nal);
+    return DE265_OK;
+  }
+
 
   if (nal_hdr.nal_unit_type<32) {
     err = read_slice_NAL(reader, nal, nal_hdr);
@@ -1403,7 +1487,7 @@ void decoder_context::process_picture_order_count(slice_segment_header* hdr)
 
 
 /* 8.3.3.2
-   Returns DPB index of the generated picture.
+   Returns DPB index of the generated picture, or -1 if it could not be allocated.
  */
 int decoder_context::generate_unavailable_reference_picture(const seq_parameter_set* sps,
                                                             int POC, bool longTerm)
@@ -1413,7 +1497,9 @@ int decoder_context::generate_unavailable_reference_picture(const seq_parameter_
   std::shared_ptr<const seq_parameter_set> current_sps = this->sps[ (int)current_pps->seq_parameter_set_id ];
 
   int idx = dpb.new_image(current_sps, this, 0,0, false);
-  assert(idx>=0);
+  if (idx<0) {
+    return -1;
+  }
   //printf("-> fill with unavailable POC %d\n",POC);
 
   de265_image* img = dpb.get_image(idx);
@@ -1438,7 +1524,7 @@ int decoder_context::generate_unavailable_reference_picture(const seq_parameter_
 
    This function will mark pictures in the DPB as 'unused' or 'used for long-term reference'
  */
-void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
+bool decoder_context::process_reference_picture_set(slice_segment_header* hdr)
 {
   std::vector<int> removeReferencesList;
 
@@ -1586,6 +1672,7 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
       // We do not know the correct MSB
       int concealedPicture = generate_unavailable_reference_picture(current_sps.get(),
                                                                     PocLtCurr[i], true);
+      if (concealedPicture < 0) { return false; }
       RefPicSetLtCurr[i] = k = concealedPicture;
       picInAnyList[concealedPicture]=true;
     }
@@ -1610,6 +1697,7 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
     else {
       int concealedPicture = k = generate_unavailable_reference_picture(current_sps.get(),
                                                                         PocLtFoll[i], true);
+      if (concealedPicture < 0) { return false; }
       RefPicSetLtFoll[i] = concealedPicture;
       picInAnyList[concealedPicture]=true;
     }
@@ -1639,6 +1727,7 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
     else {
       int concealedPicture = generate_unavailable_reference_picture(current_sps.get(),
                                                                     PocStCurrBefore[i], false);
+      if (concealedPicture < 0) { return false; }
       RefPicSetStCurrBefore[i] = k = concealedPicture;
 
 	  if (concealedPicture < picInAnyList.size()) {
@@ -1663,6 +1752,7 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
     else {
       int concealedPicture = generate_unavailable_reference_picture(current_sps.get(),
                                                                     PocStCurrAfter[i], false);
+      if (concealedPicture < 0) { return false; }
       RefPicSetStCurrAfter[i] = k = concealedPicture;
       picInAnyList[concealedPicture]=true;
 
@@ -1703,6 +1793,8 @@ void decoder_context::process_reference_picture_set(slice_segment_header* hdr)
   hdr->RemoveReferencesList = removeReferencesList;
 
   //remove_images_from_dpb(hdr->RemoveReferencesList);
+
+  return true;
 }
 
 
@@ -1941,7 +2033,7 @@ de265_error decoder_context::push_picture_to_output_queue(image_unit* imgunit)
   int maxNumPicsInReorderBuffer = 0;
 
   // TODO: I'd like to have the has_vps() check somewhere else (not decode the picture at all)
-  if (outimg->has_vps()) {
+  if (outimg->has_vps() && !param_keyframes_only) {
     int sublayer = outimg->get_vps().vps_max_sub_layers -1;
     maxNumPicsInReorderBuffer = outimg->get_vps().layer[sublayer].vps_max_num_reorder_pics;
   }
@@ -2002,7 +2094,9 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
     bool isOutputImage = (!sps->sample_adaptive_offset_enabled_flag || param_disable_sao);
     image_buffer_idx = dpb.new_image(current_sps, this, pts, user_data, isOutputImage);
     if (image_buffer_idx == -1) {
-      *err = DE265_ERROR_IMAGE_BUFFER_FULL;
+      *err = DE265_ERROR_OUT_OF_MEMORY;
+
+      img = NULL; // do not add the following slice segments to the previous picture
       return false;
     }
 
@@ -2017,6 +2111,14 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
 
     img->clear_metadata();
 
+    if (param_luma_only) {
+      img->luma_only = true;
+
+      // chroma is not decoded, output gray instead of undefined memory
+      img->fill_plane(1, 1<<(sps->BitDepth_C-1));
+      img->fill_plane(2, 1<<(sps->BitDepth_C-1));
+    }
+
 
     if (isIRAP(nal_unit_type)) {
       if (isIDR(nal_unit_type) ||
@@ -2027,8 +2129,12 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
           NoRaslOutputFlag = true;
           FirstAfterEndOfSequenceNAL = false;
         }
-      else if (0) // TODO: set HandleCraAsBlaFlag by external means
+      else if (param_keyframes_only) // TODO: set HandleCraAsBlaFlag by other external means
         {
+          // The pictures preceding the CRA were not decoded. Start a new CVS so that
+          // the POC does not depend on them.
+          NoRaslOutputFlag   = true;
+          HandleCraAsBlaFlag = true;
         }
       else
         {
@@ -2054,7 +2160,16 @@ bool decoder_context::process_slice_segment_header(slice_segment_header* hdr,
       // mark picture so that it is not overwritten by unavailable reference frames
       img->PicState = UsedForShortTermReference;
 
-      process_reference_picture_set(hdr);
+      if (!process_reference_picture_set(hdr)) {
+        // could not allocate the unavailable reference pictures, drop this picture
+
+        *err = DE265_ERROR_OUT_OF_MEMORY;
+
+        img->PicState = UnusedForReference;
+        img->PicOutputFlag = false;
+        img = NULL;
+        return false;
+      }
     }
 
     img->PicState = UsedForShortTermReference;
@@ -2221,6 +2336,8 @@ void decoder_context::calc_tid_and_framerate_ratio()
 
 void error_queue::add_warning(de265_error warning, bool once)
 {
+  de265_mutex_lock(&mutex);
+
   // check if warning was already shown
   bool add=true;
   if (once) {
@@ -2232,45 +2349,56 @@ void error_queue::add_warning(de265_error warning, bool once)
     }
   }
 
-  if (!add) {
-    return;
-  }
-
+  if (add) {
 
-  // if this is a one-time warning, remember that it was shown
+    // if this is a one-time warning, remember that it was shown
 
-  if (once) {
-    if (nWarningsShown < MAX_WARNINGS) {
-      warnings_shown[nWarningsShown++] = warning;
+    if (once) {
+      if (nWarningsShown < MAX_WARNINGS) {
+        warnings_shown[nWarningsShown++] = warning;
+      }
     }
-  }
 
 
-  // add warning to output queue
+    // add warning to output queue
 
-  if (nWarnings == MAX_WARNINGS) {
-    warnings[MAX_WARNINGS-1] = DE265_WARNING_WARNING_BUFFER_FULL;
-    return;
+    if (nWarnings == MAX_WARNINGS) {
+      warnings[MAX_WARNINGS-1] = DE265_WARNING_WARNING_BUFFER_FULL;
+    }
+    else {
+      warnings[nWarnings++] = warning;
+    }
   }
 
-  warnings[nWarnings++] = warning;
+  de265_mutex_unlock(&mutex);
 }
 
 error_queue::error_queue()
 {
   nWarnings = 0;
   nWarningsShown = 0;
+
+  de265_mutex_init(&mutex);
+}
+
+error_queue::~error_queue()
+{
+  de265_mutex_destroy(&mutex);
 }
 
 de265_error error_queue::get_warning()
 {
-  if (nWarnings==0) {
-    return DE265_OK;
+  de265_mutex_lock(&mutex);
+
+  de265_error warn = DE265_OK;
+
+  if (nWarnings>0) {
+    warn = warnings[0];
+    nWarnings--;
+    memmove(warnings, &warnings[1], nWarnings*sizeof(de265_error));
   }
 
-  de265_error warn = warnings[0];
-  nWarnings--;
-  memmove(warnings, &warnings[1], nWarnings*sizeof(de265_error));
+  de265_mutex_unlock(&mutex);
 
   return warn;
 }
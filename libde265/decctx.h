@@ -34,6 +34,7 @@
 #include "libde265/threads.h"
 #include "libde265/acceleration.h"
 #include "libde265/nal-parser.h"
+#include "libde265/memory-accounting.h"
 
 #include <memory>
 
@@ -50,6 +51,29 @@ class slice_unit;
 class decoder_context;
 
 
+/* Working memory for the residual decoding of one transform block.
+   Only one color component is processed at a time, so that the whole working
+   set (10 KB) stays in the L1 cache during residual_coding() and decode_TU().
+   This is not part of the thread_context (which exists once for each substream),
+   but lives on the stack of the thread that decodes the substream. Hence, all
+   substreams decoded by one worker thread use the same memory.
+ */
+struct residual_scratch
+{
+  // Coefficients are scattered into this buffer before the transform and
+  // zeroed again afterwards.
+  ALIGNED_64(int16_t) coeffBuf[32*32]; // alignment required for SSE code !
+
+  int16_t coeffList[32*32];  // coefficients of the current TB in decoding order
+  int16_t coeffPos[32*32];   // position of each coefficient in coeffBuf
+  int     nCoeff;
+
+  ALIGNED_64(int32_t) residual_luma[32*32]; // only used when cross-comp-prediction is enabled
+
+  void init() { memset(coeffBuf, 0, sizeof(coeffBuf)); nCoeff=0; }
+};
+
+
 class thread_context
 {
 public:
@@ -79,14 +103,7 @@ public:
   uint8_t explicit_rdpcm_flag;
   uint8_t explicit_rdpcm_dir;
 
-  ALIGNED_16(int16_t) _coeffBuf[(32*32)+8]; // alignment required for SSE code !
-  int16_t *coeffBuf;
-
-  int16_t coeffList[3][32*32];
-  int16_t coeffPos[3][32*32];
-  int16_t nCoeff[3];
-
-  int32_t residual_luma[32*32]; // only used when cross-comp-prediction is enabled
+  residual_scratch* scratch; // provided by the thread decoding this context, NULL otherwise
 
 
   // quantization
@@ -126,6 +143,7 @@ class error_queue
 {
  public:
   error_queue();
+  ~error_queue();
 
   void add_warning(de265_error warning, bool once);
   de265_error get_warning();
@@ -135,6 +153,8 @@ class error_queue
   int nWarnings;
   de265_error warnings_shown[MAX_WARNINGS]; // warnings that have already occurred
   int nWarningsShown;
+
+  de265_mutex mutex; // warnings may also be added from background tasks
 };
 
 
@@ -167,7 +187,7 @@ public:
   int first_decoded_CTB_RS; // TODO
   int last_decoded_CTB_RS;  // TODO
 
-  void allocate_thread_contexts(int n);
+  LIBDE265_CHECK_RESULT bool allocate_thread_contexts(int n);
   thread_context* get_thread_context(int n) {
     assert(n < nThreadContexts);
     return &thread_contexts[n];
@@ -293,6 +313,7 @@ class decoder_context : public base_context {
 
   de265_error start_thread_pool(int nThreads);
   void        stop_thread_pool();
+  void        wait_for_sei_hash_checks();  // block until all background SEI hash checks are done
 
   void reset();
 
@@ -304,6 +325,10 @@ class decoder_context : public base_context {
   /* */ pic_parameter_set* get_pps(int id)       { return pps[id].get(); }
   const pic_parameter_set* get_pps(int id) const { return pps[id].get(); }
 
+  // Returns the dequantization table of an already known SPS/PPS with identical
+  // scaling lists, or builds a new one.
+  std::shared_ptr<const scaling_factor_table> get_shared_scaling_factors(const scaling_list_data&) const;
+
   /*
   const slice_segment_header* get_SliceHeader_atCtb(int ctb) {
     return img->slices[img->get_SliceHeaderIndex_atIndex(ctb)];
@@ -337,8 +362,12 @@ class decoder_context : public base_context {
   // --- parameters ---
 
   bool param_sei_check_hash;
+  bool param_sei_check_hash_before_output;
   bool param_conceal_stream_errors;
   bool param_suppress_faulty_pictures;
+  bool param_keyframes_only;
+  bool param_luma_only;
+  bool param_generic_residual_coding;
 
   int  param_sps_headers_fd;
   int  param_vps_headers_fd;
@@ -347,15 +376,23 @@ class decoder_context : public base_context {
 
   bool param_disable_deblocking;
   bool param_disable_sao;
+  enum de265_cabac_engine param_cabac_engine;
   //bool param_disable_mc_residual_idct;  // not implemented yet
   //bool param_disable_intra_residual_idct;  // not implemented yet
 
   void set_image_allocation_functions(de265_image_allocation* allocfunc, void* userdata);
+  void set_image_allocation_mode(enum de265_image_allocation_mode);
 
   de265_image_allocation param_image_allocation_functions;
   void*                  param_image_allocation_userdata;
 
 
+  // --- memory accounting ---
+
+  // must be declared before all members that allocate accounted memory
+  memory_accounting memory_usage;
+
+
   // --- input stream data ---
 
   NAL_Parser nal_parser;
@@ -510,7 +547,7 @@ class decoder_context : public base_context {
   void process_picture_order_count(slice_segment_header* hdr);
   int generate_unavailable_reference_picture(const seq_parameter_set* sps,
                                              int POC, bool longTerm);
-  void process_reference_picture_set(slice_segment_header* hdr);
+  bool process_reference_picture_set(slice_segment_header* hdr);
   bool construct_reference_picture_lists(slice_segment_header* hdr);
 
 
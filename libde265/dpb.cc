@@ -259,7 +259,21 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
   default: chroma = de265_chroma_420; assert(0); break; // should never happen
   }
 
-  img->alloc_image(w,h, chroma, sps, true, decctx, NULL, pts, user_data, isOutputImage);
+  de265_error err = img->alloc_image(w,h, chroma, sps, true, decctx, NULL, pts, user_data,
+                                     isOutputImage);
+
+  if (err == DE265_ERROR_OUT_OF_MEMORY) {
+    // free the memory of the unused pictures and try again
+
+    shrink_to_used_images(free_image_buffer_idx);
+
+    err = img->alloc_image(w,h, chroma, sps, true, decctx, NULL, pts, user_data, isOutputImage);
+  }
+
+  if (err != DE265_OK) {
+    img->release();
+    return -1;
+  }
 
   img->integrity = INTEGRITY_CORRECT;
 
@@ -267,6 +281,29 @@ int decoded_picture_buffer::new_image(std::shared_ptr<const seq_parameter_set> s
 }
 
 
+void decoded_picture_buffer::shrink_to_used_images(int keep_idx)
+{
+  for (int i=0;i<(int)dpb.size();i++) {
+    if (i != keep_idx && dpb[i]->can_be_released()) {
+      dpb[i]->release();
+    }
+  }
+
+  // Only slots at the end can be removed, because the DPB indices of the other
+  // images have to stay the same.
+
+  while ((int)dpb.size()-1 > keep_idx && dpb.back()->can_be_released()) {
+    delete dpb.back();
+    dpb.pop_back();
+  }
+
+  if (norm_images_in_DPB > (int)dpb.size()) {
+    loginfo(LogDPB, "reduce DPB size to %d images\n", (int)dpb.size());
+    norm_images_in_DPB = dpb.size();
+  }
+}
+
+
 void decoded_picture_buffer::pop_next_picture_in_output_queue()
 {
   image_output_queue.pop_front();
@@ -38,7 +38,7 @@ public:
   void set_norm_size_of_DPB(int n) { norm_images_in_DPB=n; }
 
   /* Alloc a new image in the DPB and return its index.
-     If there is no space for a new image, return -1. */
+     If the image memory cannot be allocated, return -1. */
   int new_image(std::shared_ptr<const seq_parameter_set> sps, decoder_context* decctx,
                 de265_PTS pts, void* user_data, bool isOutputImage);
 
@@ -102,6 +102,10 @@ public:
   void log_dpb_queues() const;
 
 private:
+  /* Free the pixel data of all unused images (except 'keep_idx'), remove unused
+     slots at the end of the DPB and do not keep more slots than currently used. */
+  void shrink_to_used_images(int keep_idx);
+
   int max_images_in_DPB;
   int norm_images_in_DPB;
 
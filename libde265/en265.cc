@@ -165,6 +165,17 @@ LIBDE265_API de265_error en265_start_encoder(en265_encoder_context* e, int numbe
   assert(e);
   encoder_context* ectx = (encoder_context*)e;
 
+  if (number_of_threads > MAX_THREADS) {
+    number_of_threads = MAX_THREADS;
+  }
+
+  if (number_of_threads>0 && ectx->get_num_worker_threads()==0) {
+    de265_error err = ectx->start_thread_pool(number_of_threads);
+    if (err != DE265_OK) {
+      return err;
+    }
+  }
+
   ectx->start_encoder();
 
   return DE265_OK;
@@ -218,7 +229,7 @@ LIBDE265_API de265_error en265_push_image(en265_encoder_context* e,
   assert(e);
   encoder_context* ectx = (encoder_context*)e;
 
-  ectx->sop->insert_new_input_image(img);
+  ectx->push_input_image(img);
   return DE265_OK;
 }
 
@@ -228,7 +239,7 @@ LIBDE265_API de265_error en265_push_eof(en265_encoder_context* e)
   assert(e);
   encoder_context* ectx = (encoder_context*)e;
 
-  ectx->sop->insert_end_of_stream();
+  ectx->push_end_of_stream();
   return DE265_OK;
 }
 
@@ -258,6 +269,8 @@ LIBDE265_API de265_error en265_encode(en265_encoder_context* e)
   assert(e);
   encoder_context* ectx = (encoder_context*)e;
 
+  ectx->pass_lookahead_pictures_to_sop();
+
   while (ectx->picbuf.have_more_frames_to_encode())
     {
       de265_error result = ectx->encode_picture_from_input_buffer();
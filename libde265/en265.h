@@ -85,6 +85,7 @@ LIBDE265_API void en265_show_parameters(en265_encoder_context*);
 
 // ========== encoding loop ==========
 
+// With number_of_threads>0, the CTB rows are encoded in parallel (WPP).
 LIBDE265_API de265_error en265_start_encoder(en265_encoder_context*, int number_of_threads);
 
 // If we have provided our own memory release function, no image memory will be allocated.
@@ -45,16 +45,22 @@
 class Algo_CB_IntraInter : public Algo_CB
 {
  public:
+ Algo_CB_IntraInter() : mIntraAlgo(NULL), mInterAlgo(NULL), mTryInter(false) { }
   virtual ~Algo_CB_IntraInter() { }
 
   void setIntraChildAlgo(Algo_CB* algo) { mIntraAlgo = algo; }
   void setInterChildAlgo(Algo_CB* algo) { mInterAlgo = algo; }
 
+  // inter prediction is only tried in P/B slices when enabled
+  void set_try_inter(bool flag=true) { mTryInter=flag; }
+
   virtual const char* name() const { return "cb-intra-inter"; }
 
  protected:
   Algo_CB* mIntraAlgo;
   Algo_CB* mInterAlgo;
+
+  bool mTryInter;
 };
 
 class Algo_CB_IntraInter_BruteForce : public Algo_CB_IntraInter
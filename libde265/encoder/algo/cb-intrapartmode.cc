@@ -83,7 +83,7 @@ enc_cb* Algo_CB_IntraPartMode_BruteForce::analyze(encoder_context* ectx,
 
       descend(cb,p==0 ? "2Nx2N" : "NxN");
 
-      enc_tb* tb = new enc_tb(x,y,log2CbSize,cb);
+      enc_tb* tb = ectx->get_node_arena(y).create<enc_tb>(x,y,log2CbSize,cb);
       tb->downPtr = &cb->transform_tree;
 
       cb->transform_tree = mTBIntraPredModeAlgo->analyze(ectx, option[p].get_context(),
@@ -147,7 +147,7 @@ enc_cb* Algo_CB_IntraPartMode_Fixed::analyze(encoder_context* ectx,
   int IntraSplitFlag= (cb->PredMode == MODE_INTRA && cb->PartMode == PART_NxN);
   int MaxTrafoDepth = ectx->get_sps().max_transform_hierarchy_depth_intra + IntraSplitFlag;
 
-  enc_tb* tb = new enc_tb(x,y,log2CbSize,cb);
+  enc_tb* tb = ectx->get_node_arena(y).create<enc_tb>(x,y,log2CbSize,cb);
   tb->blkIdx = 0;
   tb->downPtr = &cb->transform_tree;
 
@@ -45,6 +45,8 @@ enc_cb* Algo_CB_MergeIndex_Fixed::analyze(encoder_context* ectx,
 
   int cbSize = 1 << cb->log2Size;
 
+  cb->PartMode = PART_2Nx2N; // implied by the skip flag, read by the merge derivation
+
   get_merge_candidate_list_from_tree(ectx, ectx->shdr,
                                      cb->x, cb->y, // xC/yC
                                      cb->x, cb->y, // xP/yP
@@ -61,8 +63,8 @@ enc_cb* Algo_CB_MergeIndex_Fixed::analyze(encoder_context* ectx,
 
   // build prediction
 
-  // previous frame (TODO)
-  const de265_image* refimg = ectx->get_image(ectx->imgdata->frame_number -1);
+  // first picture in reference list L0
+  const de265_image* refimg = ectx->get_image(ectx->shdr->RefPicList[0][0]);
 
   //printf("prev frame: %p %d\n",refimg,ectx->imgdata->frame_number);
 
@@ -148,7 +150,7 @@ enc_cb* Algo_CB_MergeIndex_Fixed::analyze(encoder_context* ectx,
     cb->inter.rqt_root_cbf = 0;
 
 
-    enc_tb* tb = new enc_tb(x0,y0,cb->log2Size,cb);
+    enc_tb* tb = ectx->get_node_arena(y0).create<enc_tb>(x0,y0,cb->log2Size,cb);
     tb->downPtr = &cb->transform_tree;
     cb->transform_tree = tb;
 
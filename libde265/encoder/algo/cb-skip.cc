@@ -112,3 +112,87 @@ enc_cb* Algo_CB_Skip_BruteForce::analyze(encoder_context* ectx,
   options.compute_rdo_costs();
   return options.return_best_rdo_node();
 }
+
+
+
+enc_cb* Algo_CB_Skip_Fast::analyze(encoder_context* ectx,
+                                   context_model_table& ctxModel,
+                                   enc_cb* cb)
+{
+  bool try_skip  = (ectx->shdr->slice_type != SLICE_TYPE_I);
+
+  CodingOptions<enc_cb> options(ectx,cb,ctxModel);
+  CodingOption<enc_cb> option_skip    = options.new_option(try_skip);
+  CodingOption<enc_cb> option_nonskip = options.new_option(true);
+  options.start();
+
+  if (option_skip) {
+    CodingOption<enc_cb>& opt = option_skip;
+    opt.begin();
+
+    enc_cb* cb = opt.get_node();
+
+    // calc rate for skip flag (=true)
+
+    CABAC_encoder_estim* cabac = opt.get_cabac();
+    encode_cu_skip_flag(ectx, cabac, cb, true);
+    float rate_pred_mode = cabac->getRDBits();
+    cabac->reset();
+
+    // set skip flag
+
+    cb->PredMode = MODE_SKIP;
+    ectx->img->set_pred_mode(cb->x,cb->y, cb->log2Size, cb->PredMode);
+
+    // encode CB
+
+    descend(cb,"yes");
+    cb = mSkipAlgo->analyze(ectx, opt.get_context(), cb);
+    ascend();
+
+    // add rate for PredMode
+
+    cb->rate += rate_pred_mode;
+    opt.set_node(cb);
+    opt.end();
+
+
+    // early skip detection
+
+    int nPixels = 1 << (2*cb->log2Size);
+    if (cb->distortion < mParams.threshold/100.0f * ectx->get_lambda(cb->y) * nPixels) {
+      option_nonskip = CodingOption<enc_cb>();
+    }
+  }
+
+  if (option_nonskip) {
+    CodingOption<enc_cb>& opt = option_nonskip;
+    enc_cb* cb = opt.get_node();
+
+    opt.begin();
+
+    // calc rate for skip flag (=false)
+
+    float rate_pred_mode = 0;
+
+    if (try_skip) {
+      CABAC_encoder_estim* cabac = opt.get_cabac();
+      encode_cu_skip_flag(ectx, cabac, cb, false);
+      rate_pred_mode = cabac->getRDBits();
+      cabac->reset();
+    }
+
+    descend(cb,"no");
+    cb = mNonSkipAlgo->analyze(ectx, opt.get_context(), cb);
+    ascend();
+
+    // add rate for PredMode
+
+    cb->rate += rate_pred_mode;
+    opt.set_node(cb);
+    opt.end();
+  }
+
+  options.compute_rdo_costs();
+  return options.return_best_rdo_node();
+}
@@ -40,6 +40,21 @@
 
 // ========== CB Skip/Inter decision ==========
 
+enum ALGO_CB_Skip {
+  ALGO_CB_Skip_BruteForce,
+  ALGO_CB_Skip_Fast
+};
+
+class option_ALGO_CB_Skip : public choice_option<enum ALGO_CB_Skip>
+{
+ public:
+  option_ALGO_CB_Skip() {
+    add_choice("brute-force", ALGO_CB_Skip_BruteForce, true);
+    add_choice("fast",        ALGO_CB_Skip_Fast);
+  }
+};
+
+
 class Algo_CB_Skip : public Algo_CB
 {
  public:
@@ -69,4 +84,39 @@ class Algo_CB_Skip_BruteForce : public Algo_CB_Skip
   const char* name() const { return "cb-skip-bruteforce"; }
 };
 
+
+/* Evaluates skip mode first. When the merge prediction leaves a distortion below
+   'threshold' percent of lambda per pixel, the residual would be quantized to zero
+   anyway and the CB is coded in skip mode without trying the non-skip modes.
+ */
+class Algo_CB_Skip_Fast : public Algo_CB_Skip
+{
+ public:
+  struct params
+  {
+    params() {
+      threshold.set_ID("CB-Skip-Fast-Threshold");
+      threshold.set_range(0,1000);
+      threshold.set_default(10);
+    }
+
+    option_int threshold;  // percent of lambda
+  };
+
+  void setParams(const params& p) { mParams=p; }
+
+  void registerParams(config_parameters& config) {
+    config.add_option(&mParams.threshold);
+  }
+
+  virtual enc_cb* analyze(encoder_context*,
+                          context_model_table&,
+                          enc_cb* cb);
+
+  const char* name() const { return "cb-skip-fast"; }
+
+ private:
+  params mParams;
+};
+
 #endif
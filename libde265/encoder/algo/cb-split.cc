@@ -29,13 +29,15 @@
 #include <limits>
 #include <math.h>
 #include <iostream>
+#include <algorithm>
 
 
 // Utility function to encode all four children in a splitted CB.
 // Children are coded with the specified algo_cb_split.
 enc_cb* Algo_CB_Split::encode_cb_split(encoder_context* ectx,
                                        context_model_table& ctxModel,
-                                       enc_cb* cb)
+                                       enc_cb* cb,
+                                       float maxCost)
 {
   int w = ectx->imgdata->input->get_width();
   int h = ectx->imgdata->input->get_height();
@@ -58,7 +60,7 @@ enc_cb* Algo_CB_Split::encode_cb_split(encoder_context* ectx,
       // NOP
     }
     else {
-      enc_cb* childCB = new enc_cb;
+      enc_cb* childCB = ectx->get_node_arena(child_y).create<enc_cb>();
       childCB->log2Size = cb->log2Size-1;
       childCB->ctDepth  = cb->ctDepth+1;
 
@@ -73,6 +75,10 @@ enc_cb* Algo_CB_Split::encode_cb_split(encoder_context* ectx,
 
       cb->distortion += cb->children[i]->distortion;
       cb->rate       += cb->children[i]->rate;
+
+      if (cb->distortion + ectx->get_lambda(cb->y) * cb->rate > maxCost) {
+        break;
+      }
     }
   }
 
@@ -130,7 +136,7 @@ enc_cb* Algo_CB_Split_BruteForce::analyze(encoder_context* ectx,
 
     /* We set QP here, because this is required at in non-split CBs only.
      */
-    cb->qp = ectx->active_qp;
+    cb->qp = ectx->get_active_qp(cb->y);
 
     // analyze subtree
     assert(mChildAlgo);
@@ -176,3 +182,161 @@ enc_cb* Algo_CB_Split_BruteForce::analyze(encoder_context* ectx,
 
   return bestCB;
 }
+
+
+
+static void get_CTB_depth_range(const enc_cb* cb, int* minDepth, int* maxDepth)
+{
+  if (cb->split_cu_flag) {
+    for (int i=0;i<4;i++) {
+      if (cb->children[i]) {
+        get_CTB_depth_range(cb->children[i], minDepth, maxDepth);
+      }
+    }
+  }
+  else {
+    *minDepth = std::min(*minDepth, (int)cb->ctDepth);
+    *maxDepth = std::max(*maxDepth, (int)cb->ctDepth);
+  }
+}
+
+
+bool Algo_CB_Split_Fast::get_neighbour_depth_range(encoder_context* ectx, const enc_cb* cb,
+                                                   int* minDepth, int* maxDepth) const
+{
+  const int log2CtbSize = ectx->get_sps().Log2CtbSizeY;
+  const int ctbSize = 1<<log2CtbSize;
+
+  const int xCtb = (cb->x >> log2CtbSize) << log2CtbSize;
+  const int yCtb = (cb->y >> log2CtbSize) << log2CtbSize;
+
+  // left, above-left, above, above-right
+  const int dx[4] = { -1,-1,0,1 };
+  const int dy[4] = {  0,-1,-1,-1 };
+
+  *minDepth = std::numeric_limits<int>::max();
+  *maxDepth = 0;
+
+  int nAvailable = 0;
+
+  for (int i=0;i<4;i++) {
+    int xN = xCtb + dx[i]*ctbSize;
+    int yN = yCtb + dy[i]*ctbSize;
+
+    if (check_CTB_available(ectx->img, xCtb,yCtb, xN,yN)) {
+      get_CTB_depth_range(ectx->ctbs.getCTB(xN>>log2CtbSize, yN>>log2CtbSize),
+                          minDepth, maxDepth);
+      nAvailable++;
+    }
+  }
+
+  return nAvailable >= 2;
+}
+
+
+enc_cb* Algo_CB_Split_Fast::analyze(encoder_context* ectx,
+                                    context_model_table& ctxModel,
+                                    enc_cb* cb_input)
+{
+  assert(cb_input->pcm_flag==0);
+
+  // --- prepare coding options ---
+
+  const SplitType split_type = get_split_type(&ectx->get_sps(),
+                                              cb_input->x, cb_input->y,
+                                              cb_input->log2Size);
+
+
+  bool can_split_CB   = (split_type != ForcedNonSplit);
+  bool can_nosplit_CB = (split_type != ForcedSplit);
+
+
+  // limit the depth range to that of the neighbouring CTBs
+
+  int minDepth, maxDepth;
+  if (split_type == OptionalSplit &&
+      mParams.depthMargin >= 0 &&
+      get_neighbour_depth_range(ectx, cb_input, &minDepth, &maxDepth)) {
+    if (cb_input->ctDepth <  minDepth - mParams.depthMargin) { can_nosplit_CB = false; }
+    if (cb_input->ctDepth >= maxDepth + mParams.depthMargin) { can_split_CB   = false; }
+  }
+
+
+  CodingOptions<enc_cb> options(ectx, cb_input, ctxModel);
+
+  CodingOption<enc_cb> option_no_split = options.new_option(can_nosplit_CB);
+  CodingOption<enc_cb> option_split    = options.new_option(can_split_CB);
+
+  options.start();
+
+  const float lambda = ectx->get_lambda(cb_input->y);
+
+  float noSplitCost = std::numeric_limits<float>::max();
+
+
+  // --- encode without splitting ---
+
+  if (option_no_split) {
+    CodingOption<enc_cb>& opt = option_no_split; // abbrev.
+
+    opt.begin();
+
+    enc_cb* cb = opt.get_node();
+    *cb_input->downPtr = cb;
+
+    cb->qp = ectx->get_active_qp(cb->y);
+
+    // analyze subtree
+    assert(mChildAlgo);
+
+    descend(cb,"no");
+    cb = mChildAlgo->analyze(ectx, opt.get_context(), cb);
+    ascend();
+
+    // add rate for split flag
+    if (split_type == OptionalSplit) {
+      encode_split_cu_flag(ectx,opt.get_cabac(), cb->x,cb->y, cb->ctDepth, 0);
+      cb->rate += opt.get_cabac_rate();
+    }
+
+    opt.set_node(cb);
+    opt.end();
+
+    noSplitCost = cb->distortion + lambda * cb->rate;
+
+
+    // early termination: do not split skipped or cheap CBs
+
+    if (split_type == OptionalSplit) {
+      int nPixels = 1 << (2*cb->log2Size);
+
+      if (cb->PredMode == MODE_SKIP ||
+          noSplitCost < mParams.costThreshold/100.0f * lambda * nPixels) {
+        option_split = CodingOption<enc_cb>();
+      }
+    }
+  }
+
+  // --- encode with splitting ---
+
+  if (option_split) {
+    option_split.begin();
+
+    enc_cb* cb = option_split.get_node();
+    *cb_input->downPtr = cb;
+
+    cb = encode_cb_split(ectx, option_split.get_context(), cb, noSplitCost);
+
+    // add rate for split flag
+    if (split_type == OptionalSplit) {
+      encode_split_cu_flag(ectx,option_split.get_cabac(), cb->x,cb->y, cb->ctDepth, 1);
+      cb->rate += option_split.get_cabac_rate();
+    }
+
+    option_split.set_node(cb);
+    option_split.end();
+  }
+
+  options.compute_rdo_costs();
+  return options.return_best_rdo_node();
+}
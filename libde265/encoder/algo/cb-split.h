@@ -34,6 +34,8 @@
 #include "libde265/fallback.h"
 #include "libde265/configparam.h"
 
+#include <limits>
+
 #include "libde265/encoder/algo/algo.h"
 #include "libde265/encoder/algo/tb-intrapredmode.h"
 #include "libde265/encoder/algo/tb-split.h"
@@ -55,6 +57,21 @@
 
 // ========== CB split decision ==========
 
+enum ALGO_CB_Split {
+  ALGO_CB_Split_BruteForce,
+  ALGO_CB_Split_Fast
+};
+
+class option_ALGO_CB_Split : public choice_option<enum ALGO_CB_Split>
+{
+ public:
+  option_ALGO_CB_Split() {
+    add_choice("brute-force", ALGO_CB_Split_BruteForce, true);
+    add_choice("fast",        ALGO_CB_Split_Fast);
+  }
+};
+
+
 class Algo_CB_Split : public Algo_CB
 {
  public:
@@ -69,9 +86,13 @@ class Algo_CB_Split : public Algo_CB
  protected:
   Algo_CB* mChildAlgo;
 
+  /* Children are not analysed anymore once the accumulated RD cost of the
+     children coded so far exceeds 'maxCost'.
+   */
   enc_cb* encode_cb_split(encoder_context* ectx,
                           context_model_table& ctxModel,
-                          enc_cb* cb);
+                          enc_cb* cb,
+                          float maxCost = std::numeric_limits<float>::max());
 };
 
 
@@ -85,4 +106,54 @@ class Algo_CB_Split_BruteForce : public Algo_CB_Split
   const char* name() const { return "cb-split-bruteforce"; }
 };
 
+
+/* Like the brute-force decision, but with early termination:
+
+   - The CB is not split when the non-split CB is coded in skip mode, or when its RD cost
+     per pixel is below 'costThreshold' percent of lambda.
+   - The depth range of the left, above-left, above and above-right CTBs (if at least
+     two of them are available) limits the depths that are tested in the current CTB,
+     extended by 'depthMargin' in both directions.
+   - The evaluation of the split is stopped as soon as the children coded so far are
+     more expensive than the non-split CB.
+ */
+class Algo_CB_Split_Fast : public Algo_CB_Split
+{
+ public:
+  struct params
+  {
+    params() {
+      costThreshold.set_ID("CB-Split-Fast-CostThreshold");
+      costThreshold.set_range(0,1000);
+      costThreshold.set_default(30);
+
+      depthMargin.set_ID("CB-Split-Fast-DepthMargin");
+      depthMargin.set_range(-1,3);
+      depthMargin.set_default(0);
+    }
+
+    option_int costThreshold;  // percent of lambda, 0: disabled
+    option_int depthMargin;    // -1: no depth limits from neighbouring CTBs
+  };
+
+  void setParams(const params& p) { mParams=p; }
+
+  void registerParams(config_parameters& config) {
+    config.add_option(&mParams.costThreshold);
+    config.add_option(&mParams.depthMargin);
+  }
+
+  virtual enc_cb* analyze(encoder_context*,
+                          context_model_table&,
+                          enc_cb* cb);
+
+  const char* name() const { return "cb-split-fast"; }
+
+ private:
+  params mParams;
+
+  bool get_neighbour_depth_range(encoder_context*, const enc_cb* cb,
+                                 int* minDepth, int* maxDepth) const;
+};
+
 #endif
@@ -56,7 +56,7 @@ CodingOption<node> CodingOptions<node>::new_option(bool active)
     opt.mNode = mInputNode;
   }
   else {
-    opt.mNode = new node(*mInputNode);
+    opt.mNode = mECtx->get_node_arena(mInputNode->y).template create<node>(*mInputNode);
   }
 
   opt.context  = *mContextModelInput;
@@ -113,7 +113,8 @@ void CodingOptions<node>::compute_rdo_costs()
   for (int i=0;i<mOptions.size();i++) {
     if (mOptions[i].computed) {
       //printf("compute_rdo_costs %d: %f\n",i, mOptions[i].mNode->rate);
-      mOptions[i].rdoCost = mOptions[i].mNode->distortion + mECtx->lambda * mOptions[i].mNode->rate;
+      float lambda = mECtx->get_lambda(mOptions[i].mNode->y);
+      mOptions[i].rdoCost = mOptions[i].mNode->distortion + lambda * mOptions[i].mNode->rate;
     }
   }
 }
@@ -147,6 +148,20 @@ int CodingOptions<node>::find_best_rdo_index()
 }
 
 
+/* Earlier options may have left their prediction modes and motion vectors in the image
+   metadata. Restore the ones of the chosen CB, because the motion-vector prediction of
+   the following CBs reads them from the image.
+ */
+static void write_prediction_metadata(encoder_context* ectx, const enc_tb* tb) { }
+
+static void write_prediction_metadata(encoder_context* ectx, const enc_cb* cb)
+{
+  if (ectx->shdr->slice_type != SLICE_TYPE_I) {
+    cb->writePredictionMetadata(ectx->img);
+  }
+}
+
+
 template <class node>
 node* CodingOptions<node>::return_best_rdo_node()
 {
@@ -157,12 +172,14 @@ node* CodingOptions<node>::return_best_rdo_node()
   *mContextModelInput = mOptions[bestRDO].context;
 
 
-  // delete all CBs except the best one
+  write_prediction_metadata(mECtx, mOptions[bestRDO].mNode);
+
+
+  // Drop all other options. Their subtrees are released with the node arena.
 
   for (int i=0;i<mOptions.size();i++) {
     if (i != bestRDO)
       {
-        delete mOptions[i].mNode;
         mOptions[i].mNode = NULL;
       }
   }
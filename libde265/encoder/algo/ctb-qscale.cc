@@ -26,16 +26,32 @@
 #include <assert.h>
 #include <limits>
 #include <math.h>
+#include <algorithm>
 
 
 #define ENCODER_DEVELOPMENT 1
 
 
-enc_cb* Algo_CTB_QScale_Constant::analyze(encoder_context* ectx,
-                                          context_model_table& ctxModel,
-                                          int x,int y)
+float qp_to_lambda(int qp)
+{
+  return 0.0242 * pow(1.27245, qp);
+}
+
+
+double lambda_to_qp(double lambda)
+{
+  return log(lambda / 0.0242) / log(1.27245);
+}
+
+
+enc_cb* Algo_CTB_QScale::analyze_ctb(encoder_context* ectx,
+                                     context_model_table& ctxModel,
+                                     int x,int y,
+                                     int qp, float lambda)
 {
-  enc_cb* cb = new enc_cb();
+  ectx->set_active_qscale(y, qp, lambda);
+
+  enc_cb* cb = ectx->get_node_arena(y).create<enc_cb>();
 
   cb->log2Size = ectx->get_sps().Log2CtbSizeY;
   cb->ctDepth = 0;
@@ -44,14 +60,14 @@ enc_cb* Algo_CTB_QScale_Constant::analyze(encoder_context* ectx,
   cb->downPtr = ectx->ctbs.getCTBRootPointer(x,y);
   *cb->downPtr = cb;
 
-  cb->qp = ectx->active_qp;
+  cb->qp = qp;
 
   // write currently unused coding options
   cb->cu_transquant_bypass_flag = false;
   cb->pcm_flag = false;
 
   assert(mChildAlgo);
-  descend(cb, "Q=%d",ectx->active_qp);
+  descend(cb, "Q=%d",qp);
   enc_cb* result_cb = mChildAlgo->analyze(ectx,ctxModel,cb);
   ascend();
 
@@ -59,3 +75,445 @@ enc_cb* Algo_CTB_QScale_Constant::analyze(encoder_context* ectx,
 
   return result_cb;
 }
+
+
+enc_cb* Algo_CTB_QScale_Constant::analyze(encoder_context* ectx,
+                                          context_model_table& ctxModel,
+                                          int x,int y)
+{
+  return analyze_ctb(ectx, ctxModel, x,y, mPictureQP, qp_to_lambda(mPictureQP));
+}
+
+
+int Algo_CTB_QScale_Constant::start_picture(encoder_context*, const image_data* imgdata)
+{
+  mPictureQP = Clip3(1,51, getQP() + imgdata->qp_offset);
+  return mPictureQP;
+}
+
+
+
+// lambda ratio between two successive QPs
+static const double LambdaQPStep = 1.27245;
+
+/* Starting models. The picture size depends strongly on the content, hence alpha grows
+   with the complexity (lookahead cost per pixel of the intra or inter prediction) as
+   alpha = scale * complexity^2. Fitted to the encoder output at QP 22-37, the size of
+   the first picture of each type is predicted within about +-2 QP.
+   Without lookahead, rather complex pictures are assumed.
+ */
+static const double StartAlphaScale[2] = { 0.5, 2.0 };   // intra, inter
+static const double StartBeta[2]       = { -1.3, -1.4 };
+static const double DefaultComplexity[2] = { 6.0, 2.0 };
+
+
+double Algo_CTB_QScale_RateControl::rlambda_model::lambda(double bpp) const
+{
+  return alpha * pow(std::max(bpp, 0.0001), beta);
+}
+
+
+void Algo_CTB_QScale_RateControl::rlambda_model::update(double lambda, double bpp, bool first)
+{
+  // (almost) completely skipped: the size does not depend on lambda
+
+  if (bpp < 0.001) {
+    return;
+  }
+
+  // the starting model is only a rough guess, fit it to the first coded picture
+
+  if (first) {
+    alpha = Clip3(0.05, 100.0, lambda / pow(bpp, beta));
+    return;
+  }
+
+  // lambda that the model would have predicted for the actual size
+  double modelLambda = alpha * pow(bpp, beta);
+  modelLambda = Clip3(lambda/10, lambda*10, modelLambda);
+
+  double diff = log(lambda) - log(modelLambda);
+
+  alpha += 0.1  * diff * alpha;
+  beta  += 0.05 * diff * Clip3(-5.0, -0.1, log(bpp));
+
+  alpha = Clip3(0.05, 100.0, alpha);
+  beta  = Clip3(-3.0, -0.1, beta);
+}
+
+
+Algo_CTB_QScale_RateControl::Algo_CTB_QScale_RateControl()
+{
+  mVBVEnabled = false;
+  mInitialized = false;
+}
+
+
+void Algo_CTB_QScale_RateControl::init(encoder_context* ectx)
+{
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  double bitrate = mParams.mBitrate * 1000.0;
+
+  mFrameRate    = mParams.mFrameRateNum / double(mParams.mFrameRateDen);
+  mBitsPerFrame = bitrate / mFrameRate;
+  mNumPixels    = sps.pic_width_in_luma_samples * sps.pic_height_in_luma_samples;
+
+  // the models are set up in init_models() at the first picture of each type
+
+  for (int t=0;t<NumTypes;t++) {
+    mLastLambda[t] = -1;
+    mAvgBits[t]    = -1;
+  }
+
+  mIntraPeriod = 0;
+  mPicturesSinceIntra = 0;
+
+  mTotalBits = 0;
+  mTotalTargetBits = 0;
+
+  mVBVBufferSize = (mParams.mVBVSize > 0 ? mParams.mVBVSize * 1000.0 : bitrate);
+  mVBVFullness   = mVBVBufferSize * mParams.mVBVInitialFullness / 100.0;
+
+
+  mCTBs.resize(sps.PicSizeInCtbsY);
+  mRows.resize(sps.PicHeightInCtbsY);
+
+  for (int y=0;y<sps.PicHeightInCtbsY;y++)
+    for (int x=0;x<sps.PicWidthInCtbsY;x++) {
+      ctb_state& ctb = mCTBs[x + y*sps.PicWidthInCtbsY];
+
+      for (int t=0;t<NumTypes;t++) {
+        ctb.bits[t] = -1;
+      }
+
+      int w = std::min(sps.CtbSizeY, sps.pic_width_in_luma_samples  - (x<<sps.Log2CtbSizeY));
+      int h = std::min(sps.CtbSizeY, sps.pic_height_in_luma_samples - (y<<sps.Log2CtbSizeY));
+      ctb.nPixels = w*h;
+    }
+
+  mInitialized = true;
+}
+
+
+// Start the models of the current picture type (picture and CTBs) from the complexity
+// of the first picture of this type.
+void Algo_CTB_QScale_RateControl::init_models(encoder_context* ectx,
+                                              const lookahead_costs& lookahead)
+{
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  double complexity = DefaultComplexity[mType];
+  if (lookahead.valid) {
+    int64_t cost = (mType==Type_Intra ? lookahead.intra_cost : lookahead.inter_cost);
+    complexity = cost / double(mNumPixels);
+  }
+
+  mModel[mType].alpha = Clip3(0.05, 100.0, StartAlphaScale[mType] * complexity*complexity);
+  mModel[mType].beta  = StartBeta[mType];
+
+  for (int y=0;y<sps.PicHeightInCtbsY;y++)
+    for (int x=0;x<sps.PicWidthInCtbsY;x++) {
+      ctb_state& ctb = mCTBs[x + y*sps.PicWidthInCtbsY];
+
+      double ctbComplexity = complexity;
+      if (lookahead.valid) {
+        ctbComplexity = lookahead_ctb_cost(lookahead, x,y, sps.Log2CtbSizeY) / ctb.nPixels;
+      }
+
+      ctb.model[mType].alpha = Clip3(0.05, 100.0,
+                                     StartAlphaScale[mType] * ctbComplexity*ctbComplexity);
+      ctb.model[mType].beta  = StartBeta[mType];
+    }
+}
+
+
+// lookahead cost of the 16x16 blocks covered by a CTB
+double Algo_CTB_QScale_RateControl::lookahead_ctb_cost(const lookahead_costs& lookahead,
+                                                       int ctbX,int ctbY, int log2CtbSize) const
+{
+  const std::vector<int>& cost = (mType==Type_Intra ?
+                                  lookahead.block_intra_cost :
+                                  lookahead.block_inter_cost);
+
+  if (log2CtbSize < 4) {
+    int bx = std::min((ctbX<<log2CtbSize)>>4, lookahead.blocks_w-1);
+    int by = std::min((ctbY<<log2CtbSize)>>4, lookahead.blocks_h-1);
+    return cost[bx + by*lookahead.blocks_w] / double(1<<(2*(4-log2CtbSize)));
+  }
+
+  int blocksPerCtb = 1<<(log2CtbSize-4);
+  int x0 = ctbX*blocksPerCtb, x1 = std::min(x0+blocksPerCtb, lookahead.blocks_w);
+  int y0 = ctbY*blocksPerCtb, y1 = std::min(y0+blocksPerCtb, lookahead.blocks_h);
+
+  double sum=0;
+  for (int by=y0;by<y1;by++)
+    for (int bx=x0;bx<x1;bx++) {
+      sum += cost[bx + by*lookahead.blocks_w];
+    }
+
+  return sum;
+}
+
+
+int Algo_CTB_QScale_RateControl::start_picture(encoder_context* ectx, const image_data* imgdata)
+{
+  if (!mInitialized) {
+    init(ectx);
+  }
+
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  mType = (imgdata->shdr.slice_type == SLICE_TYPE_I ? Type_Intra : Type_Inter);
+
+
+  // --- bit budget for this picture ---
+
+  double targetBits = mBitsPerFrame;
+
+  if (mVBVEnabled) {
+    // move the buffer fullness back to its initial level within half the buffer duration
+
+    double initialFullness = mVBVBufferSize * mParams.mVBVInitialFullness / 100.0;
+    double window = std::max(1.0, 0.5 * mVBVBufferSize / mBitsPerFrame);
+
+    targetBits += (mVBVFullness - initialFullness) / window;
+  }
+  else {
+    // compensate the deviation from the average bitrate within two seconds
+
+    double window = std::max(1.0, 2*mFrameRate);
+
+    targetBits += (mTotalTargetBits - mTotalBits) / window;
+  }
+
+  // Intra pictures get more bits than inter pictures, according to the ratio of their sizes.
+  // Before this ratio is known, estimate it from the lookahead costs of this picture and
+  // the following ones, or assume that intra pictures are four times as large.
+  // While the intra period is unknown, assume at least two seconds.
+
+  const lookahead_costs& lookahead = imgdata->lookahead;
+
+  if (mLastLambda[mType] < 0) {
+    init_models(ectx, lookahead);
+  }
+
+  double intraRatio = 4.0;
+  if (mAvgBits[Type_Intra] > 0 && mAvgBits[Type_Inter] > 0) {
+    intraRatio = Clip3(1.0, 20.0, mAvgBits[Type_Intra] / mAvgBits[Type_Inter]);
+  }
+  else if (lookahead.valid && lookahead.avg_inter_cost > 0) {
+    intraRatio = Clip3(1.0, 20.0, lookahead.intra_cost / lookahead.avg_inter_cost);
+  }
+
+  double intraPeriod;
+  if (mType == Type_Intra && mLastLambda[Type_Intra] > 0) {
+    intraPeriod = mPicturesSinceIntra+1;
+  }
+  else if (mIntraPeriod > 0) {
+    intraPeriod = std::max(mIntraPeriod, mPicturesSinceIntra+1);
+  }
+  else {
+    intraPeriod = std::max(mPicturesSinceIntra+1.0, 2*mFrameRate);
+  }
+
+  double meanWeight = (intraRatio + intraPeriod-1) / intraPeriod;
+
+  targetBits *= (mType==Type_Intra ? intraRatio : 1.0) / meanWeight;
+
+  // inter pictures that are more complex than the following ones get a larger share
+
+  if (mType==Type_Inter && lookahead.valid && lookahead.avg_inter_cost > 0) {
+    targetBits *= Clip3(0.5, 2.0, pow(lookahead.inter_cost / lookahead.avg_inter_cost, 0.6));
+  }
+
+  targetBits = std::max(targetBits, 0.05*mBitsPerFrame);
+
+  if (mVBVEnabled) {
+    // do not overflow the buffer, but first of all, do not underflow it
+    // (with a safety margin, as the picture size is only predicted, and a larger
+    // margin for the first picture of a type, as its model is not adapted yet)
+
+    double margin = (mLastLambda[mType] > 0 ? 0.9 : 0.5);
+
+    targetBits = std::max(targetBits, mVBVFullness + mBitsPerFrame - mVBVBufferSize);
+    targetBits = std::min(targetBits, margin*mVBVFullness);
+    targetBits = std::max(targetBits, 1.0);
+  }
+
+
+  // --- picture lambda and QP ---
+
+  double lambda = mModel[mType].lambda(targetBits / mNumPixels);
+
+  // limit the change to the previous picture of the same type to +-10 QP
+
+  if (mLastLambda[mType] > 0) {
+    double maxChange = pow(LambdaQPStep, 10);
+    lambda = Clip3(mLastLambda[mType] / maxChange, mLastLambda[mType] * maxChange, lambda);
+  }
+
+  lambda = Clip3((double)qp_to_lambda(1), (double)qp_to_lambda(51), lambda);
+
+  mFrameLambda = lambda;
+  mSliceQP = Clip3(1,51, (int)floor(lambda_to_qp(lambda) + 0.5));
+
+  loginfo(LogEncoder,"  rate control: target %d bits, lambda %f, QP %d\n",
+          (int)targetBits, lambda, mSliceQP);
+
+
+  // --- distribute the budget to the CTB rows ---
+
+  double totalWeight = 0;
+
+  for (int y=0;y<sps.PicHeightInCtbsY;y++) {
+    row_state& row = mRows[y];
+    row.remainingWeight = 0;
+    row.prevLambda = mFrameLambda;
+    row.sumLogLambda = 0;
+
+    for (int x=0;x<sps.PicWidthInCtbsY;x++) {
+      ctb_state& ctb = mCTBs[x + y*sps.PicWidthInCtbsY];
+
+      // complexity estimated by the lookahead, or from the co-located CTB
+      // in the last picture of the same type
+
+      if (lookahead.valid)           { ctb.weight = std::max(lookahead_ctb_cost(lookahead, x,y, sps.Log2CtbSizeY), 1.0); }
+      else if (ctb.bits[mType] >= 0) { ctb.weight = std::max(ctb.bits[mType], 1); }
+      else                           { ctb.weight = ctb.nPixels; }
+
+      row.remainingWeight += ctb.weight;
+    }
+
+    totalWeight += row.remainingWeight;
+  }
+
+  // The picture must not take more bits than there are in the VBV buffer.
+  // Rows that are about to exceed their share of this limit may raise the CTB QP further.
+
+  double maxBits = (mVBVEnabled ? 0.95*mVBVFullness : std::numeric_limits<double>::max());
+
+  for (int y=0;y<sps.PicHeightInCtbsY;y++) {
+    row_state& row = mRows[y];
+    row.remainingBits = targetBits * row.remainingWeight / totalWeight;
+    row.maxBits       = maxBits    * row.remainingWeight / totalWeight;
+    row.codedBits   = 0;
+    row.codedWeight = 0;
+  }
+
+  return mSliceQP;
+}
+
+
+enc_cb* Algo_CTB_QScale_RateControl::analyze(encoder_context* ectx,
+                                             context_model_table& ctxModel,
+                                             int x,int y)
+{
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  int ctbX = x >> sps.Log2CtbSizeY;
+  int ctbY = y >> sps.Log2CtbSizeY;
+
+  ctb_state& ctb = mCTBs[ctbX + ctbY*sps.PicWidthInCtbsY];
+  row_state& row = mRows[ctbY];
+
+  // share of the remaining row budget
+
+  double targetBits = row.remainingBits * ctb.weight / row.remainingWeight;
+
+  // The VBV buffer is at risk when the rest of the row, coded at the rate of its
+  // previous CTBs, would exceed the row's share of the buffer fullness.
+
+  bool vbvRisk = false;
+  if (mVBVEnabled && row.codedWeight > 0) {
+    double expectedBits = row.codedBits / row.codedWeight * row.remainingWeight;
+    if (expectedBits > row.maxBits) {
+      vbvRisk = true;
+      targetBits = std::min(targetBits, row.maxBits * ctb.weight / row.remainingWeight);
+    }
+  }
+
+  double lambda = ctb.model[mType].lambda(std::max(targetBits, 1.0) / ctb.nPixels);
+
+  // change by at most one QP step between neighboring CTBs and two steps from the slice QP,
+  // but increase the QP as fast as needed when the VBV buffer is at risk
+
+  double maxStepUp = (vbvRisk ? pow(LambdaQPStep, 4) : LambdaQPStep);
+  double maxLambda = (vbvRisk ? qp_to_lambda(51) : mFrameLambda * (LambdaQPStep*LambdaQPStep));
+
+  lambda = Clip3(row.prevLambda / LambdaQPStep, row.prevLambda * maxStepUp, lambda);
+  lambda = Clip3(mFrameLambda / (LambdaQPStep*LambdaQPStep), maxLambda, lambda);
+
+  int qp = (int)floor(lambda_to_qp(lambda) + 0.5);
+  qp = Clip3(mSliceQP-2, vbvRisk ? 51 : mSliceQP+2, qp);
+  qp = Clip3(1,51, qp);
+
+  ctb.lambda = lambda;
+  row.prevLambda = lambda;
+  row.sumLogLambda += log(lambda);
+
+  return analyze_ctb(ectx, ctxModel, x,y, qp, lambda);
+}
+
+
+void Algo_CTB_QScale_RateControl::ctb_coded(encoder_context* ectx, int ctbX,int ctbY, int nBits)
+{
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  ctb_state& ctb = mCTBs[ctbX + ctbY*sps.PicWidthInCtbsY];
+  row_state& row = mRows[ctbY];
+
+  row.remainingBits   -= nBits;
+  row.remainingWeight -= ctb.weight;
+  row.maxBits         -= nBits;
+  row.codedBits       += nBits;
+  row.codedWeight     += ctb.weight;
+
+  ctb.model[mType].update(ctb.lambda, nBits / double(ctb.nPixels), mLastLambda[mType] < 0);
+  ctb.bits[mType] = nBits;
+}
+
+
+void Algo_CTB_QScale_RateControl::end_picture(encoder_context* ectx, int nBits)
+{
+  const seq_parameter_set& sps = ectx->get_sps();
+
+  // the picture was coded with the geometric mean of the CTB lambdas
+
+  double sumLogLambda = 0;
+  for (int y=0;y<sps.PicHeightInCtbsY;y++) {
+    sumLogLambda += mRows[y].sumLogLambda;
+  }
+
+  double lambda = exp(sumLogLambda / sps.PicSizeInCtbsY);
+
+  if (mType == Type_Intra) {
+    if (mLastLambda[Type_Intra] > 0) {
+      mIntraPeriod = mPicturesSinceIntra+1;
+    }
+
+    mPicturesSinceIntra = 0;
+  }
+  else {
+    mPicturesSinceIntra++;
+  }
+
+  mModel[mType].update(lambda, nBits / double(mNumPixels), mLastLambda[mType] < 0);
+  mLastLambda[mType] = lambda;
+
+  if (mAvgBits[mType] < 0) { mAvgBits[mType] = nBits; }
+  else                     { mAvgBits[mType] = 0.8*mAvgBits[mType] + 0.2*nBits; }
+
+
+  mTotalBits       += nBits;
+  mTotalTargetBits += mBitsPerFrame;
+
+  if (mVBVEnabled) {
+    if (nBits > mVBVFullness) {
+      loginfo(LogEncoder,"  rate control: VBV underflow (%d bits, buffer %d bits)\n",
+              nBits, (int)mVBVFullness);
+    }
+
+    mVBVFullness = std::min(mVBVFullness - nBits + mBitsPerFrame, mVBVBufferSize);
+  }
+}
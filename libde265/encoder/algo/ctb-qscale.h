@@ -37,6 +37,11 @@
 
 #include "libde265/encoder/algo/cb-split.h"
 
+#include <vector>
+
+struct image_data;
+struct lookahead_costs;
+
 
 /*  Encoder search tree, bottom up:
 
@@ -52,6 +57,11 @@
  */
 
 
+// RDO lambda for coding at 'qp', and the QP that corresponds to 'lambda'
+float  qp_to_lambda(int qp);
+double lambda_to_qp(double lambda);
+
+
 // ========== choose a qscale at CTB level ==========
 
 class Algo_CTB_QScale : public Algo
@@ -66,8 +76,29 @@ class Algo_CTB_QScale : public Algo
 
   void setChildAlgo(Algo_CB_Split* algo) { mChildAlgo = algo; }
 
+
+  // --- rate control ---
+
+  // whether the QP may change between CTBs (requires cu_qp_delta)
+  virtual bool uses_cu_qp_delta() const { return false; }
+
+  // called before a picture is encoded, returns the slice QP
+  virtual int  start_picture(encoder_context*, const image_data*) = 0;
+
+  // number of bits that the CTB was actually coded with
+  virtual void ctb_coded(encoder_context*, int ctbX,int ctbY, int nBits) { }
+
+  // number of bits of the coded picture (slice header and data)
+  virtual void end_picture(encoder_context*, int nBits) { }
+
  protected:
   Algo_CB_Split* mChildAlgo;
+
+  // create the CTB root node coded at 'qp' and run the CB analysis on it
+  enc_cb* analyze_ctb(encoder_context*,
+                      context_model_table&,
+                      int ctb_x,int ctb_y,
+                      int qp, float lambda);
 };
 
 
@@ -97,12 +128,177 @@ class Algo_CTB_QScale_Constant : public Algo_CTB_QScale
                           context_model_table&,
                           int ctb_x,int ctb_y);
 
+  virtual int start_picture(encoder_context*, const image_data*);
+
   int getQP() const { return mParams.mQP; }
 
   const char* name() const { return "ctb-qscale-constant"; }
 
  private:
   params mParams;
+
+  int mPictureQP;
+};
+
+
+
+/* Rate control with the R-lambda model  lambda = alpha * bpp^beta.
+
+   Each picture gets a bit budget from the target bitrate. In CBR mode, the budget is
+   steered by a VBV buffer model (decoder buffer filled at the target bitrate), otherwise
+   deviations from the average bitrate are compensated over a window of two seconds.
+   Intra and inter pictures use separate models, and their budgets are weighted with
+   the ratio of their past sizes and the distance between intra pictures.
+
+   When the lookahead is enabled, its complexity estimates set the intra/inter ratio
+   before it is known from coded pictures, and inter pictures get a larger budget when
+   they are more complex than the following pictures.
+
+   Within a picture, each CTB row gets a share of the budget that is proportional to
+   the lookahead costs of its CTBs, or else to the bits spent on the co-located CTBs of
+   the previous picture of the same type. The rows then assign the lambda to each CTB
+   from their remaining budget and a per-CTB model. The CTB QP may deviate by +-2 from
+   the slice QP, or rise further when the row would otherwise use more than its share
+   of the VBV buffer fullness.
+
+   The models of each type start from the complexity of the first picture of that type
+   and are fitted to its coded size. As this picture is coded with an unadapted model,
+   it gets at most half of the VBV buffer fullness.
+
+   All models are updated with the actual number of bits written by the CABAC encoder.
+   CTB rows only access their own CTB state, so the rows can be coded in parallel (WPP).
+ */
+class Algo_CTB_QScale_RateControl : public Algo_CTB_QScale
+{
+ public:
+  Algo_CTB_QScale_RateControl();
+
+  struct params
+  {
+    params() {
+      mBitrate.set_ID("rc-bitrate");
+      mBitrate.set_minimum(1);
+      mBitrate.set_default(1000);
+
+      mVBVSize.set_ID("rc-vbv-size");
+      mVBVSize.set_minimum(0);
+      mVBVSize.set_default(0);
+
+      mVBVInitialFullness.set_ID("rc-vbv-init");
+      mVBVInitialFullness.set_range(1,100);
+      mVBVInitialFullness.set_default(90);
+
+      mFrameRateNum.set_ID("rc-fps-num");
+      mFrameRateNum.set_minimum(1);
+      mFrameRateNum.set_default(25);
+
+      mFrameRateDen.set_ID("rc-fps-den");
+      mFrameRateDen.set_minimum(1);
+      mFrameRateDen.set_default(1);
+    }
+
+    option_int mBitrate;            // kbit/s
+    option_int mVBVSize;            // kbit, 0: one second of data at the target bitrate
+    option_int mVBVInitialFullness; // percent
+    option_int mFrameRateNum;
+    option_int mFrameRateDen;
+  };
+
+  void setParams(const params& p) { mParams=p; }
+
+  void registerParams(config_parameters& config) {
+    config.add_option(&mParams.mBitrate);
+    config.add_option(&mParams.mVBVSize);
+    config.add_option(&mParams.mVBVInitialFullness);
+    config.add_option(&mParams.mFrameRateNum);
+    config.add_option(&mParams.mFrameRateDen);
+  }
+
+  // constant bitrate with VBV buffer constraint, or average bitrate
+  void setVBVEnabled(bool flag) { mVBVEnabled=flag; }
+
+  virtual enc_cb* analyze(encoder_context*,
+                          context_model_table&,
+                          int ctb_x,int ctb_y);
+
+  virtual bool uses_cu_qp_delta() const { return true; }
+
+  virtual int  start_picture(encoder_context*, const image_data*);
+  virtual void ctb_coded(encoder_context*, int ctbX,int ctbY, int nBits);
+  virtual void end_picture(encoder_context*, int nBits);
+
+  int getPPS_QP() const { return 26; }
+
+  const char* name() const { return "ctb-qscale-ratecontrol"; }
+
+ private:
+  params mParams;
+  bool   mVBVEnabled;
+
+  enum { Type_Intra, Type_Inter, NumTypes };
+
+  struct rlambda_model
+  {
+    double alpha, beta;
+
+    double lambda(double bpp) const;
+    void   update(double lambda, double bpp, bool first);
+  };
+
+  struct ctb_state
+  {
+    rlambda_model model[NumTypes];
+    int    bits[NumTypes]; // bits of this CTB in the last picture of each type, -1 if none
+
+    int    nPixels;
+    double weight;         // weight of this CTB in the bit allocation of the current picture
+    double lambda;         // lambda of this CTB in the current picture
+  };
+
+  struct row_state
+  {
+    double remainingBits;
+    double remainingWeight;
+    double prevLambda;
+    double sumLogLambda;
+
+    double maxBits;     // remaining share of the VBV buffer fullness
+    double codedBits;   // bits and weight of the CTBs coded so far
+    double codedWeight;
+  };
+
+  bool   mInitialized;
+  double mBitsPerFrame;
+  int    mNumPixels;
+
+  double mFrameRate;
+
+  rlambda_model mModel[NumTypes];
+  double mLastLambda[NumTypes]; // <0 when there was no picture of this type yet
+  double mAvgBits[NumTypes];    // average picture size per type, <0 when not known yet
+  int    mIntraPeriod;          // distance between the last two intra pictures, 0 if unknown
+  int    mPicturesSinceIntra;
+
+  // ABR
+  double mTotalBits;
+  double mTotalTargetBits;
+
+  // VBV, the fullness is the number of bits in the decoder buffer
+  double mVBVBufferSize;
+  double mVBVFullness;
+
+  // current picture
+  int    mType;
+  int    mSliceQP;
+  double mFrameLambda;
+
+  std::vector<ctb_state> mCTBs;
+  std::vector<row_state> mRows;
+
+  void init(encoder_context*);
+  void init_models(encoder_context*, const lookahead_costs&);
+
+  double lookahead_ctb_cost(const lookahead_costs&, int ctbX,int ctbY, int log2CtbSize) const;
 };
 
 
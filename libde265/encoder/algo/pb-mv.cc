@@ -22,11 +22,68 @@
 
 
 #include "libde265/encoder/algo/pb-mv.h"
+#include "libde265/encoder/algo/tb-split.h"
 #include "libde265/encoder/algo/coding-options.h"
 #include "libde265/encoder/encoder-context.h"
+#include "libde265/encoder/encoder-syntax.h"
 #include <assert.h>
 #include <limits>
 #include <math.h>
+#include <algorithm>
+#include <string.h>
+
+
+
+enc_cb* Algo_PB_MV::code_residual(encoder_context* ectx,
+                                  context_model_table& ctxModel,
+                                  enc_cb* cb)
+{
+  // encode_coding_unit() can only write 2Nx2N inter CBs
+  assert(cb->PartMode == PART_2Nx2N);
+
+  int cbSize = 1<<cb->log2Size;
+
+
+  // rate of the part mode and the motion data
+
+  CABAC_encoder_estim estim;
+  estim.set_context_models(&ctxModel);
+
+  encode_part_mode(ectx, &estim, MODE_INTER, cb->PartMode, cb->log2Size);
+  encode_prediction_unit(ectx, &estim, cb, 0, cb->x,cb->y, cbSize,cbSize);
+
+  float rate_prediction = estim.getRDBits();
+  estim.reset();
+
+
+  // code the residual of the motion-compensated prediction
+
+  int IntraSplitFlag = 0;
+  int MaxTrafoDepth = ectx->get_sps().max_transform_hierarchy_depth_inter;
+
+  enc_tb* tb = ectx->get_node_arena(cb->y).create<enc_tb>(cb->x,cb->y,cb->log2Size,cb);
+  tb->downPtr = &cb->transform_tree;
+  cb->transform_tree = tb;
+
+  descend(cb,"residual");
+  tb = mTBSplitAlgo->analyze(ectx, ctxModel, ectx->imgdata->input, tb,
+                             0, MaxTrafoDepth, IntraSplitFlag);
+  ascend();
+
+  cb->transform_tree = tb;
+  cb->inter.rqt_root_cbf = ! tb->isZeroBlock();
+
+  encode_rqt_root_cbf(ectx, &estim, cb->inter.rqt_root_cbf);
+
+  cb->distortion = tb->distortion;
+  cb->rate       = rate_prediction + estim.getRDBits();
+
+  if (cb->inter.rqt_root_cbf) {
+    cb->rate += tb->rate;
+  }
+
+  return cb;
+}
 
 
 
@@ -93,226 +150,648 @@ enc_cb* Algo_PB_MV_Test::analyze(encoder_context* ectx,
 
   ectx->img->set_mv_info(x,y,w,h, vec);
 
-  /* TMP REMOVE: ectx->prediction does not exist anymore
-  generate_inter_prediction_samples(ectx, ectx->shdr, ectx->prediction,
-                                    cb->x,cb->y, // int xC,int yC,
-                                    0,0,         // int xB,int yB,
-                                    1<<cb->log2Size, // int nCS,
-                                    1<<cb->log2Size,
-                                    1<<cb->log2Size, // int nPbW,int nPbH,
+  generate_inter_prediction_samples(ectx, ectx->shdr, ectx->img,
+                                    cb->x,cb->y,         // int xC,int yC,
+                                    x-cb->x,y-cb->y,     // int xB,int yB,
+                                    1<<cb->log2Size,     // int nCS,
+                                    w,h,                 // int nPbW,int nPbH,
                                     &vec);
-  */
 
-  // TODO estimate rate for sending MV
+  return code_residual(ectx, ctxModel, cb);
+}
 
-  int IntraSplitFlag = 0;
-  int MaxTrafoDepth = ectx->get_sps().max_transform_hierarchy_depth_inter;
 
-  mCodeResidual=true;
-  if (mCodeResidual) {
-    assert(mTBSplitAlgo);
-    assert(false);
-    /*
-    cb->transform_tree = mTBSplitAlgo->analyze(ectx,ctxModel, ectx->imgdata->input, NULL, cb,
-                                               cb->x,cb->y,cb->x,cb->y, cb->log2Size,0,
-                                               0, MaxTrafoDepth, IntraSplitFlag);
-    */
 
-    cb->inter.rqt_root_cbf = ! cb->transform_tree->isZeroBlock();
 
-    cb->distortion = cb->transform_tree->distortion;
-    cb->rate       = cb->transform_tree->rate;
+halfpel_plane_cache::halfpel_plane_cache()
+  : mFrameNumber(-1), mWidth(0), mHeight(0), mRefStride(0), mPlaneStride(0)
+{
+  de265_mutex_init(&mMutex);
+}
+
+
+halfpel_plane_cache::~halfpel_plane_cache()
+{
+  de265_mutex_destroy(&mMutex);
+}
+
+
+void halfpel_plane_cache::prepare(const acceleration_functions& accel,
+                                  const de265_image* ref, int frame_number)
+{
+  de265_mutex_lock(&mMutex);
+
+  if (frame_number == mFrameNumber) {
+    de265_mutex_unlock(&mMutex);
+    return;
+  }
+
+  mWidth  = ref->get_width();
+  mHeight = ref->get_height();
+
+
+  // copy reference with replicated borders
+
+  mRefStride = mWidth + 2*RefPadding;
+  mRef.resize(mRefStride * (mHeight + 2*RefPadding));
+
+  const uint8_t* src = ref->get_image_plane(0);
+  int srcStride = ref->get_image_stride(0);
+
+  for (int y=-RefPadding; y<mHeight+RefPadding; y++) {
+    const uint8_t* srcRow = src + Clip3(0,mHeight-1,y)*srcStride;
+    uint8_t* dstRow = &mRef[(y+RefPadding)*mRefStride];
+
+    memset(dstRow, srcRow[0], RefPadding);
+    memcpy(dstRow+RefPadding, srcRow, mWidth);
+    memset(dstRow+RefPadding+mWidth, srcRow[mWidth-1], RefPadding);
+  }
+
+
+  // interpolate the half-pel planes in tiles of 64x64
+
+  int planeW = mWidth  + 2*PlanePadding;
+  int planeH = mHeight + 2*PlanePadding;
+  mPlaneStride = planeW;
+
+  ALIGNED_16(int16_t) mcbuffer[64 * (64+7)];
+  ALIGNED_16(int16_t) tmp[64*64];
+
+  for (int p=0;p<3;p++) {
+    int dX = (p==1 ? 0 : 2);
+    int dY = (p==0 ? 0 : 2);
+
+    mPlane[p].resize(planeW * planeH);
+
+    for (int ty=0; ty<planeH; ty+=64)
+      for (int tx=0; tx<planeW; tx+=64) {
+        int tw = std::min(64, planeW-tx);
+        int th = std::min(64, planeH-ty);
+
+        accel.put_hevc_qpel(tmp, 64,
+                            ref_at(tx-PlanePadding, ty-PlanePadding), mRefStride,
+                            tw,th, mcbuffer, dX,dY, 8);
+
+        accel.put_unweighted_pred_8(&mPlane[p][ty*mPlaneStride + tx], mPlaneStride,
+                                    tmp, 64, tw,th);
+      }
+  }
+
+  mFrameNumber = frame_number;
+
+  de265_mutex_unlock(&mMutex);
+}
+
+
+void halfpel_plane_cache::predict(const acceleration_functions& accel,
+                                  int x,int y, int mvx,int mvy, int w,int h,
+                                  uint8_t* out, int outStride) const
+{
+  assert(mFrameNumber >= 0);
+
+  int xInt = x + (mvx>>2);
+  int yInt = y + (mvy>>2);
+  int xFrac = mvx & 3;
+  int yFrac = mvy & 3;
+
+  if (xFrac==0 && yFrac==0) {
+    assert(xInt >= -RefPadding && xInt+w <= mWidth +RefPadding);
+    assert(yInt >= -RefPadding && yInt+h <= mHeight+RefPadding);
+
+    for (int y=0;y<h;y++) {
+      memcpy(out + y*outStride, ref_at(xInt,yInt+y), w);
+    }
+  }
+  else if ((xFrac & 1)==0 && (yFrac & 1)==0) {
+    assert(xInt >= -PlanePadding && xInt+w <= mWidth +PlanePadding);
+    assert(yInt >= -PlanePadding && yInt+h <= mHeight+PlanePadding);
+
+    int p = (yFrac==0 ? 0 : (xFrac==0 ? 1 : 2));
+    const uint8_t* plane = &mPlane[p][(yInt+PlanePadding)*mPlaneStride + xInt+PlanePadding];
+
+    for (int y=0;y<h;y++) {
+      memcpy(out + y*outStride, plane + y*mPlaneStride, w);
+    }
   }
   else {
-    const de265_image* input = ectx->imgdata->input;
-    /* TODO TMP REMOVE: prediction does not exist anymore
-    de265_image* img   = ectx->prediction;
-    int x0 = cb->x;
-    int y0 = cb->y;
-    int tbSize = 1<<cb->log2Size;
-
-    cb->distortion = compute_distortion_ssd(input, img, x0,y0, cb->log2Size, 0);
-    cb->rate = 5; // fake (MV)
-
-    cb->inter.rqt_root_cbf = 0;
-    */
+    // quarter-pel position (the filter reads 3 samples before and 4 after the block)
+
+    assert(xInt-3 >= -RefPadding && xInt+w+4 <= mWidth +RefPadding);
+    assert(yInt-3 >= -RefPadding && yInt+h+4 <= mHeight+RefPadding);
+
+    ALIGNED_16(int16_t) mcbuffer[64 * (64+7)];
+    ALIGNED_16(int16_t) tmp[64*64];
+
+    accel.put_hevc_qpel(tmp, 64, ref_at(xInt,yInt), mRefStride,
+                        w,h, mcbuffer, xFrac,yFrac, 8);
+    accel.put_unweighted_pred_8(out, outStride, tmp, 64, w,h);
   }
+}
 
-  return cb;
+
+/* Approximate number of bits for coding one MVD component (quarter-pel units):
+   abs_mvd_greater0_flag, abs_mvd_greater1_flag, abs_mvd_minus2 (EG1) and sign.
+ */
+static inline int mvd_component_bits(int d)
+{
+  d = abs_value(d);
+
+  if (d==0) return 1;
+  if (d==1) return 3;
+
+  // abs_mvd_minus2 as EG1
+  int v = d-2;
+  int k = 1;
+  int bits = 2+1+1;
+  while (v >= (1<<k)) { v -= (1<<k); k++; bits++; }
+
+  return bits + k;
 }
 
 
+/* State of a single integer-pel motion search. Positions are integer MVs
+   relative to the PB. All candidates are clipped to the search window
+   (configured range intersected with the reference picture area).
+ */
+struct mv_search
+{
+  const acceleration_functions* accel;
+
+  const uint8_t* src;
+  int srcStride;
+  const uint8_t* ref;  // reference plane at the PB position
+  int refStride;
+  int pbW,pbH;
+
+  int mvxMin,mvxMax;
+  int mvyMin,mvyMax;
+
+  MotionVector mvp;   // predictor (quarter-pel) that the MVD is coded against
+  int lambda;         // SAD lambda, fixed point with 4 fractional bits
+
+  int bestX,bestY;
+  int bestCost;
+  int bestSAD;
+
+  void init_best() { bestX=bestY=0; bestCost=bestSAD=std::numeric_limits<int>::max(); }
+
+  bool inside(int mx,int my) const {
+    return mx>=mvxMin && mx<=mvxMax && my>=mvyMin && my<=mvyMax;
+  }
+
+  // returns true if the position became the new best candidate
+  bool check(int mx,int my) {
+    if (!inside(mx,my)) return false;
+
+    return consider(mx,my, accel->sad(ref + mx + my*refStride, refStride,
+                                      src, srcStride, pbW,pbH));
+  }
 
+  bool consider(int mx,int my, int s) {
+    if (s >= bestCost) return false;
 
-int sad(const uint8_t* p1,int stride1,
-        const uint8_t* p2,int stride2,
-        int w,int h)
+    int bits = (mvd_component_bits(mx*4 - mvp.x) +
+                mvd_component_bits(my*4 - mvp.y));
+    int cost = s + ((lambda*bits) >> 4);
+
+    if (cost < bestCost) {
+      bestCost=cost;
+      bestSAD =s;
+      bestX=mx;
+      bestY=my;
+      return true;
+    }
+
+    return false;
+  }
+};
+
+
+static void full_search(mv_search& s)
 {
-  int cost=0;
+  // square PBs: evaluate four horizontally adjacent positions at once
+
+  int sizeIdx = -1;
+  if (s.pbW == s.pbH) {
+    switch (s.pbW) {
+    case 4:  sizeIdx=0; break;
+    case 8:  sizeIdx=1; break;
+    case 16: sizeIdx=2; break;
+    case 32: sizeIdx=3; break;
+    case 64: sizeIdx=4; break;
+    }
+  }
 
-  for (int y=0;y<h;y++) {
-    for (int x=0;x<w;x++) {
-      cost += abs_value(*p1 - *p2);
-      p1++;
-      p2++;
+  for (int my=s.mvyMin; my<=s.mvyMax; my++) {
+    int mx=s.mvxMin;
+
+    if (sizeIdx>=0) {
+      for ( ; mx+3<=s.mvxMax; mx+=4) {
+        const uint8_t* ref = s.ref + mx + my*s.refStride;
+        const uint8_t* refs[4] = { ref, ref+1, ref+2, ref+3 };
+        int sads[4];
+
+        s.accel->sad_x4_8[sizeIdx](s.src,s.srcStride, refs,s.refStride, sads);
+
+        for (int i=0;i<4;i++) {
+          s.consider(mx+i,my, sads[i]);
+        }
+      }
     }
 
-    p1 += stride1-w;
-    p2 += stride2-w;
+    for ( ; mx<=s.mvxMax; mx++) {
+      s.check(mx,my);
+    }
   }
+}
+
 
-  return cost;
+// Refine with the small diamond until the center is the best position.
+
+static void small_diamond_search(mv_search& s, int earlyExitSAD)
+{
+  for (;;) {
+    if (s.bestSAD < earlyExitSAD) return;
+
+    int cx=s.bestX, cy=s.bestY;
+
+    s.check(cx-1,cy);
+    s.check(cx+1,cy);
+    s.check(cx,cy-1);
+    s.check(cx,cy+1);
+
+    if (s.bestX==cx && s.bestY==cy) return;
+  }
 }
 
 
-enc_cb* Algo_PB_MV_Search::analyze(encoder_context* ectx,
-                                   context_model_table& ctxModel,
-                                   enc_cb* cb,
-                                   int PBidx, int x,int y,int pbW,int pbH)
+static void diamond_search(mv_search& s, int earlyExitSAD)
 {
-  enum MVSearchAlgo searchAlgo = mParams.mvSearchAlgo();
+  static const int8_t ldsp[8][2] = {
+    { 0,-2}, { 1,-1}, { 2, 0}, { 1, 1},
+    { 0, 2}, {-1, 1}, {-2, 0}, {-1,-1}
+  };
 
+  for (;;) {
+    if (s.bestSAD < earlyExitSAD) return;
 
-  MotionVector mvp[2];
+    int cx=s.bestX, cy=s.bestY;
 
-  fill_luma_motion_vector_predictors(ectx, ectx->shdr, ectx->img,
-                                     cb->x,cb->y,1<<cb->log2Size, x,y,pbW,pbH,
-                                     0, // l
-                                     0, 0, // int refIdx, int partIdx,
-                                     mvp);
+    for (int i=0;i<8;i++) {
+      s.check(cx+ldsp[i][0], cy+ldsp[i][1]);
+    }
 
-  PBMotionCoding& spec = cb->inter.pb[PBidx].spec;
-  PBMotion&        vec = cb->inter.pb[PBidx].motion;
+    if (s.bestX==cx && s.bestY==cy) break;
+  }
 
-  spec.merge_flag = 0;
-  spec.merge_idx  = 0;
+  small_diamond_search(s, earlyExitSAD);
+}
+
+
+static void hexagon_search(mv_search& s, int earlyExitSAD)
+{
+  static const int8_t hex[6][2] = {
+    {-2, 0}, {-1,-2}, { 1,-2}, { 2, 0}, { 1, 2}, {-1, 2}
+  };
+
+  for (;;) {
+    if (s.bestSAD < earlyExitSAD) return;
+
+    int cx=s.bestX, cy=s.bestY;
+
+    for (int i=0;i<6;i++) {
+      s.check(cx+hex[i][0], cy+hex[i][1]);
+    }
+
+    if (s.bestX==cx && s.bestY==cy) break;
+  }
+
+  small_diamond_search(s, earlyExitSAD);
+
+  // final square refinement around the hexagon center
+
+  int cx=s.bestX, cy=s.bestY;
+  s.check(cx-1,cy-1);
+  s.check(cx+1,cy-1);
+  s.check(cx-1,cy+1);
+  s.check(cx+1,cy+1);
+}
 
-  spec.inter_pred_idc = PRED_L0;
-  spec.refIdx[0] = vec.refIdx[0] = 0;
-  spec.mvp_l0_flag = 0;
 
-  int hrange = mParams.hrange();
-  int vrange = mParams.vrange();
+static inline int round_mv_to_fullpel(int v)
+{
+  return (v + 2) >> 2;
+}
+
+
+// cost of a quarter-pel prediction: SATD and the approximate rate of the MVD
+static inline int prediction_cost(const acceleration_functions& accel,
+                                  const uint8_t* src,int srcStride,
+                                  const uint8_t* pred,int predStride, int w,int h,
+                                  int lambda, int mvdBits)
+{
+  return accel.satd(src,srcStride, pred,predStride, w,h) + ((lambda*mvdBits) >> 4);
+}
 
-  // previous frame (TODO)
-  const de265_image* refimg   = ectx->get_image(ectx->imgdata->frame_number -1);
+
+static inline int mvd_bits(const MotionVector& mv, const MotionVector& mvp)
+{
+  return mvd_component_bits(mv.x - mvp.x) + mvd_component_bits(mv.y - mvp.y);
+}
+
+
+int Algo_PB_MV_Search::search(encoder_context* ectx, enc_cb* cb, int PBidx,
+                              int x,int y,int pbW,int pbH, int l, int lambda,
+                              const MotionVector mvp[2], MotionVector& mv)
+{
+  enum MVSearchAlgo searchAlgo = mParams.mvSearchAlgo();
+
+  // first picture in reference list 'l'
+  int refFrame = ectx->shdr->RefPicList[l][0];
+  const de265_image* refimg   = ectx->get_image(refFrame);
   const de265_image* inputimg = ectx->imgdata->input;
 
   int w = refimg->get_width();
   int h = refimg->get_height();
 
-  int mincost = 0x7fffffff;
+  // The motion grows with the temporal distance to the reference picture.
+  // Limit the range to four times the configured range, as the full search gets expensive.
 
-  double lambda = 10.0;
+  int distance = Clip3(1,4, abs_value(ectx->imgdata->frame_number - refFrame));
 
-  double *bits_h = new double[2*hrange+1];
-  double *bits_v = new double[2*vrange+1];
+  int hrange = mParams.hrange() * distance;
+  int vrange = mParams.vrange() * distance;
 
-  for (int i=-hrange;i<=hrange;i++) {
-    int diff = (i - mvp[0].x);
-    int b;
 
-    if (diff==0) { b=0; }
-    else if (diff==1 || diff==-1) { b=2; }
-    else { b=abs_value(b+2); }
+  mv_search s;
+  s.accel     = &ectx->acceleration;
+  s.src       = inputimg->get_image_plane_at_pos(0,x,y);
+  s.srcStride = inputimg->get_image_stride(0);
+  s.ref       = refimg->get_image_plane_at_pos(0,x,y);
+  s.refStride = refimg->get_image_stride(0);
+  s.pbW = pbW;
+  s.pbH = pbH;
 
-    bits_h[i+hrange]=b;
-  }
+  s.mvxMin = std::max(-hrange, -x);
+  s.mvxMax = std::min( hrange, w-pbW-x);
+  s.mvyMin = std::max(-vrange, -y);
+  s.mvyMax = std::min( vrange, h-pbH-y);
+
+  s.mvp    = mvp[0];
+  s.lambda = lambda;
+  s.init_best();
+
+  int nPixels = pbW*pbH;
+
+  switch (searchAlgo) {
+  case MVSearchAlgo_Zero:
+    s.check(0,0);
+    break;
+
+  case MVSearchAlgo_Full:
+    full_search(s);
+    break;
+
+  case MVSearchAlgo_Diamond:
+  case MVSearchAlgo_Hexagon:
+    s.check(0,0);
+    s.check(round_mv_to_fullpel(mvp[0].x), round_mv_to_fullpel(mvp[0].y));
+    s.check(round_mv_to_fullpel(mvp[1].x), round_mv_to_fullpel(mvp[1].y));
+
+    if (searchAlgo==MVSearchAlgo_Diamond) { diamond_search(s, 0); }
+    else                                   { hexagon_search(s, 0); }
+    break;
 
-  for (int i=-vrange;i<=vrange;i++) {
-    int diff = (i - mvp[0].y);
-    int b;
+  case MVSearchAlgo_PMVFast:
+    {
+      // Predictors: AMVP candidates, merge candidates of this list and the zero vector.
+      // Stop right away when the best predictor is already good enough.
 
-    if (diff==0) { b=0; }
-    else if (diff==1 || diff==-1) { b=2; }
-    else { b=abs_value(b+2); }
+      const int earlyExitSAD = nPixels;       // ~1 per pixel
+      const int refineExitSAD = nPixels/2;
 
-    bits_v[i+vrange]=b;
+      s.check(round_mv_to_fullpel(mvp[0].x), round_mv_to_fullpel(mvp[0].y));
+
+      if (s.bestSAD >= earlyExitSAD) {
+        s.check(round_mv_to_fullpel(mvp[1].x), round_mv_to_fullpel(mvp[1].y));
+        s.check(0,0);
+
+        PBMotion mergeCandList[5];
+        get_merge_candidate_list_from_tree(ectx, ectx->shdr,
+                                           cb->x,cb->y, x,y,
+                                           1<<cb->log2Size, pbW,pbH, PBidx,
+                                           mergeCandList);
+
+        for (int i=0;i<ectx->shdr->MaxNumMergeCand;i++) {
+          if (mergeCandList[i].predFlag[l]) {
+            s.check(round_mv_to_fullpel(mergeCandList[i].mv[l].x),
+                    round_mv_to_fullpel(mergeCandList[i].mv[l].y));
+          }
+        }
+      }
+
+      if (s.bestSAD >= earlyExitSAD) {
+        // If the median predictor won, the motion field is smooth and the
+        // small diamond is sufficient. Otherwise, search with the large diamond.
+
+        if (s.bestX == round_mv_to_fullpel(mvp[0].x) &&
+            s.bestY == round_mv_to_fullpel(mvp[0].y)) {
+          small_diamond_search(s, refineExitSAD);
+        }
+        else {
+          diamond_search(s, refineExitSAD);
+        }
+      }
+    }
+    break;
   }
 
-  for (int my = y-vrange; my<=y+vrange; my++)
-    for (int mx = x-hrange; mx<=x+hrange; mx++)
-      {
-        if (mx<0 || mx+pbW>w || my<0 || my+pbH>h) continue;
+  if (s.bestCost == std::numeric_limits<int>::max()) {
+    // no valid position inside the search window (cannot happen for in-picture PBs)
+    s.bestX = s.bestY = 0;
+  }
+
+  mv.x = s.bestX*4;
+  mv.y = s.bestY*4;
+
 
-        int cost = sad(refimg->get_image_plane_at_pos(0,mx,my),
-                       refimg->get_image_stride(0),
-                       inputimg->get_image_plane_at_pos(0,x,y),
-                       inputimg->get_image_stride(0),
-                       pbW,pbH);
+  // --- sub-pel refinement around the best integer vector ---
 
-        int bits = bits_h[mx-x+hrange] + bits_v[my-y+vrange];
+  // the interpolated reference is also needed to compare against bi-prediction
+  mHalfPelCache[l].prepare(ectx->acceleration, refimg, refFrame);
 
-        cost += lambda * bits;
+  ALIGNED_16(uint8_t) pred[64*64];
 
-        //printf("%d %d : %d\n",mx,my,cost);
+  mHalfPelCache[l].predict(ectx->acceleration, x,y, mv.x,mv.y, pbW,pbH, pred,64);
+  int bestCost = prediction_cost(ectx->acceleration, s.src,s.srcStride, pred,64, pbW,pbH,
+                                 lambda, mvd_bits(mv, mvp[0]));
 
-        if (cost<mincost) {
-          mincost=cost;
+  enum MVSubpelRefinement subpel = mParams.subpel();
 
-          spec.mvd[0][0]=(mx-x)<<2;
-          spec.mvd[0][1]=(my-y)<<2;
+  if (subpel != MVSubpelRefinement_None) {
+    static const int8_t square[8][2] = {
+      {-1,-1}, { 0,-1}, { 1,-1}, {-1, 0}, { 1, 0}, {-1, 1}, { 0, 1}, { 1, 1}
+    };
+
+    for (int step = 2; step >= (subpel==MVSubpelRefinement_Quarter ? 1 : 2); step--) {
+      MotionVector center = mv;
+
+      for (int i=0;i<8;i++) {
+        MotionVector q;
+        q.x = center.x + square[i][0]*step;
+        q.y = center.y + square[i][1]*step;
+
+        mHalfPelCache[l].predict(ectx->acceleration, x,y, q.x,q.y, pbW,pbH, pred,64);
+        int cost = prediction_cost(ectx->acceleration, s.src,s.srcStride, pred,64, pbW,pbH,
+                                   lambda, mvd_bits(q, mvp[0]));
+
+        if (cost < bestCost) {
+          bestCost = cost;
+          mv = q;
         }
       }
+    }
+  }
 
-  spec.mvd[0][0] -= mvp[0].x;
-  spec.mvd[0][1] -= mvp[0].y;
+  return bestCost;
+}
 
-  vec.mv[0].x = mvp[0].x + spec.mvd[0][0];
-  vec.mv[0].y = mvp[0].y + spec.mvd[0][1];
-  vec.predFlag[0] = 1;
-  vec.predFlag[1] = 0;
 
-  ectx->img->set_mv_info(x,y,pbW,pbH, vec);
+enc_cb* Algo_PB_MV_Search::analyze(encoder_context* ectx,
+                                   context_model_table& ctxModel,
+                                   enc_cb* cb,
+                                   int PBidx, int x,int y,int pbW,int pbH)
+{
+  PBMotionCoding& spec = cb->inter.pb[PBidx].spec;
+  PBMotion&        vec = cb->inter.pb[PBidx].motion;
 
-  /* TMP REMOVE: ectx->prediction does not exist anymore
-  generate_inter_prediction_samples(ectx, ectx->shdr, ectx->prediction,
-                                    cb->x,cb->y, // int xC,int yC,
-                                    0,0,         // int xB,int yB,
-                                    1<<cb->log2Size, // int nCS,
-                                    1<<cb->log2Size,
-                                    1<<cb->log2Size, // int nPbW,int nPbH,
-                                    &vec);
-  */
+  spec.merge_flag = 0;
+  spec.merge_idx  = 0;
 
-  // --- create residual ---
+  int numLists = (ectx->shdr->slice_type == SLICE_TYPE_B ? 2 : 1);
 
+  int lambda = (int)(sqrt(ectx->get_lambda(cb->y)) * 16 + 0.5);
 
 
-  // TODO estimate rate for sending MV
+  // --- uni-directional search in each list ---
 
-  int IntraSplitFlag = 0;
-  int MaxTrafoDepth = ectx->get_sps().max_transform_hierarchy_depth_inter;
+  MotionVector mvp[2][2]; // [L0/L1][candidate]
+  MotionVector mv[2];
+  int cost[2];
+
+  for (int l=0;l<numLists;l++) {
+    fill_luma_motion_vector_predictors(ectx, ectx->shdr, ectx->img,
+                                       cb->x,cb->y,1<<cb->log2Size, x,y,pbW,pbH,
+                                       l,
+                                       0, 0, // int refIdx, int partIdx,
+                                       mvp[l]);
+
+    cost[l] = search(ectx, cb, PBidx, x,y,pbW,pbH, l, lambda, mvp[l], mv[l]);
+  }
+
+  enum InterPredIdc predIdc = PRED_L0;
+
+  if (numLists==2) {
+    // approximate rate of inter_pred_idc (8x4 and 4x8 PBs cannot be bi-predicted)
 
-  mCodeResidual=true;
-  if (mCodeResidual) {
-    assert(false);
-    /*
-    cb->transform_tree = mTBSplitAlgo->analyze(ectx,ctxModel, ectx->imgdata->input, NULL, cb,
-                                               cb->x,cb->y,cb->x,cb->y, cb->log2Size,0,
-                                               0, MaxTrafoDepth, IntraSplitFlag);
-    */
+    bool biAllowed = (pbW+pbH != 12);
+    int uniBits = (biAllowed ? 2 : 1);
 
-    cb->inter.rqt_root_cbf = ! cb->transform_tree->isZeroBlock();
+    cost[0] += (lambda*uniBits) >> 4;
+    cost[1] += (lambda*uniBits) >> 4;
 
-    cb->distortion = cb->transform_tree->distortion;
-    cb->rate       = cb->transform_tree->rate;
+    if (cost[1] < cost[0]) {
+      predIdc = PRED_L1;
+    }
+
+
+    // --- bi-prediction from the two uni-directional vectors ---
+
+    if (biAllowed) {
+      const de265_image* inputimg = ectx->imgdata->input;
+      const uint8_t* src = inputimg->get_image_plane_at_pos(0,x,y);
+      int srcStride = inputimg->get_image_stride(0);
+
+      ALIGNED_16(uint8_t) pred0[64*64];
+      ALIGNED_16(uint8_t) pred1[64*64];
+      ALIGNED_16(uint8_t) bipred[64*64];
+
+      mHalfPelCache[0].predict(ectx->acceleration, x,y, mv[0].x,mv[0].y, pbW,pbH, pred0,64);
+
+      int bestBiCost = std::numeric_limits<int>::max();
+      MotionVector bestMV1 = mv[1];
+
+      // Refine the L1 vector on the bi-predicted block, with the L0 prediction fixed.
+      // (The vector moves by less than two samples, which stays within the reference padding.)
+
+      static const int8_t cross[5][2] = {
+        { 0, 0}, {-1, 0}, { 1, 0}, { 0,-1}, { 0, 1}
+      };
+
+      for (int step = 4; step >= 1; step /= 2) {
+        MotionVector center = bestMV1;
+
+        for (int i=(step==4 ? 0 : 1); i<5; i++) {
+          MotionVector q;
+          q.x = center.x + cross[i][0]*step;
+          q.y = center.y + cross[i][1]*step;
+
+          mHalfPelCache[1].predict(ectx->acceleration, x,y, q.x,q.y, pbW,pbH, pred1,64);
+
+          for (int py=0;py<pbH;py++)
+            for (int px=0;px<pbW;px++) {
+              bipred[py*64+px] = (pred0[py*64+px] + pred1[py*64+px] + 1) >> 1;
+            }
+
+          int c = prediction_cost(ectx->acceleration, src,srcStride, bipred,64, pbW,pbH,
+                                  lambda, (mvd_bits(mv[0], mvp[0][0]) +
+                                           mvd_bits(q,     mvp[1][0]) + 1));
+          if (c < bestBiCost) {
+            bestBiCost = c;
+            bestMV1 = q;
+          }
+        }
+      }
+
+      if (bestBiCost < std::min(cost[0],cost[1])) {
+        predIdc = PRED_BI;
+        mv[1] = bestMV1;
+      }
+    }
   }
-  else {
-    const de265_image* input = ectx->imgdata->input;
-    de265_image* img   = ectx->img;
-    int x0 = cb->x;
-    int y0 = cb->y;
-    int tbSize = 1<<cb->log2Size;
 
-    cb->distortion = compute_distortion_ssd(input, img, x0,y0, cb->log2Size, 0);
-    cb->rate = 5; // fake (MV)
 
-    cb->inter.rqt_root_cbf = 0;
+  // --- write the motion of the selected prediction ---
+
+  spec.inter_pred_idc = predIdc;
+  spec.mvp_l0_flag = 0;
+  spec.mvp_l1_flag = 0;
+
+  for (int l=0;l<2;l++) {
+    bool used = (predIdc==PRED_BI || predIdc==(l==0 ? PRED_L0 : PRED_L1));
+
+    spec.refIdx[l] = vec.refIdx[l] = 0;
+    vec.predFlag[l] = used;
+
+    if (used) {
+      spec.mvd[l][0] = mv[l].x - mvp[l][0].x;
+      spec.mvd[l][1] = mv[l].y - mvp[l][0].y;
+      vec.mv[l] = mv[l];
+    }
+    else {
+      spec.mvd[l][0] = spec.mvd[l][1] = 0;
+      vec.mv[l].x = vec.mv[l].y = 0;
+    }
   }
 
-  delete[] bits_h;
-  delete[] bits_v;
+  ectx->img->set_mv_info(x,y,pbW,pbH, vec);
 
-  return cb;
+  generate_inter_prediction_samples(ectx, ectx->shdr, ectx->img,
+                                    cb->x,cb->y,         // int xC,int yC,
+                                    x-cb->x,y-cb->y,     // int xB,int yB,
+                                    1<<cb->log2Size,     // int nCS,
+                                    pbW,pbH,             // int nPbW,int nPbH,
+                                    &vec);
+
+  return code_residual(ectx, ctxModel, cb);
 }
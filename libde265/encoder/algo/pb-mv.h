@@ -33,9 +33,12 @@
 #include "libde265/quality.h"
 #include "libde265/fallback.h"
 #include "libde265/configparam.h"
+#include "libde265/threads.h"
 
 #include "libde265/encoder/algo/algo.h"
 
+#include <vector>
+
 
 // ========== CB Intra/Inter decision ==========
 
@@ -52,6 +55,11 @@ class Algo_PB_MV : public Algo_PB
 
  protected:
   Algo_TB_Split* mTBSplitAlgo;
+
+  /* Code the residual of the motion-compensated prediction (already written into
+     ectx->img) with mTBSplitAlgo and set the rate and distortion of the CB.
+   */
+  enc_cb* code_residual(encoder_context*, context_model_table&, enc_cb* cb);
 };
 
 
@@ -80,7 +88,7 @@ class option_MVTestMode : public choice_option<enum MVTestMode>
 class Algo_PB_MV_Test : public Algo_PB_MV
 {
  public:
- Algo_PB_MV_Test() : mCodeResidual(false) { }
+ Algo_PB_MV_Test() { }
 
   struct params
   {
@@ -108,8 +116,6 @@ class Algo_PB_MV_Test : public Algo_PB_MV
 
  private:
   params mParams;
-
-  bool mCodeResidual;
 };
 
 
@@ -120,6 +126,7 @@ enum MVSearchAlgo
     MVSearchAlgo_Zero,
     MVSearchAlgo_Full,
     MVSearchAlgo_Diamond,
+    MVSearchAlgo_Hexagon,
     MVSearchAlgo_PMVFast
   };
 
@@ -130,15 +137,78 @@ class option_MVSearchAlgo : public choice_option<enum MVSearchAlgo>
     add_choice("zero",   MVSearchAlgo_Zero);
     add_choice("full",   MVSearchAlgo_Full, true);
     add_choice("diamond",MVSearchAlgo_Diamond);
+    add_choice("hexagon",MVSearchAlgo_Hexagon);
     add_choice("pmvfast",MVSearchAlgo_PMVFast);
   }
 };
 
 
+enum MVSubpelRefinement
+  {
+    MVSubpelRefinement_None,
+    MVSubpelRefinement_Half,
+    MVSubpelRefinement_Quarter
+  };
+
+class option_MVSubpelRefinement : public choice_option<enum MVSubpelRefinement>
+{
+ public:
+  option_MVSubpelRefinement() {
+    add_choice("none",   MVSubpelRefinement_None);
+    add_choice("half",   MVSubpelRefinement_Half);
+    add_choice("quarter",MVSubpelRefinement_Quarter, true);
+  }
+};
+
+
+/* Luma prediction from a reference picture at quarter-pel positions.
+   The three half-pel planes of the whole picture are interpolated once per
+   reference picture and shared by all PBs (and all threads) of a picture.
+   Quarter-pel positions are interpolated on demand.
+ */
+class halfpel_plane_cache
+{
+ public:
+  halfpel_plane_cache();
+  ~halfpel_plane_cache();
+
+  // Interpolate the planes of 'ref' unless they are already cached for this frame number.
+  void prepare(const acceleration_functions& accel, const de265_image* ref, int frame_number);
+
+  // Uni-directional luma prediction of the block at (x;y) with the quarter-pel vector (mvx;mvy).
+  void predict(const acceleration_functions& accel,
+               int x,int y, int mvx,int mvy, int w,int h,
+               uint8_t* out, int outStride) const;
+
+ private:
+  enum { RefPadding = 8, PlanePadding = 2 };
+
+  de265_mutex mMutex;
+
+  int mFrameNumber; // -1 when empty
+  int mWidth, mHeight;
+
+  std::vector<uint8_t> mRef; // reference luma with replicated borders
+  int mRefStride;
+
+  std::vector<uint8_t> mPlane[3]; // half-pel planes for fractions (2,0), (0,2), (2,2)
+  int mPlaneStride;
+
+  const uint8_t* ref_at(int x,int y) const {
+    return &mRef[(y+RefPadding)*mRefStride + x+RefPadding];
+  }
+};
+
+
+/* Motion search in the first reference picture of each list. The search range is given
+   for adjacent pictures and grows with the POC distance to the reference picture.
+   In B slices, the best L0, L1 and bi-prediction (both vectors, with the L1 vector
+   refined on the bi-predicted block) are compared.
+ */
 class Algo_PB_MV_Search : public Algo_PB_MV
 {
  public:
- Algo_PB_MV_Search() : mCodeResidual(false) { }
+ Algo_PB_MV_Search() { }
 
   struct params
   {
@@ -146,6 +216,7 @@ class Algo_PB_MV_Search : public Algo_PB_MV
       mvSearchAlgo.set_ID("PB-MV-Search-Algo");
       hrange.set_ID      ("PB-MV-Search-HRange");
       vrange.set_ID      ("PB-MV-Search-VRange");
+      subpel.set_ID      ("PB-MV-Search-Subpel");
       hrange.set_default(8);
       vrange.set_default(8);
     }
@@ -153,12 +224,14 @@ class Algo_PB_MV_Search : public Algo_PB_MV
     option_MVSearchAlgo mvSearchAlgo;
     option_int        hrange;
     option_int        vrange;
+    option_MVSubpelRefinement subpel;
   };
 
   void registerParams(config_parameters& config) {
     config.add_option(&mParams.mvSearchAlgo);
     config.add_option(&mParams.hrange);
     config.add_option(&mParams.vrange);
+    config.add_option(&mParams.subpel);
   }
 
   void setParams(const params& p) { mParams=p; }
@@ -171,7 +244,12 @@ class Algo_PB_MV_Search : public Algo_PB_MV
  private:
   params mParams;
 
-  bool mCodeResidual;
+  halfpel_plane_cache mHalfPelCache[2]; // [L0/L1]
+
+  // search the reference picture RefPicList[l][0], returns the cost of the best vector 'mv'
+  int search(encoder_context*, enc_cb* cb, int PBidx,
+             int x,int y,int pbW,int pbH, int l, int lambda,
+             const MotionVector mvp[2], MotionVector& mv);
 };
 
 #endif
@@ -82,19 +82,17 @@ float estim_TB_bitrate(const encoder_context* ectx,
   switch (method)
     {
     case TBBitrateEstim_SSD:
-      return SSD(input->get_image_plane_at_pos(0, x0,y0),
-                 input->get_image_stride(0),
-                 tb->intra_prediction[0]->get_buffer_u8(),
-                 tb->intra_prediction[0]->getStride(),
-                 blkSize, blkSize);
+      return ectx->acceleration.ssd_8[tb->log2Size-2](input->get_image_plane_at_pos(0, x0,y0),
+                                                      input->get_image_stride(0),
+                                                      tb->intra_prediction[0]->get_buffer_u8(),
+                                                      tb->intra_prediction[0]->getStride());
       break;
 
     case TBBitrateEstim_SAD:
-      return SAD(input->get_image_plane_at_pos(0, x0,y0),
-                 input->get_image_stride(0),
-                 tb->intra_prediction[0]->get_buffer_u8(),
-                 tb->intra_prediction[0]->getStride(),
-                 blkSize, blkSize);
+      return ectx->acceleration.sad_8[tb->log2Size-2](input->get_image_plane_at_pos(0, x0,y0),
+                                                      input->get_image_stride(0),
+                                                      tb->intra_prediction[0]->get_buffer_u8(),
+                                                      tb->intra_prediction[0]->getStride());
       break;
 
     case TBBitrateEstim_SATD_DCT:
@@ -505,7 +503,147 @@ Algo_TB_IntraPredMode_FastBrute::analyze(encoder_context* ectx,
                                                          opt_tb->intra_mode,
                                                          intraModeC,
                                                          option[i].get_context(),
-                                                         tb->blkIdx == 0);
+                                                         opt_tb->blkIdx == 0);
+
+      opt_tb->rate_withoutCbfChroma += intraPredModeBits;
+      opt_tb->rate += intraPredModeBits;
+
+      option[i].end();
+    }
+
+
+    options.compute_rdo_costs();
+
+    return options.return_best_rdo_node();
+  }
+  else {
+    descend(tb,"NOP");
+    enc_tb* new_tb = mTBSplitAlgo->analyze(ectx, ctxModel, input, tb,
+                                           TrafoDepth, MaxTrafoDepth, IntraSplitFlag);
+    ascend();
+    return new_tb;
+  }
+
+  assert(false);
+  return nullptr;
+}
+
+
+enc_tb*
+Algo_TB_IntraPredMode_RMD::analyze(encoder_context* ectx,
+                                   context_model_table& ctxModel,
+                                   const de265_image* input,
+                                   enc_tb* tb,
+                                   int TrafoDepth, int MaxTrafoDepth, int IntraSplitFlag)
+{
+  enc_cb* cb = tb->cb;
+
+  bool selectIntraPredMode = false;
+  selectIntraPredMode |= (cb->PredMode==MODE_INTRA && cb->PartMode==PART_2Nx2N && TrafoDepth==0);
+  selectIntraPredMode |= (cb->PredMode==MODE_INTRA && cb->PartMode==PART_NxN   && TrafoDepth==1);
+
+  if (selectIntraPredMode) {
+    enum IntraPredMode candidates[3];
+    fillIntraPredModeCandidates(candidates, tb->x,tb->y,
+                                tb->x>0, tb->y>0, ectx->ctbs, &ectx->get_sps());
+
+
+    // --- rough mode decision: SATD of the prediction + estimated mode bits ---
+
+    int log2TbSize = tb->log2Size;
+    tb->intra_prediction[0] = std::make_shared<small_image_buffer>(log2TbSize, sizeof(uint8_t));
+
+    // The Hadamard transform is not normalized. Scale the rate term so that it matches
+    // a SATD that is in the range of the SAD (64x64 blocks are computed as 32x32 blocks).
+    float satdScale = std::min(1<<log2TbSize, 32) / 2.0f;
+    float lambdaMode = satdScale * sqrtf(ectx->get_lambda(tb->y));
+
+    std::vector< std::pair<enum IntraPredMode,float> > costs;
+
+    for (int idx=0;idx<nPredModesEnabled();idx++) {
+      enum IntraPredMode mode = getPredMode(idx);
+
+      tb->intra_mode = mode;
+      decode_intra_prediction_from_tree(ectx->img, tb, ectx->ctbs, ectx->get_sps(), 0);
+
+      float modeBits;
+      /**/ if (mode==candidates[0]) { modeBits = 1; }
+      else if (mode==candidates[1] ||
+               mode==candidates[2]) { modeBits = 2; }
+      else                          { modeBits = 5; }
+
+      float satd = estim_TB_bitrate(ectx, input, tb, TBBitrateEstim_SATD_Hadamard);
+
+      costs.push_back( std::make_pair(mode, satd + lambdaMode * modeBits) );
+    }
+
+    std::sort( costs.begin(), costs.end(), sortDistortions );
+
+    int keepNBest = (log2TbSize <= 3 ? mParams.keepNBestSmall() : mParams.keepNBest());
+    keepNBest = std::min(keepNBest, (int)costs.size());
+    costs.resize(keepNBest);
+
+    // always check the most probable modes
+
+    for (int c=0;c<3;c++) {
+      if (!isPredModeEnabled(candidates[c])) { continue; }
+
+      bool inList = false;
+      for (size_t i=0;i<costs.size();i++) {
+        if (costs[i].first == candidates[c]) { inList=true; break; }
+      }
+
+      if (!inList) {
+        costs.push_back(std::make_pair(candidates[c],0));
+      }
+    }
+
+
+    // --- full RDO on the remaining modes ---
+
+    CodingOptions<enc_tb> options(ectx, tb, ctxModel);
+    std::vector<CodingOption<enc_tb> >  option;
+
+    for (size_t i=0;i<costs.size();i++) {
+      CodingOption<enc_tb> opt = options.new_option(true);
+      opt.get_node()->intra_mode = costs[i].first;
+      option.push_back(opt);
+    }
+
+    options.start();
+
+
+    for (size_t i=0;i<option.size();i++) {
+
+      enc_tb* opt_tb = option[i].get_node();
+
+      *opt_tb->downPtr = opt_tb;
+
+      // set chroma mode to same mode is its luma mode
+      enum IntraPredMode intraModeC;
+      if (cb->PartMode==PART_2Nx2N || ectx->get_sps().ChromaArrayType==CHROMA_444) {
+        intraModeC = opt_tb->intra_mode;
+      }
+      else {
+        intraModeC = opt_tb->parent->children[0]->intra_mode;
+      }
+
+      opt_tb->intra_mode_chroma = intraModeC;
+
+      option[i].begin();
+
+      descend(opt_tb,"%d",opt_tb->intra_mode);
+      opt_tb = mTBSplitAlgo->analyze(ectx,option[i].get_context(),input,opt_tb,
+                                     TrafoDepth, MaxTrafoDepth, IntraSplitFlag);
+      option[i].set_node(opt_tb);
+      ascend();
+
+
+      float intraPredModeBits = get_intra_pred_mode_bits(candidates,
+                                                         opt_tb->intra_mode,
+                                                         intraModeC,
+                                                         option[i].get_context(),
+                                                         opt_tb->blkIdx == 0);
 
       opt_tb->rate_withoutCbfChroma += intraPredModeBits;
       opt_tb->rate += intraPredModeBits;
@@ -42,7 +42,8 @@
 enum ALGO_TB_IntraPredMode {
   ALGO_TB_IntraPredMode_BruteForce,
   ALGO_TB_IntraPredMode_FastBrute,
-  ALGO_TB_IntraPredMode_MinResidual
+  ALGO_TB_IntraPredMode_MinResidual,
+  ALGO_TB_IntraPredMode_RMD
 };
 
 class option_ALGO_TB_IntraPredMode : public choice_option<enum ALGO_TB_IntraPredMode>
@@ -52,6 +53,7 @@ class option_ALGO_TB_IntraPredMode : public choice_option<enum ALGO_TB_IntraPred
     add_choice("min-residual",ALGO_TB_IntraPredMode_MinResidual);
     add_choice("brute-force" ,ALGO_TB_IntraPredMode_BruteForce);
     add_choice("fast-brute"  ,ALGO_TB_IntraPredMode_FastBrute, true);
+    add_choice("rmd"         ,ALGO_TB_IntraPredMode_RMD);
   }
 };
 
@@ -294,4 +296,50 @@ class Algo_TB_IntraPredMode_MinResidual : public Algo_TB_IntraPredMode_ModeSubse
   params mParams;
 };
 
+
+/** Rough mode decision: all modes are ranked by the Hadamard SATD of their prediction
+    plus the estimated mode-signalling cost. Only the best N modes and the three most
+    probable modes are passed through the full RDO of TB split and transform.
+ */
+class Algo_TB_IntraPredMode_RMD : public Algo_TB_IntraPredMode_ModeSubset
+{
+ public:
+
+  struct params
+  {
+    params() {
+      keepNBest.set_ID("IntraPredMode-RMD-keepNBest");
+      keepNBest.set_range(1,35);
+      keepNBest.set_default(3);
+
+      keepNBestSmall.set_ID("IntraPredMode-RMD-keepNBest-small");
+      keepNBestSmall.set_range(1,35);
+      keepNBestSmall.set_default(8);
+    }
+
+    option_int keepNBest;      // for TBs of 16x16 and larger
+    option_int keepNBestSmall; // for 4x4 and 8x8 TBs
+  };
+
+  void registerParams(config_parameters& config) {
+    config.add_option(&mParams.keepNBest);
+    config.add_option(&mParams.keepNBestSmall);
+  }
+
+  void setParams(const params& p) { mParams=p; }
+
+
+  virtual enc_tb* analyze(encoder_context*,
+                          context_model_table&,
+                          const de265_image* input,
+                          enc_tb* tb,
+                          int TrafoDepth, int MaxTrafoDepth, int IntraSplitFlag);
+
+
+  const char* name() const { return "tb-intrapredmode_RMD"; }
+
+ private:
+  params mParams;
+};
+
 #endif
@@ -105,11 +105,19 @@ void compute_residual_channel(encoder_context* ectx, enc_tb* tb, const de265_ima
     mode = tb->intra_mode_chroma;
   }
 
-  // decode intra prediction
-
   tb->intra_prediction[cIdx] = std::make_shared<small_image_buffer>(log2Size, sizeof(pixel_t));
 
-  decode_intra_prediction_from_tree(ectx->img, tb, ectx->ctbs, ectx->get_sps(), cIdx);
+  if (tb->cb->PredMode == MODE_INTRA) {
+    // decode intra prediction
+
+    decode_intra_prediction_from_tree(ectx->img, tb, ectx->ctbs, ectx->get_sps(), cIdx);
+  }
+  else {
+    // the PB algorithm has put the motion-compensated prediction into the image
+
+    PixelAccessor predPixels(*tb->intra_prediction[cIdx], x,y);
+    predPixels.copyFromImage(ectx->img, cIdx);
+  }
 
   // create residual buffer and compute differences
 
@@ -203,9 +211,7 @@ Algo_TB_Split_BruteForce::analyze(encoder_context* ectx,
     //tb_no_split = new enc_tb(*tb);
     *tb->downPtr = tb_no_split;
 
-    if (cb->PredMode == MODE_INTRA) {
-      compute_residual<uint8_t>(ectx, tb_no_split, input, tb->blkIdx);
-    }
+    compute_residual<uint8_t>(ectx, tb_no_split, input, tb->blkIdx);
 
     tb_no_split = mAlgo_TB_Residual->analyze(ectx, option_no_split.get_context(),
                                              input, tb_no_split, TrafoDepth,MaxTrafoDepth,IntraSplitFlag);
@@ -309,7 +315,7 @@ enc_tb* Algo_TB_Split::encode_transform_tree_split(encoder_context* ectx,
     int dx = (i&1)  << (log2TbSize-1);
     int dy = (i>>1) << (log2TbSize-1);
 
-    enc_tb* child_tb = new enc_tb(x0+dx,y0+dy, log2TbSize-1,cb);
+    enc_tb* child_tb = ectx->get_node_arena(y0).create<enc_tb>(x0+dx,y0+dy, log2TbSize-1,cb);
 
     child_tb->intra_mode        = tb->intra_mode;
     child_tb->intra_mode_chroma = tb->intra_mode_chroma;
@@ -70,53 +70,20 @@ void compute_transform_coeffs(encoder_context* ectx,
 
   enum PredMode predMode = cb->PredMode;
 
-  int16_t blk[32*32]; // residual
-  int16_t* residual;
-
-
-  //printf("transform-coeffs %d;%d size:%d cIdx:%d\n", tb->x,tb->y,1<<tb->log2Size,cIdx);
-
-  // --- do intra prediction ---
-
-  if (predMode==MODE_INTRA) {
-    residual = tb->residual[cIdx]->get_buffer_s16();
-
-    //printf("intra residual: %p stride: %d\n",residual, tb->residual[cIdx]->get_stride());
-  }
-  else {
-    // --- subtract prediction from input image ---
-
-    /* TMP REMOVE: ectx->prediction does not exist anymore
-
-    uint8_t* pred = ectx->prediction->get_image_plane(cIdx);
-    int stride = ectx->prediction->get_image_stride(cIdx);
-
-    //printBlk("input",input->get_image_plane_at_pos(cIdx,xC,yC), tbSize, input->get_image_stride(cIdx));
-    //printBlk("prediction", pred,tbSize, stride);
-
-    diff_blk(blk,tbSize,
-             input->get_image_plane_at_pos(cIdx,xC,yC), input->get_image_stride(cIdx),
-             &pred[yC*stride+xC],stride, tbSize);
-
-    residual=blk;
-    */
-
-    //printBlk("residual", blk,tbSize,tbSize);
-  }
-
-
+  // residual of intra or motion-compensated prediction (computed in tb-split)
 
+  int16_t* residual = tb->residual[cIdx]->get_buffer_s16();
 
 
   // --- forward transform ---
 
-  tb->alloc_coeff_memory(cIdx, tbSize);
+  tb->alloc_coeff_memory(ectx->get_node_arena(tb->y), cIdx, tbSize);
 
 
   // transformation mode (DST or DCT)
 
   int trType;
-  if (cIdx==0 && log2TbSize==2 && predMode==MODE_INTRA) trType=1; // TODO: inter mode
+  if (cIdx==0 && log2TbSize==2 && predMode==MODE_INTRA) trType=1;
   else trType=0;
 
 
@@ -127,7 +94,8 @@ void compute_transform_coeffs(encoder_context* ectx,
 
   // --- quantization ---
 
-  quant_coefficients(tb->coeff[cIdx], tb->coeff[cIdx], log2TbSize,  cb->qp, true);
+  quant_coefficients(tb->coeff[cIdx], tb->coeff[cIdx], log2TbSize,
+                     cb->get_qp(cIdx, ectx->get_sps()), predMode==MODE_INTRA);
 
 
   // set CBF to 0 if there are no non-zero coefficients
@@ -244,11 +212,10 @@ enc_tb* Algo_TB_Transform::analyze(encoder_context* ectx,
 
   // measure distortion
 
-  int tbSize = 1<<log2TbSize;
-  tb->distortion = SSD(input->get_image_plane_at_pos(0, x0,y0), input->get_image_stride(0),
-                       tb->reconstruction[0]->get_buffer_u8(),
-                       tb->reconstruction[0]->getStride(),
-                       tbSize, tbSize);
+  tb->distortion = ectx->acceleration.ssd_8[log2TbSize-2](input->get_image_plane_at_pos(0, x0,y0),
+                                                          input->get_image_stride(0),
+                                                          tb->reconstruction[0]->get_buffer_u8(),
+                                                          tb->reconstruction[0]->getStride());
 
   return tb;
 }
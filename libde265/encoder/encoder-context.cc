@@ -24,6 +24,7 @@
 #include "libde265/util.h"
 
 #include <math.h>
+#include <algorithm>
 
 
 encoder_context::encoder_context()
@@ -47,6 +48,10 @@ encoder_context::encoder_context()
 
   use_adaptive_context = true; //false;
 
+  num_worker_threads = 0;
+
+  de265_mutex_init(&mNodeArenaMutex);
+
   //enc_coeff_pool.set_blk_size(64*64*20); // TODO: this a guess
 
   //switch_CABAC_to_bitstream();
@@ -59,10 +64,57 @@ encoder_context::encoder_context()
 
 encoder_context::~encoder_context()
 {
+  if (num_worker_threads>0) {
+    ::stop_thread_pool(&thread_pool_);
+  }
+
   while (!output_packets.empty()) {
     en265_free_packet(this, output_packets.front());
     output_packets.pop_front();
   }
+
+  de265_mutex_destroy(&mNodeArenaMutex);
+}
+
+
+void encoder_context::acquire_node_arena(int ctbY)
+{
+  de265_mutex_lock(&mNodeArenaMutex);
+
+  if (mFreeNodeArenas.empty()) {
+    mNodeArenas.push_back(std::make_shared<enc_node_arena>());
+    mFreeNodeArenas.push_back(mNodeArenas.back().get());
+  }
+
+  mRowNodeArena[ctbY] = mFreeNodeArenas.back();
+  mFreeNodeArenas.pop_back();
+
+  de265_mutex_unlock(&mNodeArenaMutex);
+}
+
+
+void encoder_context::release_node_arena(int ctbY)
+{
+  de265_mutex_lock(&mNodeArenaMutex);
+
+  mRowNodeArena[ctbY]->reset();
+  mFreeNodeArenas.push_back(mRowNodeArena[ctbY]);
+  mRowNodeArena[ctbY] = NULL;
+
+  de265_mutex_unlock(&mNodeArenaMutex);
+}
+
+
+de265_error encoder_context::start_thread_pool(int nThreads)
+{
+  de265_error err = ::start_thread_pool(&thread_pool_, nThreads);
+  if (err != DE265_OK) {
+    return err;
+  }
+
+  num_worker_threads = nThreads;
+
+  return DE265_OK;
 }
 
 
@@ -76,6 +128,11 @@ void encoder_context::start_encoder()
   if (params.sop_structure() == SOP_Intra) {
     sop = std::shared_ptr<sop_creator_intra_only>(new sop_creator_intra_only());
   }
+  else if (params.sop_structure() == SOP_RandomAccess) {
+    auto s = std::shared_ptr<sop_creator_random_access>(new sop_creator_random_access());
+    s->setParams(params.mSOP_RandomAccess);
+    sop = s;
+  }
   else {
     auto s = std::shared_ptr<sop_creator_trivial_low_delay>(new sop_creator_trivial_low_delay());
     s->setParams(params.mSOP_LowDelay);
@@ -85,11 +142,56 @@ void encoder_context::start_encoder()
   sop->set_encoder_context(this);
   sop->set_encoder_picture_buffer(&picbuf);
 
+  if (params.lookaheadDepth > 0) {
+    lookahead.start(&acceleration, params.lookaheadDepth, params.sceneCutThreshold);
+  }
+
 
   encoder_started=true;
 }
 
 
+void encoder_context::push_input_image(de265_image* img)
+{
+  if (lookahead.is_running()) {
+    lookahead.push_image(img);
+  }
+  else {
+    sop->insert_new_input_image(img, lookahead_costs());
+  }
+}
+
+
+void encoder_context::push_end_of_stream()
+{
+  if (lookahead.is_running()) {
+    lookahead.push_end_of_stream();
+  }
+  else {
+    sop->insert_end_of_stream();
+  }
+}
+
+
+void encoder_context::pass_lookahead_pictures_to_sop()
+{
+  if (!lookahead.is_running()) {
+    return;
+  }
+
+  de265_image* img;
+  lookahead_costs costs;
+
+  while (lookahead.get_next_picture(&img, &costs)) {
+    sop->insert_new_input_image(img, costs);
+  }
+
+  if (lookahead.end_of_stream_reached()) {
+    sop->insert_end_of_stream();
+  }
+}
+
+
 en265_packet* encoder_context::create_packet(en265_packet_content_type t)
 {
   en265_packet* pck = new en265_packet;
@@ -152,6 +254,19 @@ de265_error encoder_context::encode_headers()
     exit(10);
   }
 
+  // the VPS signals the same temporal sub-layers and DPB size as the SPS
+
+  int topLayer = sps->sps_max_sub_layers-1;
+  vps->vps_max_sub_layers = sps->sps_max_sub_layers;
+  vps->vps_temporal_id_nesting_flag = sps->sps_temporal_id_nesting_flag;
+  vps->layer[topLayer].vps_max_dec_pic_buffering = sps->sps_max_dec_pic_buffering[topLayer]-1;
+  vps->layer[topLayer].vps_max_num_reorder_pics  = sps->sps_max_num_reorder_pics[topLayer];
+  vps->layer[topLayer].vps_max_latency_increase  = sps->sps_max_latency_increase_plus1[topLayer];
+
+
+  mRowNodeArena.resize(sps->PicHeightInCtbsY, NULL);
+  mRowQScale.resize(sps->PicHeightInCtbsY);
+
 
   // PPS
 
@@ -159,12 +274,19 @@ de265_error encoder_context::encode_headers()
   pps->sps = sps.get();
   pps->pic_init_qp = algo.getPPS_QP();
 
+  // rate control adapts the QP per CTB
+  pps->cu_qp_delta_enabled_flag = algo.getAlgoCTBQScale()->uses_cu_qp_delta();
+  pps->diff_cu_qp_delta_depth = 0;
+
   // turn off deblocking filter
   pps->deblocking_filter_control_present_flag = true;
   pps->deblocking_filter_override_enabled_flag = false;
   pps->pic_disable_deblocking_filter_flag = true;
   pps->pps_loop_filter_across_slices_enabled_flag = false;
 
+  // with worker threads, CTB rows are encoded in parallel (WPP)
+  pps->entropy_coding_sync_enabled_flag = (num_worker_threads > 0);
+
   pps->set_derived_values(sps.get());
 
 
@@ -208,6 +330,34 @@ de265_error encoder_context::encode_headers()
 }
 
 
+void encoder_context::set_entry_points(slice_segment_header& shdr) const
+{
+  int nRows = sps->PicHeightInCtbsY;
+
+  shdr.num_entry_point_offsets = nRows-1;
+  shdr.entry_point_offset.resize(nRows-1);
+
+  int offset = 0;
+  int maxSize = 1;
+
+  for (int y=0;y<nRows-1;y++) {
+    int size = wpp_substreams[y]->bitstream.size();
+
+    offset += size;
+    shdr.entry_point_offset[y] = offset;
+
+    maxSize = std::max(maxSize, size);
+  }
+
+  // number of bits needed to code offset_minus1 values up to maxSize-1
+
+  shdr.offset_len = 1;
+  while ((maxSize-1) >> shdr.offset_len) {
+    shdr.offset_len++;
+  }
+}
+
+
 de265_error encoder_context::encode_picture_from_input_buffer()
 {
   if (!picbuf.have_more_frames_to_encode()) {
@@ -228,13 +378,6 @@ de265_error encoder_context::encode_picture_from_input_buffer()
   if (!parameters_have_been_set) {
     algo.setParams(params);
 
-
-    // TODO: must be <30, because Y->C mapping (tab8_22) is not implemented yet
-    int qp = algo.getPPS_QP();
-
-    //lambda = ectx->params.lambda;
-    lambda = 0.0242 * pow(1.27245, qp);
-
     parameters_have_been_set = true;
   }
 
@@ -263,6 +406,9 @@ de265_error encoder_context::encode_picture_from_input_buffer()
 
   // slice
 
+  Algo_CTB_QScale* qscale = algo.getAlgoCTBQScale();
+
+  imgdata->shdr.slice_qp_delta = qscale->start_picture(this, imgdata) - pps->pic_init_qp;
   imgdata->shdr.slice_deblocking_filter_disabled_flag = true;
   imgdata->shdr.slice_loop_filter_across_slices_enabled_flag = false;
   imgdata->shdr.compute_derived_values(pps.get());
@@ -271,20 +417,41 @@ de265_error encoder_context::encode_picture_from_input_buffer()
 
   //shdr.slice_pic_order_cnt_lsb = poc & 0xFF;
 
-  imgdata->nal.write(cabac_encoder);
-  imgdata->shdr.write(this, cabac_encoder, sps.get(), pps.get(), imgdata->nal.nal_unit_type);
-  cabac_encoder.add_trailing_bits();
-  cabac_encoder.flush_VLC();
+  if (!pps->entropy_coding_sync_enabled_flag) {
+    imgdata->nal.write(cabac_encoder);
+    imgdata->shdr.write(this, cabac_encoder, sps.get(), pps.get(), imgdata->nal.nal_unit_type);
+    cabac_encoder.add_trailing_bits();
+    cabac_encoder.flush_VLC();
 
 
-  // encode image
+    // encode image
 
-  cabac_encoder.init_CABAC();
-  double psnr = encode_image(this,imgdata->input, algo);
-  loginfo(LogEncoder,"  PSNR-Y: %f\n", psnr);
-  cabac_encoder.flush_CABAC();
-  cabac_encoder.add_trailing_bits();
-  cabac_encoder.flush_VLC();
+    cabac_encoder.init_CABAC();
+    double psnr = encode_image(this,imgdata->input, algo);
+    loginfo(LogEncoder,"  PSNR-Y: %f\n", psnr);
+    cabac_encoder.flush_CABAC();
+    cabac_encoder.add_trailing_bits();
+    cabac_encoder.flush_VLC();
+  }
+  else {
+    // With WPP, the slice header contains the entry points of the CTB-row substreams.
+    // Hence, we encode the image first and write the slice header afterwards.
+
+    double psnr = encode_image(this,imgdata->input, algo);
+    loginfo(LogEncoder,"  PSNR-Y: %f\n", psnr);
+
+    set_entry_points(imgdata->shdr);
+
+    imgdata->nal.write(cabac_encoder);
+    imgdata->shdr.write(this, cabac_encoder, sps.get(), pps.get(), imgdata->nal.nal_unit_type);
+    cabac_encoder.add_trailing_bits();
+    cabac_encoder.flush_VLC();
+
+    for (int y=0;y<sps->PicHeightInCtbsY;y++) {
+      const CABAC_encoder_bitstream& substream = wpp_substreams[y]->bitstream;
+      cabac_encoder.append_escaped_data(substream.data(), substream.size());
+    }
+  }
 
 
   // set reconstruction image
@@ -295,6 +462,8 @@ de265_error encoder_context::encode_picture_from_input_buffer()
   this->imgdata = NULL;
   this->shdr = NULL;
 
+  qscale->end_picture(this, cabac_encoder.size()*8);
+
   // build output packet
 
   en265_packet* pck = create_packet(EN265_PACKET_SLICE);
@@ -33,6 +33,16 @@
 #include "libde265/util.h"
 
 #include <memory>
+#include <vector>
+
+
+/* CABAC output of one CTB row when encoding with wavefront parallel processing. */
+struct wpp_substream
+{
+  CABAC_encoder_bitstream bitstream;
+  context_model_table     ctx_models;
+  context_model_table     ctx_models_sync; // after the second CTB, continued in the next row
+};
 
 
 class encoder_context : public base_context
@@ -80,10 +90,6 @@ class encoder_context : public base_context
   //int prediction_x0,prediction_y0;
 
 
-  int active_qp; // currently active QP
-  /*int target_qp;*/ /* QP we want to code at.
-                     (Not actually the real QP. Check image.get_QPY() for that.) */
-
   const seq_parameter_set& get_sps() const { return *sps; }
   const pic_parameter_set& get_pps() const { return *pps; }
 
@@ -107,12 +113,41 @@ class encoder_context : public base_context
   encoder_picture_buffer picbuf;
   std::shared_ptr<sop_creator> sop;
 
+  encoder_lookahead lookahead;
+
+  // input pictures pass through the lookahead (when enabled) before the SOP creator
+  void push_input_image(de265_image*);
+  void push_end_of_stream();
+  void pass_lookahead_pictures_to_sop();
+
   std::deque<en265_packet*> output_packets;
 
 
   // --- rate-control ---
 
-  float lambda;
+  /* QP and RDO lambda of the CTB that is currently analysed in the CTB row containing
+     luma position 'y'. They are set by the Algo_CTB_QScale before each CTB.
+   */
+  int   get_active_qp(int y) const { return mRowQScale[y >> sps->Log2CtbSizeY].qp; }
+  float get_lambda(int y) const    { return mRowQScale[y >> sps->Log2CtbSizeY].lambda; }
+
+  void set_active_qscale(int y, int qp, float lambda) {
+    ctb_qscale& q = mRowQScale[y >> sps->Log2CtbSizeY];
+    q.qp = qp;
+    q.lambda = lambda;
+  }
+
+  int lastQPY; // QpY of the last coded CU, QP prediction when CTB rows are coded sequentially
+
+ private:
+  struct ctb_qscale {
+    int   qp;
+    float lambda;
+  };
+
+  std::vector<ctb_qscale> mRowQScale;
+
+ public:
 
 
   // --- CABAC output and rate estimation ---
@@ -128,6 +163,41 @@ class encoder_context : public base_context
 
   bool use_adaptive_context;
 
+  // one substream per CTB row, used when entropy_coding_sync is enabled
+  std::vector<std::shared_ptr<wpp_substream> > wpp_substreams;
+
+
+  // --- memory for the enc_cb/enc_tb nodes ---
+
+  /* Arena for the nodes of the CTB that is currently analysed in the CTB row containing
+     luma position 'y'. Each CTB row in progress holds its own arena.
+   */
+  enc_node_arena& get_node_arena(int y) { return *mRowNodeArena[y >> sps->Log2CtbSizeY]; }
+
+  void acquire_node_arena(int ctbY);
+  void release_node_arena(int ctbY);
+
+ private:
+  std::vector<std::shared_ptr<enc_node_arena> > mNodeArenas;
+  std::vector<enc_node_arena*> mFreeNodeArenas;
+  std::vector<enc_node_arena*> mRowNodeArena;
+  de265_mutex mNodeArenaMutex;
+
+ public:
+
+
+  // --- worker threads ---
+
+  de265_error start_thread_pool(int nThreads);
+  int get_num_worker_threads() const { return num_worker_threads; }
+
+  thread_pool thread_pool_;
+
+ private:
+  int num_worker_threads;
+
+ public:
+
 
   /*** TODO: CABAC_encoder direkt an encode-Funktion übergeben, anstatt hier
        aussenrum zwischenzuspeichern (mit undefinierter Lifetime).
@@ -157,6 +227,9 @@ class encoder_context : public base_context
   de265_error encode_headers();
   de265_error encode_picture_from_input_buffer();
 
+  // set the slice header entry points from the sizes of the WPP substreams
+  void set_entry_points(slice_segment_header& shdr) const;
+
 
   // Input images can be released after encoding and when the output packet is released.
   // This is important to do as soon as possible, as the image might actually wrap
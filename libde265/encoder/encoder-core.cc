@@ -124,41 +124,50 @@ void print_cb_tree_rates(const enc_cb* cb, int level)
 
 // /*LIBDE265_API*/ ImageSink_YUV reconstruction_sink;
 
-double encode_image(encoder_context* ectx,
-                    const de265_image* input,
-                    EncoderCore& algo)
+/* Analyze and write one CTB row. With WPP, the row is coded into its own substream and
+   each CTB waits until the CTB above-right has been coded. 'task' is NULL when the
+   rows are encoded sequentially in the main thread.
+ */
+static double encode_ctb_row(encoder_context* ectx,
+                             EncoderCore& algo,
+                             int ctbY,
+                             thread_task* task)
 {
-  int stride=input->get_image_stride(0);
+  const seq_parameter_set& sps = ectx->get_sps();
+  const bool wpp = ectx->get_pps().entropy_coding_sync_enabled_flag;
 
-  int w = ectx->get_sps().pic_width_in_luma_samples;
-  int h = ectx->get_sps().pic_height_in_luma_samples;
+  const int ctbW = sps.PicWidthInCtbsY;
+  const int ctbH = sps.PicHeightInCtbsY;
+  const int Log2CtbSize = sps.Log2CtbSizeY;
 
-  // --- create reconstruction image ---
-  ectx->img = new de265_image;
-  ectx->img->set_headers(ectx->get_shared_vps(), ectx->get_shared_sps(), ectx->get_shared_pps());
-  ectx->img->PicOrderCntVal = input->PicOrderCntVal;
+  de265_image* img = ectx->img;
 
-  ectx->img->alloc_image(w,h, input->get_chroma_format(), ectx->get_shared_sps(), true,
-                         NULL /* no decctx */, ectx, 0,NULL,false);
-  //ectx->img->alloc_encoder_data(&ectx->sps);
-  ectx->img->clear_metadata();
 
-#if 0
-  if (1) {
-    ectx->prediction = new de265_image;
-    ectx->prediction->alloc_image(w,h, input->get_chroma_format(), &ectx->sps, false /* no metadata */,
-                                  NULL /* no decctx */, NULL /* no encctx */, 0,NULL,false);
-    ectx->prediction->vps = ectx->vps;
-    ectx->prediction->sps = ectx->sps;
-    ectx->prediction->pps = ectx->pps;
-  }
-#endif
+  // --- select CABAC output ---
 
-  ectx->active_qp = ectx->get_pps().pic_init_qp; // TODO take current qp from slice
+  CABAC_encoder_bitstream* cabac;
+  wpp_substream* substream = NULL;
 
+  if (wpp) {
+    substream = ectx->wpp_substreams[ctbY].get();
+    cabac = &substream->bitstream;
+    cabac->reset();
 
-  ectx->cabac_ctx_models.init(ectx->shdr->initType, ectx->shdr->SliceQPY);
-  ectx->cabac_encoder.set_context_models(&ectx->cabac_ctx_models);
+    // continue with the context models after the second CTB of the row above
+
+    if (ctbY>0 && ctbW>1) {
+      img->wait_for_progress(task, 1,ctbY-1, CTB_PROGRESS_PREFILTER);
+      substream->ctx_models = ectx->wpp_substreams[ctbY-1]->ctx_models_sync.transfer();
+    }
+    else {
+      substream->ctx_models.init(ectx->shdr->initType, ectx->shdr->SliceQPY);
+    }
+
+    cabac->set_context_models(&substream->ctx_models);
+  }
+  else {
+    cabac = &ectx->cabac_encoder;
+  }
 
 
   context_model_table modelEstim;
@@ -167,127 +176,232 @@ double encode_image(encoder_context* ectx,
   modelEstim.init(ectx->shdr->initType, ectx->shdr->SliceQPY);
   cabacEstim.set_context_models(&modelEstim);
 
+  ectx->acquire_node_arena(ctbY);
+  enc_node_arena& arena = ectx->get_node_arena(ctbY<<Log2CtbSize);
 
-  int Log2CtbSize = ectx->get_sps().Log2CtbSizeY;
+  Algo_CTB_QScale* qscale = algo.getAlgoCTBQScale();
 
-  uint8_t* luma_plane = ectx->img->get_image_plane(0);
-  uint8_t* cb_plane   = ectx->img->get_image_plane(1);
-  uint8_t* cr_plane   = ectx->img->get_image_plane(2);
+  // with WPP, the QP prediction restarts at the slice QP in each CTB row
+  int qPY_PRED = (wpp ? ectx->shdr->SliceQPY : ectx->lastQPY);
 
   double mse=0;
 
+  for (int x=0;x<ctbW;x++)
+    {
+      if (wpp && ctbY>0) {
+        img->wait_for_progress(task, std::min(x+1,ctbW-1),ctbY-1, CTB_PROGRESS_PREFILTER);
+      }
+
+      int x0 = x<<Log2CtbSize;
+      int y0 = ctbY<<Log2CtbSize;
 
-  // encode CTB by CTB
+      logtrace(LogSlice,"encode CTB at %d %d\n",x0,y0);
+
+      // make a copy of the context model that we can modify for testing alternatives
+
+      context_model_table ctxModel;
+      ctxModel = modelEstim.copy(); // TODO: start from the bitstream models
+
+      enc_cb* cb = qscale->analyze(ectx,ctxModel, x0,y0);
+
+      //print_cb_tree_rates(cb,0);
+
+      //statistics_IntraPredMode(ectx, x0,y0, cb);
 
-  ectx->ctbs.clear();
 
-  for (int y=0;y<ectx->get_sps().PicHeightInCtbsY;y++)
-    for (int x=0;x<ectx->get_sps().PicWidthInCtbsY;x++)
-      {
-        ectx->img->set_SliceAddrRS(x, y, ectx->shdr->SliceAddrRS);
+      // --- write bitstream ---
 
-        int x0 = x<<Log2CtbSize;
-        int y0 = y<<Log2CtbSize;
+      logdebug(LogEncoder,"write CTB %d;%d\n",x,ctbY);
 
-        logtrace(LogSlice,"encode CTB at %d %d\n",x0,y0);
+      if (logdebug_enabled(LogEncoder)) {
+        cb->debug_dumpTree(enc_tb::DUMPTREE_ALL);
+      }
+
+      int bitsBefore = cabac->get_num_written_bits();
 
-        // make a copy of the context model that we can modify for testing alternatives
+      int qPY_CTB = encode_ctb(ectx, cabac, cb, x,ctbY, qPY_PRED);
 
-        context_model_table ctxModel;
-        //copy_context_model_table(ctxModel, ectx->ctx_model_bitstream);
-        ctxModel = ectx->cabac_ctx_models.copy();
-        ctxModel = modelEstim.copy(); // TODO TMP
+      qscale->ctb_coded(ectx, x,ctbY, cabac->get_num_written_bits() - bitsBefore);
 
-        disable_logging(LogSymbols);
-        enable_logging(LogSymbols);  // TODO TMP
 
-        //printf("================================================== ANALYZE\n");
+      if (COMPARE_ESTIMATED_RATE_TO_REAL_RATE) {
+        float realPre = cabacEstim.getRDBits();
+        encode_ctb(ectx, &cabacEstim, cb, x,ctbY, qPY_PRED);
+        float realPost = cabacEstim.getRDBits();
 
-#if 1
-        /*
-          enc_cb* cb = encode_cb_may_split(ectx, ctxModel,
-          input, x0,y0, Log2CtbSize, 0, qp);
-        */
+        printf("estim: %f  real: %f  diff: %f\n",
+               cb->rate,
+               realPost-realPre,
+               cb->rate - (realPost-realPre));
+      }
 
-        enc_cb* cb = algo.getAlgoCTBQScale()->analyze(ectx,ctxModel, x0,y0);
-#else
-        float minCost = std::numeric_limits<float>::max();
-        int bestQ = 0;
-        int qp = ectx->params.constant_QP;
 
-        enc_cb* cb;
-        for (int q=1;q<51;q++) {
-          copy_context_model_table(ctxModel, ectx->ctx_model_bitstream);
+      if (wpp && x==1) {
+        substream->ctx_models_sync = substream->ctx_models.copy();
+      }
 
-          enc_cb* cbq = encode_cb_may_split(ectx, ctxModel,
-                                            input, x0,y0, Log2CtbSize, 0, q);
+      int last = (ctbY==ctbH-1 && x==ctbW-1);
+      cabac->write_CABAC_term_bit(last);
 
-          float cost = cbq->distortion + ectx->lambda * cbq->rate;
-          if (cost<minCost) { minCost=cost; bestQ=q; }
+      // end of WPP substream
 
-          if (q==qp) { cb=cbq; }
+      if (wpp && x==ctbW-1) {
+        if (!last) {
+          cabac->write_CABAC_term_bit(1); // end_of_subset_one_bit
         }
 
-        printf("Q %d\n",bestQ);
-        fflush(stdout);
-#endif
+        cabac->flush_CABAC();
+        cabac->add_trailing_bits();
+        cabac->flush_VLC();
+      }
+
+      qPY_PRED = qPY_CTB;
+
+      mse += cb->distortion;
 
-        //print_cb_tree_rates(cb,0);
+      // keep only the final CTB tree and release all nodes of the analysis
 
-        //statistics_IntraPredMode(ectx, x0,y0, cb);
+      ectx->ctbs.setCTB(x,ctbY, cb, sps);
+      arena.reset();
 
+      img->ctb_progress[x+ctbY*ctbW].set_progress(CTB_PROGRESS_PREFILTER);
+    }
 
-        // --- write bitstream ---
+  ectx->release_node_arena(ctbY);
 
-        //ectx->switch_CABAC_to_bitstream();
+  if (!wpp) {
+    ectx->lastQPY = qPY_PRED;
+  }
 
-        enable_logging(LogSymbols);
+  return mse;
+}
 
-        logdebug(LogEncoder,"write CTB %d;%d\n",x,y);
 
-        if (logdebug_enabled(LogEncoder)) {
-          cb->debug_dumpTree(enc_tb::DUMPTREE_ALL);
-        }
+class thread_task_encode_ctb_row : public thread_task
+{
+public:
+  encoder_context* ectx;
+  EncoderCore* algo;
+  int    ctbY;
+  double mse;
+
+  virtual void work();
+  virtual std::string name() const;
+};
 
-        /*
-        cb->debug_assertTreeConsistency(ectx->img);
 
-        //cb->invalidateMetadataInSubTree(ectx->img);
-        cb->writeMetadata(ectx, ectx->img,
-                          enc_node::METADATA_INTRA_MODES |
-                          enc_node::METADATA_RECONSTRUCTION |
-                          enc_node::METADATA_CT_DEPTH);
+void thread_task_encode_ctb_row::work()
+{
+  state = Running;
+  ectx->img->thread_run(this);
 
-        cb->debug_assertTreeConsistency(ectx->img);
-        */
+  mse = encode_ctb_row(ectx, *algo, ctbY, this);
 
-        encode_ctb(ectx, &ectx->cabac_encoder, cb, x,y);
+  state = Finished;
+  ectx->img->thread_finishes(this);
+}
 
-        //printf("================================================== WRITE\n");
 
+std::string thread_task_encode_ctb_row::name() const
+{
+  char buf[100];
+  sprintf(buf,"encode-row-%d",ctbY);
+  return buf;
+}
 
-        if (COMPARE_ESTIMATED_RATE_TO_REAL_RATE) {
-          float realPre = cabacEstim.getRDBits();
-          encode_ctb(ectx, &cabacEstim, cb, x,y);
-          float realPost = cabacEstim.getRDBits();
 
-          printf("estim: %f  real: %f  diff: %f\n",
-                 cb->rate,
-                 realPost-realPre,
-                 cb->rate - (realPost-realPre));
-        }
+double encode_image(encoder_context* ectx,
+                    const de265_image* input,
+                    EncoderCore& algo)
+{
+  int w = ectx->get_sps().pic_width_in_luma_samples;
+  int h = ectx->get_sps().pic_height_in_luma_samples;
+
+  // --- create reconstruction image ---
+  ectx->img = new de265_image;
+  ectx->img->set_headers(ectx->get_shared_vps(), ectx->get_shared_sps(), ectx->get_shared_pps());
+  ectx->img->PicOrderCntVal = input->PicOrderCntVal;
+
+  ectx->img->alloc_image(w,h, input->get_chroma_format(), ectx->get_shared_sps(), true,
+                         NULL /* no decctx */, ectx, 0,NULL,false);
+  //ectx->img->alloc_encoder_data(&ectx->sps);
+  ectx->img->clear_metadata();
+
+#if 0
+  if (1) {
+    ectx->prediction = new de265_image;
+    ectx->prediction->alloc_image(w,h, input->get_chroma_format(), &ectx->sps, false /* no metadata */,
+                                  NULL /* no decctx */, NULL /* no encctx */, 0,NULL,false);
+    ectx->prediction->vps = ectx->vps;
+    ectx->prediction->sps = ectx->sps;
+    ectx->prediction->pps = ectx->pps;
+  }
+#endif
 
+  ectx->lastQPY = ectx->shdr->SliceQPY;
 
-        int last = (y==ectx->get_sps().PicHeightInCtbsY-1 &&
-                    x==ectx->get_sps().PicWidthInCtbsY-1);
-        ectx->cabac_encoder.write_CABAC_term_bit(last);
 
-        //delete cb;
+  const int ctbW = ectx->get_sps().PicWidthInCtbsY;
+  const int ctbH = ectx->get_sps().PicHeightInCtbsY;
+  const bool wpp = ectx->get_pps().entropy_coding_sync_enabled_flag;
 
-        //ectx->free_all_pools();
+  if (wpp) {
+    // one substream per CTB row
 
-        mse += cb->distortion;
+    ectx->wpp_substreams.resize(ctbH);
+    for (int y=0;y<ctbH;y++) {
+      if (!ectx->wpp_substreams[y]) {
+        ectx->wpp_substreams[y] = std::make_shared<wpp_substream>();
       }
+    }
+  }
+  else {
+    ectx->cabac_ctx_models.init(ectx->shdr->initType, ectx->shdr->SliceQPY);
+    ectx->cabac_encoder.set_context_models(&ectx->cabac_ctx_models);
+  }
+
+
+  // all CTBs belong to the same slice (set in advance, as they are needed for the
+  // availability checks of concurrently coded CTB rows)
+
+  for (int y=0;y<ctbH;y++)
+    for (int x=0;x<ctbW;x++) {
+      ectx->img->set_SliceAddrRS(x, y, ectx->shdr->SliceAddrRS);
+    }
+
+
+  double mse=0;
+
+
+  // encode CTB by CTB
+
+  ectx->ctbs.clear();
+
+  if (wpp && ectx->get_num_worker_threads()>0) {
+    std::vector<thread_task_encode_ctb_row> tasks(ctbH);
+
+    ectx->img->thread_start(ctbH);
+
+    for (int y=0;y<ctbH;y++) {
+      tasks[y].ectx = ectx;
+      tasks[y].algo = &algo;
+      tasks[y].ctbY = y;
+      tasks[y].mse  = 0;
+
+      add_task(&ectx->thread_pool_, &tasks[y]);
+    }
+
+    ectx->img->wait_for_completion();
+
+    for (int y=0;y<ctbH;y++) {
+      mse += tasks[y].mse;
+    }
+  }
+  else {
+    for (int y=0;y<ctbH;y++) {
+      mse += encode_ctb_row(ectx, algo, y, NULL);
+    }
+  }
 
   mse /= ectx->img->get_width() * ectx->img->get_height();
 
@@ -332,11 +446,42 @@ void EncoderCore_Custom::setParams(encoder_params& params)
 {
   // build algorithm tree
 
-  mAlgo_CTB_QScale_Constant.setChildAlgo(&mAlgo_CB_Split_BruteForce);
-  mAlgo_CB_Split_BruteForce.setChildAlgo(&mAlgo_CB_Skip_BruteForce);
+  switch (params.rateControlMethod()) {
+  case RateControlMethod_ConstantQP:
+    mAlgo_CTB_QScale = &mAlgo_CTB_QScale_Constant;
+    break;
+  case RateControlMethod_ABR:
+  case RateControlMethod_CBR:
+    mAlgo_CTB_QScale = &mAlgo_CTB_QScale_RateControl;
+    mAlgo_CTB_QScale_RateControl.setVBVEnabled(params.rateControlMethod() == RateControlMethod_CBR);
+    break;
+  }
+
+  Algo_CB_Split* algo_CB_Split = NULL;
+  switch (params.mAlgo_CB_Split()) {
+  case ALGO_CB_Split_BruteForce:
+    algo_CB_Split = &mAlgo_CB_Split_BruteForce;
+    break;
+  case ALGO_CB_Split_Fast:
+    algo_CB_Split = &mAlgo_CB_Split_Fast;
+    break;
+  }
+
+  Algo_CB_Skip* algo_CB_Skip = NULL;
+  switch (params.mAlgo_CB_Skip()) {
+  case ALGO_CB_Skip_BruteForce:
+    algo_CB_Skip = &mAlgo_CB_Skip_BruteForce;
+    break;
+  case ALGO_CB_Skip_Fast:
+    algo_CB_Skip = &mAlgo_CB_Skip_Fast;
+    break;
+  }
+
+  mAlgo_CTB_QScale->setChildAlgo(algo_CB_Split);
+  algo_CB_Split->setChildAlgo(algo_CB_Skip);
 
-  mAlgo_CB_Skip_BruteForce.setSkipAlgo(&mAlgo_CB_MergeIndex_Fixed);
-  mAlgo_CB_Skip_BruteForce.setNonSkipAlgo(&mAlgo_CB_IntraInter_BruteForce);
+  algo_CB_Skip->setSkipAlgo(&mAlgo_CB_MergeIndex_Fixed);
+  algo_CB_Skip->setNonSkipAlgo(&mAlgo_CB_IntraInter_BruteForce);
   //&mAlgo_CB_InterPartMode_Fixed);
 
   Algo_CB_IntraPartMode* algo_CB_IntraPartMode = NULL;
@@ -364,6 +509,9 @@ void EncoderCore_Custom::setParams(encoder_params& params)
     break;
   }
 
+  // the test modes only generate artificial vectors, use inter prediction with a real search
+  mAlgo_CB_IntraInter_BruteForce.set_try_inter(params.mAlgo_MEMode() == MEMode_Search);
+
   mAlgo_CB_InterPartMode_Fixed.setChildAlgo(pbAlgo);
   pbAlgo->setChildAlgo(&mAlgo_TB_Split_BruteForce);
 
@@ -379,6 +527,9 @@ void EncoderCore_Custom::setParams(encoder_params& params)
   case ALGO_TB_IntraPredMode_MinResidual:
     algo_TB_IntraPredMode = &mAlgo_TB_IntraPredMode_MinResidual;
     break;
+  case ALGO_TB_IntraPredMode_RMD:
+    algo_TB_IntraPredMode = &mAlgo_TB_IntraPredMode_RMD;
+    break;
   }
 
   algo_CB_IntraPartMode->setChildAlgo(algo_TB_IntraPredMode);
@@ -87,24 +87,40 @@ class EncoderCore_Custom : public EncoderCore
 
   void registerParams(config_parameters& config) {
     mAlgo_CTB_QScale_Constant.registerParams(config);
+    mAlgo_CTB_QScale_RateControl.registerParams(config);
+    mAlgo_CB_Split_Fast.registerParams(config);
+    mAlgo_CB_Skip_Fast.registerParams(config);
     mAlgo_CB_IntraPartMode_Fixed.registerParams(config);
     mAlgo_CB_InterPartMode_Fixed.registerParams(config);
     mAlgo_PB_MV_Test.registerParams(config);
     mAlgo_PB_MV_Search.registerParams(config);
     mAlgo_TB_IntraPredMode_FastBrute.registerParams(config);
     mAlgo_TB_IntraPredMode_MinResidual.registerParams(config);
+    mAlgo_TB_IntraPredMode_RMD.registerParams(config);
     mAlgo_TB_Split_BruteForce.registerParams(config);
   }
 
-  virtual Algo_CTB_QScale* getAlgoCTBQScale() { return &mAlgo_CTB_QScale_Constant; }
+  virtual Algo_CTB_QScale* getAlgoCTBQScale() { return mAlgo_CTB_QScale; }
 
-  virtual int getPPS_QP() const { return mAlgo_CTB_QScale_Constant.getQP(); }
+  virtual int getPPS_QP() const {
+    if (mAlgo_CTB_QScale == &mAlgo_CTB_QScale_RateControl) {
+      return mAlgo_CTB_QScale_RateControl.getPPS_QP();
+    }
+    else {
+      return mAlgo_CTB_QScale_Constant.getQP();
+    }
+  }
 
  private:
+  Algo_CTB_QScale*                 mAlgo_CTB_QScale;
+
   Algo_CTB_QScale_Constant         mAlgo_CTB_QScale_Constant;
+  Algo_CTB_QScale_RateControl      mAlgo_CTB_QScale_RateControl;
 
   Algo_CB_Split_BruteForce         mAlgo_CB_Split_BruteForce;
+  Algo_CB_Split_Fast               mAlgo_CB_Split_Fast;
   Algo_CB_Skip_BruteForce          mAlgo_CB_Skip_BruteForce;
+  Algo_CB_Skip_Fast                mAlgo_CB_Skip_Fast;
   Algo_CB_IntraInter_BruteForce    mAlgo_CB_IntraInter_BruteForce;
 
   Algo_CB_IntraPartMode_BruteForce mAlgo_CB_IntraPartMode_BruteForce;
@@ -121,6 +137,7 @@ class EncoderCore_Custom : public EncoderCore
   Algo_TB_IntraPredMode_BruteForce  mAlgo_TB_IntraPredMode_BruteForce;
   Algo_TB_IntraPredMode_FastBrute   mAlgo_TB_IntraPredMode_FastBrute;
   Algo_TB_IntraPredMode_MinResidual mAlgo_TB_IntraPredMode_MinResidual;
+  Algo_TB_IntraPredMode_RMD         mAlgo_TB_IntraPredMode_RMD;
 
   Algo_TB_Transform                 mAlgo_TB_Transform;
   Algo_TB_RateEstimation_None       mAlgo_TB_RateEstimation_None;
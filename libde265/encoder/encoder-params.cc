@@ -34,8 +34,6 @@ static std::vector<int> power2range(int low,int high)
 
 encoder_params::encoder_params()
 {
-  //rateControlMethod = RateControlMethod_ConstantQP;
-
   min_cb_size.set_ID("min-cb-size"); min_cb_size.set_valid_values(power2range(8,64)); min_cb_size.set_default(8);
   max_cb_size.set_ID("max-cb-size"); max_cb_size.set_valid_values(power2range(8,64)); max_cb_size.set_default(32);
   min_tb_size.set_ID("min-tb-size"); min_tb_size.set_valid_values(power2range(4,32)); min_tb_size.set_default(4);
@@ -51,12 +49,24 @@ encoder_params::encoder_params()
 
   sop_structure.set_ID("sop-structure");
 
+  lookaheadDepth.set_ID("lookahead");
+  lookaheadDepth.set_range(0,250);
+  lookaheadDepth.set_default(10);
+
+  sceneCutThreshold.set_ID("scenecut");
+  sceneCutThreshold.set_range(0,100);
+  sceneCutThreshold.set_default(40);
+
   mAlgo_TB_IntraPredMode.set_ID("TB-IntraPredMode");
   mAlgo_TB_IntraPredMode_Subset.set_ID("TB-IntraPredMode-subset");
   mAlgo_CB_IntraPartMode.set_ID("CB-IntraPartMode");
+  mAlgo_CB_Split.set_ID("CB-Split");
+  mAlgo_CB_Skip.set_ID("CB-Skip");
 
   mAlgo_TB_RateEstimation.set_ID("TB-RateEstimation");
 
+  rateControlMethod.set_ID("rate-control");
+
   mAlgo_MEMode.set_ID("MEMode");
 }
 
@@ -72,12 +82,19 @@ void encoder_params::registerParams(config_parameters& config)
 
   config.add_option(&sop_structure);
 
+  config.add_option(&lookaheadDepth);
+  config.add_option(&sceneCutThreshold);
+
   config.add_option(&mAlgo_TB_IntraPredMode);
   config.add_option(&mAlgo_TB_IntraPredMode_Subset);
   config.add_option(&mAlgo_CB_IntraPartMode);
+  config.add_option(&mAlgo_CB_Split);
+  config.add_option(&mAlgo_CB_Skip);
 
   config.add_option(&mAlgo_MEMode);
   config.add_option(&mAlgo_TB_RateEstimation);
+  config.add_option(&rateControlMethod);
 
   mSOP_LowDelay.registerParams(config);
+  mSOP_RandomAccess.registerParams(config);
 }
@@ -31,9 +31,20 @@
 enum RateControlMethod
   {
     RateControlMethod_ConstantQP,
-    RateControlMethod_ConstantLambda
+    RateControlMethod_ABR,  // average bitrate
+    RateControlMethod_CBR   // constant bitrate with VBV buffer constraint
   };
 
+class option_RateControlMethod : public choice_option<enum RateControlMethod>
+{
+ public:
+  option_RateControlMethod() {
+    add_choice("constant-qp", RateControlMethod_ConstantQP, true);
+    add_choice("abr",         RateControlMethod_ABR);
+    add_choice("cbr",         RateControlMethod_CBR);
+  }
+};
+
 enum IntraPredSearch
   {
     IntraPredSearch_Complete
@@ -43,7 +54,8 @@ enum IntraPredSearch
 enum SOP_Structure
   {
     SOP_Intra,
-    SOP_LowDelay
+    SOP_LowDelay,
+    SOP_RandomAccess
   };
 
 class option_SOP_Structure : public choice_option<enum SOP_Structure>
@@ -52,6 +64,7 @@ class option_SOP_Structure : public choice_option<enum SOP_Structure>
   option_SOP_Structure() {
     add_choice("intra",     SOP_Intra);
     add_choice("low-delay", SOP_LowDelay, true);
+    add_choice("random-access", SOP_RandomAccess);
   }
 };
 
@@ -94,6 +107,13 @@ struct encoder_params
   option_SOP_Structure sop_structure;
 
   sop_creator_trivial_low_delay::params mSOP_LowDelay;
+  sop_creator_random_access::params mSOP_RandomAccess;
+
+
+  // lookahead
+
+  option_int lookaheadDepth;     // number of pictures, 0: no lookahead
+  option_int sceneCutThreshold;  // percent, 0: no scene-cut detection
 
 
   // --- Algo_TB_IntraPredMode
@@ -118,6 +138,14 @@ struct encoder_params
 
   // --- Algo_CB_Split
 
+  option_ALGO_CB_Split mAlgo_CB_Split;
+
+
+  // --- Algo_CB_Skip
+
+  option_ALGO_CB_Skip mAlgo_CB_Skip;
+
+
   // --- Algo_CTB_QScale
 
   //Algo_CTB_QScale_Constant::params    CTB_QScale_Constant;
@@ -132,7 +160,7 @@ struct encoder_params
 
   // rate-control
 
-  enum RateControlMethod rateControlMethod;
+  option_RateControlMethod rateControlMethod;
   option_ALGO_TB_RateEstimation mAlgo_TB_RateEstimation;
 
   //int constant_QP;
@@ -348,6 +348,34 @@ void encode_cbf_chroma(CABAC_encoder* cabac,
   cabac->write_CABAC_bit(CONTEXT_MODEL_CBF_CHROMA + context, cbf_chroma);
 }
 
+
+static void encode_cu_qp_delta(CABAC_encoder* cabac, int CuQpDelta)
+{
+  logtrace(LogSymbols,"$1 cu_qp_delta=%d\n",CuQpDelta);
+  logtrace(LogSlice,"> cu_qp_delta = %d\n",CuQpDelta);
+
+  int cu_qp_delta_abs = abs(CuQpDelta);
+
+  // prefix: TU binarization with cMax=5, first bin with its own context
+
+  int prefix = std::min(cu_qp_delta_abs, 5);
+
+  for (int i=0;i<prefix;i++) {
+    cabac->write_CABAC_bit(CONTEXT_MODEL_CU_QP_DELTA_ABS + (i==0 ? 0 : 1), 1);
+  }
+
+  if (prefix<5) {
+    cabac->write_CABAC_bit(CONTEXT_MODEL_CU_QP_DELTA_ABS + (prefix==0 ? 0 : 1), 0);
+  }
+  else {
+    cabac->write_CABAC_EGk(cu_qp_delta_abs-5, 0);
+  }
+
+  if (cu_qp_delta_abs) {
+    cabac->write_CABAC_bypass(CuQpDelta<0);
+  }
+}
+
 static inline void encode_coded_sub_block_flag(encoder_context* ectx,
                                                CABAC_encoder* cabac,
                                                int cIdx,
@@ -1149,12 +1177,14 @@ void encode_transform_unit(encoder_context* ectx,
 {
   ESTIM_BITS_BEGIN;
 
-  if (tb->cbf[0] || tb->cbf[1] || tb->cbf[2]) {
-    if (ectx->img->get_pps().cu_qp_delta_enabled_flag &&
-        true /*!ectx->IsCuQpDeltaCoded*/) {
-      assert(0);
-    }
+  /* Note: for 4x4 luma blocks, the decoder checks the chroma CBFs of the parent.
+     Hence, cu_qp_delta may be coded in a TU without CBFs of its own (see encode_ctb()). */
+  if (tb->code_cu_qp_delta) {
+    assert(ectx->img->get_pps().cu_qp_delta_enabled_flag);
+    encode_cu_qp_delta(cabac, tb->CuQpDelta);
+  }
 
+  if (tb->cbf[0] || tb->cbf[1] || tb->cbf[2]) {
     if (tb->cbf[0]) {
       encode_residual(ectx,cabac, tb,cb,x0,y0,log2TrafoSize,0);
     }
@@ -1349,9 +1379,9 @@ void encode_merge_idx(encoder_context* ectx,
 }
 
 
-static inline void encode_rqt_root_cbf(encoder_context* ectx,
-                                       CABAC_encoder* cabac,
-                                       int rqt_root_cbf)
+void encode_rqt_root_cbf(encoder_context* ectx,
+                         CABAC_encoder* cabac,
+                         int rqt_root_cbf)
 {
   logtrace(LogSymbols,"$1 rqt_root_cbf=%d\n",rqt_root_cbf);
   cabac->write_CABAC_bit(CONTEXT_MODEL_RQT_ROOT_CBF, rqt_root_cbf);
@@ -1394,6 +1424,23 @@ void encode_mvd(encoder_context* ectx,
 }
 
 
+static void encode_inter_pred_idc(CABAC_encoder* cabac,
+                                  enum InterPredIdc inter_pred_idc,
+                                  int nPbW, int nPbH, int ctDepth)
+{
+  logtrace(LogSymbols,"$1 inter_pred_idc=%d\n",inter_pred_idc);
+
+  if (nPbW+nPbH != 12) {
+    cabac->write_CABAC_bit(CONTEXT_MODEL_INTER_PRED_IDC + ctDepth, inter_pred_idc==PRED_BI);
+    if (inter_pred_idc==PRED_BI) {
+      return;
+    }
+  }
+
+  cabac->write_CABAC_bit(CONTEXT_MODEL_INTER_PRED_IDC + 4, inter_pred_idc==PRED_L1);
+}
+
+
 void encode_prediction_unit(encoder_context* ectx,
                             CABAC_encoder* cabac,
                             const enc_cb* cb, int pbIdx,
@@ -1409,7 +1456,7 @@ void encode_prediction_unit(encoder_context* ectx,
   }
   else {
     if (ectx->shdr->slice_type == SLICE_TYPE_B) {
-      assert(false); // TODO
+      encode_inter_pred_idc(cabac, (enum InterPredIdc)pb.spec.inter_pred_idc, w,h, cb->ctDepth);
     }
 
     if (pb.spec.inter_pred_idc != PRED_L1) {
@@ -1425,7 +1472,17 @@ void encode_prediction_unit(encoder_context* ectx,
     }
 
     if (pb.spec.inter_pred_idc != PRED_L0) {
-      assert(false); // TODO
+      if (ectx->shdr->num_ref_idx_l1_active > 1) {
+        assert(false); // TODO
+      }
+
+      // with mvd_l1_zero_flag, the L1 MVD of bi-predicted PBs is not coded
+      if (!(ectx->shdr->mvd_l1_zero_flag && pb.spec.inter_pred_idc == PRED_BI)) {
+        encode_mvd(ectx,cabac, pb.spec.mvd[1]);
+      }
+
+      logtrace(LogSymbols,"$1 mvp_lx_flag=%d\n",pb.spec.mvp_l1_flag);
+      cabac->write_CABAC_bit(CONTEXT_MODEL_MVP_LX_FLAG, pb.spec.mvp_l1_flag);
     }
 
     /*
@@ -1700,9 +1757,61 @@ void encode_quadtree(encoder_context* ectx,
 }
 
 
-void encode_ctb(encoder_context* ectx,
-                CABAC_encoder* cabac,
-                enc_cb* cb, int ctbX,int ctbY)
+/* First TU in decoding order in which the decoder reads cu_qp_delta, i.e. the first TU
+   with coded luma or chroma residual.
+ */
+static enc_tb* find_first_coded_tb(enc_tb* tb, int ChromaArrayType)
+{
+  if (tb->split_transform_flag) {
+    for (int i=0;i<4;i++) {
+      enc_tb* coded_tb = find_first_coded_tb(tb->children[i], ChromaArrayType);
+      if (coded_tb) {
+        return coded_tb;
+      }
+    }
+
+    return NULL;
+  }
+
+  bool cbfChroma = (tb->cbf[1] || tb->cbf[2]);
+
+  // 4x4 luma blocks use the chroma CBFs of their parent
+  if (tb->log2Size==2 && ChromaArrayType != CHROMA_444) {
+    cbfChroma = (tb->parent->cbf[1] || tb->parent->cbf[2]);
+  }
+
+  return (tb->cbf[0] || cbfChroma) ? tb : NULL;
+}
+
+
+static enc_tb* find_first_coded_tb(enc_cb* cb, int ChromaArrayType)
+{
+  if (cb->split_cu_flag) {
+    for (int i=0;i<4;i++) {
+      if (cb->children[i]) {
+        enc_tb* coded_tb = find_first_coded_tb(cb->children[i], ChromaArrayType);
+        if (coded_tb) {
+          return coded_tb;
+        }
+      }
+    }
+
+    return NULL;
+  }
+
+  if (cb->PredMode == MODE_SKIP ||
+      (cb->PredMode == MODE_INTER && !cb->inter.rqt_root_cbf)) {
+    return NULL;
+  }
+
+  return find_first_coded_tb(cb->transform_tree, ChromaArrayType);
+}
+
+
+int encode_ctb(encoder_context* ectx,
+               CABAC_encoder* cabac,
+               enc_cb* cb, int ctbX,int ctbY,
+               int qPY_PRED)
 {
   logtrace(LogSlice,"----- encode CTB (%d;%d) -----\n",ctbX,ctbY);
 
@@ -1722,7 +1831,26 @@ void encode_ctb(encoder_context* ectx,
   de265_image* img = ectx->img;
   int log2ctbSize = img->get_sps().Log2CtbSizeY;
 
+
+  // --- QP of the CTB (one quantization group per CTB) ---
+
+  int QPY = qPY_PRED;
+
+  if (img->get_pps().cu_qp_delta_enabled_flag) {
+    assert(img->get_pps().diff_cu_qp_delta_depth == 0);
+
+    enc_tb* tb = find_first_coded_tb(cb, img->get_sps().ChromaArrayType);
+    if (tb) {
+      QPY = tb->cb->qp;
+
+      tb->code_cu_qp_delta = true;
+      tb->CuQpDelta = QPY - qPY_PRED;
+    }
+  }
+
   encode_quadtree(ectx,cabac, cb, ctbX<<log2ctbSize, ctbY<<log2ctbSize, log2ctbSize, 0, true);
+
+  return QPY;
 }
 
 
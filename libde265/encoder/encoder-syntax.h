@@ -77,6 +77,19 @@ void encode_cu_skip_flag(encoder_context* ectx,
                          const enc_cb* cb,
                          bool skip);
 
+void encode_part_mode(encoder_context* ectx,
+                      CABAC_encoder* cabac,
+                      enum PredMode PredMode, enum PartMode PartMode, int cLog2CbSize);
+
+void encode_prediction_unit(encoder_context* ectx,
+                            CABAC_encoder* cabac,
+                            const enc_cb* cb, int pbIdx,
+                            int x0,int y0, int w, int h);
+
+void encode_rqt_root_cbf(encoder_context* ectx,
+                         CABAC_encoder* cabac,
+                         int rqt_root_cbf);
+
 void encode_cbf_luma(CABAC_encoder* cabac,
                      bool zeroTrafoDepth, int cbf_luma);
 
@@ -95,8 +108,13 @@ void encode_quadtree(encoder_context* ectx,
                      const enc_cb* cb, int x0,int y0, int log2CbSize, int ctDepth,
                      bool recurse);
 
-void encode_ctb(encoder_context* ectx,
-                CABAC_encoder* cabac,
-                enc_cb* cb, int ctbX,int ctbY);
+/* Write the CTB. With cu_qp_delta enabled, each CTB is one quantization group and its QP
+   is coded relative to 'qPY_PRED'. Returns the QpY of the last CU in the CTB, which is
+   the QP prediction for the next CTB.
+ */
+int encode_ctb(encoder_context* ectx,
+               CABAC_encoder* cabac,
+               enc_cb* cb, int ctbX,int ctbY,
+               int qPY_PRED);
 
 #endif
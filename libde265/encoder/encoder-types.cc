@@ -35,6 +35,64 @@ int allocCB = 0;
 
 #define DEBUG_ALLOCS 0
 
+#define NODE_ARENA_BLOCK_SIZE (64*1024)
+#define NODE_ARENA_ALIGNMENT  16
+
+
+enc_node_arena::enc_node_arena()
+{
+  mCurrentBlock = -1;
+  mBlockFill = NODE_ARENA_BLOCK_SIZE;
+}
+
+
+enc_node_arena::~enc_node_arena()
+{
+  reset();
+
+  for (size_t i=0;i<mBlocks.size();i++) {
+    delete[] mBlocks[i];
+  }
+}
+
+
+void* enc_node_arena::alloc(size_t size)
+{
+  assert(size <= NODE_ARENA_BLOCK_SIZE);
+
+  size = (size + NODE_ARENA_ALIGNMENT-1) & ~(NODE_ARENA_ALIGNMENT-1);
+
+  if (mBlockFill + size > NODE_ARENA_BLOCK_SIZE) {
+    mCurrentBlock++;
+    mBlockFill = 0;
+
+    if ((size_t)mCurrentBlock == mBlocks.size()) {
+      mBlocks.push_back(new uint8_t[NODE_ARENA_BLOCK_SIZE]);
+    }
+  }
+
+  void* p = mBlocks[mCurrentBlock] + mBlockFill;
+  mBlockFill += size;
+
+  return p;
+}
+
+
+void enc_node_arena::reset()
+{
+  // Nodes do not own their children or coefficients. Thus, the destructors only have
+  // to release the members that are not in the arena (e.g. the image buffers).
+
+  for (size_t i=0;i<mNodes.size();i++) {
+    mNodes[i]->~enc_node();
+  }
+
+  mNodes.clear();
+
+  mCurrentBlock = -1;
+  mBlockFill = NODE_ARENA_BLOCK_SIZE;
+}
+
 
 small_image_buffer::small_image_buffer(int log2Size,int bytes_per_pixel)
 {
@@ -54,6 +112,16 @@ small_image_buffer::~small_image_buffer()
 }
 
 
+int enc_cb::get_qp(int cIdx, const seq_parameter_set& sps) const
+{
+  if (cIdx>0 && sps.ChromaArrayType == CHROMA_420) {
+    return table8_22(qp);
+  }
+
+  return qp;
+}
+
+
 void enc_cb::set_rqt_root_bf_from_children_cbf()
 {
   assert(transform_tree);
@@ -65,8 +133,6 @@ void enc_cb::set_rqt_root_bf_from_children_cbf()
 
 
 
-alloc_pool enc_tb::mMemPool(sizeof(enc_tb));
-
 enc_tb::enc_tb(int x,int y,int log2TbSize, enc_cb* _cb)
   : enc_node(x,y,log2TbSize)
 {
@@ -78,6 +144,9 @@ enc_tb::enc_tb(int x,int y,int log2TbSize, enc_cb* _cb)
   split_transform_flag = false;
   coeff[0]=coeff[1]=coeff[2]=NULL;
 
+  code_cu_qp_delta = false;
+  CuQpDelta = 0;
+
   TrafoDepth = 0;
   cbf[0] = cbf[1] = cbf[2] = 0;
 
@@ -94,25 +163,49 @@ enc_tb::enc_tb(int x,int y,int log2TbSize, enc_cb* _cb)
 
 enc_tb::~enc_tb()
 {
+  // children and coefficients are released with the enc_node_arena
+
+  if (DEBUG_ALLOCS) { allocTB--; printf("TB ~: %d\n",allocTB); }
+}
+
+
+void enc_tb::alloc_coeff_memory(enc_node_arena& arena, int cIdx, int tbSize)
+{
+  assert(coeff[cIdx]==NULL);
+  coeff[cIdx] = arena.alloc_array<int16_t>(tbSize*tbSize);
+}
+
+
+enc_tb* enc_tb::copy_tree(enc_node_arena& arena, const seq_parameter_set& sps,
+                          enc_cb* cb, enc_tb* parent, enc_tb** downPtr) const
+{
+  enc_tb* tb = arena.create<enc_tb>(*this);
+  tb->cb      = cb;
+  tb->parent  = parent;
+  tb->downPtr = downPtr;
+
   if (split_transform_flag) {
     for (int i=0;i<4;i++) {
-      delete children[i];
+      tb->children[i] = children[i]->copy_tree(arena, sps, cb, tb, &tb->children[i]);
     }
   }
   else {
-    for (int i=0;i<3;i++) {
-      delete[] coeff[i];
+    for (int cIdx=0;cIdx<3;cIdx++) {
+      if (coeff[cIdx]) {
+        // same block sizes as used in the transform (chroma 4x4 for 4x4 luma blocks)
+        int log2TbSize = log2Size;
+        if (cIdx>0 && sps.chroma_format_idc != CHROMA_444 && log2Size>2) {
+          log2TbSize--;
+        }
+
+        int nCoeff = 1<<(log2TbSize<<1);
+        tb->coeff[cIdx] = arena.alloc_array<int16_t>(nCoeff);
+        memcpy(tb->coeff[cIdx], coeff[cIdx], nCoeff*sizeof(int16_t));
+      }
     }
   }
 
-  if (DEBUG_ALLOCS) { allocTB--; printf("TB ~: %d\n",allocTB); }
-}
-
-
-void enc_tb::alloc_coeff_memory(int cIdx, int tbSize)
-{
-  assert(coeff[cIdx]==NULL);
-  coeff[cIdx] = new int16_t[tbSize*tbSize];
+  return tb;
 }
 
 
@@ -165,28 +258,15 @@ void enc_tb::reconstruct_tb(encoder_context* ectx,
         */
       }
       else {
-        assert(0); // -> TODO: now only store in tb_enc
-
-        int size = 1<<log2TbSize;
-
-        uint8_t* dst_ptr  = img->get_image_plane_at_pos(cIdx, xC,  yC  );
-        int dst_stride  = img->get_image_stride(cIdx);
+        // motion-compensated prediction, stored by tb-split
 
-        /* TODO TMP HACK: prediction does not exist anymore
-        uint8_t* src_ptr  = ectx->prediction->get_image_plane_at_pos(cIdx, xC,  yC  );
-        int src_stride  = ectx->prediction->get_image_stride(cIdx);
-
-        for (int y=0;y<size;y++) {
-          for (int x=0;x<size;x++) {
-            dst_ptr[y*dst_stride+x] = src_ptr[y*src_stride+x];
-          }
-        }
-        */
+        intra_prediction[cIdx]->copy_to(*reconstruction[cIdx]);
       }
 
       ALIGNED_16(int16_t) dequant_coeff[32*32];
 
-      if (cbf[cIdx]) dequant_coefficients(dequant_coeff, coeff[cIdx], log2TbSize, cb->qp);
+      if (cbf[cIdx]) dequant_coefficients(dequant_coeff, coeff[cIdx], log2TbSize,
+                                          cb->get_qp(cIdx, ectx->get_sps()));
 
       if (0 && cbf[cIdx]) {
         printf("--- quantized coeffs ---\n");
@@ -201,7 +281,7 @@ void enc_tb::reconstruct_tb(encoder_context* ectx,
       int stride  = img->get_image_stride(cIdx);
 #endif
 
-      int trType = (cIdx==0 && log2TbSize==2); // TODO: inter
+      int trType = (cIdx==0 && log2TbSize==2 && cb->PredMode==MODE_INTRA);
 
       //printf("--- prediction %d %d / %d ---\n",x0,y0,cIdx);
       //printBlk("prediction",ptr,1<<log2TbSize,stride);
@@ -301,9 +381,6 @@ void enc_tb::set_cbf_flags_from_children()
 
 
 
-alloc_pool enc_cb::mMemPool(sizeof(enc_cb), 200);
-
-
 enc_cb::enc_cb()
   : split_cu_flag(false),
     cu_transquant_bypass_flag(false),
@@ -320,14 +397,7 @@ enc_cb::enc_cb()
 
 enc_cb::~enc_cb()
 {
-  if (split_cu_flag) {
-    for (int i=0;i<4;i++) {
-      delete children[i];
-    }
-  }
-  else {
-    delete transform_tree;
-  }
+  // children and the transform tree are released with the enc_node_arena
 
   if (DEBUG_ALLOCS) { allocCB--; printf("CB ~: %d\n",allocCB); }
 }
@@ -414,6 +484,68 @@ void enc_cb::write_to_image(de265_image* img) const
 }
 */
 
+void enc_cb::writePredictionMetadata(de265_image* img) const
+{
+  if (split_cu_flag) {
+    for (int i=0;i<4;i++) {
+      if (children[i]) {
+        children[i]->writePredictionMetadata(img);
+      }
+    }
+
+    return;
+  }
+
+  img->set_pred_mode(x,y, log2Size, PredMode);
+  img->set_PartMode(x,y, PartMode);
+
+  if (PredMode == MODE_INTRA) {
+    return;
+  }
+
+  int nC = 1<<log2Size;
+  int nC2 = nC>>1;
+  int nC4 = nC>>2;
+  int nC3 = nC-nC4;
+
+  switch (PartMode) {
+  case PART_2Nx2N:
+    img->set_mv_info(x,y,nC,nC, inter.pb[0].motion);
+    break;
+  case PART_NxN:
+    img->set_mv_info(x    ,y    ,nC2,nC2, inter.pb[0].motion);
+    img->set_mv_info(x+nC2,y    ,nC2,nC2, inter.pb[1].motion);
+    img->set_mv_info(x    ,y+nC2,nC2,nC2, inter.pb[2].motion);
+    img->set_mv_info(x+nC2,y+nC2,nC2,nC2, inter.pb[3].motion);
+    break;
+  case PART_2NxN:
+    img->set_mv_info(x,y    ,nC,nC2, inter.pb[0].motion);
+    img->set_mv_info(x,y+nC2,nC,nC2, inter.pb[1].motion);
+    break;
+  case PART_Nx2N:
+    img->set_mv_info(x    ,y,nC2,nC, inter.pb[0].motion);
+    img->set_mv_info(x+nC2,y,nC2,nC, inter.pb[1].motion);
+    break;
+  case PART_2NxnU:
+    img->set_mv_info(x,y    ,nC,nC4, inter.pb[0].motion);
+    img->set_mv_info(x,y+nC4,nC,nC3, inter.pb[1].motion);
+    break;
+  case PART_2NxnD:
+    img->set_mv_info(x,y    ,nC,nC3, inter.pb[0].motion);
+    img->set_mv_info(x,y+nC3,nC,nC4, inter.pb[1].motion);
+    break;
+  case PART_nLx2N:
+    img->set_mv_info(x    ,y,nC4,nC, inter.pb[0].motion);
+    img->set_mv_info(x+nC4,y,nC3,nC, inter.pb[1].motion);
+    break;
+  case PART_nRx2N:
+    img->set_mv_info(x    ,y,nC3,nC, inter.pb[0].motion);
+    img->set_mv_info(x+nC3,y,nC4,nC, inter.pb[1].motion);
+    break;
+  }
+}
+
+
 void enc_cb::reconstruct(encoder_context* ectx, de265_image* img) const
 {
   assert(0);
@@ -560,6 +692,28 @@ const enc_tb* enc_tb::getTB(int px,int py) const
 
 
 
+enc_cb* enc_cb::copy_tree(enc_node_arena& arena, const seq_parameter_set& sps,
+                          enc_cb* parent, enc_cb** downPtr) const
+{
+  enc_cb* cb = arena.create<enc_cb>(*this);
+  cb->parent  = parent;
+  cb->downPtr = downPtr;
+
+  if (split_cu_flag) {
+    for (int i=0;i<4;i++) {
+      if (children[i]) {
+        cb->children[i] = children[i]->copy_tree(arena, sps, cb, &cb->children[i]);
+      }
+    }
+  }
+  else if (transform_tree) {
+    cb->transform_tree = transform_tree->copy_tree(arena, sps, cb, NULL, &cb->transform_tree);
+  }
+
+  return cb;
+}
+
+
 void CTBTreeMatrix::alloc(int w,int h, int log2CtbSize)
 {
   free();
@@ -571,6 +725,13 @@ void CTBTreeMatrix::alloc(int w,int h, int log2CtbSize)
   mLog2CtbSize = log2CtbSize;
 
   mCTBs.resize(mWidthCtbs * mHeightCtbs, NULL);
+
+  mRowArenas.resize(mHeightCtbs);
+  for (int y=0;y<mHeightCtbs;y++) {
+    if (!mRowArenas[y]) {
+      mRowArenas[y] = std::make_shared<enc_node_arena>();
+    }
+  }
 }
 
 
@@ -26,14 +26,53 @@
 #include "libde265/image.h"
 #include "libde265/decctx.h"
 #include "libde265/image-io.h"
-#include "libde265/alloc_pool.h"
 
 #include <memory>
+#include <new>
+#include <vector>
 
 class encoder_context;
+class enc_node;
 class enc_cb;
 
 
+/* Memory for the enc_cb/enc_tb nodes (and TB coefficients).
+
+   Nodes are never deleted individually. When a coding option is rejected, its whole
+   subtree is simply dropped and its memory is only reused after reset(). Hence, each
+   CTB is analysed with an arena that is reset after the CTB has been written.
+ */
+class enc_node_arena
+{
+ public:
+  enc_node_arena();
+  ~enc_node_arena();
+
+  template <class T, class... Args> T* create(const Args&... args) {
+    T* node = new (alloc(sizeof(T))) T(args...);
+    mNodes.push_back(node);
+    return node;
+  }
+
+  template <class T> T* alloc_array(int n) { return (T*)alloc(n*sizeof(T)); }
+
+  // destroy all nodes, the memory blocks are kept for reuse
+  void reset();
+
+ private:
+  std::vector<uint8_t*>  mBlocks;
+  int                    mCurrentBlock;
+  size_t                 mBlockFill;
+
+  std::vector<enc_node*> mNodes;
+
+  void* alloc(size_t size);
+
+  enc_node_arena(const enc_node_arena&); // = delete;
+  enc_node_arena& operator=(const enc_node_arena&); // = delete;
+};
+
+
 class small_image_buffer
 {
  public:
@@ -145,6 +184,11 @@ class enc_tb : public enc_node
   uint8_t TrafoDepth : 2;  // 2 bits enough ? (TODO)
   uint8_t blkIdx : 2;
 
+  /* Whether cu_qp_delta is coded in this TU, i.e. it is the first TU with coded residual
+     in its quantization group. Only set for the final CTB tree, when it is written. */
+  uint8_t code_cu_qp_delta : 1;
+  int8_t  CuQpDelta;
+
   enum IntraPredMode intra_mode;
 
   // Note: in NxN partition mode, the chroma mode is always derived from
@@ -155,7 +199,8 @@ class enc_tb : public enc_node
 
 
   /* intra_prediction and residual is filled in tb-split, because this is where we decide
-     on the final block-size the TB is coded with.
+     on the final block-size the TB is coded with. For inter CBs, intra_prediction holds
+     the motion-compensated prediction.
    */
   //mutable uint8_t debug_intra_border[2*64+1];
   std::shared_ptr<small_image_buffer> intra_prediction[3];
@@ -191,7 +236,7 @@ class enc_tb : public enc_node
 
   bool isZeroBlock() const { return cbf[0]==false && cbf[1]==false && cbf[2]==false; }
 
-  void alloc_coeff_memory(int cIdx, int tbSize);
+  void alloc_coeff_memory(enc_node_arena& arena, int cIdx, int tbSize);
 
   const enc_tb* getTB(int x,int y) const;
 
@@ -200,17 +245,14 @@ class enc_tb : public enc_node
   void writeReconstructionToImage(de265_image* img,
                                   const seq_parameter_set* sps) const;
 
-  /*
-  static void* operator new(const size_t size) { return mMemPool.new_obj(size); }
-  static void operator delete(void* obj) { mMemPool.delete_obj(obj); }
-  */
+  // copy the TB tree into 'arena'
+  enc_tb* copy_tree(enc_node_arena& arena, const seq_parameter_set& sps,
+                    enc_cb* cb, enc_tb* parent, enc_tb** downPtr) const;
 
 
   virtual void debug_dumpTree(int flags, int indent=0) const;
 
 private:
-  static alloc_pool mMemPool;
-
   void reconstruct_tb(encoder_context* ectx,
                       de265_image* img, int x0,int y0, int log2TbSize,
                       int cIdx) const;
@@ -296,6 +338,11 @@ public:
 
   void set_rqt_root_bf_from_children_cbf();
 
+  /* QP for the residual of color component 'cIdx' (chroma QPs are mapped from the
+     luma QP, there are no chroma QP offsets).
+   */
+  int get_qp(int cIdx, const seq_parameter_set& sps) const;
+
   /* Save CB reconstruction in the node and restore it again to the image.
      Pixel data and metadata.
    */
@@ -313,26 +360,21 @@ public:
   void writeReconstructionToImage(de265_image* img,
                                   const seq_parameter_set* sps) const;
 
+  /* Write prediction mode, partitioning and motion vectors of the CB tree into the
+     image metadata. The motion-vector prediction reads these from the image.
+   */
+  void writePredictionMetadata(de265_image* img) const;
 
-  virtual void debug_dumpTree(int flags, int indent=0) const;
 
+  // copy the CB tree (with its TB trees) into 'arena'
+  enc_cb* copy_tree(enc_node_arena& arena, const seq_parameter_set& sps,
+                    enc_cb* parent, enc_cb** downPtr) const;
 
-  // memory management
 
-  static void* operator new(const size_t size) {
-    void* p = mMemPool.new_obj(size);
-    //printf("ALLOC %p\n",p);
-    return p;
-  }
-  static void operator delete(void* obj) {
-    //printf("DELETE %p\n",obj);
-    mMemPool.delete_obj(obj);
-  }
+  virtual void debug_dumpTree(int flags, int indent=0) const;
 
  private:
   //void write_to_image(de265_image*) const;
-
-  static alloc_pool mMemPool;
 };
 
 
@@ -346,11 +388,13 @@ class CTBTreeMatrix
   void alloc(int w,int h, int log2CtbSize);
   void clear() { free(); }
 
-  void setCTB(int xCTB, int yCTB, enc_cb* ctb) {
+  /* Store a copy of the final CTB tree. The nodes are kept in an arena for each
+     CTB row, such that rows can be stored concurrently.
+   */
+  void setCTB(int xCTB, int yCTB, const enc_cb* ctb, const seq_parameter_set& sps) {
     int idx = xCTB + yCTB*mWidthCtbs;
     assert(idx < mCTBs.size());
-    if (mCTBs[idx]) { delete mCTBs[idx]; }
-    mCTBs[idx] = ctb;
+    mCTBs[idx] = ctb->copy_tree(*mRowArenas[yCTB], sps, NULL, &mCTBs[idx]);
   }
 
   const enc_cb* getCTB(int xCTB, int yCTB) const {
@@ -377,16 +421,18 @@ class CTBTreeMatrix
 
  private:
   std::vector<enc_cb*> mCTBs;
+  std::vector<std::shared_ptr<enc_node_arena> > mRowArenas;
   int mWidthCtbs;
   int mHeightCtbs;
   int mLog2CtbSize;
 
   void free() {
     for (int i=0 ; i<mWidthCtbs*mHeightCtbs ; i++) {
-      if (mCTBs[i]) {
-        delete mCTBs[i];
-        mCTBs[i]=NULL;
-      }
+      mCTBs[i]=NULL;
+    }
+
+    for (size_t y=0 ; y<mRowArenas.size() ; y++) {
+      mRowArenas[y]->reset();
     }
   }
 };
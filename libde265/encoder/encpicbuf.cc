@@ -21,6 +21,8 @@
 #include "libde265/encoder/encpicbuf.h"
 #include "libde265/util.h"
 
+#include <algorithm>
+
 
 encoder_picture_buffer::encoder_picture_buffer()
 {
@@ -46,6 +48,7 @@ image_data::image_data()
 
   sps_index = -1;
   skip_priority = 0;
+  qp_offset = 0;
   is_intra = true;
 
   state = state_unprocessed;
@@ -85,11 +88,13 @@ void encoder_picture_buffer::flush_images()
 
 
 image_data* encoder_picture_buffer::insert_next_image_in_encoding_order(const de265_image* img,
-                                                                        int frame_number)
+                                                                        int frame_number,
+                                                                        const lookahead_costs& costs)
 {
   image_data* data = new image_data();
   data->frame_number = frame_number;
   data->input = img;
+  data->lookahead = costs;
   data->shdr.set_defaults();
 
   mImages.push_back(data);
@@ -131,19 +136,19 @@ void image_data::set_references(int sps_index, // -1 -> custom
   // TODO: pps.num_ref_idx_l0_default_active
 
   shdr.num_ref_idx_l0_active = l0.size();
-  //shdr.num_ref_idx_l1_active = l1.size();
+  if (!l1.empty()) {
+    shdr.num_ref_idx_l1_active = l1.size();
+  }
 
   assert(l0.size() < MAX_NUM_REF_PICS);
   for (int i=0;i<l0.size();i++) {
     shdr.RefPicList[0][i] = l0[i];
   }
 
-  /*
   assert(l1.size() < MAX_NUM_REF_PICS);
   for (int i=0;i<l1.size();i++) {
     shdr.RefPicList[1][i] = l1[i];
   }
-  */
 }
 
 void image_data::set_NAL_temporal_id(int temporal_id)
@@ -225,7 +230,9 @@ void encoder_picture_buffer::mark_encoding_finished(int frame_number)
   FOR_LOOP(image_data *, imgdata, mImages) {
 #endif
     if (imgdata->mark_used || imgdata->is_in_output_queue) {
-      imgdata->reconstruction->PicState = UsedForShortTermReference; // TODO: this is only a hack
+      if (imgdata->reconstruction) { // not for pictures that are still waiting to be encoded
+        imgdata->reconstruction->PicState = UsedForShortTermReference; // TODO: this is only a hack
+      }
 
       newImageSet.push_back(imgdata);
     }
@@ -319,3 +326,397 @@ void encoder_picture_buffer::release_input_image(int frame_number)
   delete idata->input;
   idata->input = NULL;
 }
+
+
+
+// ---------------------------------------------------------------------------
+
+
+lookahead_costs::lookahead_costs()
+{
+  valid = false;
+  scene_cut = false;
+
+  intra_cost = 0;
+  inter_cost = 0;
+  avg_inter_cost = 0;
+
+  blocks_w = blocks_h = 0;
+}
+
+
+encoder_lookahead::encoder_lookahead()
+{
+  mAccel = NULL;
+  mDepth = 0;
+  mSceneCutThreshold = 0;
+
+  mRunning = false;
+  mNumAnalysed = 0;
+  mEndOfStream = false;
+  mStopped = false;
+
+  mLowresWidth = mLowresHeight = 0;
+  mHavePrevious = false;
+  mPrevCostRatio = 1.0;
+
+  de265_mutex_init(&mMutex);
+  de265_cond_init(&mCond);
+}
+
+
+encoder_lookahead::~encoder_lookahead()
+{
+  stop();
+
+  while (!mQueue.empty()) {
+    delete mQueue.front()->img;
+    delete mQueue.front();
+    mQueue.pop_front();
+  }
+
+  de265_cond_destroy(&mCond);
+  de265_mutex_destroy(&mMutex);
+}
+
+
+void encoder_lookahead::start(const acceleration_functions* accel, int depth, int sceneCutThreshold)
+{
+  assert(!mRunning);
+
+  mAccel = accel;
+  mDepth = depth;
+  mSceneCutThreshold = sceneCutThreshold;
+
+  mStopped = false;
+
+  if (de265_thread_create(&mThread, thread_main, this) == 0) {
+    mRunning = true;
+  }
+}
+
+
+void encoder_lookahead::stop()
+{
+  if (!mRunning) {
+    return;
+  }
+
+  de265_mutex_lock(&mMutex);
+  mStopped = true;
+  de265_cond_broadcast(&mCond, &mMutex);
+  de265_mutex_unlock(&mMutex);
+
+  de265_thread_join(mThread);
+  de265_thread_destroy(&mThread);
+
+  mRunning = false;
+}
+
+
+void encoder_lookahead::push_image(de265_image* img)
+{
+  entry* e = new entry;
+  e->img = img;
+
+  de265_mutex_lock(&mMutex);
+  mQueue.push_back(e);
+  de265_cond_broadcast(&mCond, &mMutex);
+  de265_mutex_unlock(&mMutex);
+}
+
+
+void encoder_lookahead::push_end_of_stream()
+{
+  de265_mutex_lock(&mMutex);
+  mEndOfStream = true;
+  de265_cond_broadcast(&mCond, &mMutex);
+  de265_mutex_unlock(&mMutex);
+}
+
+
+bool encoder_lookahead::end_of_stream_reached() const
+{
+  de265_mutex_lock(&mMutex);
+  bool eos = (mEndOfStream && mQueue.empty());
+  de265_mutex_unlock(&mMutex);
+
+  return eos;
+}
+
+
+bool encoder_lookahead::get_next_picture(de265_image** img, lookahead_costs* costs)
+{
+  de265_mutex_lock(&mMutex);
+
+  for (;;) {
+    int queueSize = mQueue.size();
+    int window = std::min(mDepth+1, queueSize);
+
+    bool due = (queueSize > mDepth || (mEndOfStream && queueSize>0));
+    if (!due) {
+      break;
+    }
+
+    if (mNumAnalysed >= window) {
+      entry* e = mQueue.front();
+      mQueue.pop_front();
+      mNumAnalysed--;
+
+      int64_t sum = 0;
+      for (int i=0;i<window-1;i++) {
+        sum += mQueue[i]->costs.inter_cost;
+      }
+
+      de265_mutex_unlock(&mMutex);
+
+      if (window>1) { e->costs.avg_inter_cost = sum / (double)(window-1); }
+      else          { e->costs.avg_inter_cost = e->costs.inter_cost; }
+
+      *img = e->img;
+      std::swap(*costs, e->costs);
+      delete e;
+
+      return true;
+    }
+
+    // Only wait when the window does not contain the picture that was pushed last.
+    // Its analysis can then run while the encoder is busy with the due pictures.
+
+    if (queueSize > window || mEndOfStream) {
+      de265_cond_wait(&mCond, &mMutex);
+    }
+    else {
+      break;
+    }
+  }
+
+  de265_mutex_unlock(&mMutex);
+  return false;
+}
+
+
+THREAD_RESULT encoder_lookahead::thread_main(THREAD_PARAM lookahead_ptr)
+{
+  ((encoder_lookahead*)lookahead_ptr)->run();
+  return 0;
+}
+
+
+void encoder_lookahead::run()
+{
+  de265_mutex_lock(&mMutex);
+
+  for (;;) {
+    while (!mStopped && mNumAnalysed == (int)mQueue.size()) {
+      de265_cond_wait(&mCond, &mMutex);
+    }
+
+    if (mStopped) {
+      break;
+    }
+
+    entry* e = mQueue[mNumAnalysed];
+
+    de265_mutex_unlock(&mMutex);
+
+    analyse(e->costs, e->img);
+
+    de265_mutex_lock(&mMutex);
+
+    mNumAnalysed++;
+    de265_cond_broadcast(&mCond, &mMutex);
+  }
+
+  de265_mutex_unlock(&mMutex);
+}
+
+
+void encoder_lookahead::analyse(lookahead_costs& costs, const de265_image* img)
+{
+  const int w = img->get_width(0);
+  const int h = img->get_height(0);
+
+  costs.valid = true;
+  costs.blocks_w = (w+15)/16;
+  costs.blocks_h = (h+15)/16;
+
+  int lowresWidth  = costs.blocks_w*8;
+  int lowresHeight = costs.blocks_h*8;
+
+  if (lowresWidth != mLowresWidth || lowresHeight != mLowresHeight) {
+    mLowresWidth  = lowresWidth;
+    mLowresHeight = lowresHeight;
+    mHavePrevious = false;
+  }
+
+  mLowres.swap(mPrevLowres);
+  mMV.swap(mPrevMV);
+
+  mLowres.resize(mLowresWidth*mLowresHeight);
+  mMV.assign(costs.blocks_w*costs.blocks_h*2, 0);
+  mPrevMV.resize(mMV.size(), 0);
+
+
+  // --- downscale the luma channel by two, repeat the border pixels to fill the last blocks
+
+  const uint8_t* src = img->get_image_plane(0);
+  const int stride = img->get_image_stride(0);
+
+  for (int y=0;y<mLowresHeight;y++) {
+    const uint8_t* row0 = src + std::min(2*y  , h-1)*stride;
+    const uint8_t* row1 = src + std::min(2*y+1, h-1)*stride;
+
+    for (int x=0;x<mLowresWidth;x++) {
+      int x0 = std::min(2*x  , w-1);
+      int x1 = std::min(2*x+1, w-1);
+
+      mLowres[x+y*mLowresWidth] = (row0[x0] + row0[x1] + row1[x0] + row1[x1] + 2) >> 2;
+    }
+  }
+
+
+  // --- block costs ---
+
+  int nBlocks = costs.blocks_w*costs.blocks_h;
+  costs.block_intra_cost.resize(nBlocks);
+  costs.block_inter_cost.resize(nBlocks);
+
+  costs.intra_cost = 0;
+  costs.inter_cost = 0;
+
+  for (int by=0;by<costs.blocks_h;by++)
+    for (int bx=0;bx<costs.blocks_w;bx++) {
+      int idx = bx + by*costs.blocks_w;
+
+      int intra = intra_cost(bx,by);
+      int inter = intra;
+      if (mHavePrevious) {
+        inter = std::min(intra, inter_cost(bx,by));
+      }
+
+      costs.block_intra_cost[idx] = intra;
+      costs.block_inter_cost[idx] = inter;
+
+      costs.intra_cost += intra;
+      costs.inter_cost += inter;
+    }
+
+  // Scene cut: inter prediction is hardly cheaper than intra prediction, and much less
+  // efficient than in the previous picture (so that noisy content does not trigger cuts).
+
+  double costRatio = costs.inter_cost / std::max(double(costs.intra_cost), 1.0);
+  double threshold = mSceneCutThreshold / 100.0;
+
+  costs.scene_cut = (mHavePrevious && mSceneCutThreshold > 0 &&
+                     costRatio > 1.0 - threshold &&
+                     costRatio > mPrevCostRatio + threshold/2);
+
+  mPrevCostRatio = (mHavePrevious ? costRatio : 1.0);
+  mHavePrevious = true;
+}
+
+
+/* Cheapest of DC, horizontal and vertical prediction of an 8x8 block, predicted from
+   the (unquantized) neighboring pixels.
+ */
+int encoder_lookahead::intra_cost(int bx,int by) const
+{
+  const uint8_t* p = &mLowres[bx*8 + by*8*mLowresWidth];
+  const int stride = mLowresWidth;
+
+  bool haveTop  = (by>0);
+  bool haveLeft = (bx>0);
+
+  int sum=0, n=0;
+  if (haveTop)  { for (int i=0;i<8;i++) { sum += p[i-stride];   } n+=8; }
+  if (haveLeft) { for (int i=0;i<8;i++) { sum += p[i*stride-1]; } n+=8; }
+
+  uint8_t pred[8*8];
+
+  memset(pred, n ? (sum + n/2)/n : 128, 8*8);
+  int cost = mAccel->satd_8[1](p,stride, pred,8);
+
+  if (haveTop) {
+    for (int y=0;y<8;y++) { memcpy(pred+y*8, p-stride, 8); }
+    cost = std::min(cost, mAccel->satd_8[1](p,stride, pred,8));
+  }
+
+  if (haveLeft) {
+    for (int y=0;y<8;y++) { memset(pred+y*8, p[y*stride-1], 8); }
+    cost = std::min(cost, mAccel->satd_8[1](p,stride, pred,8));
+  }
+
+  return cost;
+}
+
+
+/* Motion search in the previous picture: the best of the zero vector and the vectors
+   of neighboring blocks is refined with a small diamond search (SAD). The cost is the
+   SATD at the final position.
+ */
+int encoder_lookahead::inter_cost(int bx,int by)
+{
+  const int SearchRange = 16;
+
+  const int stride = mLowresWidth;
+  const uint8_t* p   = &mLowres    [bx*8 + by*8*stride];
+  const uint8_t* ref = &mPrevLowres[bx*8 + by*8*stride];
+
+  const int blocks_w = mLowresWidth/8;
+  const int idx = bx + by*blocks_w;
+
+  int minX = std::max(-SearchRange, -bx*8), maxX = std::min(SearchRange, mLowresWidth -8-bx*8);
+  int minY = std::max(-SearchRange, -by*8), maxY = std::min(SearchRange, mLowresHeight-8-by*8);
+
+  int bestX=0, bestY=0;
+  int bestSAD = mAccel->sad_8[1](p,stride, ref,stride);
+
+  int16_t candidates[3][2] = {
+    { mPrevMV[2*idx], mPrevMV[2*idx+1] },
+    { 0,0 },
+    { 0,0 }
+  };
+  int nCandidates=1;
+  if (bx>0) { candidates[nCandidates][0]=mMV[2*(idx-1)]; candidates[nCandidates][1]=mMV[2*(idx-1)+1]; nCandidates++; }
+  if (by>0) { candidates[nCandidates][0]=mMV[2*(idx-blocks_w)]; candidates[nCandidates][1]=mMV[2*(idx-blocks_w)+1]; nCandidates++; }
+
+  for (int i=0;i<nCandidates;i++) {
+    int mx = Clip3(minX,maxX, (int)candidates[i][0]);
+    int my = Clip3(minY,maxY, (int)candidates[i][1]);
+
+    int sad = mAccel->sad_8[1](p,stride, ref+mx+my*stride,stride);
+    if (sad < bestSAD) {
+      bestSAD=sad; bestX=mx; bestY=my;
+    }
+  }
+
+  static const int diamond[4][2] = { {-1,0}, {1,0}, {0,-1}, {0,1} };
+
+  for (int iter=0;iter<2*SearchRange;iter++) {
+    int centerX=bestX, centerY=bestY;
+
+    for (int i=0;i<4;i++) {
+      int mx = centerX + diamond[i][0];
+      int my = centerY + diamond[i][1];
+
+      if (mx<minX || mx>maxX || my<minY || my>maxY) {
+        continue;
+      }
+
+      int sad = mAccel->sad_8[1](p,stride, ref+mx+my*stride,stride);
+      if (sad < bestSAD) {
+        bestSAD=sad; bestX=mx; bestY=my;
+      }
+    }
+
+    if (bestX==centerX && bestY==centerY) {
+      break;
+    }
+  }
+
+  mMV[2*idx  ] = bestX;
+  mMV[2*idx+1] = bestY;
+
+  return mAccel->satd_8[1](p,stride, ref+bestX+bestY*stride,stride);
+}
@@ -23,11 +23,34 @@
 
 #include "libde265/image.h"
 #include "libde265/sps.h"
+#include "libde265/acceleration.h"
+#include "libde265/threads.h"
 
 #include <deque>
 #include <vector>
 
 
+/* Complexity estimates of a picture, computed by the lookahead on a half-resolution
+   version of the luma channel. All costs are SATD values at that resolution.
+ */
+struct lookahead_costs
+{
+  lookahead_costs();
+
+  bool valid;     // false when the lookahead is disabled
+  bool scene_cut; // prediction from the previous picture is not much cheaper than intra
+
+  int64_t intra_cost;
+  int64_t inter_cost;     // per block, the cheaper of inter and intra prediction
+  double  avg_inter_cost; // mean inter cost of the following pictures in the lookahead window
+
+  // costs of the 16x16 blocks of the input picture
+  int blocks_w, blocks_h;
+  std::vector<int> block_intra_cost;
+  std::vector<int> block_inter_cost;
+};
+
+
 /* TODO: we need a way to quickly access pictures with a stable ID, like in the DPB.
  */
 
@@ -54,8 +77,11 @@ struct image_data
   std::vector<int> keep;
   int sps_index;
   int skip_priority;
+  int qp_offset;  // added to the QP of constant-QP coding
   bool is_intra;  // TODO: remove, use shdr.slice_type instead
 
+  lookahead_costs lookahead;
+
   /* unprocessed              only input image has been inserted, no metadata
      sop_metadata_available   sop-creator has filled in references and skipping metadata
      a) encoding              encoding started for this frame, reconstruction image was created
@@ -99,7 +125,8 @@ class encoder_picture_buffer
 
   void reset();
 
-  image_data* insert_next_image_in_encoding_order(const de265_image*, int frame_number);
+  image_data* insert_next_image_in_encoding_order(const de265_image*, int frame_number,
+                                                  const lookahead_costs&);
   void insert_end_of_stream();
 
 
@@ -141,4 +168,75 @@ class encoder_picture_buffer
 };
 
 
+
+/* Analyses the input pictures on its own thread, before they are passed to the SOP
+   creator. A picture leaves the lookahead when the following 'depth' pictures have been
+   analysed as well (or at the end of the stream), so that the SOP creator and the rate
+   control see the complexity of the upcoming pictures.
+ */
+class encoder_lookahead
+{
+ public:
+  encoder_lookahead();
+  ~encoder_lookahead();
+
+  void start(const acceleration_functions*, int depth, int sceneCutThreshold);
+  void stop();
+
+  bool is_running() const { return mRunning; }
+
+
+  // --- input pushed by the input process ---
+
+  void push_image(de265_image*);
+  void push_end_of_stream();
+
+
+  // --- output to the SOP creator, in input order ---
+
+  /* Returns false if the next picture cannot be output yet. Blocks only if the
+     picture is due, but the analysis of its window is still running.
+   */
+  bool get_next_picture(de265_image** img, lookahead_costs* costs);
+
+  bool end_of_stream_reached() const;
+
+ private:
+  struct entry {
+    de265_image* img;
+    lookahead_costs costs;
+  };
+
+  const acceleration_functions* mAccel;
+  int  mDepth;
+  int  mSceneCutThreshold; // percent, 0: no scene-cut detection
+
+  bool mRunning;
+
+  de265_thread mThread;
+  mutable de265_mutex mMutex;
+  de265_cond   mCond; // signals new input, finished analyses and the end of the thread
+
+  std::deque<entry*> mQueue;
+  int  mNumAnalysed;  // number of analysed pictures at the front of the queue
+  bool mEndOfStream;
+  bool mStopped;
+
+
+  // analysis state, only accessed by the lookahead thread
+
+  int mLowresWidth, mLowresHeight;
+  std::vector<uint8_t> mLowres, mPrevLowres;
+  std::vector<int16_t> mMV, mPrevMV; // motion vectors per block, (x,y) pairs
+  bool mHavePrevious;
+  double mPrevCostRatio; // inter/intra cost ratio of the previous picture
+
+  static THREAD_RESULT thread_main(THREAD_PARAM);
+  void run();
+  void analyse(lookahead_costs&, const de265_image*);
+  int  intra_cost(int bx,int by) const;
+  int  inter_cost(int bx,int by);
+};
+
+
 #endif
@@ -21,6 +21,8 @@
 #include "libde265/encoder/sop.h"
 #include "libde265/encoder/encoder-context.h"
 
+#include <algorithm>
+
 
 sop_creator_intra_only::sop_creator_intra_only()
 {
@@ -33,7 +35,8 @@ void sop_creator_intra_only::set_SPS_header_values()
 }
 
 
-void sop_creator_intra_only::insert_new_input_image(de265_image* img)
+void sop_creator_intra_only::insert_new_input_image(de265_image* img,
+                                                    const lookahead_costs& costs)
 {
   img->PicOrderCntVal = get_pic_order_count();
 
@@ -41,7 +44,8 @@ void sop_creator_intra_only::insert_new_input_image(de265_image* img)
   int poc = get_pic_order_count();
 
   assert(mEncPicBuf);
-  image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(img, get_frame_number());
+  image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(img, get_frame_number(),
+                                                                        costs);
 
   imgdata->set_intra();
   imgdata->set_NAL_type(NAL_UNIT_IDR_N_LP);
@@ -59,6 +63,7 @@ void sop_creator_intra_only::insert_new_input_image(de265_image* img)
 
 sop_creator_trivial_low_delay::sop_creator_trivial_low_delay()
 {
+  mLastIntraFrame = 0;
 }
 
 
@@ -75,21 +80,29 @@ void sop_creator_trivial_low_delay::set_SPS_header_values()
 }
 
 
-void sop_creator_trivial_low_delay::insert_new_input_image(de265_image* img)
+void sop_creator_trivial_low_delay::insert_new_input_image(de265_image* img,
+                                                           const lookahead_costs& costs)
 {
   img->PicOrderCntVal = get_pic_order_count();
 
   int frame = get_frame_number();
+  bool intra = isIntra(frame, costs);
 
   std::vector<int> l0, l1, empty;
-  if (!isIntra(frame)) {
+  if (!intra) {
     l0.push_back(frame-1);
   }
 
   assert(mEncPicBuf);
-  image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(img, get_frame_number());
+  image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(img, get_frame_number(),
+                                                                        costs);
+
+  if (intra) {
+    if (costs.scene_cut) {
+      loginfo(LogEncoder,"scene cut at frame %d, coded as IDR picture\n",frame);
+    }
 
-  if (isIntra(frame)) {
+    mLastIntraFrame = frame;
     reset_poc();
     imgdata->set_intra();
     imgdata->set_NAL_type(NAL_UNIT_IDR_N_LP);
@@ -104,3 +117,299 @@ void sop_creator_trivial_low_delay::insert_new_input_image(de265_image* img)
 
   advance_frame();
 }
+
+
+// ---------------------------------------------------------------------------
+
+
+/* One picture of a hierarchical GOP. Positions are relative to the previous key picture
+   (position 0). The key picture of a GOP of size n is at position n.
+ */
+struct gop_picture
+{
+  int  pos;
+  int  temporal_id;
+  int  ref0, ref1;  // positions of the L0/L1 reference pictures, -1 if unused
+  bool referenced;  // used for reference by a later picture of the GOP
+};
+
+
+static void build_GOP_bisection(std::vector<gop_picture>& gop, int a, int b, int depth)
+{
+  if (b-a < 2) {
+    return;
+  }
+
+  int m = (a+b)/2;
+
+  gop_picture p;
+  p.pos = m;
+  p.temporal_id = depth;
+  p.ref0 = a;
+  p.ref1 = b;
+  p.referenced = (m-a >= 2 || b-m >= 2);
+  gop.push_back(p);
+
+  build_GOP_bisection(gop, a,m, depth+1);
+  build_GOP_bisection(gop, m,b, depth+1);
+}
+
+
+// the pictures of a GOP with 'n' pictures, in coding order
+static std::vector<gop_picture> build_GOP(int n, bool intraKey)
+{
+  std::vector<gop_picture> gop;
+
+  gop_picture key;
+  key.pos = n;
+  key.temporal_id = 0;
+  key.ref0 = (intraKey ? -1 : 0);
+  key.ref1 = -1;
+  key.referenced = true;
+  gop.push_back(key);
+
+  build_GOP_bisection(gop, 0,n, 1);
+
+  return gop;
+}
+
+
+/* Positions of the already decoded pictures that have to be kept in the DPB when coding
+   picture 'idx' of the GOP: all references of the remaining pictures and the key picture,
+   which is the reference for the next GOP.
+ */
+static std::vector<int> GOP_reference_set(const std::vector<gop_picture>& gop, int idx)
+{
+  std::vector<int> refs;
+
+  for (int j=-1;j<idx;j++) {
+    int pos = (j<0 ? 0 : gop[j].pos);  // j<0: previous key picture
+
+    bool needed = (pos == gop[0].pos);
+    for (int k=idx;k<(int)gop.size();k++) {
+      if (gop[k].ref0 == pos || gop[k].ref1 == pos) {
+        needed = true;
+      }
+    }
+
+    if (needed) {
+      refs.push_back(pos);
+    }
+  }
+
+  return refs;
+}
+
+
+sop_creator_random_access::sop_creator_random_access()
+{
+  mLastKeyFrame = -1;
+  mLastIntraFrame = 0;
+}
+
+
+int sop_creator_random_access::get_number_of_temporal_layers() const
+{
+  std::vector<gop_picture> gop = build_GOP(mParams.gopSize, false);
+
+  int maxTid = 0;
+  for (size_t i=0;i<gop.size();i++) {
+    maxTid = std::max(maxTid, gop[i].temporal_id);
+  }
+
+  return maxTid+1;
+}
+
+
+void sop_creator_random_access::set_SPS_header_values()
+{
+  seq_parameter_set& sps = mEncCtx->get_sps();
+
+  sps.log2_max_pic_order_cnt_lsb = get_num_poc_lsb_bits();
+
+
+  // DPB size and reordering delay of a full GOP
+
+  std::vector<gop_picture> gop = build_GOP(mParams.gopSize, false);
+
+  int maxRefs = 0;
+  int maxReorder = 0;
+  for (int i=0;i<(int)gop.size();i++) {
+    maxRefs = std::max(maxRefs, (int)GOP_reference_set(gop,i).size());
+
+    int reorder = 0;
+    for (int j=0;j<i;j++) {
+      if (gop[j].pos > gop[i].pos) { reorder++; }
+    }
+
+    maxReorder = std::max(maxReorder, reorder);
+  }
+
+  int nLayers = get_number_of_temporal_layers();
+
+  sps.sps_max_sub_layers = nLayers;
+  sps.sps_temporal_id_nesting_flag = (nLayers==1);
+  sps.sps_sub_layer_ordering_info_present_flag = 0;
+
+  for (int i=0;i<nLayers;i++) {
+    sps.sps_max_dec_pic_buffering[i] = std::max(maxRefs, maxReorder) + 1;
+    sps.sps_max_num_reorder_pics[i]  = maxReorder;
+    sps.sps_max_latency_increase_plus1[i] = 0;
+  }
+}
+
+
+void sop_creator_random_access::insert_new_input_image(de265_image* img,
+                                                       const lookahead_costs& costs)
+{
+  int frame = get_frame_number();
+  advance_frame();
+
+  input_picture in;
+  in.img = img;
+  in.costs = costs;
+
+
+  // the first picture is an IDR picture on its own
+
+  if (mLastKeyFrame < 0) {
+    img->PicOrderCntVal = frame;
+
+    assert(mEncPicBuf);
+    image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(img, frame, costs);
+
+    imgdata->set_intra();
+    imgdata->set_NAL_type(NAL_UNIT_IDR_N_LP);
+    imgdata->shdr.slice_type = SLICE_TYPE_I;
+    imgdata->shdr.slice_pic_order_cnt_lsb = 0;
+    mEncPicBuf->sop_metadata_commit(frame);
+
+    mLastKeyFrame = frame;
+    mLastIntraFrame = frame;
+    return;
+  }
+
+
+  // close the GOP before a scene cut and start a new one with an intra picture
+
+  if (costs.scene_cut) {
+    loginfo(LogEncoder,"scene cut at frame %d, coded as CRA picture\n",frame);
+
+    encode_GOP(isIntraKey(frame-1));
+
+    mPending.push_back(in);
+    encode_GOP(true);
+    return;
+  }
+
+
+  mPending.push_back(in);
+
+  if ((int)mPending.size() == mParams.gopSize) {
+    encode_GOP(isIntraKey(frame));
+  }
+}
+
+
+void sop_creator_random_access::insert_end_of_stream()
+{
+  encode_GOP(isIntraKey(mLastKeyFrame + mPending.size()));
+
+  mEncPicBuf->insert_end_of_stream();
+}
+
+
+void sop_creator_random_access::encode_GOP(bool intraKey)
+{
+  int n = mPending.size();
+  if (n==0) {
+    return;
+  }
+
+  std::vector<gop_picture> gop = build_GOP(n, intraKey);
+
+  for (size_t i=0;i<gop.size();i++) {
+    const gop_picture& p = gop[i];
+    const input_picture& in = mPending[p.pos-1];
+
+    int frame = mLastKeyFrame + p.pos;
+    in.img->PicOrderCntVal = frame;
+
+    std::vector<int> l0, l1, keep, empty;
+    if (p.ref0>=0) { l0.push_back(mLastKeyFrame + p.ref0); }
+    if (p.ref1>=0) { l1.push_back(mLastKeyFrame + p.ref1); }
+
+
+    // reference picture set, sent in the slice header
+
+    std::vector<int> refs = GOP_reference_set(gop,i);
+    std::sort(refs.begin(), refs.end());
+
+    ref_pic_set rps;
+    rps.NumNegativePics = 0;
+    rps.NumPositivePics = 0;
+
+    for (int r=refs.size()-1;r>=0;r--) {
+      if (refs[r] < p.pos) {
+        rps.DeltaPocS0     [rps.NumNegativePics] = refs[r] - p.pos;
+        rps.UsedByCurrPicS0[rps.NumNegativePics] = (refs[r]==p.ref0 || refs[r]==p.ref1);
+        rps.NumNegativePics++;
+      }
+    }
+
+    for (size_t r=0;r<refs.size();r++) {
+      if (refs[r] > p.pos) {
+        rps.DeltaPocS1     [rps.NumPositivePics] = refs[r] - p.pos;
+        rps.UsedByCurrPicS1[rps.NumPositivePics] = (refs[r]==p.ref0 || refs[r]==p.ref1);
+        rps.NumPositivePics++;
+      }
+    }
+
+    rps.compute_derived_values();
+
+    for (size_t r=0;r<refs.size();r++) {
+      if (refs[r] != p.ref0 && refs[r] != p.ref1) {
+        keep.push_back(mLastKeyFrame + refs[r]);
+      }
+    }
+
+
+    assert(mEncPicBuf);
+    image_data* imgdata = mEncPicBuf->insert_next_image_in_encoding_order(in.img, frame,
+                                                                          in.costs);
+
+    bool leading = (intraKey && p.pos < n);
+
+    if (i==0 && intraKey) {
+      mLastIntraFrame = frame;
+      imgdata->set_intra();
+      imgdata->set_NAL_type(NAL_UNIT_CRA_NUT);
+      imgdata->shdr.slice_type = SLICE_TYPE_I;
+    }
+    else {
+      if (leading) {
+        imgdata->set_NAL_type(p.referenced ? NAL_UNIT_RASL_R : NAL_UNIT_RASL_N);
+      }
+      else {
+        imgdata->set_NAL_type(p.referenced ? NAL_UNIT_TRAIL_R : NAL_UNIT_TRAIL_N);
+      }
+
+      imgdata->shdr.slice_type = (l1.empty() ? SLICE_TYPE_P : SLICE_TYPE_B);
+
+      // coarser quantization in the higher temporal layers
+      imgdata->qp_offset = 1 + p.temporal_id;
+    }
+
+    imgdata->set_references(-1, l0,l1, empty,keep);
+    imgdata->set_NAL_temporal_id(p.temporal_id);
+
+    imgdata->shdr.slice_pic_order_cnt_lsb = frame & ((1<<get_num_poc_lsb_bits())-1);
+    imgdata->shdr.short_term_ref_pic_set_sps_flag = 0;
+    imgdata->shdr.slice_ref_pic_set = rps;
+
+    mEncPicBuf->sop_metadata_commit(frame);
+  }
+
+  mLastKeyFrame += n;
+  mPending.clear();
+}
@@ -83,8 +83,9 @@ class sop_creator : public pic_order_counter
      - SHDR.slice_type
      - SHDR.slice_pic_order_cnt_lsb
      - IMGDATA.references
+     - IMGDATA.lookahead
    */
-  virtual void insert_new_input_image(de265_image*) = 0;
+  virtual void insert_new_input_image(de265_image*, const lookahead_costs&) = 0;
   virtual void insert_end_of_stream() { mEncPicBuf->insert_end_of_stream(); }
 
   virtual int  get_number_of_temporal_layers() const { return 1; }
@@ -104,11 +105,14 @@ class sop_creator_intra_only : public sop_creator
   sop_creator_intra_only();
 
   virtual void set_SPS_header_values();
-  virtual void insert_new_input_image(de265_image* img);
+  virtual void insert_new_input_image(de265_image* img, const lookahead_costs&);
 };
 
 
 
+/* Low-delay P structure with an IDR picture at least every 'intraPeriod' pictures.
+   Additional IDR pictures are inserted at scene cuts detected by the lookahead.
+ */
 class sop_creator_trivial_low_delay : public sop_creator
 {
  public:
@@ -131,12 +135,86 @@ class sop_creator_trivial_low_delay : public sop_creator
   void setParams(const params& p) { mParams=p; }
 
   virtual void set_SPS_header_values();
-  virtual void insert_new_input_image(de265_image* img);
+  virtual void insert_new_input_image(de265_image* img, const lookahead_costs&);
+
+ private:
+  params mParams;
+
+  int mLastIntraFrame;
+
+  bool isIntra(int frame, const lookahead_costs& costs) const {
+    return (frame==0 || costs.scene_cut || frame - mLastIntraFrame >= mParams.intraPeriod);
+  }
+};
+
+
+
+/* Random-access structure with hierarchical B pictures.
+
+   Input pictures are collected into GOPs of 'gopSize' pictures. The last picture of a GOP
+   (the key picture) is coded first and predicted from the previous key picture. The
+   remaining pictures are coded by recursive bisection, each predicted from the two
+   enclosing, already coded pictures (L0: past, L1: future). The bisection depth is
+   the temporal ID, such that pictures never reference pictures of a higher temporal
+   layer and pictures of the same layer are independent of each other.
+   The motion search of the B pictures (Algo_PB_MV_Search) chooses between L0, L1
+   and bi-prediction for each PB.
+
+   At least every 'intraPeriod' pictures, the key picture is coded as a CRA picture.
+   At a scene cut detected by the lookahead, the current GOP is closed before the cut
+   and the scene-cut picture is coded as a CRA picture on its own.
+ */
+class sop_creator_random_access : public sop_creator
+{
+ public:
+  struct params {
+    params() {
+      gopSize.set_ID("sop-randomAccess-gopSize");
+      gopSize.set_range(1,16);
+      gopSize.set_default(8);
+
+      intraPeriod.set_ID("sop-randomAccess-intraPeriod");
+      intraPeriod.set_minimum(1);
+      intraPeriod.set_default(256);
+    }
+
+    void registerParams(config_parameters& config) {
+      config.add_option(&gopSize);
+      config.add_option(&intraPeriod);
+    }
+
+    option_int gopSize;
+    option_int intraPeriod;
+  };
+
+  sop_creator_random_access();
+
+  void setParams(const params& p) { mParams=p; }
+
+  virtual void set_SPS_header_values();
+  virtual void insert_new_input_image(de265_image* img, const lookahead_costs&);
+  virtual void insert_end_of_stream();
+
+  virtual int  get_number_of_temporal_layers() const;
 
  private:
   params mParams;
 
-  bool isIntra(int frame) const { return (frame % mParams.intraPeriod)==0; }
+  struct input_picture {
+    de265_image* img;
+    lookahead_costs costs;
+  };
+
+  std::vector<input_picture> mPending;
+
+  int mLastKeyFrame;   // -1 before the first picture
+  int mLastIntraFrame;
+
+  bool isIntraKey(int keyFrame) const {
+    return keyFrame - mLastIntraFrame >= mParams.intraPeriod;
+  }
+
+  void encode_GOP(bool intraKey);
 };
 
 
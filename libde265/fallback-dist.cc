@@ -0,0 +1,182 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fallback-dist.h"
+#include "util.h"
+
+
+template <int N> int sad_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                    const uint8_t* p2, ptrdiff_t stride2)
+{
+  int sum=0;
+
+  for (int y=0;y<N;y++) {
+    for (int x=0;x<N;x++) {
+      sum += abs_value(p1[x] - p2[x]);
+    }
+
+    p1 += stride1;
+    p2 += stride2;
+  }
+
+  return sum;
+}
+
+
+template <int N> int ssd_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                    const uint8_t* p2, ptrdiff_t stride2)
+{
+  int sum=0;
+
+  for (int y=0;y<N;y++) {
+    for (int x=0;x<N;x++) {
+      int d = p1[x] - p2[x];
+      sum += d*d;
+    }
+
+    p1 += stride1;
+    p2 += stride2;
+  }
+
+  return sum;
+}
+
+
+static int satd_4x4_8(const uint8_t* p1, ptrdiff_t stride1,
+                      const uint8_t* p2, ptrdiff_t stride2)
+{
+  int m[4][4];
+
+  for (int y=0;y<4;y++) {
+    int d0 = p1[y*stride1+0] - p2[y*stride2+0];
+    int d1 = p1[y*stride1+1] - p2[y*stride2+1];
+    int d2 = p1[y*stride1+2] - p2[y*stride2+2];
+    int d3 = p1[y*stride1+3] - p2[y*stride2+3];
+
+    int a0 = d0+d2, a1 = d1+d3, a2 = d0-d2, a3 = d1-d3;
+
+    m[y][0] = a0+a1;
+    m[y][1] = a0-a1;
+    m[y][2] = a2+a3;
+    m[y][3] = a2-a3;
+  }
+
+  int sum=0;
+
+  for (int x=0;x<4;x++) {
+    int a0 = m[0][x]+m[2][x], a1 = m[1][x]+m[3][x];
+    int a2 = m[0][x]-m[2][x], a3 = m[1][x]-m[3][x];
+
+    sum += abs_value(a0+a1) + abs_value(a0-a1) + abs_value(a2+a3) + abs_value(a2-a3);
+  }
+
+  return (sum+1)>>1;
+}
+
+
+static inline void hadamard8_1d(int* v, int step)
+{
+  int a[8],b[8];
+
+  for (int i=0;i<4;i++) {
+    a[i  ] = v[i*step] + v[(i+4)*step];
+    a[i+4] = v[i*step] - v[(i+4)*step];
+  }
+
+  for (int k=0;k<8;k+=4) {
+    b[k  ] = a[k  ] + a[k+2];
+    b[k+1] = a[k+1] + a[k+3];
+    b[k+2] = a[k  ] - a[k+2];
+    b[k+3] = a[k+1] - a[k+3];
+  }
+
+  for (int k=0;k<8;k+=2) {
+    v[ k   *step] = b[k] + b[k+1];
+    v[(k+1)*step] = b[k] - b[k+1];
+  }
+}
+
+
+static int satd_8x8_8(const uint8_t* p1, ptrdiff_t stride1,
+                      const uint8_t* p2, ptrdiff_t stride2)
+{
+  int m[8*8];
+
+  for (int y=0;y<8;y++) {
+    for (int x=0;x<8;x++) {
+      m[y*8+x] = p1[y*stride1+x] - p2[y*stride2+x];
+    }
+
+    hadamard8_1d(&m[y*8], 1);
+  }
+
+  int sum=0;
+
+  for (int x=0;x<8;x++) {
+    hadamard8_1d(&m[x], 8);
+
+    for (int y=0;y<8;y++) {
+      sum += abs_value(m[y*8+x]);
+    }
+  }
+
+  return (sum+2)>>2;
+}
+
+
+template <int N> int satd_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                     const uint8_t* p2, ptrdiff_t stride2)
+{
+  if (N==4) {
+    return satd_4x4_8(p1,stride1, p2,stride2);
+  }
+
+  int sum=0;
+
+  for (int y=0;y<N;y+=8)
+    for (int x=0;x<N;x+=8) {
+      sum += satd_8x8_8(p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
+
+template <int N> void sad_x4_8_fallback(const uint8_t* src, ptrdiff_t srcStride,
+                                        const uint8_t* const ref[4], ptrdiff_t refStride,
+                                        int sads[4])
+{
+  for (int i=0;i<4;i++) {
+    sads[i] = sad_8_fallback<N>(src,srcStride, ref[i],refStride);
+  }
+}
+
+
+#define INSTANTIATE_DIST_FALLBACK(N)                                    \
+  template int  sad_8_fallback<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template int  ssd_8_fallback<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template int  satd_8_fallback<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template void sad_x4_8_fallback<N>(const uint8_t*,ptrdiff_t, const uint8_t* const[4],ptrdiff_t, int[4]);
+
+INSTANTIATE_DIST_FALLBACK(4)
+INSTANTIATE_DIST_FALLBACK(8)
+INSTANTIATE_DIST_FALLBACK(16)
+INSTANTIATE_DIST_FALLBACK(32)
+INSTANTIATE_DIST_FALLBACK(64)
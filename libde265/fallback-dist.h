@@ -0,0 +1,47 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FALLBACK_DIST_H
+#define FALLBACK_DIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Distortion between two square blocks of 8-bit samples.
+   The template parameter is the block size (4,8,16,32,64). */
+
+template <int N> int sad_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                    const uint8_t* p2, ptrdiff_t stride2);
+
+template <int N> int ssd_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                    const uint8_t* p2, ptrdiff_t stride2);
+
+// Sum of absolute Hadamard coefficients on 4x4 (N=4) or 8x8 sub-blocks,
+// normalized to the scale of the SAD.
+template <int N> int satd_8_fallback(const uint8_t* p1, ptrdiff_t stride1,
+                                     const uint8_t* p2, ptrdiff_t stride2);
+
+// SAD of 'src' against four reference positions at once
+template <int N> void sad_x4_8_fallback(const uint8_t* src, ptrdiff_t srcStride,
+                                        const uint8_t* const ref[4], ptrdiff_t refStride,
+                                        int sads[4]);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "fallback-nal.h"
+
+#include <string.h>
+
+
+int find_zero_byte_pair_fallback(const uint8_t* data, int len)
+{
+  int i=0;
+
+  // Check 8 bytes at a time whether there is a zero byte in them.
+  // A pair cannot start in a word without zero bytes.
+
+  for ( ; i+9 <= len ; i+=8) {
+    uint64_t w;
+    memcpy(&w, data+i, 8);
+
+    if (((w - UINT64_C(0x0101010101010101)) & ~w & UINT64_C(0x8080808080808080)) != 0) {
+      for (int k=i;k<i+8;k++) {
+        if (data[k]==0 && data[k+1]==0) {
+          return k;
+        }
+      }
+    }
+  }
+
+  for ( ; i+1 < len ; i++) {
+    if (data[i]==0 && data[i+1]==0) {
+      return i;
+    }
+  }
+
+  return len;
+}
@@ -1,8 +1,6 @@
 /*
  * H.265 video codec.
- * Copyright (c) 2014 struktur AG, Dirk Farin <farin@struktur.de>
- *
- * Authors: Dirk Farin <farin@struktur.de>
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
  *
  * This file is part of libde265.
  *
@@ -20,42 +18,15 @@
  * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef ALLOC_POOL_H
-#define ALLOC_POOL_H
-
-#ifdef HAVE_CONFIG_H
-#include "config.h"
-#endif
+#ifndef FALLBACK_NAL_H
+#define FALLBACK_NAL_H
 
-#include <vector>
-#include <cstddef>
-#ifdef HAVE_STDINT_H
 #include <stdint.h>
-#endif
-#ifdef HAVE_CSTDINT
-#include <cstdint>
-#endif
-
-
-class alloc_pool
-{
- public:
-  alloc_pool(size_t objSize, int poolSize=1000, bool grow=true);
-  ~alloc_pool();
-
-  void* new_obj(const size_t size);
-  void  delete_obj(void*);
-  void  purge();
-
- private:
-  size_t mObjSize;
-  int    mPoolSize;
-  bool   mGrow;
 
-  std::vector<uint8_t*> m_memBlocks;
-  std::vector<void*>    m_freeList;
 
-  void add_memory_block();
-};
+/* Returns the position of the first pair of zero bytes (00 00) in 'data'.
+   These are the candidates for start codes and emulation prevention bytes.
+   If there is no such pair, 'len' is returned. */
+int find_zero_byte_pair_fallback(const uint8_t* data, int len);
 
 #endif
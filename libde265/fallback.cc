@@ -21,6 +21,8 @@
 #include "fallback.h"
 #include "fallback-motion.h"
 #include "fallback-dct.h"
+#include "fallback-nal.h"
+#include "fallback-dist.h"
 
 
 void init_acceleration_functions_fallback(struct acceleration_functions* accel)
@@ -124,4 +126,30 @@ void init_acceleration_functions_fallback(struct acceleration_functions* accel)
   accel->hadamard_transform_8[1] = hadamard_8x8_8_fallback;
   accel->hadamard_transform_8[2] = hadamard_16x16_8_fallback;
   accel->hadamard_transform_8[3] = hadamard_32x32_8_fallback;
+
+  accel->sad_8[0] = sad_8_fallback<4>;
+  accel->sad_8[1] = sad_8_fallback<8>;
+  accel->sad_8[2] = sad_8_fallback<16>;
+  accel->sad_8[3] = sad_8_fallback<32>;
+  accel->sad_8[4] = sad_8_fallback<64>;
+
+  accel->ssd_8[0] = ssd_8_fallback<4>;
+  accel->ssd_8[1] = ssd_8_fallback<8>;
+  accel->ssd_8[2] = ssd_8_fallback<16>;
+  accel->ssd_8[3] = ssd_8_fallback<32>;
+  accel->ssd_8[4] = ssd_8_fallback<64>;
+
+  accel->satd_8[0] = satd_8_fallback<4>;
+  accel->satd_8[1] = satd_8_fallback<8>;
+  accel->satd_8[2] = satd_8_fallback<16>;
+  accel->satd_8[3] = satd_8_fallback<32>;
+  accel->satd_8[4] = satd_8_fallback<64>;
+
+  accel->sad_x4_8[0] = sad_x4_8_fallback<4>;
+  accel->sad_x4_8[1] = sad_x4_8_fallback<8>;
+  accel->sad_x4_8[2] = sad_x4_8_fallback<16>;
+  accel->sad_x4_8[3] = sad_x4_8_fallback<32>;
+  accel->sad_x4_8[4] = sad_x4_8_fallback<64>;
+
+  accel->find_zero_byte_pair = find_zero_byte_pair_fallback;
 }
@@ -33,6 +33,10 @@
 #include <malloc.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 #ifdef HAVE_SSE4_1
 #define MEMORY_PADDING  8
 #else
@@ -40,6 +44,7 @@
 #endif
 
 #define STANDARD_ALIGNMENT 16
+#define WIDE_ALIGNMENT     64  // cache line / AVX-512 register size
 
 #ifdef HAVE___MINGW_ALIGNED_MALLOC
 #define ALLOC_ALIGNED(alignment, size)         __mingw_aligned_malloc((size), (alignment))
@@ -103,46 +108,167 @@ LIBDE265_API void de265_free_image_plane(struct de265_image* img, int cIdx)
 }
 
 
-static int  de265_image_get_buffer(de265_decoder_context* ctx,
-                                   de265_image_spec* spec, de265_image* img, void* userdata)
+static void* alloc_plane_aligned16(size_t size) { return ALLOC_ALIGNED(16, size); }
+static void* alloc_plane_aligned64(size_t size) { return ALLOC_ALIGNED(WIDE_ALIGNMENT, size); }
+static void  free_plane_aligned(void* p) { FREE_ALIGNED(p); }
+
+
+/* --- huge page backed planes ---
+
+   Each plane is preceded by a header that remembers how the memory was obtained.
+   The header is WIDE_ALIGNMENT bytes large to keep the plane start aligned.
+ */
+
+#define HUGE_PAGE_SIZE (2*1024*1024)
+
+struct hugepage_plane_header
+{
+  uint8_t* base;
+  size_t   mapped_size;  // size of explicit huge page mapping, 0 if allocated with ALLOC_ALIGNED
+};
+
+// only use huge pages if the plane (with header) fills a good part of a huge page
+static bool plane_uses_huge_pages(size_t total)
+{
+#if defined(__linux__) && (defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE))
+  return total >= HUGE_PAGE_SIZE/2;
+#else
+  return false;
+#endif
+}
+
+// Memory taken by a plane of 'size' bytes, including the header and huge page rounding.
+static size_t hugepage_plane_footprint(size_t size)
+{
+  size_t total = size + WIDE_ALIGNMENT;
+
+  if (plane_uses_huge_pages(total)) {
+    return (total + HUGE_PAGE_SIZE-1) & ~((size_t)HUGE_PAGE_SIZE-1);
+  }
+
+  return total;
+}
+
+static void* alloc_plane_hugepages(size_t size)
+{
+  size_t total = size + WIDE_ALIGNMENT;
+
+  uint8_t* base = NULL;
+  size_t   mapped_size = 0;
+
+#if defined(__linux__)
+  if (plane_uses_huge_pages(total)) {
+    size_t rounded_size = hugepage_plane_footprint(size);
+
+#ifdef MAP_HUGETLB
+    // explicit huge pages (only available if a huge page pool has been configured)
+
+    void* m = mmap(NULL, rounded_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (m != MAP_FAILED) {
+      base = (uint8_t*)m;
+      mapped_size = rounded_size;
+    }
+#endif
+
+#ifdef MADV_HUGEPAGE
+    // transparent huge pages
+
+    if (base == NULL) {
+      base = (uint8_t*)ALLOC_ALIGNED(HUGE_PAGE_SIZE, rounded_size);
+      if (base) {
+        madvise(base, rounded_size, MADV_HUGEPAGE);
+      }
+    }
+#endif
+  }
+#endif
+
+  // fallback: normal pages
+
+  if (base == NULL) {
+    base = (uint8_t*)ALLOC_ALIGNED(WIDE_ALIGNMENT, total);
+    if (base == NULL) {
+      return NULL;
+    }
+  }
+
+  hugepage_plane_header* hdr = (hugepage_plane_header*)base;
+  hdr->base = base;
+  hdr->mapped_size = mapped_size;
+
+  return base + WIDE_ALIGNMENT;
+}
+
+static void free_plane_hugepages(void* p)
+{
+  const hugepage_plane_header* hdr = (const hugepage_plane_header*)((uint8_t*)p - WIDE_ALIGNMENT);
+
+#if defined(__linux__)
+  if (hdr->mapped_size) {
+    munmap(hdr->base, hdr->mapped_size);
+    return;
+  }
+#endif
+
+  FREE_ALIGNED(hdr->base);
+}
+
+
+/* Strides and byte sizes of the image planes when rows are aligned to 'alignment'.
+   Shared by the allocators and the memory accounting.
+ */
+static void image_plane_layout(const de265_image_spec* spec, const de265_image* img, int alignment,
+                               int* luma_stride, int* chroma_stride, size_t plane_size[3])
 {
   const int rawChromaWidth  = spec->width  / img->SubWidthC;
   const int rawChromaHeight = spec->height / img->SubHeightC;
 
-  int luma_stride   = (spec->width    + spec->alignment-1) / spec->alignment * spec->alignment;
-  int chroma_stride = (rawChromaWidth + spec->alignment-1) / spec->alignment * spec->alignment;
+  *luma_stride   = (spec->width    + alignment-1) / alignment * alignment;
+  *chroma_stride = (rawChromaWidth + alignment-1) / alignment * alignment;
 
   assert(img->BitDepth_Y >= 8 && img->BitDepth_Y <= 16);
   assert(img->BitDepth_C >= 8 && img->BitDepth_C <= 16);
 
-  int luma_bpl   = luma_stride   * ((img->BitDepth_Y+7)/8);
-  int chroma_bpl = chroma_stride * ((img->BitDepth_C+7)/8);
+  size_t luma_bpl   = (size_t)*luma_stride   * ((img->BitDepth_Y+7)/8);
+  size_t chroma_bpl = (size_t)*chroma_stride * ((img->BitDepth_C+7)/8);
 
-  int luma_height   = spec->height;
-  int chroma_height = rawChromaHeight;
+  plane_size[0] = spec->height * luma_bpl + MEMORY_PADDING;
+
+  if (img->get_chroma_format() != de265_chroma_mono) {
+    plane_size[1] = plane_size[2] = rawChromaHeight * chroma_bpl + MEMORY_PADDING;
+  }
+  else {
+    plane_size[1] = plane_size[2] = 0;
+    *chroma_stride = 0;
+  }
+}
+
+
+static int image_get_buffer(de265_image_spec* spec, de265_image* img, int alignment,
+                            void* (*alloc_plane)(size_t), void (*free_plane)(void*))
+{
+  int luma_stride, chroma_stride;
+  size_t plane_size[3];
+  image_plane_layout(spec, img, alignment, &luma_stride, &chroma_stride, plane_size);
 
   bool alloc_failed = false;
 
   uint8_t* p[3] = { 0,0,0 };
-  p[0] = (uint8_t *)ALLOC_ALIGNED_16(luma_height   * luma_bpl   + MEMORY_PADDING);
+  p[0] = (uint8_t *)alloc_plane(plane_size[0]);
   if (p[0]==NULL) { alloc_failed=true; }
 
   if (img->get_chroma_format() != de265_chroma_mono) {
-    p[1] = (uint8_t *)ALLOC_ALIGNED_16(chroma_height * chroma_bpl + MEMORY_PADDING);
-    p[2] = (uint8_t *)ALLOC_ALIGNED_16(chroma_height * chroma_bpl + MEMORY_PADDING);
+    p[1] = (uint8_t *)alloc_plane(plane_size[1]);
+    p[2] = (uint8_t *)alloc_plane(plane_size[2]);
 
     if (p[1]==NULL || p[2]==NULL) { alloc_failed=true; }
   }
-  else {
-    p[1] = NULL;
-    p[2] = NULL;
-    chroma_stride = 0;
-  }
 
   if (alloc_failed) {
     for (int i=0;i<3;i++)
       if (p[i]) {
-        FREE_ALIGNED(p[i]);
+        free_plane(p[i]);
       }
 
     return 0;
@@ -155,23 +281,135 @@ static int  de265_image_get_buffer(de265_decoder_context* ctx,
   return 1;
 }
 
-static void de265_image_release_buffer(de265_decoder_context* ctx,
-                                       de265_image* img, void* userdata)
+static void image_release_buffer(de265_image* img, void (*free_plane)(void*))
 {
   for (int i=0;i<3;i++) {
     uint8_t* p = (uint8_t*)img->get_image_plane(i);
     if (p) {
-      FREE_ALIGNED(p);
+      free_plane(p);
     }
   }
 }
 
 
+static int  de265_image_get_buffer(de265_decoder_context* ctx,
+                                   de265_image_spec* spec, de265_image* img, void* userdata)
+{
+  return image_get_buffer(spec, img, spec->alignment, alloc_plane_aligned16, free_plane_aligned);
+}
+
+static void de265_image_release_buffer(de265_decoder_context* ctx,
+                                       de265_image* img, void* userdata)
+{
+  image_release_buffer(img, free_plane_aligned);
+}
+
+static int wide_alignment(const de265_image_spec* spec)
+{
+  return libde265_max(spec->alignment, WIDE_ALIGNMENT);
+}
+
+static int  de265_image_get_buffer_aligned64(de265_decoder_context* ctx,
+                                             de265_image_spec* spec, de265_image* img,
+                                             void* userdata)
+{
+  return image_get_buffer(spec, img, wide_alignment(spec), alloc_plane_aligned64, free_plane_aligned);
+}
+
+static int  de265_image_get_buffer_hugepages(de265_decoder_context* ctx,
+                                             de265_image_spec* spec, de265_image* img,
+                                             void* userdata)
+{
+  return image_get_buffer(spec, img, wide_alignment(spec), alloc_plane_hugepages, free_plane_hugepages);
+}
+
+static void de265_image_release_buffer_hugepages(de265_decoder_context* ctx,
+                                                 de265_image* img, void* userdata)
+{
+  image_release_buffer(img, free_plane_hugepages);
+}
+
+
 de265_image_allocation de265_image::default_image_allocation = {
   de265_image_get_buffer,
   de265_image_release_buffer
 };
 
+de265_image_allocation de265_image::aligned64_image_allocation = {
+  de265_image_get_buffer_aligned64,
+  de265_image_release_buffer
+};
+
+de265_image_allocation de265_image::hugepage_image_allocation = {
+  de265_image_get_buffer_hugepages,
+  de265_image_release_buffer_hugepages
+};
+
+
+/* Size of the image planes as allocated by the built-in allocation functions.
+   For custom allocation functions, the default layout is used as an estimate. */
+static size_t image_planes_memory_size(const de265_image_spec* spec, const de265_image* img,
+                                       const de265_image_allocation& allocation)
+{
+  bool hugepages = (allocation.get_buffer == de265_image_get_buffer_hugepages);
+  bool wide      = (allocation.get_buffer == de265_image_get_buffer_aligned64 || hugepages);
+
+  int luma_stride, chroma_stride;
+  size_t plane_size[3];
+  image_plane_layout(spec, img, wide ? wide_alignment(spec) : spec->alignment,
+                     &luma_stride, &chroma_stride, plane_size);
+
+  size_t size = 0;
+  for (int c=0;c<3;c++) {
+    if (plane_size[c]) {
+      size += (hugepages ? hugepage_plane_footprint(plane_size[c]) : plane_size[c]);
+    }
+  }
+
+  return size;
+}
+
+
+/* Size of the decoding metadata arrays allocated in alloc_image(). */
+static size_t image_metadata_memory_size(const seq_parameter_set& sps)
+{
+  size_t size = 0;
+
+  size += (size_t)sps.PicWidthInMinPUs * sps.PicHeightInMinPUs;  // intraPredModeC
+  size += (size_t)sps.PicWidthInMinCbsY * sps.PicHeightInMinCbsY * sizeof(CB_ref_info);
+
+  int puWidth  = sps.PicWidthInMinCbsY  << (sps.Log2MinCbSizeY -2);
+  int puHeight = sps.PicHeightInMinCbsY << (sps.Log2MinCbSizeY -2);
+  size += (size_t)puWidth * puHeight * sizeof(PBMotion);
+
+  size += (size_t)sps.PicWidthInTbsY * sps.PicHeightInTbsY;  // tu_info
+
+  size += (size_t)sps.PicSizeInCtbsY * 3 * (sps.CtbSizeY/4) * (sps.CtbSizeY/4);  // blk_info
+
+  size += (size_t)sps.PicSizeInCtbsY * (sizeof(CTB_info) + sizeof(de265_progress_lock));
+
+  return size;
+}
+
+
+size_t de265_image::allocated_metadata_size() const
+{
+  size_t size = 0;
+
+  size += intraPredModeC.data_size * sizeof(uint8_t);
+  size += cb_info.data_size * sizeof(CB_ref_info);
+  size += pb_info.data_size * sizeof(PBMotion);
+  size += tu_info.data_size * sizeof(uint8_t);
+  size += blk_info.data_size * sizeof(uint8_t);
+  size += ctb_info.data_size * sizeof(CTB_info);
+
+  if (ctb_progress) {
+    size += ctb_info.data_size * sizeof(de265_progress_lock);
+  }
+
+  return size;
+}
+
 
 void de265_image::set_image_plane(int cIdx, uint8_t* mem, int stride, void *userdata)
 {
@@ -195,6 +433,10 @@ de265_image::de265_image()
 
   encoder_image_release_func = NULL;
 
+  plane_memory_category = de265_memory_image_planes;
+  plane_memory_bytes = 0;
+  metadata_memory_bytes = 0;
+
   //alloc_functions.get_buffer = NULL;
   //alloc_functions.release_buffer = NULL;
 
@@ -217,6 +459,7 @@ de265_image::de265_image()
   PicOrderCntVal = -1; // undefined
   PicState = UnusedForReference;
   PicOutputFlag = false;
+  luma_only = false;
 
   nThreadsQueued   = 0;
   nThreadsRunning  = 0;
@@ -224,6 +467,10 @@ de265_image::de265_image()
   nThreadsFinished = 0;
   nThreadsTotal    = 0;
 
+  sei_hash_checked = false;
+  sei_hash_tasks_pending = 0;
+  sei_hash_mismatch = false;
+
   de265_mutex_init(&mutex);
   de265_cond_init(&finished_cond);
 }
@@ -245,6 +492,11 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
                 allocated to the requested size. Without the release, the old image-data
                 will not be freed. */
 
+  sei_hash_checked = false;
+  sei_hash_mismatch = false;
+
+  luma_only = false;
+
   ID = s_next_image_ID++;
   removed_at_picture_id = std::numeric_limits<int32_t>::max();
 
@@ -378,7 +630,18 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
 
   bool mem_alloc_success = true;
 
+  memory_accounting* accounting = (decctx ? &decctx->memory_usage : NULL);
+
   if (image_allocation_functions.get_buffer != NULL) {
+    if (accounting) {
+      size_t planes_size = image_planes_memory_size(&spec, this, image_allocation_functions);
+      if (!accounting->reserve(plane_memory_category, planes_size)) {
+        return DE265_ERROR_OUT_OF_MEMORY;
+      }
+
+      plane_memory_bytes = planes_size;
+    }
+
     mem_alloc_success = image_allocation_functions.get_buffer(decctx, &spec, this,
                                                               alloc_userdata);
 
@@ -391,6 +654,11 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
 
     if (!mem_alloc_success)
       {
+        if (accounting) {
+          accounting->release(plane_memory_category, plane_memory_bytes);
+          plane_memory_bytes = 0;
+        }
+
         return DE265_ERROR_OUT_OF_MEMORY;
       }
   }
@@ -401,10 +669,21 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
   // --- allocate decoding info arrays ---
 
   if (allocMetadata) {
-    // intra pred mode
+    // check the memory limit before changing anything
+
+    if (accounting) {
+      size_t metadata_size = image_metadata_memory_size(*sps);
+      if (metadata_size > metadata_memory_bytes) {
+        if (!accounting->reserve(de265_memory_image_metadata,
+                                 metadata_size - metadata_memory_bytes)) {
+          return DE265_ERROR_OUT_OF_MEMORY;
+        }
+
+        metadata_memory_bytes = metadata_size;
+      }
+    }
 
-    mem_alloc_success &= intraPredMode.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
-                                             sps->Log2MinPUSize);
+    // intra pred mode
 
     mem_alloc_success &= intraPredModeC.alloc(sps->PicWidthInMinPUs, sps->PicHeightInMinPUs,
                                               sps->Log2MinPUSize);
@@ -427,12 +706,12 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
     mem_alloc_success &= tu_info.alloc(sps->PicWidthInTbsY, sps->PicHeightInTbsY,
                                        sps->Log2MinTrafoSize);
 
-    // deblk info
+    // deblk info, luma intra modes, and per-4x4 flags (tiled per CTB)
 
     int deblk_w = (sps->pic_width_in_luma_samples +3)/4;
     int deblk_h = (sps->pic_height_in_luma_samples+3)/4;
 
-    mem_alloc_success &= deblk_info.alloc(deblk_w, deblk_h, 2);
+    mem_alloc_success &= blk_info.alloc(deblk_w, deblk_h, sps->Log2CtbSizeY);
 
     // CTB info
 
@@ -447,6 +726,17 @@ de265_error de265_image::alloc_image(int w,int h, enum de265_chroma c,
       }
 
 
+    // arrays may have become smaller, or some allocations failed
+
+    if (accounting) {
+      size_t metadata_size = allocated_metadata_size();
+      if (metadata_size < metadata_memory_bytes) {
+        accounting->release(de265_memory_image_metadata, metadata_memory_bytes - metadata_size);
+        metadata_memory_bytes = metadata_size;
+      }
+    }
+
+
     // check for memory shortage
 
     if (!mem_alloc_success)
@@ -469,6 +759,10 @@ de265_image::~de265_image()
     delete[] ctb_progress;
   }
 
+  if (decctx && metadata_memory_bytes) {
+    decctx->memory_usage.release(de265_memory_image_metadata, metadata_memory_bytes);
+  }
+
   de265_cond_destroy(&finished_cond);
   de265_mutex_destroy(&mutex);
 }
@@ -476,6 +770,15 @@ de265_image::~de265_image()
 
 void de265_image::release()
 {
+  // background hash checks may still read the image planes
+
+  wait_for_sei_hash_check();
+
+  for (size_t i=0;i<sei_hash_tasks.size();i++) {
+    delete sei_hash_tasks[i];
+  }
+  sei_hash_tasks.clear();
+
   // free image memory
 
   if (pixels[0])
@@ -498,6 +801,11 @@ void de265_image::release()
         }
     }
 
+  if (decctx && plane_memory_bytes) {
+    decctx->memory_usage.release(plane_memory_category, plane_memory_bytes);
+    plane_memory_bytes = 0;
+  }
+
   // free slices
 
   for (int i=0;i<slices.size();i++) {
@@ -523,6 +831,33 @@ void de265_image::fill_image(int y,int cb,int cr)
 }
 
 
+void de265_image::fill_plane(int cIdx, int value)
+{
+  if (pixels[cIdx]==NULL) {
+    return;
+  }
+
+  int w = get_width(cIdx);
+  int h = get_height(cIdx);
+  int s = get_image_stride(cIdx);
+
+  if (high_bit_depth(cIdx)) {
+    uint16_t* p = (uint16_t*)pixels[cIdx];
+
+    for (int y=0;y<h;y++) {
+      for (int x=0;x<w;x++) {
+        p[x+y*s] = value;
+      }
+    }
+  }
+  else {
+    for (int y=0;y<h;y++) {
+      memset(pixels[cIdx] + y*s, value, w);
+    }
+  }
+}
+
+
 de265_error de265_image::copy_image(const de265_image* src)
 {
   /* TODO: actually, since we allocate the image only for internal purpose, we
@@ -604,6 +939,15 @@ void de265_image::exchange_pixel_data_with(de265_image& b)
   std::swap(stride, b.stride);
   std::swap(chroma_stride, b.chroma_stride);
   std::swap(image_allocation_functions, b.image_allocation_functions);
+
+  // the accounted memory moves along with the pixel data
+
+  if (decctx && plane_memory_category != b.plane_memory_category) {
+    decctx->memory_usage.move(plane_memory_category, b.plane_memory_category, plane_memory_bytes);
+    decctx->memory_usage.move(b.plane_memory_category, plane_memory_category, b.plane_memory_bytes);
+  }
+
+  std::swap(plane_memory_bytes, b.plane_memory_bytes);
 }
 
 
@@ -703,6 +1047,47 @@ void de265_image::wait_for_completion()
   de265_mutex_unlock(&mutex);
 }
 
+void de265_image::start_sei_hash_check(int nTasks)
+{
+  sei_hash_checked = true;
+  sei_hash_tasks_pending += nTasks;
+}
+
+void de265_image::sei_hash_check_done(bool correct)
+{
+  de265_mutex_lock(&mutex);
+
+  if (!correct) {
+    sei_hash_mismatch = true;
+  }
+
+  sei_hash_tasks_pending--;
+  assert(sei_hash_tasks_pending >= 0);
+
+  if (sei_hash_tasks_pending==0) {
+    de265_cond_broadcast(&finished_cond, &mutex);
+  }
+
+  de265_mutex_unlock(&mutex);
+}
+
+void de265_image::wait_for_sei_hash_check()
+{
+  de265_mutex_lock(&mutex);
+  while (sei_hash_tasks_pending > 0) {
+    de265_cond_wait(&finished_cond, &mutex);
+  }
+  de265_mutex_unlock(&mutex);
+}
+
+enum de265_sei_hash_check_result de265_image::get_sei_hash_check_result() const
+{
+  if (!sei_hash_checked)         return de265_sei_hash_check_result_NOT_CHECKED;
+  if (sei_hash_check_pending())  return de265_sei_hash_check_result_PENDING;
+  if (sei_hash_mismatch)         return de265_sei_hash_check_result_MISMATCH;
+  return de265_sei_hash_check_result_CORRECT;
+}
+
 bool de265_image::debug_is_completed() const
 {
   return nThreadsFinished==nThreadsTotal;
@@ -718,7 +1103,7 @@ void de265_image::clear_metadata()
   cb_info.clear();
   //tu_info.clear();  // done on the fly
   ctb_info.clear();
-  deblk_info.clear();
+  blk_info.clear();
 
   // --- reset CTB progresses ---
 
@@ -64,7 +64,6 @@ enum PictureState {
 #define SEI_HASH_CORRECT   1
 #define SEI_HASH_INCORRECT 2
 
-#define TU_FLAG_NONZERO_COEFF  (1<<7)
 #define TU_FLAG_SPLIT_TRANSFORM_MASK  0x1F
 
 #define DEBLOCK_FLAG_VERTI (1<<4)
@@ -73,6 +72,10 @@ enum PictureState {
 #define DEBLOCK_PB_EDGE_HORIZ (1<<7)
 #define DEBLOCK_BS_MASK     0x03
 
+#define BLK_FLAG_INTRA          (1<<0)  // PredMode == MODE_INTRA
+#define BLK_FLAG_PCM            (1<<1)
+#define BLK_FLAG_NONZERO_COEFF  (1<<2)  // luma TB has non-zero coefficients
+
 
 #define CTB_PROGRESS_NONE      0
 #define CTB_PROGRESS_PREFILTER 1
@@ -177,6 +180,96 @@ template <class DataUnit> class MetaDataArray
       }
 
 
+/* Per-4x4 metadata used by the deblocking filter and for the intra-mode
+   prediction from neighboring blocks.
+   The data is tiled per CTB, such that all values of a CTB are contiguous in
+   memory. Within a CTB tile, the values are stored as structure-of-arrays:
+   the deblocking flags/bS, the BLK_FLAG_* flags, and the luma intra-prediction
+   modes. All three values of a 4x4 block are accessed with the same index.
+ */
+class CTBTiledBlkInfo
+{
+ public:
+  CTBTiledBlkInfo() { data=NULL; data_size=0; width_in_units=0; height_in_units=0;
+    log2CtbSize=0; width_in_ctbs=0; log2UnitsPerCtbRow=0; unitsPerCtb=0; }
+  ~CTBTiledBlkInfo() { free(data); }
+
+  LIBDE265_CHECK_RESULT bool alloc(int w,int h, int _log2CtbSize) {
+    log2CtbSize = _log2CtbSize;
+    log2UnitsPerCtbRow = log2CtbSize-2;
+    unitsPerCtb = 1<<(2*log2UnitsPerCtbRow);
+
+    width_in_ctbs  = (w + (1<<log2UnitsPerCtbRow)-1) >> log2UnitsPerCtbRow;
+    int height_in_ctbs = (h + (1<<log2UnitsPerCtbRow)-1) >> log2UnitsPerCtbRow;
+
+    int size = width_in_ctbs * height_in_ctbs * unitsPerCtb * 3;
+
+    if (size != data_size) {
+      free(data);
+      data = (uint8_t*)malloc(size);
+      if (data == NULL) {
+        data_size = 0;
+        return false;
+      }
+      data_size = size;
+    }
+
+    width_in_units = w;
+    height_in_units = h;
+
+    return true;
+  }
+
+  void clear() {
+    if (data) memset(data, 0, data_size);
+  }
+
+  // index of the 4x4 block containing luma sample (x,y)
+  int index(int x,int y) const {
+    assert((x>>2) < width_in_units);
+    assert((y>>2) < height_in_units);
+
+    int ctb  = (x>>log2CtbSize) + (y>>log2CtbSize)*width_in_ctbs;
+    int mask = (1<<log2UnitsPerCtbRow)-1;
+
+    return ctb*3*unitsPerCtb + ((((y>>2) & mask) << log2UnitsPerCtbRow) | ((x>>2) & mask));
+  }
+
+  // index offset between vertically adjacent 4x4 blocks in the same CTB
+  int row_stride() const { return 1<<log2UnitsPerCtbRow; }
+
+  uint8_t& deblk(int idx) { return data[idx]; }
+  uint8_t  deblk(int idx) const { return data[idx]; }
+  uint8_t& flags(int idx) { return data[idx + unitsPerCtb]; }
+  uint8_t  flags(int idx) const { return data[idx + unitsPerCtb]; }
+  uint8_t& intraPredMode(int idx) { return data[idx + 2*unitsPerCtb]; }
+  uint8_t  intraPredMode(int idx) const { return data[idx + 2*unitsPerCtb]; }
+
+  // set/clear flags in all 4x4 blocks of a square block
+  void set_flags(int x0,int y0, int log2BlkWidth, uint8_t flag, bool value) {
+    const int width = 1<<(log2BlkWidth-2);
+
+    for (int y=0;y<width;y++)
+      for (int x=0;x<width;x++) {
+        uint8_t& f = flags(index(x0+x*4, y0+y*4));
+        if (value) f |= flag;
+        else       f &= ~flag;
+      }
+  }
+
+  // private:
+  uint8_t* data;
+  int data_size;
+  int width_in_units;   // width of the image in 4x4 blocks
+  int height_in_units;
+
+  int log2CtbSize;
+  int width_in_ctbs;
+  int log2UnitsPerCtbRow;
+  int unitsPerCtb;
+};
+
+
 typedef struct {
   uint16_t SliceAddrRS;
   uint16_t SliceHeaderIndex; // index into array to slice header for this CTB
@@ -246,6 +339,7 @@ struct de265_image {
   }
 
   void fill_image(int y,int u,int v);
+  void fill_plane(int cIdx, int value); // also for high bit depths
   de265_error copy_image(const de265_image* src);
   void copy_lines_from(const de265_image* src, int first, int end);
   void exchange_pixel_data_with(de265_image&);
@@ -320,7 +414,8 @@ struct de265_image {
     return get_bit_depth(cIdx)>8;
   }
 
-  bool can_be_released() const { return PicOutputFlag==false && PicState==UnusedForReference; }
+  bool can_be_released() const { return PicOutputFlag==false && PicState==UnusedForReference &&
+                                        !sei_hash_check_pending(); }
 
 
   void add_slice_segment_header(slice_segment_header* shdr) {
@@ -337,6 +432,8 @@ struct de265_image {
 
 
   static de265_image_allocation default_image_allocation;
+  static de265_image_allocation aligned64_image_allocation; // planes and rows aligned to 64 bytes
+  static de265_image_allocation hugepage_image_allocation;  // as above, backed by huge pages
 
   void printBlk(const char* title, int x0,int y0,int blkSize,int cIdx) const {
     ::printBlk(title, get_image_plane_at_pos(cIdx,x0,y0),
@@ -380,6 +477,8 @@ public:
   enum PictureState PicState;
   bool PicOutputFlag;
 
+  bool luma_only; // chroma planes are not reconstructed (DE265_DECODER_PARAM_BOOL_LUMA_ONLY)
+
   int32_t removed_at_picture_id;
 
   const video_parameter_set& get_vps() const { return *vps; }
@@ -411,10 +510,11 @@ private:
   MetaDataArray<CTB_info>    ctb_info;
   MetaDataArray<CB_ref_info> cb_info;
   MetaDataArray<PBMotion>    pb_info;
-  MetaDataArray<uint8_t>     intraPredMode;
   MetaDataArray<uint8_t>     intraPredModeC;
   MetaDataArray<uint8_t>     tu_info;
-  MetaDataArray<uint8_t>     deblk_info;
+  CTBTiledBlkInfo            blk_info;  // deblocking, intra modes, and per-4x4 flags
+
+  size_t allocated_metadata_size() const;
 
 public:
   // --- meta information ---
@@ -427,11 +527,33 @@ public:
                                      de265_image*,
                                      void* userdata);
 
+  // --- memory accounting (only for images of a decoder context) ---
+
+  enum de265_memory_category plane_memory_category; // category the pixel memory is counted in
+  size_t plane_memory_bytes;     // pixel memory currently accounted for this image
+  size_t metadata_memory_bytes;  // metadata memory currently accounted for this image
+
   uint8_t integrity; /* Whether an error occured while the image was decoded.
                         When generated, this is initialized to INTEGRITY_CORRECT,
                         and changed on decoding errors.
                       */
-  bool sei_hash_check_result;
+
+  // --- SEI decoded picture hash check ---
+
+  void start_sei_hash_check(int nTasks);  // announce 'nTasks' plane checks
+  void sei_hash_check_done(bool correct); // NOTE: do not access the calling task afterwards
+  void wait_for_sei_hash_check();         // block until all background checks are finished
+  bool sei_hash_check_pending() const { return sei_hash_tasks_pending > 0; }
+  enum de265_sei_hash_check_result get_sei_hash_check_result() const;
+
+  std::vector<thread_task*> sei_hash_tasks; // we are the owner
+
+ private:
+  bool sei_hash_checked;
+  std::atomic<int>  sei_hash_tasks_pending;
+  std::atomic<bool> sei_hash_mismatch;
+
+ public:
 
   nal_header nal_hdr;
 
@@ -486,12 +608,18 @@ public:
   void set_pred_mode(int x,int y, int log2BlkWidth, enum PredMode mode)
   {
     SET_CB_BLK(x,y,log2BlkWidth, PredMode, mode);
+
+    blk_info.set_flags(x,y,log2BlkWidth, BLK_FLAG_INTRA, mode==MODE_INTRA);
   }
 
   void fill_pred_mode(enum PredMode mode)
   {
     for (int i=0;i<cb_info.data_size;i++)
       { cb_info[i].PredMode = MODE_INTRA; }
+
+    for (int y=0;y<blk_info.height_in_units;y++)
+      for (int x=0;x<blk_info.width_in_units;x++)
+        { blk_info.flags(blk_info.index(x*4,y*4)) |= BLK_FLAG_INTRA; }
   }
 
   enum PredMode get_pred_mode(int x,int y) const
@@ -508,6 +636,8 @@ public:
   {
     SET_CB_BLK(x,y,log2BlkWidth, pcm_flag, value);
 
+    blk_info.set_flags(x,y,log2BlkWidth, BLK_FLAG_PCM, value);
+
     // TODO: in the encoder, we somewhere have to clear this
     ctb_info.get(x,y).has_pcm_or_cu_transquant_bypass = true;
   }
@@ -593,6 +723,8 @@ public:
   void clear_split_transform_flags(int x0,int y0,int log2CbSize)
   {
     CLEAR_TB_BLK (x0,y0, log2CbSize);
+
+    blk_info.set_flags(x0,y0,log2CbSize, BLK_FLAG_NONZERO_COEFF, false);
   }
 
   int  get_split_transform_flag(int x0,int y0,int trafoDepth) const
@@ -602,20 +734,12 @@ public:
 
   void set_nonzero_coefficient(int x,int y, int log2TrafoSize)
   {
-    const int tuX = x >> tu_info.log2unitSize;
-    const int tuY = y >> tu_info.log2unitSize;
-    const int width = 1 << (log2TrafoSize - tu_info.log2unitSize);
-
-    for (int tuy=tuY;tuy<tuY+width;tuy++)
-      for (int tux=tuX;tux<tuX+width;tux++)
-        {
-          tu_info[ tux + tuy*tu_info.width_in_units ] |= TU_FLAG_NONZERO_COEFF;
-        }
+    blk_info.set_flags(x,y,log2TrafoSize, BLK_FLAG_NONZERO_COEFF, true);
   }
 
   int  get_nonzero_coefficient(int x,int y) const
   {
-    return tu_info.get(x,y) & TU_FLAG_NONZERO_COEFF;
+    return blk_info.flags(blk_info.index(x,y)) & BLK_FLAG_NONZERO_COEFF;
   }
 
 
@@ -623,37 +747,30 @@ public:
 
   enum IntraPredMode get_IntraPredMode(int x,int y) const
   {
-    return (enum IntraPredMode)intraPredMode.get(x,y);
-  }
-
-  enum IntraPredMode get_IntraPredMode_atIndex(int idx) const
-  {
-    return (enum IntraPredMode)intraPredMode[idx];
+    return (enum IntraPredMode)blk_info.intraPredMode(blk_info.index(x,y));
   }
 
-  void set_IntraPredMode(int PUidx,int log2blkSize, enum IntraPredMode mode)
+  /* Intra-prediction mode of a neighboring block as used for the MPM derivation.
+     Returns INTRA_DC if the block is not intra coded or uses PCM. */
+  enum IntraPredMode get_IntraPredMode_for_MPM(int x,int y) const
   {
-    int pbSize = 1<<(log2blkSize - intraPredMode.log2unitSize);
+    int idx = blk_info.index(x,y);
+    if ((blk_info.flags(idx) & (BLK_FLAG_INTRA | BLK_FLAG_PCM)) != BLK_FLAG_INTRA) {
+      return INTRA_DC;
+    }
 
-    for (int y=0;y<pbSize;y++)
-      for (int x=0;x<pbSize;x++)
-        intraPredMode[PUidx + x + y*intraPredMode.width_in_units] = mode;
+    return (enum IntraPredMode)blk_info.intraPredMode(idx);
   }
 
   void set_IntraPredMode(int x0,int y0,int log2blkSize,
                          enum IntraPredMode mode)
   {
-    int pbSize = 1<<(log2blkSize - intraPredMode.log2unitSize);
-    int PUidx  = (x0>>sps->Log2MinPUSize) + (y0>>sps->Log2MinPUSize)*sps->PicWidthInMinPUs;
+    // The intra-pred modes are stored at 4x4 granularity, independent of the MinPUSize.
+    int pbSize = 1<<(log2blkSize - 2);
 
     for (int y=0;y<pbSize;y++)
       for (int x=0;x<pbSize;x++) {
-        assert(x < sps->PicWidthInMinPUs);
-        assert(y < sps->PicHeightInMinPUs);
-
-        int idx = PUidx + x + y*intraPredMode.width_in_units;
-        assert(idx<intraPredMode.data_size);
-        intraPredMode[idx] = mode;
+        blk_info.intraPredMode(blk_info.index(x0+x*4, y0+y*4)) = mode;
       }
   }
 
@@ -674,7 +791,7 @@ public:
     uint8_t combinedValue = mode;
     if (is_mode4) combinedValue |= 0x80;
 
-    int pbSize = 1<<(log2blkSize - intraPredMode.log2unitSize);
+    int pbSize = 1<<(log2blkSize - intraPredModeC.log2unitSize);
     int PUidx  = (x0>>sps->Log2MinPUSize) + (y0>>sps->Log2MinPUSize)*sps->PicWidthInMinPUs;
 
     for (int y=0;y<pbSize;y++)
@@ -807,40 +924,41 @@ public:
 
   // --- DEBLK metadata access ---
 
-  int  get_deblk_width()  const { return deblk_info.width_in_units; }
-  int  get_deblk_height() const { return deblk_info.height_in_units; }
+  int  get_deblk_width()  const { return blk_info.width_in_units; }
+  int  get_deblk_height() const { return blk_info.height_in_units; }
 
   void    set_deblk_flags(int x0,int y0, uint8_t flags)
   {
     const int xd = x0/4;
     const int yd = y0/4;
 
-    if (xd<deblk_info.width_in_units &&
-        yd<deblk_info.height_in_units) {
-      deblk_info[xd + yd*deblk_info.width_in_units] |= flags;
+    if (xd<blk_info.width_in_units &&
+        yd<blk_info.height_in_units) {
+      blk_info.deblk(blk_info.index(x0,y0)) |= flags;
     }
   }
 
   uint8_t get_deblk_flags(int x0,int y0) const
   {
-    const int xd = x0/4;
-    const int yd = y0/4;
-
-    return deblk_info[xd + yd*deblk_info.width_in_units];
+    return blk_info.deblk(blk_info.index(x0,y0));
   }
 
   void    set_deblk_bS(int x0,int y0, uint8_t bS)
   {
-    uint8_t* data = &deblk_info[x0/4 + y0/4*deblk_info.width_in_units];
-    *data &= ~DEBLOCK_BS_MASK;
-    *data |= bS;
+    uint8_t& data = blk_info.deblk(blk_info.index(x0,y0));
+    data &= ~DEBLOCK_BS_MASK;
+    data |= bS;
   }
 
   uint8_t get_deblk_bS(int x0,int y0) const
   {
-    return deblk_info[x0/4 + y0/4*deblk_info.width_in_units] & DEBLOCK_BS_MASK;
+    return blk_info.deblk(blk_info.index(x0,y0)) & DEBLOCK_BS_MASK;
   }
 
+  // direct access to the CTB-tiled 4x4 block metadata (see CTBTiledBlkInfo)
+  const CTBTiledBlkInfo& get_blk_info() const { return blk_info; }
+  CTBTiledBlkInfo& get_blk_info() { return blk_info; }
+
 
   // --- PB metadata access ---
 
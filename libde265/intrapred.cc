@@ -104,7 +104,7 @@ void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3],
 }
 
 
-void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3], int x,int y, int PUidx,
+void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3], int x,int y,
                                  bool availableA, // left
                                  bool availableB, // top
                                  const de265_image* img)
@@ -112,17 +112,14 @@ void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3], int x,int y
   const seq_parameter_set* sps = &img->get_sps();
 
   // block on left side
+  // (non-intra and PCM blocks are mapped to INTRA_DC by get_IntraPredMode_for_MPM())
 
   enum IntraPredMode candIntraPredModeA, candIntraPredModeB;
   if (availableA==false) {
     candIntraPredModeA=INTRA_DC;
   }
-  else if (img->get_pred_mode(x-1,y) != MODE_INTRA ||
-           img->get_pcm_flag (x-1,y)) {
-    candIntraPredModeA=INTRA_DC;
- }
   else {
-    candIntraPredModeA = img->get_IntraPredMode_atIndex(PUidx-1);
+    candIntraPredModeA = img->get_IntraPredMode_for_MPM(x-1,y);
   }
 
   // block above
@@ -130,15 +127,11 @@ void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3], int x,int y
   if (availableB==false) {
     candIntraPredModeB=INTRA_DC;
   }
-  else if (img->get_pred_mode(x,y-1) != MODE_INTRA ||
-           img->get_pcm_flag (x,y-1)) {
-    candIntraPredModeB=INTRA_DC;
-  }
   else if (y-1 < ((y >> sps->Log2CtbSizeY) << sps->Log2CtbSizeY)) {
     candIntraPredModeB=INTRA_DC;
   }
   else {
-    candIntraPredModeB = img->get_IntraPredMode_atIndex(PUidx-sps->PicWidthInMinPUs);
+    candIntraPredModeB = img->get_IntraPredMode_for_MPM(x,y-1);
   }
 
 
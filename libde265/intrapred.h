@@ -32,22 +32,12 @@ extern const int intraPredAngle_table[1+34];
    availableA/B is the output of check_CTB_available().
  */
 void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3],
-                                 int x,int y, int PUidx,
+                                 int x,int y,
                                  bool availableA, // left
                                  bool availableB, // top
                                  const de265_image* img);
 
 
-inline void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3], int x,int y,
-                                 bool availableA, // left
-                                 bool availableB, // top
-                                 const de265_image* img)
-{
-  int PUidx = img->get_sps().getPUIndexRS(x,y);
-  fillIntraPredModeCandidates(candModeList, x,y, PUidx, availableA,availableB, img);
-}
-
-
 void fillIntraPredModeCandidates(enum IntraPredMode candModeList[3],
                                  int x,int y,
                                  bool availableA, // left
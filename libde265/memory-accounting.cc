@@ -0,0 +1,120 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "libde265/memory-accounting.h"
+
+#include <assert.h>
+
+
+memory_accounting::memory_accounting()
+{
+  for (int i=0;i<NumCategories;i++) {
+    current[i] = 0;
+    peak[i] = 0;
+  }
+
+  limit = 0;
+
+  de265_mutex_init(&mutex);
+}
+
+
+memory_accounting::~memory_accounting()
+{
+  de265_mutex_destroy(&mutex);
+}
+
+
+LIBDE265_CHECK_RESULT bool memory_accounting::reserve(enum de265_memory_category cat, size_t bytes)
+{
+  assert(cat != de265_memory_total);
+
+  de265_mutex_lock(&mutex);
+
+  size_t& total = current[de265_memory_total];
+
+  if (limit != 0 && total + bytes > limit) {
+    de265_mutex_unlock(&mutex);
+    return false;
+  }
+
+  current[cat] += bytes;
+  total        += bytes;
+
+  if (current[cat] > peak[cat]) { peak[cat] = current[cat]; }
+  if (total > peak[de265_memory_total]) { peak[de265_memory_total] = total; }
+
+  de265_mutex_unlock(&mutex);
+
+  return true;
+}
+
+
+void memory_accounting::release(enum de265_memory_category cat, size_t bytes)
+{
+  assert(cat != de265_memory_total);
+
+  de265_mutex_lock(&mutex);
+
+  assert(current[cat] >= bytes);
+
+  current[cat]                -= bytes;
+  current[de265_memory_total] -= bytes;
+
+  de265_mutex_unlock(&mutex);
+}
+
+
+void memory_accounting::move(enum de265_memory_category from, enum de265_memory_category to,
+                             size_t bytes)
+{
+  if (from == to) { return; }
+
+  de265_mutex_lock(&mutex);
+
+  assert(current[from] >= bytes);
+
+  current[from] -= bytes;
+  current[to]   += bytes;
+
+  if (current[to] > peak[to]) { peak[to] = current[to]; }
+
+  de265_mutex_unlock(&mutex);
+}
+
+
+size_t memory_accounting::get_current(enum de265_memory_category cat) const
+{
+  de265_mutex_lock(&mutex);
+  size_t n = current[cat];
+  de265_mutex_unlock(&mutex);
+
+  return n;
+}
+
+
+size_t memory_accounting::get_peak(enum de265_memory_category cat) const
+{
+  de265_mutex_lock(&mutex);
+  size_t n = peak[cat];
+  de265_mutex_unlock(&mutex);
+
+  return n;
+}
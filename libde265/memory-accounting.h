@@ -0,0 +1,70 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DE265_MEMORY_ACCOUNTING_H
+#define DE265_MEMORY_ACCOUNTING_H
+
+#include "libde265/de265.h"
+#include "libde265/threads.h"
+#include "libde265/util.h"
+
+#include <stddef.h>
+
+
+/* Counts the memory allocated by a decoder context, split into categories
+   (enum de265_memory_category). All allocations that should be counted have to
+   be announced with reserve() before calling malloc() and returned with release()
+   after freeing the memory.
+ */
+class memory_accounting
+{
+ public:
+  memory_accounting();
+  ~memory_accounting();
+
+  /* Account for 'bytes' more in the given category. Returns false (and does not
+     count anything) if this would exceed the memory limit. */
+  LIBDE265_CHECK_RESULT bool reserve(enum de265_memory_category, size_t bytes);
+
+  void release(enum de265_memory_category, size_t bytes);
+
+  // Move already reserved memory from one category to another (does not change the total).
+  void move(enum de265_memory_category from, enum de265_memory_category to, size_t bytes);
+
+  void   set_limit(size_t max_bytes) { limit = max_bytes; } // 0 = unlimited
+  size_t get_limit() const { return limit; }
+
+  size_t get_current(enum de265_memory_category) const;
+  size_t get_peak(enum de265_memory_category) const;
+
+ private:
+  enum { NumCategories = de265_memory_total+1 };
+
+  size_t current[NumCategories];
+  size_t peak[NumCategories];
+  size_t limit;
+
+  mutable de265_mutex mutex;
+
+  memory_accounting(const memory_accounting&); // no copy
+  memory_accounting& operator=(const memory_accounting&); // no copy
+};
+
+#endif
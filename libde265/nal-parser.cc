@@ -24,6 +24,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <atomic>
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -39,11 +40,22 @@ NAL_unit::NAL_unit()
   nal_data = NULL;
   data_size = 0;
   capacity = 0;
+
+  external_data = NULL;
+  release_func = NULL;
+  release_userdata = NULL;
+
+  accounting = NULL;
 }
 
 NAL_unit::~NAL_unit()
 {
+  release_external_data();
   free(nal_data);
+
+  if (accounting) {
+    accounting->release(de265_memory_NAL_queue, capacity);
+  }
 }
 
 void NAL_unit::clear()
@@ -52,20 +64,54 @@ void NAL_unit::clear()
   pts = 0;
   user_data = NULL;
 
+  release_external_data();
+
   // set size to zero but keep memory
   data_size = 0;
 
   skipped_bytes.clear();
 }
 
+void NAL_unit::set_external_data(const unsigned char* in_data, int n,
+                                 de265_release_data_func release, void* userdata)
+{
+  release_external_data();
+
+  external_data = in_data;
+  release_func = release;
+  release_userdata = userdata;
+  data_size = n;
+}
+
+void NAL_unit::release_external_data()
+{
+  if (external_data) {
+    if (release_func) {
+      release_func(external_data, release_userdata);
+    }
+
+    external_data = NULL;
+    release_func = NULL;
+    release_userdata = NULL;
+    data_size = 0;
+  }
+}
+
 LIBDE265_CHECK_RESULT bool NAL_unit::resize(int new_size)
 {
   if (capacity < new_size) {
+    if (accounting && !accounting->reserve(de265_memory_NAL_queue, new_size)) {
+      return false;
+    }
+
     unsigned char* newbuffer = (unsigned char*)malloc(new_size);
     if (newbuffer == NULL) {
+      if (accounting) { accounting->release(de265_memory_NAL_queue, new_size); }
       return false;
     }
 
+    if (accounting) { accounting->release(de265_memory_NAL_queue, capacity); }
+
     if (nal_data != NULL) {
       memcpy(newbuffer, nal_data, data_size);
       free(nal_data);
@@ -112,40 +158,76 @@ int NAL_unit::num_skipped_bytes_before(int byte_position, int headerLength) cons
   return 0;
 }
 
-void NAL_unit::remove_stuffing_bytes()
+void NAL_unit::remove_stuffing_bytes(find_zero_byte_pair_func find_zero_byte_pair)
 {
   uint8_t* p = data();
+  const int n = size();
 
-  for (int i=0;i<size()-2;i++)
-    {
-#if 0
-        for (int k=i;k<i+64;k++) 
-          if (i*0+k<size()) {
-            printf("%c%02x", (k==i) ? '[':' ', data()[k]);
-          }
-        printf("\n");
-#endif
+  int search = 0; // position to continue searching for 00 00 03
+  int in  = 0;    // start of the run of input bytes that still has to be moved
+  int out = 0;    // output position (data is compacted in place)
 
-      if (p[2]!=3 && p[2]!=0) {
-        // fast forward 3 bytes (2+1)
-        p+=2;
-        i+=2;
-      }
-      else {
-        if (p[0]==0 && p[1]==0 && p[2]==3) {
-          //printf("SKIP NAL @ %d\n",i+2+num_skipped_bytes);
-          insert_skipped_byte(i+2 + num_skipped_bytes());
+  for (;;) {
+    int pos = search + find_zero_byte_pair(p+search, n-search);
+    if (pos+2 >= n) {
+      break;
+    }
 
-          memmove(p+2, p+3, size()-i-3);
-          set_size(size()-1);
+    if (p[pos+2]==3) {
+      int run = pos+2 - in;
+      memmove(p+out, p+in, run);
+      out += run;
 
-          p++;
-          i++;
-        }
-      }
+      // remember which byte we removed (position in the original data)
+      insert_skipped_byte(pos+2);
 
-      p++;
+      in = search = pos+3;
+    }
+    else {
+      search = pos+1;
     }
+  }
+
+  memmove(p+out, p+in, n-in);
+  set_size(out + n-in);
+}
+
+
+void NAL_unit::find_stuffing_bytes(find_zero_byte_pair_func find_zero_byte_pair)
+{
+  const uint8_t* p = data();
+  const int n = size();
+
+  int search = 0;
+
+  for (;;) {
+    int pos = search + find_zero_byte_pair(p+search, n-search);
+    if (pos+2 >= n) {
+      break;
+    }
+
+    if (p[pos+2]==3) {
+      insert_skipped_byte(pos+2);
+      search = pos+3;
+    }
+    else {
+      search = pos+1;
+    }
+  }
+}
+
+const stuffing_bytes* NAL_unit::get_stuffing_bytes()
+{
+  if (!stuffing_bytes_in_data() || skipped_bytes.empty()) {
+    return NULL;
+  }
+
+  stuffing.base  = data();
+  stuffing.begin = &skipped_bytes[0];
+  stuffing.next  = stuffing.begin;
+  stuffing.end   = stuffing.begin + skipped_bytes.size();
+
+  return &stuffing;
 }
 
 
@@ -159,6 +241,8 @@ NAL_Parser::NAL_Parser()
   input_push_state = 0;
   pending_input_NAL = NULL;
   nBytes_in_NAL_queue = 0;
+  accounting = NULL;
+  acceleration = NULL;
 }
 
 
@@ -199,6 +283,7 @@ LIBDE265_CHECK_RESULT NAL_unit* NAL_Parser::alloc_NAL_unit(int size)
   }
   else {
     nal = new NAL_unit;
+    nal->accounting = accounting;
   }
 
   nal->clear();
@@ -216,6 +301,9 @@ void NAL_Parser::free_NAL_unit(NAL_unit* nal)
     // Allow calling with NULL just like regular "free()"
     return;
   }
+
+  // give the input buffer back to the caller as early as possible
+  nal->release_external_data();
   if (NAL_free_list.size() < DE265_NAL_FREE_LIST_SIZE) {
     NAL_free_list.push_back(nal);
   }
@@ -269,7 +357,26 @@ de265_error NAL_Parser::push_data(const unsigned char* data, int len,
 
   unsigned char* out = nal->data() + nal->size();
 
+  const find_zero_byte_pair_func find_zero_byte_pair = get_find_zero_byte_pair();
+
   for (int i=0;i<len;i++) {
+    // Inside of the NAL payload, copy all bytes up to the next 00 00 in one go.
+    // Only these pairs can start a start code or an emulation prevention byte.
+    // The last input byte is always passed through the state machine, because it
+    // might form a pair with the next input chunk.
+
+    if (input_push_state==5) {
+      int n = find_zero_byte_pair(data, len-i);
+      if (n == len-i) { n--; }
+
+      if (n>0) {
+        memcpy(out, data, n);
+        out  += n;
+        data += n;
+        i    += n;
+      }
+    }
+
     /*
     printf("state=%d input=%02x (%p) (output size: %d)\n",ctx->input_push_state, *data, data,
            out - ctx->nal_data.data);
@@ -384,7 +491,35 @@ de265_error NAL_Parser::push_NAL(const unsigned char* data, int len,
   nal->pts = pts;
   nal->user_data = user_data;
 
-  nal->remove_stuffing_bytes();
+  nal->remove_stuffing_bytes(get_find_zero_byte_pair());
+
+  push_to_NAL_queue(nal);
+
+  return DE265_OK;
+}
+
+
+de265_error NAL_Parser::push_NAL_zerocopy(const unsigned char* data, int len,
+                                          de265_PTS pts, void* user_data,
+                                          de265_release_data_func release,
+                                          void* release_userdata)
+{
+  // Cannot use byte-stream input and NAL input at the same time.
+  assert(pending_input_NAL == NULL);
+
+  end_of_frame = false;
+
+  NAL_unit* nal = alloc_NAL_unit(0);
+  if (nal == NULL) {
+    if (release) { release(data, release_userdata); }
+    return DE265_ERROR_OUT_OF_MEMORY;
+  }
+
+  nal->set_external_data(data, len, release, release_userdata);
+  nal->pts = pts;
+  nal->user_data = user_data;
+
+  nal->find_stuffing_bytes(get_find_zero_byte_pair());
 
   push_to_NAL_queue(nal);
 
@@ -392,6 +527,110 @@ de265_error NAL_Parser::push_NAL(const unsigned char* data, int len,
 }
 
 
+// Reference counter for an input buffer that is shared by several zero-copy NALs.
+struct shared_input_buffer
+{
+  std::atomic<int> nRefs;
+  const unsigned char* data;
+  de265_release_data_func release;
+  void* release_userdata;
+};
+
+static void release_shared_input_buffer(const void* /*nal_data*/, void* userdata)
+{
+  shared_input_buffer* buf = (shared_input_buffer*)userdata;
+
+  if (--buf->nRefs == 0) {
+    if (buf->release) { buf->release(buf->data, buf->release_userdata); }
+    delete buf;
+  }
+}
+
+
+de265_error NAL_Parser::push_length_prefixed_NALs(const unsigned char* data, int len,
+                                                  int length_size,
+                                                  de265_PTS pts, void* user_data,
+                                                  bool zerocopy,
+                                                  de265_release_data_func release,
+                                                  void* release_userdata)
+{
+  // Check the complete input first, such that we either push all NALs or none.
+
+  int nNALs = 0;
+  bool valid = (length_size==1 || length_size==2 || length_size==4);
+
+  for (int pos=0; valid && pos<len; ) {
+    if (len-pos < length_size) { valid=false; break; }
+
+    uint32_t nal_size = 0;
+    for (int i=0;i<length_size;i++) {
+      nal_size = (nal_size<<8) | data[pos+i];
+    }
+    pos += length_size;
+
+    if (nal_size > (uint32_t)(len-pos)) { valid=false; break; }
+    pos += nal_size;
+
+    if (nal_size>0) { nNALs++; }
+  }
+
+  if (!valid || nNALs==0) {
+    if (zerocopy && release) { release(data, release_userdata); }
+    return valid ? DE265_OK : DE265_ERROR_INVALID_NAL_LENGTH;
+  }
+
+
+  shared_input_buffer* shared = NULL;
+  if (zerocopy) {
+    shared = new shared_input_buffer;
+    shared->nRefs = nNALs;
+    shared->data = data;
+    shared->release = release;
+    shared->release_userdata = release_userdata;
+  }
+
+  for (int pos=0; pos<len; ) {
+    int nal_size = 0;
+    for (int i=0;i<length_size;i++) {
+      nal_size = (nal_size<<8) | data[pos+i];
+    }
+    pos += length_size;
+
+    if (nal_size>0) {
+      de265_error err;
+      if (zerocopy) {
+        err = push_NAL_zerocopy(data+pos, nal_size, pts, user_data,
+                                release_shared_input_buffer, shared);
+      }
+      else {
+        err = push_NAL(data+pos, nal_size, pts, user_data);
+      }
+
+      if (err != DE265_OK) {
+        // Release the references of the NALs that will not be pushed anymore.
+        // (A failed push_NAL_zerocopy() has already released its own reference.)
+
+        if (zerocopy) {
+          for (int p=pos+nal_size; p<len; ) {
+            int s = 0;
+            for (int i=0;i<length_size;i++) { s = (s<<8) | data[p+i]; }
+            p += length_size + s;
+
+            if (s>0) { release_shared_input_buffer(data, shared); }
+          }
+        }
+
+        return err;
+      }
+    }
+
+    pos += nal_size;
+  }
+
+  return DE265_OK;
+}
+
+
 de265_error NAL_Parser::flush_data()
 {
   if (pending_input_NAL) {
@@ -443,4 +682,7 @@ void NAL_Parser::remove_pending_input_data()
 
   input_push_state = 0;
   nBytes_in_NAL_queue = 0;
+
+  end_of_stream = false;
+  end_of_frame = false;
 }
@@ -25,6 +25,9 @@
 #include "libde265/pps.h"
 #include "libde265/nal.h"
 #include "libde265/util.h"
+#include "libde265/memory-accounting.h"
+#include "libde265/acceleration.h"
+#include "libde265/fallback-nal.h"
 
 #include <vector>
 #include <queue>
@@ -33,6 +36,10 @@
 #define DE265_SKIPPED_BYTES_INITIAL_SIZE 16
 
 
+// see acceleration_functions::find_zero_byte_pair
+typedef int (*find_zero_byte_pair_func)(const uint8_t* data, int len);
+
+
 class NAL_unit {
  public:
   NAL_unit();
@@ -52,10 +59,18 @@ class NAL_unit {
   LIBDE265_CHECK_RESULT bool append(const unsigned char* data, int n);
   LIBDE265_CHECK_RESULT bool set_data(const unsigned char* data, int n);
 
+  /* Use the caller's buffer directly instead of copying it (zero-copy input).
+     The stuffing bytes are not removed, but only recorded, so that the readers
+     can skip them. 'release' is called when the NAL is not needed anymore.
+   */
+  void set_external_data(const unsigned char* data, int n,
+                         de265_release_data_func release, void* release_userdata);
+  void release_external_data();
+
   int size() const { return data_size; }
   void set_size(int s) { data_size=s; }
-  unsigned char* data() { return nal_data; }
-  const unsigned char* data() const { return nal_data; }
+  unsigned char* data() { return external_data ? (unsigned char*)external_data : nal_data; }
+  const unsigned char* data() const { return external_data ? external_data : nal_data; }
 
 
   // --- skipped stuffing bytes ---
@@ -73,13 +88,35 @@ class NAL_unit {
   /* Remove all stuffing bytes from NAL data. The NAL data is modified and
      the removed bytes are marked as skipped bytes.
    */
-  void remove_stuffing_bytes();
+  void remove_stuffing_bytes(find_zero_byte_pair_func find_zero_byte_pair =
+                             find_zero_byte_pair_fallback);
+
+  /* Mark all stuffing bytes as skipped without modifying the NAL data.
+   */
+  void find_stuffing_bytes(find_zero_byte_pair_func find_zero_byte_pair =
+                           find_zero_byte_pair_fallback);
+
+  /* True if the stuffing bytes are still contained in the NAL data.
+     Readers have to be initialized with get_stuffing_bytes() in this case.
+   */
+  bool stuffing_bytes_in_data() const { return external_data != NULL; }
+
+  // Returns NULL if there are no stuffing bytes in the NAL data.
+  const stuffing_bytes* get_stuffing_bytes();
+
+  // The NAL buffer memory is counted here (may be NULL).
+  memory_accounting* accounting;
 
  private:
   unsigned char* nal_data;
   int data_size;
   int capacity;
 
+  const unsigned char* external_data;
+  de265_release_data_func release_func;
+  void* release_userdata;
+  stuffing_bytes stuffing;
+
   std::vector<int> skipped_bytes; // up to position[x], there were 'x' skipped bytes
 };
 
@@ -96,6 +133,19 @@ class NAL_Parser
   de265_error push_NAL(const unsigned char* data, int len,
                        de265_PTS pts, void* user_data = NULL);
 
+  de265_error push_NAL_zerocopy(const unsigned char* data, int len,
+                                de265_PTS pts, void* user_data,
+                                de265_release_data_func release, void* release_userdata);
+
+  /* Split a sequence of NALs, each prefixed with its big-endian length of
+     'length_size' bytes. In zero-copy mode, all NALs share the input buffer
+     and 'release' is called after the last of them has been freed.
+   */
+  de265_error push_length_prefixed_NALs(const unsigned char* data, int len, int length_size,
+                                        de265_PTS pts, void* user_data,
+                                        bool zerocopy,
+                                        de265_release_data_func release, void* release_userdata);
+
   NAL_unit*   pop_from_NAL_queue();
   de265_error flush_data();
   void        mark_end_of_stream() { end_of_stream=true; }
@@ -120,6 +170,11 @@ class NAL_Parser
 
   void free_NAL_unit(NAL_unit*);
 
+  void set_memory_accounting(memory_accounting* a) { accounting = a; }
+
+  // The byte-stream scanner is taken from these functions (may be NULL for the fallback).
+  void set_acceleration_functions(const acceleration_functions* a) { acceleration = a; }
+
 
   int get_NAL_queue_length() const { return NAL_queue.size(); }
   bool is_end_of_stream() const { return end_of_stream; }
@@ -148,6 +203,14 @@ class NAL_Parser
   std::vector<NAL_unit*> NAL_free_list;  // maximum size: DE265_NAL_FREE_LIST_SIZE
 
   LIBDE265_CHECK_RESULT NAL_unit* alloc_NAL_unit(int size);
+
+  memory_accounting* accounting;
+
+  const acceleration_functions* acceleration;
+
+  find_zero_byte_pair_func get_find_zero_byte_pair() const {
+    return acceleration ? acceleration->find_zero_byte_pair : find_zero_byte_pair_fallback;
+  }
 };
 
 
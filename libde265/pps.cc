@@ -476,9 +476,12 @@ bool pic_parameter_set::read(bitreader* br, decoder_context* ctx)
       ctx->add_warning(err, false);
       return false;
     }
+
+    scaling_factors = ctx->get_shared_scaling_factors(scaling_list);
   }
   else {
     memcpy(&scaling_list, &sps->scaling_list, sizeof(scaling_list_data));
+    scaling_factors = sps->scaling_factors;
   }
 
 
@@ -126,6 +126,7 @@ public:
 
   char pic_scaling_list_data_present_flag;
   struct scaling_list_data scaling_list; // contains valid data if sps->scaling_list_enabled_flag set
+  std::shared_ptr<const scaling_factor_table> scaling_factors; // shared with SPS / other PPSs
 
   char lists_modification_present_flag;
   int log2_parallel_merge_level; // [2 ; log2(max CB size)]
@@ -0,0 +1,430 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "random-access.h"
+#include "nal.h"
+#include "sps.h"
+#include "bitstream.h"
+#include "util.h"
+
+#include <string.h>
+
+
+// Slice NALs are only parsed up to slice_pic_order_cnt_lsb, which is always within
+// the first few bytes. We do not keep more than this of NALs other than parameter sets.
+#define MAX_SLICE_HEADER_BYTES 64
+
+
+static void remove_emulation_prevention_bytes(const uint8_t* in, int len,
+                                              std::vector<uint8_t>& out)
+{
+  out.clear();
+  out.reserve(len);
+
+  int nZeros=0;
+  for (int i=0;i<len;i++) {
+    if (nZeros>=2 && in[i]==3) {
+      nZeros=0;
+      continue;
+    }
+
+    out.push_back(in[i]);
+
+    if (in[i]==0) nZeros++;
+    else          nZeros=0;
+  }
+}
+
+
+random_access_index::random_access_index()
+{
+  for (int i=0;i<DE265_MAX_VPS_SETS;i++) { vps_NAL[i]=-1; }
+  for (int i=0;i<DE265_MAX_SPS_SETS;i++) { sps_NAL[i]=-1; sps[i].valid=false; }
+  for (int i=0;i<DE265_MAX_PPS_SETS;i++) { pps_NAL[i]=-1; pps[i].valid=false; }
+
+  prevTid0POC = 0;
+  first_picture = true;
+  after_end_of_sequence = false;
+  nPictures = 0;
+
+  stream_pos = 0;
+  nZeros = 0;
+  in_NAL = false;
+  NAL_start = 0;
+  NAL_length = 0;
+  AU_start = -1;
+}
+
+
+de265_error random_access_index::push_data(const uint8_t* data, int len)
+{
+  int segment_start = 0; // first byte not yet appended to the current NAL
+  int search = 0;
+
+  for (;;) {
+    const uint8_t* one = (const uint8_t*)memchr(data+search, 1, len-search);
+    if (one==NULL) {
+      break;
+    }
+
+    int i = one-data;
+
+    // count the zero bytes in front of the 0x01 (may continue into the previous chunk)
+
+    int zeros=0;
+    while (i-zeros-1>=0 && data[i-zeros-1]==0) {
+      zeros++;
+    }
+
+    if (i-zeros==0) {
+      zeros += nZeros;
+    }
+
+    if (zeros>=2) {
+      // start code found: finish previous NAL and begin a new one
+
+      append_NAL_data(data+segment_start, i-segment_start);
+      end_of_NAL(zeros);
+
+      in_NAL = true;
+      NAL_start = stream_pos + i - libde265_min(zeros,3);
+      NAL_length = 0;
+      NAL_data.clear();
+
+      segment_start = i+1;
+    }
+
+    search = i+1;
+  }
+
+  append_NAL_data(data+segment_start, len-segment_start);
+
+
+  // remember number of zero bytes at the end of this chunk
+
+  int zeros=0;
+  while (zeros<len && data[len-zeros-1]==0) {
+    zeros++;
+  }
+
+  if (zeros==len) { nZeros += zeros; }
+  else            { nZeros  = zeros; }
+
+  stream_pos += len;
+
+  return DE265_OK;
+}
+
+
+void random_access_index::flush()
+{
+  end_of_NAL(nZeros);
+
+  nZeros = 0;
+}
+
+
+void random_access_index::append_NAL_data(const uint8_t* data, int len)
+{
+  if (!in_NAL || len==0) {
+    return;
+  }
+
+  NAL_length += len;
+
+  // keep parameter sets completely, only the beginning of all other NALs
+
+  int keep = len;
+  if (NAL_data.size()+len >= 2) {
+    int nal_unit_type = ((NAL_data.size()>=1 ? NAL_data[0] : data[0]) >> 1) & 0x3f;
+
+    if (nal_unit_type != NAL_UNIT_VPS_NUT &&
+        nal_unit_type != NAL_UNIT_SPS_NUT &&
+        nal_unit_type != NAL_UNIT_PPS_NUT) {
+      keep = libde265_max(0, libde265_min(len, MAX_SLICE_HEADER_BYTES - (int)NAL_data.size()));
+    }
+  }
+
+  NAL_data.insert(NAL_data.end(), data, data+keep);
+}
+
+
+void random_access_index::end_of_NAL(int nTrailingZeros)
+{
+  if (!in_NAL) {
+    return;
+  }
+
+  in_NAL = false;
+
+  // trailing zero bytes belong to the start code of the next NAL (or are trailing_zero_8bits)
+
+  int64_t length = libde265_max((int64_t)0, NAL_length - nTrailingZeros);
+  if ((int64_t)NAL_data.size() > length) {
+    NAL_data.resize(length);
+  }
+
+  process_NAL(NAL_data.data(), NAL_data.size(), NAL_start);
+}
+
+
+int random_access_index::store_parameter_set_NAL(int current, const uint8_t* data, int len)
+{
+  if (current>=0 &&
+      parameter_set_NALs[current].size() == (size_t)len &&
+      memcmp(parameter_set_NALs[current].data(), data, len)==0) {
+    return current;
+  }
+
+  parameter_set_NALs.push_back(std::vector<uint8_t>(data, data+len));
+  return parameter_set_NALs.size()-1;
+}
+
+
+void random_access_index::process_NAL(const uint8_t* data, int len, int64_t start)
+{
+  if (len<3) {
+    return;
+  }
+
+  int nal_unit_type = (data[0]>>1) & 0x3f;
+  int nuh_layer_id  = ((data[0]&1)<<5) | (data[1]>>3);
+
+  if (nuh_layer_id > 0) {
+    return;
+  }
+
+  std::vector<uint8_t> rbsp;
+  bitreader reader;
+
+  switch (nal_unit_type) {
+  case NAL_UNIT_VPS_NUT:
+    {
+      int id = data[2]>>4;
+      vps_NAL[id] = store_parameter_set_NAL(vps_NAL[id], data, len);
+    }
+    break;
+
+  case NAL_UNIT_SPS_NUT:
+    {
+      remove_emulation_prevention_bytes(data+2, len-2, rbsp);
+      bitreader_init(&reader, rbsp.data(), rbsp.size());
+
+      error_queue errqueue;
+      seq_parameter_set new_sps;
+      if (new_sps.read(&errqueue, &reader) != DE265_OK) {
+        break;
+      }
+
+      int id = new_sps.seq_parameter_set_id;
+      sps[id].valid = true;
+      sps[id].log2_max_pic_order_cnt_lsb = new_sps.log2_max_pic_order_cnt_lsb;
+      sps[id].separate_colour_plane_flag = new_sps.separate_colour_plane_flag;
+
+      sps_NAL[id] = store_parameter_set_NAL(sps_NAL[id], data, len);
+    }
+    break;
+
+  case NAL_UNIT_PPS_NUT:
+    {
+      remove_emulation_prevention_bytes(data+2, len-2, rbsp);
+      bitreader_init(&reader, rbsp.data(), rbsp.size());
+
+      int id = get_uvlc(&reader);
+      int sps_id = get_uvlc(&reader);
+      if (id<0 || id>=DE265_MAX_PPS_SETS ||
+          sps_id<0 || sps_id>=DE265_MAX_SPS_SETS) {
+        break;
+      }
+
+      pps[id].valid = true;
+      pps[id].seq_parameter_set_id = sps_id;
+      pps[id].dependent_slice_segments_enabled_flag = get_bits(&reader,1);
+      pps[id].output_flag_present_flag = get_bits(&reader,1);
+      pps[id].num_extra_slice_header_bits = get_bits(&reader,3);
+
+      pps_NAL[id] = store_parameter_set_NAL(pps_NAL[id], data, len);
+    }
+    break;
+
+  case NAL_UNIT_EOS_NUT:
+  case NAL_UNIT_EOB_NUT:
+    after_end_of_sequence = true;
+    AU_start = -1;
+    return;
+
+  case NAL_UNIT_SUFFIX_SEI_NUT:
+  case NAL_UNIT_FD_NUT:
+    AU_start = -1;
+    return;
+
+  default:
+    if (nal_unit_type < 32) {
+      process_slice_NAL(data, len, start);
+      AU_start = -1;
+    }
+    return;
+  }
+
+  // parameter sets, AUD and prefix SEIs in front of a picture belong to its access unit
+
+  if (AU_start<0) {
+    AU_start = start;
+  }
+}
+
+
+void random_access_index::process_slice_NAL(const uint8_t* data, int len, int64_t start)
+{
+  int nal_unit_type = (data[0]>>1) & 0x3f;
+  int temporal_id   = (data[1] & 7) - 1;
+
+  std::vector<uint8_t> rbsp;
+  remove_emulation_prevention_bytes(data+2, len-2, rbsp);
+
+  bitreader reader;
+  bitreader_init(&reader, rbsp.data(), rbsp.size());
+
+  int first_slice_segment_in_pic_flag = get_bits(&reader,1);
+  if (!first_slice_segment_in_pic_flag) {
+    return;
+  }
+
+  int picture_number = nPictures++;
+
+
+  // --- read slice header up to slice_pic_order_cnt_lsb ---
+
+  if (isIRAP(nal_unit_type)) {
+    skip_bits(&reader,1); // no_output_of_prior_pics_flag
+  }
+
+  int pps_id = get_uvlc(&reader);
+  if (pps_id<0 || pps_id>=DE265_MAX_PPS_SETS || !pps[pps_id].valid ||
+      !sps[ pps[pps_id].seq_parameter_set_id ].valid) {
+    // cannot decode this picture
+    return;
+  }
+
+  const pps_info& p = pps[pps_id];
+  const sps_info& s = sps[p.seq_parameter_set_id];
+
+  skip_bits(&reader, p.num_extra_slice_header_bits);
+  get_uvlc(&reader); // slice_type
+  if (p.output_flag_present_flag) {
+    skip_bits(&reader,1);
+  }
+  if (s.separate_colour_plane_flag) {
+    skip_bits(&reader,2);
+  }
+
+  int slice_pic_order_cnt_lsb = 0;
+  if (!isIDR(nal_unit_type)) {
+    slice_pic_order_cnt_lsb = get_bits(&reader, s.log2_max_pic_order_cnt_lsb);
+  }
+
+
+  // --- derive POC (8.3.1) ---
+
+  bool NoRaslOutputFlag = false;
+  if (isIRAP(nal_unit_type)) {
+    NoRaslOutputFlag = (isIDR(nal_unit_type) ||
+                        isBLA(nal_unit_type) ||
+                        first_picture ||
+                        after_end_of_sequence);
+    after_end_of_sequence = false;
+  }
+
+  first_picture = false;
+
+  int MaxPicOrderCntLsb = 1<<s.log2_max_pic_order_cnt_lsb;
+  int PicOrderCntMsb;
+
+  if (isIRAP(nal_unit_type) && NoRaslOutputFlag) {
+    PicOrderCntMsb = 0;
+  }
+  else {
+    int prevPicOrderCntLsb = prevTid0POC & (MaxPicOrderCntLsb-1);
+    int prevPicOrderCntMsb = prevTid0POC - prevPicOrderCntLsb;
+
+    if ((slice_pic_order_cnt_lsb < prevPicOrderCntLsb) &&
+        (prevPicOrderCntLsb - slice_pic_order_cnt_lsb) >= MaxPicOrderCntLsb/2) {
+      PicOrderCntMsb = prevPicOrderCntMsb + MaxPicOrderCntLsb;
+    }
+    else if ((slice_pic_order_cnt_lsb > prevPicOrderCntLsb) &&
+             (slice_pic_order_cnt_lsb - prevPicOrderCntLsb) > MaxPicOrderCntLsb/2) {
+      PicOrderCntMsb = prevPicOrderCntMsb - MaxPicOrderCntLsb;
+    }
+    else {
+      PicOrderCntMsb = prevPicOrderCntMsb;
+    }
+  }
+
+  int POC = PicOrderCntMsb + slice_pic_order_cnt_lsb;
+
+  if (temporal_id==0 &&
+      !isRASL(nal_unit_type) &&
+      !isRADL(nal_unit_type) &&
+      !isSublayerNonReference(nal_unit_type)) {
+    prevTid0POC = POC;
+  }
+
+
+  // --- add random-access point ---
+
+  if (isIRAP(nal_unit_type)) {
+    entry e;
+    e.point.byte_offset = (AU_start>=0 ? AU_start : start);
+    e.point.nal_unit_type = nal_unit_type;
+    e.point.POC = POC;
+    e.point.picture_number = picture_number;
+
+    for (int i=0;i<DE265_MAX_VPS_SETS;i++) { if (vps_NAL[i]>=0) e.parameter_sets.push_back(vps_NAL[i]); }
+    for (int i=0;i<DE265_MAX_SPS_SETS;i++) { if (sps_NAL[i]>=0) e.parameter_sets.push_back(sps_NAL[i]); }
+    for (int i=0;i<DE265_MAX_PPS_SETS;i++) { if (pps_NAL[i]>=0) e.parameter_sets.push_back(pps_NAL[i]); }
+
+    entries.push_back(e);
+  }
+}
+
+
+int random_access_index::find_entry(int picture_number) const
+{
+  // binary search for the last entry with entry.picture_number <= picture_number
+
+  int lo=0, hi=entries.size();
+  while (lo<hi) {
+    int mid = (lo+hi)/2;
+    if (entries[mid].point.picture_number <= picture_number) { lo=mid+1; }
+    else                                                     { hi=mid; }
+  }
+
+  return lo-1;
+}
+
+
+void random_access_index::get_parameter_sets(int i, std::vector<const std::vector<uint8_t>*>& nals) const
+{
+  nals.clear();
+
+  FOR_LOOP(int, idx, entries[i].parameter_sets) {
+    nals.push_back(&parameter_set_NALs[idx]);
+  }
+}
@@ -0,0 +1,113 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DE265_RANDOM_ACCESS_H
+#define DE265_RANDOM_ACCESS_H
+
+#include "libde265/de265.h"
+#include "libde265/decctx.h"
+
+#include <vector>
+
+
+/* Index of the random-access points (IRAP pictures) in a bytestream.
+
+   The bytestream is scanned for start codes. Parameter sets are parsed completely,
+   slice NALs only up to slice_pic_order_cnt_lsb, so that the POCs can be derived
+   as in a continuous decode (8.3.1).
+ */
+class random_access_index
+{
+ public:
+  random_access_index();
+
+  de265_error push_data(const uint8_t* data, int len);
+  void flush();
+
+  int number_of_entries() const { return entries.size(); }
+  int number_of_pictures() const { return nPictures; }
+
+  const de265_random_access_point& get_entry(int i) const { return entries[i].point; }
+
+  // last entry at or before the picture (in decoding order), -1 if none
+  int find_entry(int picture_number) const;
+
+  // raw NALs (without start code) of the parameter sets active at entry 'i'
+  void get_parameter_sets(int i, std::vector<const std::vector<uint8_t>*>& nals) const;
+
+ private:
+  struct entry {
+    de265_random_access_point point;
+    std::vector<int> parameter_sets; // indices into 'parameter_set_NALs'
+  };
+
+  std::vector<entry> entries;
+
+  std::vector<std::vector<uint8_t> > parameter_set_NALs;
+
+  // currently active parameter set NALs, index into 'parameter_set_NALs' or -1
+  int vps_NAL[DE265_MAX_VPS_SETS];
+  int sps_NAL[DE265_MAX_SPS_SETS];
+  int pps_NAL[DE265_MAX_PPS_SETS];
+
+
+  // --- header values needed to read slice_pic_order_cnt_lsb ---
+
+  struct sps_info {
+    bool valid;
+    int  log2_max_pic_order_cnt_lsb;
+    bool separate_colour_plane_flag;
+  } sps[DE265_MAX_SPS_SETS];
+
+  struct pps_info {
+    bool valid;
+    int  seq_parameter_set_id;
+    bool dependent_slice_segments_enabled_flag;
+    bool output_flag_present_flag;
+    int  num_extra_slice_header_bits;
+  } pps[DE265_MAX_PPS_SETS];
+
+
+  // --- POC derivation ---
+
+  int  prevTid0POC;
+  bool first_picture;
+  bool after_end_of_sequence;
+  int  nPictures;
+
+
+  // --- bytestream scanner ---
+
+  int64_t stream_pos;    // number of bytes pushed so far
+  int     nZeros;        // number of zero bytes directly before 'stream_pos'
+  bool    in_NAL;
+  int64_t NAL_start;     // stream position of the start code of the current NAL
+  int64_t NAL_length;    // number of bytes of the current NAL seen so far
+  int64_t AU_start;      // start of the non-VCL NALs preceding the next picture, -1 if none
+  std::vector<uint8_t> NAL_data; // beginning of the current NAL (complete for parameter sets)
+
+  void append_NAL_data(const uint8_t* data, int len);
+  void end_of_NAL(int nStartCodeZeros);
+  void process_NAL(const uint8_t* data, int len, int64_t start);
+  void process_slice_NAL(const uint8_t* data, int len, int64_t start);
+  int  store_parameter_set_NAL(int current, const uint8_t* data, int len);
+};
+
+#endif
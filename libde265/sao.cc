@@ -282,6 +282,7 @@ void apply_sample_adaptive_offset(de265_image* img)
   }
 
   de265_image inputCopy;
+  inputCopy.plane_memory_category = de265_memory_SAO_scratch;
   de265_error err = inputCopy.copy_image(img);
   if (err != DE265_OK) {
     img->decctx->add_warning(DE265_WARNING_CANNOT_APPLY_SAO_OUT_OF_MEMORY,false);
@@ -299,7 +300,7 @@ void apply_sample_adaptive_offset(de265_image* img)
                     img->get_image_plane(0), img->get_image_stride(0));
         }
 
-        if (shdr->slice_sao_chroma_flag) {
+        if (shdr->slice_sao_chroma_flag && !img->luma_only) {
           int nSW = (1<<sps.Log2CtbSizeY) / sps.SubWidthC;
           int nSH = (1<<sps.Log2CtbSizeY) / sps.SubHeightC;
 
@@ -334,7 +335,7 @@ void apply_sample_adaptive_offset_sequential(de265_image* img)
 
 
   int nChannels = 3;
-  if (sps.ChromaArrayType == CHROMA_MONO) { nChannels=1; }
+  if (sps.ChromaArrayType == CHROMA_MONO || img->luma_only) { nChannels=1; }
 
   for (int cIdx=0;cIdx<nChannels;cIdx++) {
 
@@ -437,7 +438,7 @@ void thread_task_sao::work()
                   outputImg->get_image_plane(0), outputImg->get_image_stride(0));
       }
 
-      if (shdr->slice_sao_chroma_flag) {
+      if (shdr->slice_sao_chroma_flag && !img->luma_only) {
         int nSW = ctbSize / sps.SubWidthC;
         int nSH = ctbSize / sps.SubHeightC;
 
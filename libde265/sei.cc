@@ -270,9 +270,111 @@ static void compute_MD5(uint8_t* data,int w,int h,int stride, uint8_t* result, i
 }
 
 
+// Returns false if the hash of color plane 'cIdx' does not match the SEI.
+static bool check_decoded_picture_hash(const sei_decoded_picture_hash* seihash,
+                                       de265_image* img, int cIdx)
+{
+  uint8_t* data;
+  int w,h,stride;
+
+  w = img->get_width(cIdx);
+  h = img->get_height(cIdx);
+
+  data = img->get_image_plane(cIdx);
+  stride = img->get_image_stride(cIdx);
+
+  switch (seihash->hash_type) {
+  case sei_decoded_picture_hash_type_MD5:
+    {
+      uint8_t md5[16];
+      compute_MD5(data,w,h,stride,md5, img->get_bit_depth(cIdx));
+
+/*
+      fprintf(stderr,"computed MD5: ");
+      for (int b=0;b<16;b++) {
+        fprintf(stderr,"%02x", md5[b]);
+      }
+      fprintf(stderr,"\n");
+*/
+
+      for (int b=0;b<16;b++) {
+        if (md5[b] != seihash->md5[cIdx][b]) {
+          fprintf(stderr,"SEI decoded picture MD5 mismatch (POC=%d)\n", img->PicOrderCntVal);
+          return false;
+        }
+      }
+    }
+    break;
+
+  case sei_decoded_picture_hash_type_CRC:
+    {
+      uint16_t crc = compute_CRC_8bit_fast(data,w,h,stride, img->get_bit_depth(cIdx));
+
+      logtrace(LogSEI,"SEI decoded picture hash: %04x <-[%d]-> decoded picture: %04x\n",
+               seihash->crc[cIdx], cIdx, crc);
+
+      if (crc != seihash->crc[cIdx]) {
+        fprintf(stderr,"SEI decoded picture hash: %04x, decoded picture: %04x (POC=%d)\n",
+                seihash->crc[cIdx], crc, img->PicOrderCntVal);
+        return false;
+      }
+    }
+    break;
+
+  case sei_decoded_picture_hash_type_checksum:
+    {
+      uint32_t chksum = compute_checksum_8bit(data,w,h,stride, img->get_bit_depth(cIdx));
+
+      if (chksum != seihash->checksum[cIdx]) {
+        fprintf(stderr,"SEI decoded picture hash: %04x, decoded picture: %04x (POC=%d)\n",
+                seihash->checksum[cIdx], chksum, img->PicOrderCntVal);
+        return false;
+      }
+    }
+    break;
+  }
+
+  return true;
+}
+
+
+class thread_task_sei_hash : public thread_task
+{
+public:
+  de265_image* img;
+  int cIdx;
+  sei_decoded_picture_hash hash;
+
+  virtual void work();
+  virtual std::string name() const {
+    char buf[100];
+    sprintf(buf,"sei-hash-%d",cIdx);
+    return buf;
+  }
+};
+
+
+void thread_task_sei_hash::work()
+{
+  state = Running;
+
+  de265_image* image = img;
+  bool correct = check_decoded_picture_hash(&hash, image, cIdx);
+
+  if (!correct && !image->decctx->param_sei_check_hash_before_output) {
+    image->decctx->add_warning(DE265_WARNING_PICTURE_HASH_MISMATCH, false);
+  }
+
+  state = Finished;
+
+  image->sei_hash_check_done(correct);
+}
+
+
 static de265_error process_sei_decoded_picture_hash(const sei_message* sei, de265_image* img)
 {
   const sei_decoded_picture_hash* seihash = &sei->data.decoded_picture_hash;
+  decoder_context* ctx = img->decctx;
 
   /* Do not check SEI on pictures that are not output.
      Hash may be wrong, because of a broken link (BLA).
@@ -284,71 +386,51 @@ static de265_error process_sei_decoded_picture_hash(const sei_message* sei, de26
 
   //write_picture(img);
 
-  int nHashes = img->get_sps().chroma_format_idc==0 ? 1 : 3;
-  for (int i=0;i<nHashes;i++) {
-    uint8_t* data;
-    int w,h,stride;
+  int nHashes = (img->get_sps().chroma_format_idc==0 || img->luma_only) ? 1 : 3;
 
-    w = img->get_width(i);
-    h = img->get_height(i);
+  img->start_sei_hash_check(nHashes);
 
-    data = img->get_image_plane(i);
-    stride = img->get_image_stride(i);
+  if (ctx->get_num_worker_threads()==0) {
+    bool correct = true;
 
-    switch (seihash->hash_type) {
-    case sei_decoded_picture_hash_type_MD5:
-      {
-        uint8_t md5[16];
-        compute_MD5(data,w,h,stride,md5, img->get_bit_depth(i));
+    for (int i=0;i<nHashes;i++) {
+      bool planeCorrect = check_decoded_picture_hash(seihash, img, i);
+      img->sei_hash_check_done(planeCorrect);
 
-/*
-        fprintf(stderr,"computed MD5: ");
-        for (int b=0;b<16;b++) {
-          fprintf(stderr,"%02x", md5[b]);
-        }
-        fprintf(stderr,"\n");
-*/
-
-        for (int b=0;b<16;b++) {
-          if (md5[b] != seihash->md5[i][b]) {
-            fprintf(stderr,"SEI decoded picture MD5 mismatch (POC=%d)\n", img->PicOrderCntVal);
-            return DE265_ERROR_CHECKSUM_MISMATCH;
-          }
-        }
-      }
-      break;
-
-    case sei_decoded_picture_hash_type_CRC:
-      {
-        uint16_t crc = compute_CRC_8bit_fast(data,w,h,stride, img->get_bit_depth(i));
+      correct &= planeCorrect;
+    }
 
-        logtrace(LogSEI,"SEI decoded picture hash: %04x <-[%d]-> decoded picture: %04x\n",
-                 seihash->crc[i], i, crc);
+    if (!correct && !ctx->param_sei_check_hash_before_output) {
+      ctx->add_warning(DE265_WARNING_PICTURE_HASH_MISMATCH, false);
+    }
+  }
+  else {
+    // compute the plane hashes in the background, in parallel to decoding the next picture
 
-        if (crc != seihash->crc[i]) {
-          fprintf(stderr,"SEI decoded picture hash: %04x, decoded picture: %04x (POC=%d)\n",
-                  seihash->crc[i], crc, img->PicOrderCntVal);
-          return DE265_ERROR_CHECKSUM_MISMATCH;
-        }
-      }
-      break;
+    for (int i=0;i<nHashes;i++) {
+      thread_task_sei_hash* task = new thread_task_sei_hash;
+      task->img  = img;
+      task->cIdx = i;
+      task->hash = *seihash;
 
-    case sei_decoded_picture_hash_type_checksum:
-      {
-        uint32_t chksum = compute_checksum_8bit(data,w,h,stride, img->get_bit_depth(i));
+      img->sei_hash_tasks.push_back(task);
+      add_task(&ctx->thread_pool_, task);
+    }
 
-        if (chksum != seihash->checksum[i]) {
-          fprintf(stderr,"SEI decoded picture hash: %04x, decoded picture: %04x (POC=%d)\n",
-                  seihash->checksum[i], chksum, img->PicOrderCntVal);
-          return DE265_ERROR_CHECKSUM_MISMATCH;
-        }
-      }
-      break;
+    if (ctx->param_sei_check_hash_before_output) {
+      img->wait_for_sei_hash_check();
     }
   }
 
-  loginfo(LogSEI,"decoded picture hash checked: OK\n");
-  //printf("checked picture %d SEI: OK\n", img->PicOrderCntVal);
+  if (ctx->param_sei_check_hash_before_output &&
+      img->get_sei_hash_check_result() == de265_sei_hash_check_result_MISMATCH) {
+    return DE265_ERROR_CHECKSUM_MISMATCH;
+  }
+
+  if (img->get_sei_hash_check_result() == de265_sei_hash_check_result_CORRECT) {
+    loginfo(LogSEI,"decoded picture hash checked: OK\n");
+    //printf("checked picture %d SEI: OK\n", img->PicOrderCntVal);
+  }
 
   return DE265_OK;
 }
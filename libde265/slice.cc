@@ -46,6 +46,14 @@ extern bool read_short_term_ref_pic_set(error_queue* errqueue,
                                         const std::vector<ref_pic_set>& sets,
                                         bool sliceRefPicSet);
 
+extern bool write_short_term_ref_pic_set(error_queue* errqueue,
+                                         const seq_parameter_set* sps,
+                                         CABAC_encoder& out,
+                                         const ref_pic_set* in_set,
+                                         int idxRps,
+                                         const std::vector<ref_pic_set>& sets,
+                                         bool sliceRefPicSet);
+
 
 void read_coding_tree_unit(thread_context* tctx);
 void read_coding_quadtree(thread_context* tctx,
@@ -948,15 +956,14 @@ de265_error slice_segment_header::write(error_queue* errqueue, CABAC_encoder& ou
       out.write_bit(short_term_ref_pic_set_sps_flag);
 
       if (!short_term_ref_pic_set_sps_flag) {
-        /* TODO
-        read_short_term_ref_pic_set(ctx, sps,
-                                    br, &slice_ref_pic_set,
-                                    sps->num_short_term_ref_pic_sets,
-                                    sps->ref_pic_sets,
-                                    true);
-        */
-        //CurrRpsIdx = sps->num_short_term_ref_pic_sets;
-        //CurrRps    = slice_ref_pic_set;
+        write_short_term_ref_pic_set(errqueue, sps,
+                                     out, &slice_ref_pic_set,
+                                     sps->num_short_term_ref_pic_sets(),
+                                     sps->ref_pic_sets,
+                                     true);
+
+        CurrRpsIdx = sps->num_short_term_ref_pic_sets();
+        CurrRps    = slice_ref_pic_set;
       }
       else {
         int nBits = ceil_log2(sps->num_short_term_ref_pic_sets());
@@ -968,8 +975,8 @@ de265_error slice_segment_header::write(error_queue* errqueue, CABAC_encoder& ou
           return DE265_ERROR_CODED_PARAMETER_OUT_OF_RANGE;
         }
 
-        //CurrRpsIdx = short_term_ref_pic_set_idx;
-        //CurrRps    = sps->ref_pic_sets[CurrRpsIdx];
+        CurrRpsIdx = short_term_ref_pic_set_idx;
+        CurrRps    = sps->ref_pic_sets[CurrRpsIdx];
       }
 
 
@@ -2451,17 +2458,12 @@ static int decode_coeff_abs_level_remaining(thread_context* tctx,
 {
   logtrace(LogSlice,"# decode_coeff_abs_level_remaining\n");
 
-  int prefix=-1;
-  int codeword=0;
-  do {
-    prefix++;
-    codeword = decode_CABAC_bypass(&tctx->cabac_decoder);
-
-    if (prefix>MAX_PREFIX) {
-      return 0; // TODO: error
-    }
+  int prefix = decode_CABAC_TU_bypass(&tctx->cabac_decoder, MAX_PREFIX+2);
+  if (prefix>MAX_PREFIX) {
+    return 0; // TODO: error
   }
-  while (codeword);
+
+  int codeword;
 
   // prefix = nb. 1 bits
 
@@ -2902,10 +2904,10 @@ int check_CTB_available(const de265_image* img,
 }
 
 
-int residual_coding(thread_context* tctx,
-                    int x0, int y0,  // position of TU in frame
-                    int log2TrafoSize,
-                    int cIdx)
+static int residual_coding_generic(thread_context* tctx,
+                                   int x0, int y0,  // position of TU in frame
+                                   int log2TrafoSize,
+                                   int cIdx)
 {
   logtrace(LogSlice,"- residual_coding x0:%d y0:%d log2TrafoSize:%d cIdx:%d\n",x0,y0,log2TrafoSize,cIdx);
 
@@ -3071,7 +3073,8 @@ int residual_coding(thread_context* tctx,
 
   // ----- decode coefficients -----
 
-  tctx->nCoeff[cIdx] = 0;
+  residual_scratch* scratch = tctx->scratch;
+  scratch->nCoeff = 0;
 
 
   // i - subblock index
@@ -3405,9 +3408,9 @@ int residual_coding(thread_context* tctx,
         xC = (S.x<<2) + ScanOrderPos[p].x;
         yC = (S.y<<2) + ScanOrderPos[p].y;
 
-        tctx->coeffList[cIdx][ tctx->nCoeff[cIdx] ] = currCoeff;
-        tctx->coeffPos [cIdx][ tctx->nCoeff[cIdx] ] = xC + yC*CoeffStride;
-        tctx->nCoeff[cIdx]++;
+        scratch->coeffList[ scratch->nCoeff ] = currCoeff;
+        scratch->coeffPos[ scratch->nCoeff ] = xC + yC*CoeffStride;
+        scratch->nCoeff++;
 
         //printf("%d ",currCoeff);
       }  // iterate through coefficients in sub-block
@@ -3421,6 +3424,328 @@ int residual_coding(thread_context* tctx,
 }
 
 
+// --- specialized residual_coding() without range extension tools ---
+
+// Compile-time copies of the scan orders generated in scan.cc.
+
+static constexpr position scan_order_1x1[1] = { {0,0} };
+
+static constexpr position scan_order_2x2[3][4] = {
+  { {0,0},{0,1},{1,0},{1,1} },  // diag
+  { {0,0},{1,0},{0,1},{1,1} },  // horiz
+  { {0,0},{0,1},{1,0},{1,1} }   // verti
+};
+
+static constexpr position scan_order_4x4[3][16] = {
+  { {0,0},{0,1},{1,0},{0,2},{1,1},{2,0},{0,3},{1,2},{2,1},{3,0},{1,3},{2,2},{3,1},{2,3},{3,2},{3,3} },
+  { {0,0},{1,0},{2,0},{3,0},{0,1},{1,1},{2,1},{3,1},{0,2},{1,2},{2,2},{3,2},{0,3},{1,3},{2,3},{3,3} },
+  { {0,0},{0,1},{0,2},{0,3},{1,0},{1,1},{1,2},{1,3},{2,0},{2,1},{2,2},{2,3},{3,0},{3,1},{3,2},{3,3} }
+};
+
+// only the diagonal scan is used for 32x32 blocks
+static constexpr position scan_order_8x8_diag[64] = {
+  {0,0},{0,1},{1,0},{0,2},{1,1},{2,0},{0,3},{1,2},{2,1},{3,0},{0,4},{1,3},{2,2},{3,1},{4,0},{0,5},
+  {1,4},{2,3},{3,2},{4,1},{5,0},{0,6},{1,5},{2,4},{3,3},{4,2},{5,1},{6,0},{0,7},{1,6},{2,5},{3,4},
+  {4,3},{5,2},{6,1},{7,0},{1,7},{2,6},{3,5},{4,4},{5,3},{6,2},{7,1},{2,7},{3,6},{4,5},{5,4},{6,3},
+  {7,2},{3,7},{4,6},{5,5},{6,4},{7,3},{4,7},{5,6},{6,5},{7,4},{5,7},{6,6},{7,5},{6,7},{7,6},{7,7}
+};
+
+
+/* Same as residual_coding_generic(), but for SPSs without range extension tools that
+   modify the residual syntax. The transform size and luma/chroma are template parameters
+   such that the scan tables, sub-block counts, and context offsets are constants.
+ */
+template <int log2TrafoSize, bool isChroma>
+static int residual_coding_fast(thread_context* tctx,
+                                int x0, int y0,  // position of TU in frame
+                                int cIdx)
+{
+  logtrace(LogSlice,"- residual_coding (fast) x0:%d y0:%d log2TrafoSize:%d cIdx:%d\n",x0,y0,log2TrafoSize,cIdx);
+
+  const int sbWidth = 1<<(log2TrafoSize-2);
+  const int CoeffStride = 1<<log2TrafoSize;
+  const int cIdxClass = isChroma ? 1 : 0;
+
+  de265_image* img = tctx->img;
+  const pic_parameter_set& pps = img->get_pps();
+  CABAC_decoder* cabac = &tctx->cabac_decoder;
+
+  if (!isChroma) {
+    img->set_nonzero_coefficient(x0,y0,log2TrafoSize);
+  }
+
+  if (pps.transform_skip_enabled_flag &&
+      !tctx->cu_transquant_bypass_flag &&
+      (log2TrafoSize <= pps.Log2MaxTransformSkipSize))
+    {
+      tctx->transform_skip_flag[cIdx] = decode_transform_skip_flag(tctx,cIdx);
+    }
+  else
+    {
+      tctx->transform_skip_flag[cIdx] = 0;
+    }
+
+  tctx->explicit_rdpcm_flag = false;
+
+
+  // --- decode position of last coded coefficient ---
+
+  int last_significant_coeff_x_prefix =
+    decode_last_significant_coeff_prefix(tctx,log2TrafoSize,cIdxClass,
+                                         &tctx->ctx_model[CONTEXT_MODEL_LAST_SIGNIFICANT_COEFFICIENT_X_PREFIX]);
+
+  int last_significant_coeff_y_prefix =
+    decode_last_significant_coeff_prefix(tctx,log2TrafoSize,cIdxClass,
+                                         &tctx->ctx_model[CONTEXT_MODEL_LAST_SIGNIFICANT_COEFFICIENT_Y_PREFIX]);
+
+  int LastSignificantCoeffX = last_significant_coeff_x_prefix;
+  if (last_significant_coeff_x_prefix > 3) {
+    int nBits = (last_significant_coeff_x_prefix>>1)-1;
+    LastSignificantCoeffX = ((2+(last_significant_coeff_x_prefix & 1)) << nBits) +
+      decode_CABAC_FL_bypass(cabac,nBits);
+  }
+
+  int LastSignificantCoeffY = last_significant_coeff_y_prefix;
+  if (last_significant_coeff_y_prefix > 3) {
+    int nBits = (last_significant_coeff_y_prefix>>1)-1;
+    LastSignificantCoeffY = ((2+(last_significant_coeff_y_prefix & 1)) << nBits) +
+      decode_CABAC_FL_bypass(cabac,nBits);
+  }
+
+
+  // --- determine scanIdx (only 4x4 and 8x8 intra blocks use non-diagonal scans) ---
+
+  int scanIdx = 0;
+
+  if (log2TrafoSize <= 3 && img->get_pred_mode(x0,y0) == MODE_INTRA) {
+    scanIdx = get_intra_scan_idx(log2TrafoSize,
+                                 isChroma ? img->get_IntraPredModeC(x0,y0) : img->get_IntraPredMode(x0,y0),
+                                 cIdx, &img->get_sps());
+
+    if (scanIdx==2) {
+      std::swap(LastSignificantCoeffX, LastSignificantCoeffY);
+    }
+  }
+
+  const position* ScanOrderSub = (log2TrafoSize==2 ? scan_order_1x1 :
+                                  log2TrafoSize==3 ? scan_order_2x2[scanIdx] :
+                                  log2TrafoSize==4 ? scan_order_4x4[0] :
+                                  scan_order_8x8_diag);
+  const position* ScanOrderPos = scan_order_4x4[scanIdx];
+
+
+  // --- find last sub block and last scan pos ---
+
+  scan_position lastScanP = get_scan_position(LastSignificantCoeffX, LastSignificantCoeffY,
+                                              scanIdx, log2TrafoSize);
+
+  const int lastScanPos  = lastScanP.scanPos;
+  const int lastSubBlock = lastScanP.subBlock;
+
+  uint8_t coded_sub_block_neighbors[sbWidth*sbWidth];
+  memset(coded_sub_block_neighbors,0,sizeof(coded_sub_block_neighbors));
+
+  uint8_t** ctxIdxMaps = ctxIdxLookup[log2TrafoSize-2][cIdxClass][!!scanIdx];
+
+  context_model* sigModel      = &tctx->ctx_model[CONTEXT_MODEL_SIGNIFICANT_COEFF_FLAG];
+  context_model* greater1Model = &tctx->ctx_model[CONTEXT_MODEL_COEFF_ABS_LEVEL_GREATER1_FLAG +
+                                                  (isChroma ? 16 : 0)];
+
+  bool prevSubblockHadGreater1 = false;
+
+  const bool signHidingAllowed = pps.sign_data_hiding_flag && !tctx->cu_transquant_bypass_flag;
+
+
+  // ----- decode coefficients -----
+
+  residual_scratch* scratch = tctx->scratch;
+  scratch->nCoeff = 0;
+
+  for (int i=lastSubBlock;i>=0;i--) {
+    const position S = ScanOrderSub[i];
+    bool inferSbDcSigCoeffFlag = false;
+
+    // --- check whether this sub-block is coded ---
+
+    if (i<lastSubBlock && i>0) {
+      if (!decode_coded_sub_block_flag(tctx, cIdxClass,
+                                       coded_sub_block_neighbors[S.x+S.y*sbWidth])) {
+        continue;
+      }
+
+      inferSbDcSigCoeffFlag = true;
+    }
+
+    if (S.x > 0) coded_sub_block_neighbors[S.x-1 + S.y  *sbWidth] |= 1;
+    if (S.y > 0) coded_sub_block_neighbors[S.x + (S.y-1)*sbWidth] |= 2;
+
+
+    // ----- find significant coefficients in this sub-block -----
+
+    int16_t  coeff_value[16];
+    int8_t   coeff_scan_pos[16];
+    int8_t   coeff_has_max_base_level[16];
+    int nCoefficients=0;
+
+    const int xS = S.x<<2;
+    const int yS = S.y<<2;
+    const int prevCsbf = coded_sub_block_neighbors[S.x+S.y*sbWidth];
+    const uint8_t* ctxIdxMap = ctxIdxMaps[prevCsbf] + xS + (yS<<log2TrafoSize);
+
+    int last_coeff = 15;
+
+    if (i==lastSubBlock) {
+      coeff_value[0] = 1;
+      coeff_has_max_base_level[0] = 1;
+      coeff_scan_pos[0] = lastScanPos;
+      nCoefficients=1;
+
+      last_coeff = lastScanPos-1;
+    }
+
+    for (int n=last_coeff ; n>0 ; n--) {
+      int ctxInc = ctxIdxMap[ScanOrderPos[n].x + (ScanOrderPos[n].y<<log2TrafoSize)];
+
+      if (decode_CABAC_bit(cabac, &sigModel[ctxInc])) {
+        coeff_value[nCoefficients] = 1;
+        coeff_has_max_base_level[nCoefficients] = 1;
+        coeff_scan_pos[nCoefficients] = n;
+        nCoefficients++;
+
+        inferSbDcSigCoeffFlag = false;
+      }
+    }
+
+    if (last_coeff>=0 &&
+        (inferSbDcSigCoeffFlag || decode_CABAC_bit(cabac, &sigModel[ctxIdxMap[0]]))) {
+      coeff_value[nCoefficients] = 1;
+      coeff_has_max_base_level[nCoefficients] = 1;
+      coeff_scan_pos[nCoefficients] = 0;
+      nCoefficients++;
+    }
+
+    if (nCoefficients==0) {
+      continue;
+    }
+
+
+    // --- decode greater-1 flags ---
+
+    int ctxSet = (i==0 || isChroma) ? 0 : 2;
+    if (prevSubblockHadGreater1) { ctxSet++; }
+
+    int c1 = 1;
+    int firstGreater1Coefficient = -1;
+
+    int lastGreater1Coefficient = libde265_min(8,nCoefficients);
+    for (int c=0;c<lastGreater1Coefficient;c++) {
+      if (decode_CABAC_bit(cabac, &greater1Model[ctxSet*4 + c1])) {
+        coeff_value[c]++;
+        c1=0;
+
+        if (firstGreater1Coefficient == -1) {
+          firstGreater1Coefficient=c;
+        }
+      }
+      else {
+        coeff_has_max_base_level[c] = 0;
+
+        if (c1<3 && c1>0) {
+          c1++;
+        }
+      }
+    }
+
+    prevSubblockHadGreater1 = (c1==0);
+
+
+    // --- decode greater-2 flag ---
+
+    if (firstGreater1Coefficient != -1) {
+      int flag = decode_coeff_abs_level_greater2(tctx,cIdxClass, ctxSet);
+      coeff_value[firstGreater1Coefficient] += flag;
+      coeff_has_max_base_level[firstGreater1Coefficient] = flag;
+    }
+
+
+    // --- decode coefficient signs (all at once, first sign in the MSB) ---
+
+    const bool signHidden = (signHidingAllowed &&
+                             coeff_scan_pos[0]-coeff_scan_pos[nCoefficients-1] > 3);
+
+    const int nSigns = nCoefficients - signHidden;
+    uint32_t coeff_signs = decode_CABAC_FL_bypass(cabac, nSigns) << (16-nSigns);
+
+
+    // --- decode coefficient values ---
+
+    int sumAbsLevel=0;
+    int uiGoRiceParam=0;
+
+    for (int n=0;n<nCoefficients;n++) {
+      int baseLevel = coeff_value[n];
+      int coeff_abs_level_remaining = 0;
+
+      if (coeff_has_max_base_level[n]) {
+        coeff_abs_level_remaining = decode_coeff_abs_level_remaining(tctx, uiGoRiceParam);
+
+        // (2014.10 / 9-20)
+        if (baseLevel + coeff_abs_level_remaining > 3*(1<<uiGoRiceParam)) {
+          uiGoRiceParam++;
+          if (uiGoRiceParam>4) uiGoRiceParam=4;
+        }
+      }
+
+      int16_t currCoeff = baseLevel + coeff_abs_level_remaining;
+      if (coeff_signs & (0x8000>>n)) {
+        currCoeff = -currCoeff;
+      }
+
+      if (signHidden) {
+        sumAbsLevel += baseLevel + coeff_abs_level_remaining;
+
+        if (n==nCoefficients-1 && (sumAbsLevel & 1)) {
+          currCoeff = -currCoeff;
+        }
+      }
+
+      // put coefficient in list
+      int p = coeff_scan_pos[n];
+
+      scratch->coeffList[ scratch->nCoeff ] = currCoeff;
+      scratch->coeffPos[ scratch->nCoeff ] = (xS + ScanOrderPos[p].x) + (yS + ScanOrderPos[p].y)*CoeffStride;
+      scratch->nCoeff++;
+    }
+  }  // next sub-block
+
+  return DE265_OK;
+}
+
+
+typedef int (*residual_coding_func)(thread_context* tctx, int x0, int y0, int cIdx);
+
+static const residual_coding_func residual_coding_fast_functions[4][2] = {
+  { residual_coding_fast<2,false>, residual_coding_fast<2,true> },
+  { residual_coding_fast<3,false>, residual_coding_fast<3,true> },
+  { residual_coding_fast<4,false>, residual_coding_fast<4,true> },
+  { residual_coding_fast<5,false>, residual_coding_fast<5,true> }
+};
+
+
+int residual_coding(thread_context* tctx,
+                    int x0, int y0,  // position of TU in frame
+                    int log2TrafoSize,
+                    int cIdx)
+{
+  if (!tctx->img->get_sps().range_extension_residual_coding &&
+      !tctx->decctx->param_generic_residual_coding) {
+    return residual_coding_fast_functions[log2TrafoSize-2][cIdx>0](tctx, x0,y0, cIdx);
+  }
+
+  return residual_coding_generic(tctx, x0,y0, log2TrafoSize, cIdx);
+}
+
+
 static void decode_TU(thread_context* tctx,
                       int x0,int y0,
                       int xCUBase,int yCUBase,
@@ -3429,6 +3754,10 @@ static void decode_TU(thread_context* tctx,
   de265_image* img = tctx->img;
   const seq_parameter_set& sps = img->get_sps();
 
+  if (cIdx>0 && img->luma_only) {
+    return; // residual has been parsed, but is not needed
+  }
+
   int residualDpcm = 0;
 
   if (cuPredMode == MODE_INTRA) // if intra mode
@@ -3473,13 +3802,13 @@ static void decode_TU(thread_context* tctx,
   }
   /*
   else if (!cbf && cIdx==0) {
-    memset(tctx->residual_luma,0,32*32*sizeof(int32_t));
+    memset(tctx->scratch->residual_luma,0,32*32*sizeof(int32_t));
   }
   */
   else if (!cbf && cIdx!=0 && tctx->ResScaleVal) {
     // --- cross-component-prediction when CBF==0 ---
 
-    tctx->nCoeff[cIdx] = 0;
+    tctx->scratch->nCoeff = 0;
     residualDpcm=0;
 
     scale_coefficients(tctx, x0,y0, xCUBase,yCUBase, nT, cIdx,
@@ -4174,21 +4503,27 @@ void read_pcm_samples_internal(thread_context* tctx, int x0, int y0, int log2CbS
 
   int shift = bitDepth - nPcmBits;
 
-  for (int y=0;y<h;y++)
-    for (int x=0;x<w;x++)
-      {
-        int value = get_bits(&br, nPcmBits);
-        ptr[y*stride+x] = value << shift;
-      }
+  uint16_t row[64];
+
+  for (int y=0;y<h;y++) {
+    get_bits_bulk(&br, nPcmBits, row, w);
+
+    for (int x=0;x<w;x++) {
+      ptr[y*stride+x] = row[x] << shift;
+    }
+  }
 }
 
 static void read_pcm_samples(thread_context* tctx, int x0, int y0, int log2CbSize)
 {
+  CABAC_return_lookahead_bytes(&tctx->cabac_decoder);
+
   bitreader br;
   br.data            = tctx->cabac_decoder.bitstream_curr;
-  br.bytes_remaining = tctx->cabac_decoder.bitstream_end - tctx->cabac_decoder.bitstream_curr;
+  br.bytes_remaining = tctx->cabac_decoder.bitstream_stop - tctx->cabac_decoder.bitstream_curr;
   br.nextbits = 0;
   br.nextbits_cnt = 0;
+  br.stuffing = tctx->cabac_decoder.stuffing;
 
 
   if (tctx->img->high_bit_depth(0)) {
@@ -4209,6 +4544,7 @@ static void read_pcm_samples(thread_context* tctx, int x0, int y0, int log2CbSiz
 
   prepare_for_CABAC(&br);
   tctx->cabac_decoder.bitstream_curr = br.data;
+  tctx->cabac_decoder.stuffing = br.stuffing;
   init_CABAC_decoder_2(&tctx->cabac_decoder);
 }
 
@@ -4399,11 +4735,9 @@ void read_coding_unit(thread_context* tctx,
 
 
 
-              int PUidx = (x>>sps.Log2MinPUSize) + (y>>sps.Log2MinPUSize)*sps.PicWidthInMinPUs;
-
               enum IntraPredMode candModeList[3];
 
-              fillIntraPredModeCandidates(candModeList,x,y,PUidx,
+              fillIntraPredModeCandidates(candModeList,x,y,
                                           availableA, availableB, img);
 
               for (int i=0;i<3;i++)
@@ -4435,7 +4769,7 @@ void read_coding_unit(thread_context* tctx,
 
               logtrace(LogSlice,"IntraPredMode[%d][%d] = %d (log2blk:%d)\n",x,y,IntraPredMode, log2IntraPredSize);
 
-              img->set_IntraPredMode(PUidx, log2IntraPredSize,
+              img->set_IntraPredMode(x,y, log2IntraPredSize,
                                      (enum IntraPredMode)IntraPredMode);
 
               idx++;
@@ -4910,6 +5244,10 @@ void thread_task_slice_segment::work()
   thread_context* tctx = data->tctx;
   de265_image* img = tctx->img;
 
+  residual_scratch scratch;
+  scratch.init();
+  tctx->scratch = &scratch;
+
   state = Running;
   img->thread_run(this);
 
@@ -4920,6 +5258,7 @@ void thread_task_slice_segment::work()
   if (data->firstSliceSubstream) {
     bool success = initialize_CABAC_at_slice_segment_start(tctx);
     if (!success) {
+      tctx->scratch = NULL;
       state = Finished;
       tctx->sliceunit->finished_threads.increase_progress(1);
       img->thread_finishes(this);
@@ -4934,6 +5273,7 @@ void thread_task_slice_segment::work()
 
   /*enum DecodeResult result =*/ decode_substream(tctx, false, data->firstSliceSubstream);
 
+  tctx->scratch = NULL; // points into this stack frame
   state = Finished;
   tctx->sliceunit->finished_threads.increase_progress(1);
   img->thread_finishes(this);
@@ -4948,6 +5288,10 @@ void thread_task_ctb_row::work()
   thread_context* tctx = data->tctx;
   de265_image* img = tctx->img;
 
+  residual_scratch scratch;
+  scratch.init();
+  tctx->scratch = &scratch;
+
   const seq_parameter_set& sps = img->get_sps();
   int ctbW = sps.PicWidthInCtbsY;
 
@@ -4969,6 +5313,7 @@ void thread_task_ctb_row::work()
         img->ctb_progress[myCtbRow*ctbW + x].set_progress(CTB_PROGRESS_PREFILTER);
       }
 
+      tctx->scratch = NULL;
       state = Finished;
       tctx->sliceunit->finished_threads.increase_progress(1);
       img->thread_finishes(this);
@@ -5000,6 +5345,7 @@ void thread_task_ctb_row::work()
     }
   }
 
+  tctx->scratch = NULL; // points into this stack frame
   state = Finished;
   tctx->sliceunit->finished_threads.increase_progress(1);
   img->thread_finishes(this);
@@ -5037,7 +5383,7 @@ de265_error read_slice_segment_data(thread_context* tctx)
 
     if (substream>0) {
       if (substream-1 >= tctx->shdr->entry_point_offset.size() ||
-          tctx->cabac_decoder.bitstream_curr - tctx->cabac_decoder.bitstream_start -2 /* -2 because of CABAC init */
+          tctx->cabac_decoder.substream_start - tctx->cabac_decoder.bitstream_start
           != tctx->shdr->entry_point_offset[substream-1]) {
         tctx->decctx->add_warning(DE265_WARNING_INCORRECT_ENTRY_POINT_OFFSET, true);
       }
@@ -101,6 +101,11 @@ void seq_parameter_set::set_defaults(enum PresetSet)
 
   profile_tier_level_.general.set_defaults(Profile_Main, 6,2); // TODO
 
+  for (int i=0;i<MAX_TEMPORAL_SUBLAYERS;i++) {
+    profile_tier_level_.sub_layer[i].profile_present_flag = 0;
+    profile_tier_level_.sub_layer[i].level_present_flag = 0;
+  }
+
   seq_parameter_set_id = 0;
   chroma_format_idc = 1;
   ChromaArrayType = chroma_format_idc;
@@ -550,6 +555,12 @@ de265_error seq_parameter_set::compute_derived_values(bool sanitize_values)
   PicSizeInTbsY = PicWidthInTbsY * PicHeightInTbsY;
 
 
+  range_extension_residual_coding = (range_extension.transform_skip_context_enabled_flag ||
+                                     range_extension.implicit_rdpcm_enabled_flag ||
+                                     range_extension.explicit_rdpcm_enabled_flag ||
+                                     range_extension.persistent_rice_adaptation_enabled_flag ||
+                                     range_extension.cabac_bypass_alignment_enabled_flag);
+
   if (range_extension.high_precision_offsets_enabled_flag) {
     WpOffsetBdShiftY = 0;
     WpOffsetBdShiftC = 0;
@@ -595,6 +606,17 @@ de265_error seq_parameter_set::compute_derived_values(bool sanitize_values)
   }
 
 
+  if (scaling_list_enable_flag) {
+    if (!scaling_factors ||
+        memcmp(&scaling_factors->get_scaling_list(), &scaling_list, sizeof(scaling_list_data))) {
+      scaling_factors = std::make_shared<scaling_factor_table>(scaling_list);
+    }
+  }
+  else {
+    scaling_factors.reset();
+  }
+
+
   sps_read = true;
 
   return DE265_OK;
@@ -1022,6 +1044,61 @@ void set_default_scaling_lists(scaling_list_data* sclist)
 }
 
 
+static const int levelScale[] = { 40,45,51,57,64,72 };
+
+const int scaling_factor_table::table_offset[4] = {
+  0,
+  6*6*(4*4),
+  6*6*(4*4 + 8*8),
+  6*6*(4*4 + 8*8 + 16*16)
+};
+
+scaling_factor_table::scaling_factor_table(const scaling_list_data& sclist)
+{
+  scaling_list = sclist;
+
+  for (int log2TrafoSize=2;log2TrafoSize<=5;log2TrafoSize++) {
+    const int nT = 1<<log2TrafoSize;
+
+    for (int matrixId=0;matrixId<6;matrixId++) {
+      uint8_t m[32*32];
+
+      switch (log2TrafoSize) {
+      case 2: memcpy(m, &sclist.ScalingFactor_Size0[matrixId][0][0], 4*4); break;
+      case 3: memcpy(m, &sclist.ScalingFactor_Size1[matrixId][0][0], 8*8); break;
+      case 4: memcpy(m, &sclist.ScalingFactor_Size2[matrixId][0][0], 16*16); break;
+      case 5:
+        if (matrixId==0 || matrixId==3) {
+          memcpy(m, &sclist.ScalingFactor_Size3[matrixId/3][0][0], 32*32);
+        }
+        else {
+          // 32x32 chroma (ChromaArrayType==3) is derived from the 16x16 lists:
+          // each coded coefficient covers a 4x4 area, with a separate DC value.
+
+          const uint8_t* m16 = &sclist.ScalingFactor_Size2[matrixId][0][0];
+          for (int y=0;y<32;y++)
+            for (int x=0;x<32;x++) {
+              m[x+32*y] = m16[(x/4)*2+1 + ((y/4)*2+1)*16];
+            }
+
+          m[0] = m16[0];
+        }
+        break;
+      }
+
+      for (int qPmod6=0;qPmod6<6;qPmod6++) {
+        uint16_t* out = &factors[ table_offset[log2TrafoSize-2] +
+                                  ((matrixId*6 + qPmod6) << (2*log2TrafoSize)) ];
+
+        for (int i=0;i<nT*nT;i++) {
+          out[i] = m[i] * levelScale[qPmod6];
+        }
+      }
+    }
+  }
+}
+
+
 de265_error seq_parameter_set::write(error_queue* errqueue, CABAC_encoder& out)
 {
   out.write_bits(video_parameter_set_id, 4);
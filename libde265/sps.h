@@ -29,6 +29,7 @@
 #include "libde265/cabac.h"
 
 #include <vector>
+#include <memory>
 
 class error_queue;
 
@@ -58,6 +59,32 @@ typedef struct scaling_list_data {
 } scaling_list_data;
 
 
+/* Dequantization multipliers m[x][y]*levelScale[qP%6] (8.6.3), precomputed from the
+   scaling lists for all transform sizes, matrixIds and qP%6. Tables are immutable and
+   shared between all parameter sets that use the same scaling lists.
+   matrixId is cIdx for intra and cIdx+3 for inter blocks, for all sizes.
+ */
+class scaling_factor_table
+{
+ public:
+  explicit scaling_factor_table(const scaling_list_data& sclist);
+
+  const scaling_list_data& get_scaling_list() const { return scaling_list; }
+
+  const uint16_t* get_factors(int log2TrafoSize, int matrixId, int qPmod6) const {
+    return &factors[ table_offset[log2TrafoSize-2] +
+                     ((matrixId*6 + qPmod6) << (2*log2TrafoSize)) ];
+  }
+
+ private:
+  scaling_list_data scaling_list;
+
+  static const int table_offset[4];
+
+  uint16_t factors[6*6*(4*4 + 8*8 + 16*16 + 32*32)];
+};
+
+
 enum PresetSet {
   Preset_Default
 };
@@ -142,6 +169,7 @@ public:
                                               in scaling_list */
 
   struct scaling_list_data scaling_list;
+  std::shared_ptr<const scaling_factor_table> scaling_factors; // set if scaling_list_enable_flag
 
   char amp_enabled_flag;
   char sample_adaptive_offset_enabled_flag;
@@ -230,6 +258,8 @@ public:
 
   int SpsMaxLatencyPictures[7]; // [temporal layer]
 
+  bool range_extension_residual_coding; // not in standard: RExt tools change residual_coding() syntax
+
   uint8_t WpOffsetBdShiftY;
   uint8_t WpOffsetBdShiftC;
   int32_t WpOffsetHalfRangeY;
@@ -32,9 +32,6 @@
 #ifndef _WIN32
 // #include <intrin.h>
 
-#define THREAD_RESULT       void*
-#define THREAD_PARAM        void*
-
 #include <stdio.h>
 
 int  de265_thread_create(de265_thread* t, void *(*start_routine) (void *), void *arg) { return pthread_create(t,NULL,start_routine,arg); }
@@ -51,9 +48,6 @@ void de265_cond_wait(de265_cond* c,de265_mutex* m) { pthread_cond_wait(c,m); }
 void de265_cond_signal(de265_cond* c) { pthread_cond_signal(c); }
 #else  // _WIN32
 
-#define THREAD_RESULT       DWORD WINAPI
-#define THREAD_PARAM        LPVOID
-
 int  de265_thread_create(de265_thread* t, LPTHREAD_START_ROUTINE start_routine, void *arg) {
     HANDLE handle = CreateThread(NULL, 0, start_routine, arg, 0, NULL);
     if (handle == NULL) {
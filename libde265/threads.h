@@ -42,6 +42,10 @@ typedef pthread_t        de265_thread;
 typedef pthread_mutex_t  de265_mutex;
 typedef pthread_cond_t   de265_cond;
 
+// signature of thread entry functions
+#define THREAD_RESULT       void*
+#define THREAD_PARAM        void*
+
 #else // _WIN32
 #include <windows.h>
 #include "../extra/win32cond.h"
@@ -52,6 +56,9 @@ typedef pthread_cond_t   de265_cond;
 typedef HANDLE              de265_thread;
 typedef HANDLE              de265_mutex;
 typedef win32_cond_t        de265_cond;
+
+#define THREAD_RESULT       DWORD WINAPI
+#define THREAD_PARAM        LPVOID
 #endif  // _WIN32
 
 #ifndef _WIN32
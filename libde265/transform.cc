@@ -246,7 +246,7 @@ void cross_comp_pred(const thread_context* tctx, int32_t* residual, int nT)
       */
 
       residual[y*nT+x] += (tctx->ResScaleVal *
-                           ((tctx->residual_luma[y*nT+x] << BitDepthC ) >> BitDepthY ) ) >> 3;
+                           ((tctx->scratch->residual_luma[y*nT+x] << BitDepthC ) >> BitDepthY ) ) >> 3;
     }
 }
 
@@ -263,7 +263,7 @@ void transform_coefficients_explicit(thread_context* tctx,
   int32_t residual_buffer[32*32];
   int32_t* residual;
   if (cIdx==0) {
-    residual = tctx->residual_luma;
+    residual = tctx->scratch->residual_luma;
   }
   else {
     residual = residual_buffer;
@@ -373,7 +373,9 @@ void scale_coefficients_internal(thread_context* tctx,
   int16_t* coeff;
   int      coeffStride;
 
-  coeff = tctx->coeffBuf;
+  residual_scratch* scratch = tctx->scratch;
+
+  coeff = scratch->coeffBuf;
   coeffStride = nT;
 
 
@@ -401,14 +403,14 @@ void scale_coefficients_internal(thread_context* tctx,
     int32_t residual_buffer[32*32];
 
     int32_t* residual;
-    if (cIdx==0) residual = tctx->residual_luma;
+    if (cIdx==0) residual = scratch->residual_luma;
     else         residual = residual_buffer;
 
 
     // TODO: we could fold the coefficient rotation into the coefficient expansion here:
-    for (int i=0;i<tctx->nCoeff[cIdx];i++) {
-      int32_t currCoeff = tctx->coeffList[cIdx][i];
-      tctx->coeffBuf[ tctx->coeffPos[cIdx][i] ] = currCoeff;
+    for (int i=0;i<scratch->nCoeff;i++) {
+      int32_t currCoeff = scratch->coeffList[i];
+      scratch->coeffBuf[ scratch->coeffPos[i] ] = currCoeff;
     }
 
     if (rotateCoeffs) {
@@ -449,7 +451,7 @@ void scale_coefficients_internal(thread_context* tctx,
 
     // --- inverse quantization ---
 
-    if (sps.scaling_list_enable_flag==0) {
+    if (sps.scaling_list_enable_flag==0 || !pps.scaling_factors) {
 
       //const int m_x_y = 16;
       const int m_x_y = 1;
@@ -458,54 +460,40 @@ void scale_coefficients_internal(thread_context* tctx,
       const int offset = (1<<(bdShift-1));
       const int fact = m_x_y * levelScale[qP%6] << (qP/6);
 
-      for (int i=0;i<tctx->nCoeff[cIdx];i++) {
+      for (int i=0;i<scratch->nCoeff;i++) {
 
         // usually, this needs to be 64bit, but because we modify the shift above, we can use 16 bit
-        int32_t currCoeff  = tctx->coeffList[cIdx][i];
+        int32_t currCoeff  = scratch->coeffList[i];
 
-        //logtrace(LogTransform,"coefficient[%d] = %d\n",tctx->coeffPos[cIdx][i],
-        //tctx->coeffList[cIdx][i]);
+        //logtrace(LogTransform,"coefficient[%d] = %d\n",scratch->coeffPos[i],
+        //scratch->coeffList[i]);
 
         currCoeff = Clip3(-32768,32767,
                           ( (currCoeff * fact + offset ) >> bdShift));
 
         //logtrace(LogTransform," -> %d\n",currCoeff);
 
-        tctx->coeffBuf[ tctx->coeffPos[cIdx][i] ] = currCoeff;
+        scratch->coeffBuf[ scratch->coeffPos[i] ] = currCoeff;
       }
     }
     else {
       const int offset = (1<<(bdShift-1));
 
-      const uint8_t* sclist;
-      int matrixID = cIdx;
-      if (!intra) {
-        if (nT<32) { matrixID += 3; }
-        else { matrixID++; }
-      }
-
-      switch (nT) {
-      case  4: sclist = &pps.scaling_list.ScalingFactor_Size0[matrixID][0][0]; break;
-      case  8: sclist = &pps.scaling_list.ScalingFactor_Size1[matrixID][0][0]; break;
-      case 16: sclist = &pps.scaling_list.ScalingFactor_Size2[matrixID][0][0]; break;
-      case 32: sclist = &pps.scaling_list.ScalingFactor_Size3[matrixID][0][0]; break;
-      default: assert(0);
-      }
+      const int matrixID = (intra ? cIdx : cIdx+3);
+      const uint16_t* factors = pps.scaling_factors->get_factors(Log2(nT), matrixID, qP%6);
+      const int qPper = qP/6;
 
-      for (int i=0;i<tctx->nCoeff[cIdx];i++) {
-        int pos = tctx->coeffPos[cIdx][i];
-        int x = pos%nT;
-        int y = pos/nT;
+      for (int i=0;i<scratch->nCoeff;i++) {
+        int pos = scratch->coeffPos[i];
 
-        const int m_x_y = sclist[x+y*nT];
-        const int fact = m_x_y * levelScale[qP%6] << (qP/6);
+        const int fact = factors[pos] << qPper;
 
-        int64_t currCoeff  = tctx->coeffList[cIdx][i];
+        int64_t currCoeff  = scratch->coeffList[i];
 
         currCoeff = Clip3(-32768,32767,
                           ( (currCoeff * fact + offset ) >> bdShift));
 
-        tctx->coeffBuf[ tctx->coeffPos[cIdx][i] ] = currCoeff;
+        scratch->coeffBuf[ scratch->coeffPos[i] ] = currCoeff;
       }
     }
 
@@ -543,7 +531,7 @@ void scale_coefficients_internal(thread_context* tctx,
       int32_t residual_buffer[32*32];
 
       int32_t* residual;
-      if (cIdx==0) residual = tctx->residual_luma;
+      if (cIdx==0) residual = scratch->residual_luma;
       else         residual = residual_buffer;
 
       if (rdpcmMode) {
@@ -619,8 +607,8 @@ void scale_coefficients_internal(thread_context* tctx,
 
   // zero out scrap coefficient buffer again
 
-  for (int i=0;i<tctx->nCoeff[cIdx];i++) {
-    tctx->coeffBuf[ tctx->coeffPos[cIdx][i] ] = 0;
+  for (int i=0;i<scratch->nCoeff;i++) {
+    scratch->coeffBuf[ scratch->coeffPos[i] ] = 0;
   }
 }
 
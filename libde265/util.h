@@ -30,8 +30,14 @@
 #endif
 
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
 #include <string>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #include "libde265/de265.h"
 
 #ifdef __GNUC__
@@ -56,6 +62,7 @@
 #define LIBDE265_CHECK_RESULT
 #endif
 
+#define ALIGNED_64( var ) LIBDE265_DECLARE_ALIGNED( var, 64 )
 #define ALIGNED_32( var ) LIBDE265_DECLARE_ALIGNED( var, 32 )
 #define ALIGNED_16( var ) LIBDE265_DECLARE_ALIGNED( var, 16 )
 #define ALIGNED_8( var )  LIBDE265_DECLARE_ALIGNED( var, 8 )
@@ -145,6 +152,40 @@ LIBDE265_INLINE static int Log2SizeToArea(int v)
   return (1<<(v<<1));
 }
 
+// Read 8 bytes in big-endian order from a possibly unaligned address.
+LIBDE265_INLINE static uint64_t read_big_endian_64(const uint8_t* p)
+{
+  uint64_t v;
+  memcpy(&v,p,8);
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return v;
+#elif defined(_MSC_VER)
+  return _byteswap_uint64(v);
+#elif defined(__GNUC__)
+  return __builtin_bswap64(v);
+#else
+  return ((uint64_t)p[0]<<56) | ((uint64_t)p[1]<<48) | ((uint64_t)p[2]<<40) | ((uint64_t)p[3]<<32) |
+         ((uint64_t)p[4]<<24) | ((uint64_t)p[5]<<16) | ((uint64_t)p[6]<< 8) |  (uint64_t)p[7];
+#endif
+}
+
+// Number of leading zero bits in a non-zero 64-bit value.
+LIBDE265_INLINE static int count_leading_zeros_64(uint64_t v)
+{
+#if defined(__GNUC__)
+  return __builtin_clzll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long idx;
+  _BitScanReverse64(&idx, v);
+  return 63-idx;
+#else
+  int n=0;
+  while ((v & ((uint64_t)1<<63))==0) { v<<=1; n++; }
+  return n;
+#endif
+}
+
 void copy_subimage(uint8_t* dst,int dststride,
                    const uint8_t* src,int srcstride,
                    int w, int h);
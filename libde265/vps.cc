@@ -71,6 +71,11 @@ void video_parameter_set::set_defaults(enum profile_idc profile, int level_major
 
   profile_tier_level_.general.set_defaults(profile,level_major,level_minor);
 
+  for (int i=0;i<MAX_TEMPORAL_SUBLAYERS;i++) {
+    profile_tier_level_.sub_layer[i].profile_present_flag = 0;
+    profile_tier_level_.sub_layer[i].level_present_flag = 0;
+  }
+
   vps_sub_layer_ordering_info_present_flag = 0;
   layer[0].vps_max_dec_pic_buffering = 1;
   layer[0].vps_max_num_reorder_pics  = 0;
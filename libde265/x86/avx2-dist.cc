@@ -0,0 +1,215 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "x86/sse-dist.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <immintrin.h> // AVX2
+
+
+static inline int sum_sad_256(__m256i s)
+{
+  __m128i t = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s,1));
+  return _mm_cvtsi128_si32(t) + _mm_extract_epi32(t, 2);
+}
+
+static inline __m256i load_16_epi16(const uint8_t* p)
+{
+  return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)p));
+}
+
+
+template <int N> int sad_8_avx2(const uint8_t* p1, ptrdiff_t stride1,
+                                const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m256i acc = _mm256_setzero_si256();
+
+  for (int y=0;y<N;y++) {
+    for (int x=0;x<N;x+=32) {
+      __m256i a = _mm256_loadu_si256((const __m256i*)(p1+x));
+      __m256i b = _mm256_loadu_si256((const __m256i*)(p2+x));
+      acc = _mm256_add_epi64(acc, _mm256_sad_epu8(a,b));
+    }
+
+    p1 += stride1;
+    p2 += stride2;
+  }
+
+  return sum_sad_256(acc);
+}
+
+
+template <int N> void sad_x4_8_avx2(const uint8_t* src, ptrdiff_t srcStride,
+                                    const uint8_t* const ref[4], ptrdiff_t refStride,
+                                    int sads[4])
+{
+  __m256i acc0 = _mm256_setzero_si256();
+  __m256i acc1 = _mm256_setzero_si256();
+  __m256i acc2 = _mm256_setzero_si256();
+  __m256i acc3 = _mm256_setzero_si256();
+
+  for (int y=0;y<N;y++) {
+    ptrdiff_t refOffset = y*refStride;
+
+    for (int x=0;x<N;x+=32) {
+      __m256i s = _mm256_loadu_si256((const __m256i*)(src + y*srcStride + x));
+
+      acc0 = _mm256_add_epi64(acc0, _mm256_sad_epu8(s, _mm256_loadu_si256((const __m256i*)(ref[0]+refOffset+x))));
+      acc1 = _mm256_add_epi64(acc1, _mm256_sad_epu8(s, _mm256_loadu_si256((const __m256i*)(ref[1]+refOffset+x))));
+      acc2 = _mm256_add_epi64(acc2, _mm256_sad_epu8(s, _mm256_loadu_si256((const __m256i*)(ref[2]+refOffset+x))));
+      acc3 = _mm256_add_epi64(acc3, _mm256_sad_epu8(s, _mm256_loadu_si256((const __m256i*)(ref[3]+refOffset+x))));
+    }
+  }
+
+  sads[0] = sum_sad_256(acc0);
+  sads[1] = sum_sad_256(acc1);
+  sads[2] = sum_sad_256(acc2);
+  sads[3] = sum_sad_256(acc3);
+}
+
+
+template <int N> int ssd_8_avx2(const uint8_t* p1, ptrdiff_t stride1,
+                                const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m256i acc = _mm256_setzero_si256();
+
+  for (int y=0;y<N;y++) {
+    for (int x=0;x<N;x+=16) {
+      __m256i d = _mm256_sub_epi16(load_16_epi16(p1+x), load_16_epi16(p2+x));
+      acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d,d));
+    }
+
+    p1 += stride1;
+    p2 += stride2;
+  }
+
+  __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc,1));
+  s = _mm_hadd_epi32(s,s);
+  s = _mm_hadd_epi32(s,s);
+  return _mm_cvtsi128_si32(s);
+}
+
+
+static inline void butterfly(__m256i& a, __m256i& b)
+{
+  __m256i s = _mm256_add_epi16(a,b);
+  b = _mm256_sub_epi16(a,b);
+  a = s;
+}
+
+static inline void hadamard8_rows(__m256i r[8])
+{
+  butterfly(r[0],r[4]); butterfly(r[1],r[5]); butterfly(r[2],r[6]); butterfly(r[3],r[7]);
+  butterfly(r[0],r[2]); butterfly(r[1],r[3]); butterfly(r[4],r[6]); butterfly(r[5],r[7]);
+  butterfly(r[0],r[1]); butterfly(r[2],r[3]); butterfly(r[4],r[5]); butterfly(r[6],r[7]);
+}
+
+// The unpack instructions work within 128 bit lanes, so this transposes two 8x8 blocks at once.
+static inline void transpose_2x8x8_epi16(__m256i r[8])
+{
+  __m256i a0 = _mm256_unpacklo_epi16(r[0],r[1]);
+  __m256i a1 = _mm256_unpackhi_epi16(r[0],r[1]);
+  __m256i a2 = _mm256_unpacklo_epi16(r[2],r[3]);
+  __m256i a3 = _mm256_unpackhi_epi16(r[2],r[3]);
+  __m256i a4 = _mm256_unpacklo_epi16(r[4],r[5]);
+  __m256i a5 = _mm256_unpackhi_epi16(r[4],r[5]);
+  __m256i a6 = _mm256_unpacklo_epi16(r[6],r[7]);
+  __m256i a7 = _mm256_unpackhi_epi16(r[6],r[7]);
+
+  __m256i b0 = _mm256_unpacklo_epi32(a0,a2);
+  __m256i b1 = _mm256_unpackhi_epi32(a0,a2);
+  __m256i b2 = _mm256_unpacklo_epi32(a1,a3);
+  __m256i b3 = _mm256_unpackhi_epi32(a1,a3);
+  __m256i b4 = _mm256_unpacklo_epi32(a4,a6);
+  __m256i b5 = _mm256_unpackhi_epi32(a4,a6);
+  __m256i b6 = _mm256_unpacklo_epi32(a5,a7);
+  __m256i b7 = _mm256_unpackhi_epi32(a5,a7);
+
+  r[0] = _mm256_unpacklo_epi64(b0,b4);
+  r[1] = _mm256_unpackhi_epi64(b0,b4);
+  r[2] = _mm256_unpacklo_epi64(b1,b5);
+  r[3] = _mm256_unpackhi_epi64(b1,b5);
+  r[4] = _mm256_unpacklo_epi64(b2,b6);
+  r[5] = _mm256_unpackhi_epi64(b2,b6);
+  r[6] = _mm256_unpacklo_epi64(b3,b7);
+  r[7] = _mm256_unpackhi_epi64(b3,b7);
+}
+
+// SATD of the two horizontally adjacent 8x8 blocks of a 16x8 area
+static inline int satd_16x8_8_avx2(const uint8_t* p1, ptrdiff_t stride1,
+                                   const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m256i r[8];
+
+  for (int y=0;y<8;y++) {
+    r[y] = _mm256_sub_epi16(load_16_epi16(p1+y*stride1), load_16_epi16(p2+y*stride2));
+  }
+
+  hadamard8_rows(r);
+  transpose_2x8x8_epi16(r);
+  hadamard8_rows(r);
+
+  const __m256i one = _mm256_set1_epi16(1);
+  __m256i acc = _mm256_setzero_si256();
+  for (int i=0;i<8;i++) {
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_abs_epi16(r[i]), one));
+  }
+
+  // the two blocks are normalized separately, as in the SSE and C versions
+
+  acc = _mm256_hadd_epi32(acc,acc);
+  acc = _mm256_hadd_epi32(acc,acc);
+
+  int sumA = _mm256_extract_epi32(acc, 0);
+  int sumB = _mm256_extract_epi32(acc, 4);
+
+  return ((sumA+2)>>2) + ((sumB+2)>>2);
+}
+
+
+template <int N> int satd_8_avx2(const uint8_t* p1, ptrdiff_t stride1,
+                                 const uint8_t* p2, ptrdiff_t stride2)
+{
+  int sum=0;
+
+  for (int y=0;y<N;y+=8)
+    for (int x=0;x<N;x+=16) {
+      sum += satd_16x8_8_avx2(p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
+
+template int  sad_8_avx2<32>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template int  sad_8_avx2<64>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template void sad_x4_8_avx2<32>(const uint8_t*,ptrdiff_t, const uint8_t* const[4],ptrdiff_t, int[4]);
+template void sad_x4_8_avx2<64>(const uint8_t*,ptrdiff_t, const uint8_t* const[4],ptrdiff_t, int[4]);
+
+template int  ssd_8_avx2<16>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template int  ssd_8_avx2<32>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template int  ssd_8_avx2<64>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+
+template int  satd_8_avx2<16>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template int  satd_8_avx2<32>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
+template int  satd_8_avx2<64>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t);
@@ -0,0 +1,321 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "x86/sse-dist.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <smmintrin.h> // SSE4.1
+
+
+static inline __m128i load_4(const uint8_t* p)
+{
+  int32_t v;
+  memcpy(&v, p, 4);
+  return _mm_cvtsi32_si128(v);
+}
+
+static inline int sum_sad_halves(__m128i s)
+{
+  return _mm_cvtsi128_si32(s) + _mm_extract_epi32(s, 2);
+}
+
+static inline int sum_epi32(__m128i s)
+{
+  s = _mm_hadd_epi32(s,s);
+  s = _mm_hadd_epi32(s,s);
+  return _mm_cvtsi128_si32(s);
+}
+
+
+// --- SAD ---
+
+static inline __m128i sad_4x4_rows(const uint8_t* p, ptrdiff_t stride)
+{
+  __m128i r01 = _mm_unpacklo_epi32(load_4(p         ), load_4(p+  stride));
+  __m128i r23 = _mm_unpacklo_epi32(load_4(p+2*stride), load_4(p+3*stride));
+  return _mm_unpacklo_epi64(r01,r23);
+}
+
+static inline __m128i sad_8x2_rows(const uint8_t* p, ptrdiff_t stride)
+{
+  return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)p),
+                            _mm_loadl_epi64((const __m128i*)(p+stride)));
+}
+
+
+template <int N> int sad_8_sse(const uint8_t* p1, ptrdiff_t stride1,
+                               const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m128i acc = _mm_setzero_si128();
+
+  if (N==4) {
+    acc = _mm_sad_epu8(sad_4x4_rows(p1,stride1), sad_4x4_rows(p2,stride2));
+  }
+  else if (N==8) {
+    for (int y=0;y<8;y+=2) {
+      acc = _mm_add_epi64(acc, _mm_sad_epu8(sad_8x2_rows(p1+y*stride1,stride1),
+                                            sad_8x2_rows(p2+y*stride2,stride2)));
+    }
+  }
+  else {
+    for (int y=0;y<N;y++) {
+      for (int x=0;x<N;x+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p1+x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p2+x));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(a,b));
+      }
+
+      p1 += stride1;
+      p2 += stride2;
+    }
+  }
+
+  return sum_sad_halves(acc);
+}
+
+
+template <int N> void sad_x4_8_sse(const uint8_t* src, ptrdiff_t srcStride,
+                                   const uint8_t* const ref[4], ptrdiff_t refStride,
+                                   int sads[4])
+{
+  if (N<16) {
+    for (int i=0;i<4;i++) {
+      sads[i] = sad_8_sse<N>(src,srcStride, ref[i],refStride);
+    }
+    return;
+  }
+
+  // each source row is loaded once and compared against all four references
+
+  __m128i acc0 = _mm_setzero_si128();
+  __m128i acc1 = _mm_setzero_si128();
+  __m128i acc2 = _mm_setzero_si128();
+  __m128i acc3 = _mm_setzero_si128();
+
+  for (int y=0;y<N;y++) {
+    ptrdiff_t refOffset = y*refStride;
+
+    for (int x=0;x<N;x+=16) {
+      __m128i s = _mm_loadu_si128((const __m128i*)(src + y*srcStride + x));
+
+      acc0 = _mm_add_epi64(acc0, _mm_sad_epu8(s, _mm_loadu_si128((const __m128i*)(ref[0]+refOffset+x))));
+      acc1 = _mm_add_epi64(acc1, _mm_sad_epu8(s, _mm_loadu_si128((const __m128i*)(ref[1]+refOffset+x))));
+      acc2 = _mm_add_epi64(acc2, _mm_sad_epu8(s, _mm_loadu_si128((const __m128i*)(ref[2]+refOffset+x))));
+      acc3 = _mm_add_epi64(acc3, _mm_sad_epu8(s, _mm_loadu_si128((const __m128i*)(ref[3]+refOffset+x))));
+    }
+  }
+
+  sads[0] = sum_sad_halves(acc0);
+  sads[1] = sum_sad_halves(acc1);
+  sads[2] = sum_sad_halves(acc2);
+  sads[3] = sum_sad_halves(acc3);
+}
+
+
+// --- SSD ---
+
+template <int N> int ssd_8_sse(const uint8_t* p1, ptrdiff_t stride1,
+                               const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m128i acc = _mm_setzero_si128();
+
+  for (int y=0;y<N;y++) {
+    if (N==4) {
+      __m128i d = _mm_sub_epi16(_mm_cvtepu8_epi16(load_4(p1)),
+                                _mm_cvtepu8_epi16(load_4(p2)));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d,d));
+    }
+    else if (N==8) {
+      __m128i d = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p1)),
+                                _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)p2)));
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(d,d));
+    }
+    else {
+      const __m128i zero = _mm_setzero_si128();
+
+      for (int x=0;x<N;x+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p1+x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p2+x));
+
+        __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(a,zero), _mm_unpacklo_epi8(b,zero));
+        __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(a,zero), _mm_unpackhi_epi8(b,zero));
+
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(dlo,dlo));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(dhi,dhi));
+      }
+    }
+
+    p1 += stride1;
+    p2 += stride2;
+  }
+
+  return sum_epi32(acc);
+}
+
+
+// --- SATD ---
+
+static inline void butterfly(__m128i& a, __m128i& b)
+{
+  __m128i s = _mm_add_epi16(a,b);
+  b = _mm_sub_epi16(a,b);
+  a = s;
+}
+
+// 8-point Hadamard transform across the eight registers (one per row)
+static inline void hadamard8_rows(__m128i r[8])
+{
+  butterfly(r[0],r[4]); butterfly(r[1],r[5]); butterfly(r[2],r[6]); butterfly(r[3],r[7]);
+  butterfly(r[0],r[2]); butterfly(r[1],r[3]); butterfly(r[4],r[6]); butterfly(r[5],r[7]);
+  butterfly(r[0],r[1]); butterfly(r[2],r[3]); butterfly(r[4],r[5]); butterfly(r[6],r[7]);
+}
+
+static inline void transpose_8x8_epi16(__m128i r[8])
+{
+  __m128i a0 = _mm_unpacklo_epi16(r[0],r[1]);
+  __m128i a1 = _mm_unpackhi_epi16(r[0],r[1]);
+  __m128i a2 = _mm_unpacklo_epi16(r[2],r[3]);
+  __m128i a3 = _mm_unpackhi_epi16(r[2],r[3]);
+  __m128i a4 = _mm_unpacklo_epi16(r[4],r[5]);
+  __m128i a5 = _mm_unpackhi_epi16(r[4],r[5]);
+  __m128i a6 = _mm_unpacklo_epi16(r[6],r[7]);
+  __m128i a7 = _mm_unpackhi_epi16(r[6],r[7]);
+
+  __m128i b0 = _mm_unpacklo_epi32(a0,a2);
+  __m128i b1 = _mm_unpackhi_epi32(a0,a2);
+  __m128i b2 = _mm_unpacklo_epi32(a1,a3);
+  __m128i b3 = _mm_unpackhi_epi32(a1,a3);
+  __m128i b4 = _mm_unpacklo_epi32(a4,a6);
+  __m128i b5 = _mm_unpackhi_epi32(a4,a6);
+  __m128i b6 = _mm_unpacklo_epi32(a5,a7);
+  __m128i b7 = _mm_unpackhi_epi32(a5,a7);
+
+  r[0] = _mm_unpacklo_epi64(b0,b4);
+  r[1] = _mm_unpackhi_epi64(b0,b4);
+  r[2] = _mm_unpacklo_epi64(b1,b5);
+  r[3] = _mm_unpackhi_epi64(b1,b5);
+  r[4] = _mm_unpacklo_epi64(b2,b6);
+  r[5] = _mm_unpackhi_epi64(b2,b6);
+  r[6] = _mm_unpacklo_epi64(b3,b7);
+  r[7] = _mm_unpackhi_epi64(b3,b7);
+}
+
+static int satd_8x8_8_sse(const uint8_t* p1, ptrdiff_t stride1,
+                          const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m128i r[8];
+
+  for (int y=0;y<8;y++) {
+    r[y] = _mm_sub_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(p1+y*stride1))),
+                         _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(p2+y*stride2))));
+  }
+
+  hadamard8_rows(r);
+  transpose_8x8_epi16(r);
+  hadamard8_rows(r);
+
+  // coefficients are at most 64*255 in magnitude and fit into 16 bits
+
+  const __m128i one = _mm_set1_epi16(1);
+  __m128i acc = _mm_setzero_si128();
+  for (int i=0;i<8;i++) {
+    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_abs_epi16(r[i]), one));
+  }
+
+  return (sum_epi32(acc)+2)>>2;
+}
+
+static int satd_4x4_8_sse(const uint8_t* p1, ptrdiff_t stride1,
+                          const uint8_t* p2, ptrdiff_t stride2)
+{
+  __m128i r[4];
+
+  for (int y=0;y<4;y++) {
+    r[y] = _mm_sub_epi16(_mm_cvtepu8_epi16(load_4(p1+y*stride1)),
+                         _mm_cvtepu8_epi16(load_4(p2+y*stride2)));
+  }
+
+  // vertical transform in the lower four lanes
+
+  butterfly(r[0],r[2]); butterfly(r[1],r[3]);
+  butterfly(r[0],r[1]); butterfly(r[2],r[3]);
+
+  // transpose: a = columns 0|1, b = columns 2|3
+
+  __m128i t01 = _mm_unpacklo_epi16(r[0],r[1]);
+  __m128i t23 = _mm_unpacklo_epi16(r[2],r[3]);
+  __m128i a = _mm_unpacklo_epi32(t01,t23);
+  __m128i b = _mm_unpackhi_epi32(t01,t23);
+
+  // horizontal transform: (col0,col2),(col1,col3) and then (col0,col1),(col2,col3)
+
+  butterfly(a,b);
+
+  __m128i as = _mm_shuffle_epi32(a, 0x4E);
+  __m128i bs = _mm_shuffle_epi32(b, 0x4E);
+
+  // each coefficient appears twice (in both 64 bit halves)
+
+  const __m128i one = _mm_set1_epi16(1);
+  __m128i acc;
+  acc =                    _mm_madd_epi16(_mm_abs_epi16(_mm_add_epi16(a,as)), one);
+  acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_abs_epi16(_mm_sub_epi16(a,as)), one));
+  acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_abs_epi16(_mm_add_epi16(b,bs)), one));
+  acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_abs_epi16(_mm_sub_epi16(b,bs)), one));
+
+  int sum = sum_epi32(acc) >> 1;
+
+  return (sum+1)>>1;
+}
+
+
+template <int N> int satd_8_sse(const uint8_t* p1, ptrdiff_t stride1,
+                                const uint8_t* p2, ptrdiff_t stride2)
+{
+  if (N==4) {
+    return satd_4x4_8_sse(p1,stride1, p2,stride2);
+  }
+
+  int sum=0;
+
+  for (int y=0;y<N;y+=8)
+    for (int x=0;x<N;x+=8) {
+      sum += satd_8x8_8_sse(p1+y*stride1+x,stride1, p2+y*stride2+x,stride2);
+    }
+
+  return sum;
+}
+
+
+#define INSTANTIATE_DIST_SSE(N)                                         \
+  template int  sad_8_sse<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template int  ssd_8_sse<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template int  satd_8_sse<N>(const uint8_t*,ptrdiff_t, const uint8_t*,ptrdiff_t); \
+  template void sad_x4_8_sse<N>(const uint8_t*,ptrdiff_t, const uint8_t* const[4],ptrdiff_t, int[4]);
+
+INSTANTIATE_DIST_SSE(4)
+INSTANTIATE_DIST_SSE(8)
+INSTANTIATE_DIST_SSE(16)
+INSTANTIATE_DIST_SSE(32)
+INSTANTIATE_DIST_SSE(64)
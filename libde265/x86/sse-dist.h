@@ -0,0 +1,44 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SSE_DIST_H
+#define SSE_DIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// SSE4.1, all block sizes (4,8,16,32,64)
+
+template <int N> int  sad_8_sse (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> int  ssd_8_sse (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> int  satd_8_sse(const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> void sad_x4_8_sse(const uint8_t* src, ptrdiff_t srcStride,
+                                   const uint8_t* const ref[4], ptrdiff_t refStride, int sads[4]);
+
+// AVX2, block sizes 16 (SSD, SATD), 32 and 64
+
+template <int N> int  sad_8_avx2 (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> int  ssd_8_avx2 (const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> int  satd_8_avx2(const uint8_t* p1, ptrdiff_t stride1, const uint8_t* p2, ptrdiff_t stride2);
+template <int N> void sad_x4_8_avx2(const uint8_t* src, ptrdiff_t srcStride,
+                                    const uint8_t* const ref[4], ptrdiff_t refStride, int sads[4]);
+
+#endif
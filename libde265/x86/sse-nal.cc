@@ -0,0 +1,70 @@
+/*
+ * H.265 video codec.
+ * Copyright (c) 2013-2014 struktur AG, Dirk Farin <farin@struktur.de>
+ *
+ * This file is part of libde265.
+ *
+ * libde265 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * libde265 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "x86/sse-nal.h"
+#include "libde265/fallback-nal.h"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <emmintrin.h> // SSE2
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+static inline int first_set_bit(uint32_t mask)
+{
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward(&idx, mask);
+  return idx;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+
+int find_zero_byte_pair_sse2(const uint8_t* data, int len)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  int i=0;
+
+  // Compare two overlapping loads, shifted by one byte, against zero.
+  // Bit k of the mask is set if data[i+k] and data[i+k+1] are both zero.
+
+  for ( ; i+17 <= len ; i+=16) {
+    __m128i v0 = _mm_loadu_si128((const __m128i*)(data+i));
+    __m128i v1 = _mm_loadu_si128((const __m128i*)(data+i+1));
+
+    __m128i pair = _mm_and_si128(_mm_cmpeq_epi8(v0,zero),
+                                 _mm_cmpeq_epi8(v1,zero));
+
+    uint32_t mask = _mm_movemask_epi8(pair);
+    if (mask) {
+      return i + first_set_bit(mask);
+    }
+  }
+
+  return i + find_zero_byte_pair_fallback(data+i, len-i);
+}
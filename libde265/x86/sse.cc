@@ -25,6 +25,8 @@
 #include "x86/sse.h"
 #include "x86/sse-motion.h"
 #include "x86/sse-dct.h"
+#include "x86/sse-nal.h"
+#include "x86/sse-dist.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -34,6 +36,45 @@
 #include <cpuid.h>
 #endif
 
+
+#if HAVE_AVX2
+// AVX2 has to be supported by the CPU and its register state has to be saved by the OS.
+static bool cpu_has_avx2(uint32_t cpuid1_ecx)
+{
+  bool have_OSXSAVE = !!(cpuid1_ecx & (1<<27));
+  bool have_AVX     = !!(cpuid1_ecx & (1<<28));
+  if (!have_OSXSAVE || !have_AVX) {
+    return false;
+  }
+
+  uint32_t xcr0;
+  uint32_t ebx7;
+
+#ifdef _MSC_VER
+  xcr0 = (uint32_t)_xgetbv(0);
+
+  int regs[4];
+  __cpuidex(regs, 7, 0);
+  ebx7 = regs[1];
+#else
+  uint32_t edx_xcr0;
+  __asm__ ("xgetbv" : "=a"(xcr0), "=d"(edx_xcr0) : "c"(0));
+
+  uint32_t eax7,ecx7,edx7;
+  if (__get_cpuid_max(0, NULL) < 7) {
+    return false;
+  }
+  __cpuid_count(7, 0, eax7,ebx7,ecx7,edx7);
+#endif
+
+  if ((xcr0 & 6) != 6) {  // XMM and YMM state
+    return false;
+  }
+
+  return !!(ebx7 & (1<<5));
+}
+#endif
+
 void init_acceleration_functions_sse(struct acceleration_functions* accel)
 {
   uint32_t ecx=0,edx=0;
@@ -55,6 +96,7 @@ void init_acceleration_functions_sse(struct acceleration_functions* accel)
 
   //int have_MMX    = !!(edx & (1<<23));
   int have_SSE    = !!(edx & (1<<25));
+  int have_SSE2   = !!(edx & (1<<26));
   int have_SSE4_1 = !!(ecx & (1<<19));
 
   // printf("MMX:%d SSE:%d SSE4_1:%d\n",have_MMX,have_SSE,have_SSE4_1);
@@ -62,6 +104,11 @@ void init_acceleration_functions_sse(struct acceleration_functions* accel)
   if (have_SSE) {
   }
 
+  if (have_SSE2) {
+    accel->find_zero_byte_pair = find_zero_byte_pair_sse2;
+  }
+
+
 #if HAVE_SSE4_1
   if (have_SSE4_1) {
     accel->put_unweighted_pred_8   = ff_hevc_put_unweighted_pred_8_sse;
@@ -98,6 +145,50 @@ void init_acceleration_functions_sse(struct acceleration_functions* accel)
     accel->transform_add_8[1] = ff_hevc_transform_8x8_add_8_sse4;
     accel->transform_add_8[2] = ff_hevc_transform_16x16_add_8_sse4;
     accel->transform_add_8[3] = ff_hevc_transform_32x32_add_8_sse4;
+
+    accel->sad_8[0] = sad_8_sse<4>;
+    accel->sad_8[1] = sad_8_sse<8>;
+    accel->sad_8[2] = sad_8_sse<16>;
+    accel->sad_8[3] = sad_8_sse<32>;
+    accel->sad_8[4] = sad_8_sse<64>;
+
+    accel->ssd_8[0] = ssd_8_sse<4>;
+    accel->ssd_8[1] = ssd_8_sse<8>;
+    accel->ssd_8[2] = ssd_8_sse<16>;
+    accel->ssd_8[3] = ssd_8_sse<32>;
+    accel->ssd_8[4] = ssd_8_sse<64>;
+
+    accel->satd_8[0] = satd_8_sse<4>;
+    accel->satd_8[1] = satd_8_sse<8>;
+    accel->satd_8[2] = satd_8_sse<16>;
+    accel->satd_8[3] = satd_8_sse<32>;
+    accel->satd_8[4] = satd_8_sse<64>;
+
+    accel->sad_x4_8[0] = sad_x4_8_sse<4>;
+    accel->sad_x4_8[1] = sad_x4_8_sse<8>;
+    accel->sad_x4_8[2] = sad_x4_8_sse<16>;
+    accel->sad_x4_8[3] = sad_x4_8_sse<32>;
+    accel->sad_x4_8[4] = sad_x4_8_sse<64>;
+  }
+#endif
+
+#if HAVE_AVX2
+  if (cpu_has_avx2(ecx)) {
+    accel->find_zero_byte_pair = find_zero_byte_pair_avx2;
+
+    accel->sad_8[3] = sad_8_avx2<32>;
+    accel->sad_8[4] = sad_8_avx2<64>;
+
+    accel->ssd_8[2] = ssd_8_avx2<16>;
+    accel->ssd_8[3] = ssd_8_avx2<32>;
+    accel->ssd_8[4] = ssd_8_avx2<64>;
+
+    accel->satd_8[2] = satd_8_avx2<16>;
+    accel->satd_8[3] = satd_8_avx2<32>;
+    accel->satd_8[4] = satd_8_avx2<64>;
+
+    accel->sad_x4_8[3] = sad_x4_8_avx2<32>;
+    accel->sad_x4_8[4] = sad_x4_8_avx2<64>;
   }
 #endif
 }
@@ -150,6 +150,30 @@ Preset preset[] = {
     // 0 // all frames
   },
 
+  { 4, "pre04-fastCB", "pre01, but fast CB split decision",
+    /* de265  */ "--sop-structure intra --CB-Split fast",
+    /* HM     */ "-c $HM13CFG/encoder_intra_main.cfg -SBH 0 --SAO=0 --LoopFilterDisable --DeblockingFilterControlPresent --MaxCUSize=32 --MaxPartitionDepth=2",
+    /* HM SCC */ "-c $HMSCCCFG/encoder_intra_main_scc.cfg -SBH 0 --SAO=0 --LoopFilterDisable --DeblockingFilterControlPresent --MaxCUSize=32 --MaxPartitionDepth=2",
+    /* x265   */ "--no-lft -I 1 --no-signhide",
+    /* f265   */ "key-frame-spacing=1",
+    /* x264   */ "-I 1",
+    /* ffmpeg */ "-g 1",
+    /* mpeg-2 */ "-g 1"
+    // 0 // all frames
+  },
+
+  { 5, "pre05-rmd", "pre01, but rough-mode-decision intra search",
+    /* de265  */ "--sop-structure intra --TB-IntraPredMode rmd",
+    /* HM     */ "-c $HM13CFG/encoder_intra_main.cfg -SBH 0 --SAO=0 --LoopFilterDisable --DeblockingFilterControlPresent --MaxCUSize=32 --MaxPartitionDepth=2",
+    /* HM SCC */ "-c $HMSCCCFG/encoder_intra_main_scc.cfg -SBH 0 --SAO=0 --LoopFilterDisable --DeblockingFilterControlPresent --MaxCUSize=32 --MaxPartitionDepth=2",
+    /* x265   */ "--no-lft -I 1 --no-signhide",
+    /* f265   */ "key-frame-spacing=1",
+    /* x264   */ "-I 1",
+    /* ffmpeg */ "-g 1",
+    /* mpeg-2 */ "-g 1"
+    // 0 // all frames
+  },
+
   { 50, "cb-auto16", "(development test)",
     /* de265  */ "--max-cb-size 16 --min-cb-size 8",
     /* HM     */ "-c $HM13CFG/encoder_intra_main.cfg -SBH 0 --SAO=0 --LoopFilterDisable --DeblockingFilterControlPresent --MaxCUSize=32 --MaxPartitionDepth=2",
@@ -175,6 +199,18 @@ Preset preset[] = {
     // 0 // all frames
   },
 
+  { 81, "lowdelay-fastCB", "lowdelay, but fast CB split and skip decisions",
+    "--MEMode search --max-cb-size 32 --min-cb-size 8 --min-tb-size 4 --CB-IntraPartMode-Fixed-partMode 2Nx2N --CB-IntraPartMode fixed --TB-IntraPredMode min-residual --PB-MV-TestMode zero --CB-Split fast --CB-Skip fast",
+    /* HM     */ "-c $HM13CFG/encoder_lowdelay_main.cfg -ip 248",
+    /* HM SCC */ "-c $HMSCCCFG/encoder_lowdelay_main_scc.cfg -ip 248",
+    /* x265   */ "-I 248 --no-wpp --bframes 0", // GOP size: 248
+    /* f265   */ 0, //"key-frame-spacing=248",
+    /* x264   */ "",
+    /* ffmpeg */ "-g 248 -bf 0",
+    /* mpeg-2 */ "" // GOP size 248 does not make sense here
+    // 0 // all frames
+  },
+
   { 98, "best", "default (random-access) encoder parameters",
     /* de265  */ "--max-cb-size 16 --min-cb-size 8",
     /* HM     */ "-c $HM13CFG/encoder_randomaccess_main.cfg",
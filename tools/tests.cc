@@ -18,9 +18,27 @@
  * along with libde265.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include "config.h"
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <iostream>
 #include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "libde265/de265.h"
+#include "libde265/en265.h"
+#include "libde265/image.h"
+#include "libde265/nal-parser.h"
+#include "libde265/cabac.h"
+#include "libde265/fallback-nal.h"
+#include "libde265/fallback.h"
+#ifdef HAVE_SSE4_1
+#include "libde265/x86/sse.h"
+#include "libde265/x86/sse-nal.h"
+#endif
 
 
 class Test
@@ -63,9 +81,13 @@ public:
 public:
   Test* next;
   static Test* s_firstTest;
+
+  // streams given on the command line (tests that decode streams use them in addition)
+  static std::vector<const char*> s_inputFiles;
 };
 
 Test* Test::s_firstTest = NULL;
+std::vector<const char*> Test::s_inputFiles;
 
 
 class ListTests : public Test
@@ -86,10 +108,774 @@ public:
 } listtest;
 
 
+// --- helpers for the differential tests ---
+
+// Random bytes with many zeros, so that start codes and stuffing bytes appear frequently.
+static void random_nal_bytes(std::vector<uint8_t>& data, int len)
+{
+  data.resize(len);
+  for (int i=0;i<len;i++) {
+    int r = rand()%16;
+    if      (r<8)  data[i] = 0;
+    else if (r<10) data[i] = 1;
+    else if (r<12) data[i] = 3;
+    else           data[i] = rand()&0xFF;
+  }
+}
+
+struct scanner_function
+{
+  const char* name;
+  find_zero_byte_pair_func func;
+};
+
+// The fallback and all SIMD scanners supported by this CPU.
+static std::vector<scanner_function> get_scanner_functions()
+{
+  std::vector<scanner_function> funcs;
+
+  scanner_function f = { "fallback", find_zero_byte_pair_fallback };
+  funcs.push_back(f);
+
+#ifdef HAVE_SSE4_1
+  acceleration_functions accel;
+  init_acceleration_functions_fallback(&accel);
+  init_acceleration_functions_sse(&accel);
+
+  if (accel.find_zero_byte_pair != find_zero_byte_pair_fallback) {
+    scanner_function f = { "sse2", find_zero_byte_pair_sse2 };
+    funcs.push_back(f);
+  }
+
+  if (accel.find_zero_byte_pair == find_zero_byte_pair_avx2) {
+    scanner_function f = { "avx2", find_zero_byte_pair_avx2 };
+    funcs.push_back(f);
+  }
+#endif
+
+  return funcs;
+}
+
+
+/* Byte-wise start code parser and stuffing byte removal, as they were before
+   the block-wise scanners were introduced. Used as reference.
+ */
+class ReferenceNALParser
+{
+public:
+  struct NAL {
+    std::vector<uint8_t> data;
+    std::vector<int> skipped;
+  };
+
+  std::vector<NAL> NALs;
+
+  ReferenceNALParser() : state(0) { }
+
+  void push_data(const uint8_t* data, int len)
+  {
+    for (int i=0;i<len;i++) {
+      uint8_t c = data[i];
+
+      switch (state) {
+      case 0:
+      case 1:
+        if (c == 0) { state++; }
+        else { state=0; }
+        break;
+      case 2:
+        if      (c == 1) { start_NAL(); state=3; }
+        else if (c != 0) { state=0; }
+        break;
+      case 3:
+        current.data.push_back(c);
+        state = 4;
+        break;
+      case 4:
+        current.data.push_back(c);
+        state = 5;
+        break;
+      case 5:
+        if (c==0) { state=6; }
+        else { current.data.push_back(c); }
+        break;
+      case 6:
+        if (c==0) { state=7; }
+        else {
+          current.data.push_back(0);
+          current.data.push_back(c);
+          state=5;
+        }
+        break;
+      case 7:
+        if      (c==0) { current.data.push_back(0); }
+        else if (c==3) {
+          current.data.push_back(0);
+          current.data.push_back(0);
+          current.skipped.push_back(current.data.size() + current.skipped.size());
+          state=5;
+        }
+        else if (c==1) {
+          NALs.push_back(current);
+          start_NAL();
+          state=3;
+        }
+        else {
+          current.data.push_back(0);
+          current.data.push_back(0);
+          current.data.push_back(c);
+          state=5;
+        }
+        break;
+      }
+    }
+  }
+
+  void flush_data()
+  {
+    if (state==6) { current.data.push_back(0); }
+    if (state==7) { current.data.push_back(0); current.data.push_back(0); }
+    if (state>=5) { NALs.push_back(current); }
+    state=0;
+  }
+
+  static void remove_stuffing_bytes(NAL& nal)
+  {
+    std::vector<uint8_t>& d = nal.data;
+    for (int i=0; i+2 < (int)d.size(); i++) {
+      if (d[i]==0 && d[i+1]==0 && d[i+2]==3) {
+        nal.skipped.push_back(i+2 + nal.skipped.size());
+        d.erase(d.begin()+i+2);
+        i++;
+      }
+    }
+  }
+
+  static int num_skipped_bytes_before(const NAL& nal, int byte_position)
+  {
+    for (int k=nal.skipped.size()-1;k>=0;k--)
+      if (nal.skipped[k] <= byte_position) {
+        return k+1;
+      }
+
+    return 0;
+  }
+
+private:
+  int state;
+  NAL current;
+
+  void start_NAL() { current.data.clear(); current.skipped.clear(); }
+};
+
+
+static bool same_NAL(const ReferenceNALParser::NAL& ref, const NAL_unit* nal)
+{
+  if (nal->size() != (int)ref.data.size() ||
+      memcmp(nal->data(), ref.data.data(), ref.data.size()) != 0 ||
+      nal->num_skipped_bytes() != (int)ref.skipped.size()) {
+    return false;
+  }
+
+  for (int p=0; p <= nal->size() + nal->num_skipped_bytes(); p++) {
+    if (nal->num_skipped_bytes_before(p,0) !=
+        ReferenceNALParser::num_skipped_bytes_before(ref,p)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+class TestNALScanner : public Test
+{
+public:
+  const char* getName() const { return "nal-scan"; }
+  const char* getDescription() const {
+    return "compare the start code and stuffing byte scanners with the byte-wise reference";
+  }
+
+  bool work(bool quiet) {
+    std::vector<scanner_function> funcs = get_scanner_functions();
+
+    srand(1);
+
+    // find_zero_byte_pair() at all lengths and alignments.
+    // Exactly sized buffers, so that memory checkers see reads behind the end.
+
+    for (int iter=0;iter<20000;iter++) {
+      int len = rand()%300;
+      uint8_t* buf = (uint8_t*)malloc(len+1);
+
+      for (int i=0;i<len;i++) {
+        buf[i] = (rand()%4==0) ? 0 : 1+rand()%255;
+      }
+
+      int expected = len;
+      for (int i=0;i+1<len;i++) {
+        if (buf[i]==0 && buf[i+1]==0) { expected=i; break; }
+      }
+
+      for (size_t f=0;f<funcs.size();f++) {
+        int pos = funcs[f].func(buf,len);
+        if (pos != expected) {
+          if (!quiet) {
+            printf("find_zero_byte_pair_%s: length %d, got %d, expected %d\n",
+                   funcs[f].name, len, pos, expected);
+          }
+          free(buf);
+          return false;
+        }
+      }
+
+      free(buf);
+    }
+
+
+    // Byte-stream parsing with random chunk sizes and stuffing byte removal.
+
+    std::vector<uint8_t> stream;
+
+    for (int iter=0;iter<2000;iter++) {
+      random_nal_bytes(stream, rand()%4000);
+
+      for (size_t f=0;f<funcs.size();f++) {
+        acceleration_functions accel;
+        init_acceleration_functions_fallback(&accel);
+        accel.find_zero_byte_pair = funcs[f].func;
+
+        NAL_Parser parser;
+        parser.set_acceleration_functions(&accel);
+
+        ReferenceNALParser ref;
+
+        for (size_t pos=0; pos<stream.size(); ) {
+          int chunk = 1 + rand() % (rand()%4==0 ? 4 : 500);
+          if (chunk > (int)(stream.size()-pos)) { chunk = stream.size()-pos; }
+
+          parser.push_data(&stream[pos], chunk, 0);
+          ref.push_data(&stream[pos], chunk);
+          pos += chunk;
+        }
+
+        parser.flush_data();
+        ref.flush_data();
+
+        for (size_t i=0;i<=ref.NALs.size();i++) {
+          NAL_unit* nal = parser.pop_from_NAL_queue();
+
+          if (i==ref.NALs.size()) {
+            if (nal) {
+              if (!quiet) { printf("%s: parser returned more NALs than the reference\n",
+                                   funcs[f].name); }
+              parser.free_NAL_unit(nal);
+              return false;
+            }
+            break;
+          }
+
+          if (nal==NULL || !same_NAL(ref.NALs[i], nal)) {
+            if (!quiet) { printf("%s: NAL %d of byte stream %d differs\n",
+                                 funcs[f].name, (int)i, iter); }
+            if (nal) { parser.free_NAL_unit(nal); }
+            return false;
+          }
+
+          // remove stuffing bytes from a copy of the NAL data
+
+          NAL_unit copy;
+          copy.clear();
+          ReferenceNALParser::NAL refcopy;
+          refcopy.data = ref.NALs[i].data;
+          if (!copy.set_data(refcopy.data.data(), refcopy.data.size())) {
+            parser.free_NAL_unit(nal);
+            return false;
+          }
+
+          copy.remove_stuffing_bytes(funcs[f].func);
+          ReferenceNALParser::remove_stuffing_bytes(refcopy);
+
+          if (!same_NAL(refcopy, &copy)) {
+            if (!quiet) { printf("%s: stuffing bytes of NAL %d of byte stream %d differ\n",
+                                 funcs[f].name, (int)i, iter); }
+            parser.free_NAL_unit(nal);
+            return false;
+          }
+
+          parser.free_NAL_unit(nal);
+        }
+      }
+    }
+
+    if (!quiet) {
+      printf("scanners checked:");
+      for (size_t f=0;f<funcs.size();f++) { printf(" %s",funcs[f].name); }
+      printf("\n");
+    }
+
+    return true;
+  }
+} test_nal_scanner;
+
+
+/* Runs identical sequences of decoding operations through several CABAC decoders and
+   checks that the decoded values, the context models, and the input positions agree.
+ */
+class TestCABACEngines : public Test
+{
+public:
+  const char* getName() const { return "cabac-engines"; }
+  const char* getDescription() const {
+    return "compare the 64-bit CABAC engine with the reference engine";
+  }
+
+  enum { nDecoders = 4, nModels = 16 };
+
+  struct Decoder {
+    const char* name;
+    CABAC_decoder cabac;
+    context_model models[nModels];
+    bool zerocopy;
+  };
+
+  bool work(bool quiet) {
+    srand(1);
+
+    std::vector<uint8_t> rbsp, ebsp;
+
+    for (int iter=0;iter<3000;iter++) {
+      random_nal_bytes(rbsp, 1 + rand()%2000);
+
+      // insert emulation prevention bytes
+
+      ebsp.clear();
+      int zeros=0;
+      for (size_t i=0;i<rbsp.size();i++) {
+        if (zeros>=2 && rbsp[i]<=3) {
+          ebsp.push_back(3);
+          zeros=0;
+        }
+
+        ebsp.push_back(rbsp[i]);
+        zeros = (rbsp[i]==0) ? zeros+1 : 0;
+      }
+
+      NAL_unit nal;
+      nal.clear();
+      nal.set_external_data(ebsp.data(), ebsp.size(), NULL, NULL);
+      nal.find_stuffing_bytes();
+
+      // zero-copy (stuffing bytes skipped while reading) and copied input (stuffing bytes removed)
+
+      Decoder dec[nDecoders] = {
+        { "reference zero-copy" }, { "window zero-copy" },
+        { "reference" }, { "window" }
+      };
+
+      for (int d=0;d<nDecoders;d++) {
+        enum de265_cabac_engine engine = (d&1) ? de265_cabac_engine_DEFAULT
+                                               : de265_cabac_engine_REFERENCE;
+        dec[d].zerocopy = (d<2);
+        if (dec[d].zerocopy) {
+          init_CABAC_decoder(&dec[d].cabac, nal.data(), nal.size(),
+                             nal.get_stuffing_bytes(), engine);
+        }
+        else {
+          init_CABAC_decoder(&dec[d].cabac, rbsp.data(), rbsp.size(), NULL, engine);
+        }
+
+        init_CABAC_decoder_2(&dec[d].cabac);
+      }
+
+      for (int m=0;m<nModels;m++) {
+        context_model model;
+        model.MPSbit = rand()&1;
+        model.state  = rand()%63;
+        for (int d=0;d<nDecoders;d++) { dec[d].models[m] = model; }
+      }
+
+      int nOps = rand()%4000;
+      for (int op=0;op<nOps;op++) {
+        int type  = rand()%10;
+        int model = rand()%nModels;
+        int param = rand();
+        int result[nDecoders];
+
+        for (int d=0;d<nDecoders;d++) {
+          CABAC_decoder* cabac = &dec[d].cabac;
+
+          switch (type) {
+          case 0:
+          case 1:
+          case 2: result[d] = decode_CABAC_bit(cabac, &dec[d].models[model]); break;
+          case 3: result[d] = decode_CABAC_TU(cabac, 1+param%5, &dec[d].models[model]); break;
+          case 4: result[d] = decode_CABAC_term_bit(cabac); break;
+          case 5: result[d] = decode_CABAC_bypass(cabac); break;
+          case 6: result[d] = decode_CABAC_TU_bypass(cabac, 1+param%8); break;
+          case 7: result[d] = decode_CABAC_FL_bypass(cabac, param%17); break;
+          case 8: result[d] = decode_CABAC_TR_bypass(cabac, param%5, 4<<(param%5)); break;
+          case 9: result[d] = decode_CABAC_EGk_bypass(cabac, param%5); break;
+          }
+        }
+
+        for (int d=1;d<nDecoders;d++) {
+          if (result[d] != result[0] ||
+              memcmp(dec[d].models, dec[0].models, sizeof(dec[0].models)) != 0) {
+            if (!quiet) {
+              printf("input %d, operation %d (type %d): %s decoded %d, %s decoded %d\n",
+                     iter, op, type, dec[0].name, result[0], dec[d].name, result[d]);
+            }
+            return false;
+          }
+        }
+
+        // Restart at the current input position, as after the end of a substream.
+        // Decoding cannot continue after a terminating bin, because the arithmetic
+        // decoder value is then outside of the range.
+
+        if ((type==4 && result[0]==1) || rand()%200==0) {
+          int pos[nDecoders];
+
+          for (int d=0;d<nDecoders;d++) {
+            CABAC_return_lookahead_bytes(&dec[d].cabac);
+            pos[d] = rbsp_position(dec[d], nal);
+            init_CABAC_decoder_2(&dec[d].cabac);
+          }
+
+          for (int d=1;d<nDecoders;d++) {
+            if (pos[d] != pos[0]) {
+              if (!quiet) {
+                printf("input %d, operation %d: %s restarts at byte %d, %s at byte %d\n",
+                       iter, op, dec[0].name, pos[0], dec[d].name, pos[d]);
+              }
+              return false;
+            }
+          }
+        }
+      }
+    }
+
+    return true;
+  }
+
+private:
+  // input position of the decoder, counted without stuffing bytes
+  static int rbsp_position(const Decoder& dec, const NAL_unit& nal)
+  {
+    int pos = dec.cabac.bitstream_curr - dec.cabac.bitstream_start;
+    if (dec.zerocopy) {
+      pos -= nal.num_skipped_bytes_before(pos-1, 0);
+    }
+    return pos;
+  }
+} test_cabac_engines;
+
+
+// --- decoding complete streams ---
+
+static bool read_file(const char* filename, std::vector<uint8_t>& data)
+{
+  FILE* fh = fopen(filename,"rb");
+  if (fh==NULL) {
+    return false;
+  }
+
+  uint8_t buf[4096];
+  size_t n;
+  data.clear();
+  while ((n = fread(buf,1,sizeof(buf),fh)) > 0) {
+    data.insert(data.end(), buf, buf+n);
+  }
+
+  fclose(fh);
+  return true;
+}
+
+/* Encode a few pictures of noise over gradients, so that there are residuals in all
+   transform sizes and, at low QPs, large coefficient levels.
+   The size of each picture (with the headers that precede it) is returned in
+   'pictureBits' when it is not NULL.
+ */
+static bool encode_test_stream(en265_encoder_context* ectx,
+                               int width,int height, int nFrames,
+                               std::vector<uint8_t>& stream,
+                               std::vector<int>* pictureBits = NULL)
+{
+  en265_start_encoder(ectx, 0);
+
+  stream.clear();
+  if (pictureBits) { pictureBits->clear(); }
+
+  int bits = 0;
+
+  for (int frame=0; frame<=nFrames; frame++) {
+    if (frame==nFrames) {
+      en265_push_eof(ectx);
+    }
+    else {
+      de265_image* img = en265_allocate_image(ectx, width,height, de265_chroma_420, frame, NULL);
+      if (img==NULL) {
+        return false;
+      }
+
+      for (int c=0;c<3;c++) {
+        uint8_t* p = img->get_image_plane(c);
+        int stride = img->get_image_stride(c);
+        int w = img->get_width(c);
+        int h = img->get_height(c);
+
+        for (int y=0;y<h;y++)
+          for (int x=0;x<w;x++) {
+            int v = ((x+frame)*255/w + y*2) / 2 + (x/16+y/16)%2 * 64;
+            if ((x/8+y/8+frame)%3==0) { v += rand()%64; }
+            p[y*stride+x] = v & 0xFF;
+          }
+      }
+
+      en265_push_image(ectx, img);
+    }
+
+    en265_encode(ectx);
+
+    for (;;) {
+      en265_packet* pck = en265_get_packet(ectx,0);
+      if (pck==NULL)
+        break;
+
+      const uint8_t startCode[4] = { 0,0,0,1 };
+      stream.insert(stream.end(), startCode, startCode+4);
+      stream.insert(stream.end(), pck->data, pck->data + pck->length);
+
+      bits += (4 + pck->length) * 8;
+      if (pck->content_type == EN265_PACKET_SLICE) { // one slice per picture
+        if (pictureBits) { pictureBits->push_back(bits); }
+        bits = 0;
+      }
+
+      en265_free_packet(ectx,pck);
+    }
+  }
+
+  return true;
+}
+
+static bool encode_test_stream(int qp, std::vector<uint8_t>& stream)
+{
+  en265_encoder_context* ectx = en265_new_encoder();
+  if (ectx==NULL) {
+    return false;
+  }
+
+  en265_set_parameter_int(ectx, "CTB-QScale-Constant", qp);
+
+  bool ok = encode_test_stream(ectx, 128,64, 4, stream);
+
+  en265_free_encoder(ectx);
+  return ok;
+}
+
+// Decode a byte-stream and compute a hash of each output picture.
+static bool decode_stream(const std::vector<uint8_t>& stream,
+                          enum de265_cabac_engine engine, bool generic_residual_coding,
+                          std::vector<uint64_t>& hashes)
+{
+  de265_decoder_context* ctx = de265_new_decoder();
+
+  de265_set_parameter_int(ctx, DE265_DECODER_PARAM_CABAC_ENGINE, engine);
+  de265_set_parameter_bool(ctx, DE265_DECODER_PARAM_BOOL_GENERIC_RESIDUAL_CODING,
+                           generic_residual_coding);
+
+  de265_error err = de265_push_data(ctx, stream.data(), stream.size(), 0, NULL);
+  if (err==DE265_OK) {
+    err = de265_flush_data(ctx);
+  }
+
+  hashes.clear();
+
+  int more=1;
+  while (err==DE265_OK && more) {
+    err = de265_decode(ctx, &more);
+    if (err==DE265_ERROR_WAITING_FOR_INPUT_DATA) {
+      err = DE265_OK;
+    }
+
+    const de265_image* img;
+    while ((img = de265_get_next_picture(ctx)) != NULL) {
+      uint64_t hash = UINT64_C(14695981039346656037); // FNV-1a
+
+      for (int c=0;c<3;c++) {
+        int stride;
+        const uint8_t* p = de265_get_image_plane(img, c, &stride);
+        if (p==NULL) {
+          continue;
+        }
+
+        int w = de265_get_image_width(img, c) * ((de265_get_bits_per_pixel(img, c)+7)/8);
+        int h = de265_get_image_height(img, c);
+
+        for (int y=0;y<h;y++)
+          for (int x=0;x<w;x++) {
+            hash = (hash ^ p[y*stride+x]) * UINT64_C(1099511628211);
+          }
+      }
+
+      hashes.push_back(hash);
+    }
+  }
+
+  de265_free_decoder(ctx);
+
+  return de265_isOK(err);
+}
+
+
+class TestResidualCoding : public Test
+{
+public:
+  const char* getName() const { return "residual-coding"; }
+  const char* getDescription() const {
+    return "compare the specialized residual syntax parsers with the generic one "
+      "(decodes additional streams given on the command line)";
+  }
+
+  bool work(bool quiet) {
+    std::vector<std::string> names;
+    std::vector<std::vector<uint8_t> > streams;
+
+    srand(1);
+
+    const int qps[] = { 4, 18, 32 };
+    for (int i=0;i<3;i++) {
+      std::vector<uint8_t> stream;
+      if (!encode_test_stream(qps[i], stream)) {
+        if (!quiet) { printf("cannot encode test stream\n"); }
+        return false;
+      }
+
+      char name[20];
+      sprintf(name,"encoded QP %d",qps[i]);
+      names.push_back(name);
+      streams.push_back(stream);
+    }
+
+    for (size_t i=0;i<s_inputFiles.size();i++) {
+      std::vector<uint8_t> stream;
+      if (!read_file(s_inputFiles[i], stream)) {
+        if (!quiet) { printf("cannot read %s\n",s_inputFiles[i]); }
+        return false;
+      }
+
+      names.push_back(s_inputFiles[i]);
+      streams.push_back(stream);
+    }
+
+    for (size_t i=0;i<streams.size();i++) {
+      std::vector<uint64_t> fast, generic, reference;
+
+      if (!decode_stream(streams[i], de265_cabac_engine_DEFAULT, false, fast) ||
+          !decode_stream(streams[i], de265_cabac_engine_DEFAULT, true, generic) ||
+          !decode_stream(streams[i], de265_cabac_engine_REFERENCE, false, reference)) {
+        if (!quiet) { printf("%s: decoding error\n",names[i].c_str()); }
+        return false;
+      }
+
+      if (fast.empty() || fast != generic || fast != reference) {
+        if (!quiet) {
+          printf("%s: %d pictures with the specialized parsers, %d with the generic parser, "
+                 "%d with the reference CABAC engine, or the pictures differ\n",
+                 names[i].c_str(), (int)fast.size(), (int)generic.size(),
+                 (int)reference.size());
+        }
+        return false;
+      }
+
+      if (!quiet) {
+        printf("%s: %d pictures identical\n",names[i].c_str(), (int)fast.size());
+      }
+    }
+
+    return true;
+  }
+} test_residual_coding;
+
+
+class TestRateControl : public Test
+{
+public:
+  const char* getName() const { return "rate-control"; }
+  const char* getDescription() const {
+    return "check that CBR rate control keeps the VBV buffer from underflowing";
+  }
+
+  bool work(bool quiet) {
+    const int kbps=100, vbvSize=50, fps=25, nFrames=30;
+
+    srand(1);
+
+    en265_encoder_context* ectx = en265_new_encoder();
+    if (ectx==NULL) {
+      return false;
+    }
+
+    en265_set_parameter_choice(ectx, "rate-control", "cbr");
+    en265_set_parameter_int(ectx, "rc-bitrate", kbps);
+    en265_set_parameter_int(ectx, "rc-vbv-size", vbvSize);
+    en265_set_parameter_int(ectx, "rc-fps-num", fps);
+
+    std::vector<uint8_t> stream;
+    std::vector<int> pictureBits;
+    bool ok = encode_test_stream(ectx, 176,144, nFrames, stream, &pictureBits);
+
+    en265_free_encoder(ectx);
+
+    if (!ok || (int)pictureBits.size() != nFrames) {
+      if (!quiet) { printf("cannot encode test stream\n"); }
+      return false;
+    }
+
+    // decoder buffer, filled at the target bitrate (starting at the default 90%)
+
+    double bitsPerFrame = kbps*1000.0 / fps;
+    double bufferSize = vbvSize*1000.0;
+    double fullness = 0.9 * bufferSize;
+    double minFullness = fullness;
+    double totalBits = 0;
+
+    for (int i=0;i<nFrames;i++) {
+      fullness -= pictureBits[i];
+      totalBits += pictureBits[i];
+
+      if (fullness < 0) {
+        if (!quiet) {
+          printf("VBV underflow at picture %d (%d bits, %d bits missing)\n",
+                 i, pictureBits[i], (int)-fullness);
+        }
+        return false;
+      }
+
+      minFullness = std::min(minFullness, fullness);
+      fullness = std::min(fullness + bitsPerFrame, bufferSize);
+    }
+
+    if (!quiet) {
+      printf("%d pictures, %.1f kbit/s, minimum VBV fullness %d bits\n",
+             nFrames, totalBits/nFrames*fps/1000, (int)minFullness);
+    }
+
+    return true;
+  }
+} test_rate_control;
+
+
 
 int main(int argc,char** argv)
 {
   if (argc>=2) {
+    for (int i=2;i<argc;i++) {
+      Test::s_inputFiles.push_back(argv[i]);
+    }
+
     Test::runTest(argv[1]);
   }
   else {